@@ -0,0 +1,294 @@
+// Service-bench archive download over the serial port (src/serial_dump.h).
+//
+// Sends a dump command, decodes the segment data as it arrives and prints
+// every record in the sample payload schema (payload_schema.h): one JSON
+// object per line, or CSV with --csv. --save keeps the raw bytes received
+// so a capture can be decoded again later with --in.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++17 -Isrc src/serial_frame.cpp src/archive_codec.cpp src/payload_schema.cpp sim/aqs_dump.cpp -o aqs-dump
+//
+// Usage:
+//   aqs-dump --port DEV [--baud N] [--from SEQ] [--to SEQ] [--csv] [--save FILE] [--timeout-s N]
+//   aqs-dump --in FILE [--from SEQ] [--to SEQ] [--csv]
+//
+// End to end without hardware, over a pty pair:
+//   aqs-sim --days 3 --serial-pty &      (prints "serial port on /dev/pts/N")
+//   aqs-dump --port /dev/pts/N > archive.jsonl
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "archive_record.h"
+#include "archive_codec.h"
+#include "crc.h"
+#include "payload_schema.h"
+#include "serial_dump.h"
+
+static double wallSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t getU32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static speed_t baudConstant(unsigned long baud) {
+    switch (baud) {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    default: return 0;
+    }
+}
+
+// decoder for the segment stream, the slot format of archive_log.h
+struct Decoder {
+    uint32_t firstSeq = 0;
+    uint32_t lastSeq = UINT32_MAX;
+    bool csv = false;
+    bool haveSegment = false;
+    uint32_t segment = 0;
+    uint32_t nextOffset = 0;
+    bool broken = false;                 // rest of the segment is unusable
+    CodecState state;
+    uint8_t carry[1 + sizeof(ArchiveRecord) + 2];
+    size_t carryLen = 0;
+    uint64_t records = 0;
+    uint64_t skipped = 0;                // outside the range
+    uint32_t badSlots = 0;
+    uint32_t gaps = 0;                   // data frames lost in between
+    uint32_t lastPrinted = 0;
+
+    void record(const ArchiveRecord &rec) {
+        if (rec.seq < firstSeq || rec.seq > lastSeq || (records && rec.seq <= lastPrinted)) {
+            skipped++;
+            return;
+        }
+        char line[PAYLOAD_MAX_SIZE];
+        size_t n = csv ? payloadEncodeCsv(recordFields, PAYLOAD_FIELD_COUNT(recordFields), &rec, rec.flags,
+                                          line, sizeof(line))
+                       : formatRecordJson(rec, line, sizeof(line));
+        if (n) puts(line);
+        lastPrinted = rec.seq;
+        records++;
+    }
+
+    // one slot at p with everything there; false stops the segment
+    bool slot(const uint8_t *p, size_t len) {
+        uint16_t crc = (uint16_t)(p[1 + len] | (p[2 + len] << 8));
+        if (crc != crc16(p, 1 + len)) return false;
+        ArchiveRecord rec;
+        if (len == sizeof(ArchiveRecord)) {
+            memcpy(&rec, p + 1, sizeof(rec));
+            state.keyframe(rec);
+        } else if (!state.primed || codecDecodeDelta(state, p + 1, len, rec) != len) {
+            return false;
+        }
+        record(rec);
+        return true;
+    }
+
+    void data(uint32_t seg, uint32_t offset, const uint8_t *p, size_t n) {
+        if (!haveSegment || seg != segment || offset != nextOffset) {
+            // a segment starts with a keyframe; frames missing inside one
+            // leave nothing to decode the rest against
+            broken = haveSegment && seg == segment;
+            if (broken) gaps++;
+            haveSegment = true;
+            segment = seg;
+            state = CodecState();
+            carryLen = 0;
+        }
+        nextOffset = offset + (uint32_t)n;
+        if (broken) return;
+        size_t pos = 0;
+        while (pos < n) {
+            // complete the slot left over from the previous frame first
+            const uint8_t *s;
+            size_t have;
+            if (carryLen) {
+                size_t want = carry[0] + 3 - carryLen;
+                size_t take = want < n - pos ? want : n - pos;
+                memcpy(carry + carryLen, p + pos, take);
+                carryLen += take;
+                pos += take;
+                if (carryLen < (size_t)carry[0] + 3) return;
+                s = carry;
+                have = carryLen;
+                carryLen = 0;
+            } else {
+                s = p + pos;
+                have = n - pos;
+            }
+            size_t len = s[0];
+            if (len == 0 || len > sizeof(ArchiveRecord)) {
+                badSlots++;
+                broken = true;
+                return;
+            }
+            if (have < len + 3) {
+                memcpy(carry, s, have);
+                carryLen = have;
+                return;
+            }
+            if (!slot(s, len)) {
+                badSlots++;
+                broken = true;
+                return;
+            }
+            if (s != carry) pos += len + 3;
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    const char *port = nullptr;
+    const char *inPath = nullptr;
+    const char *savePath = nullptr;
+    unsigned long baud = 921600;
+    double timeoutS = 5.0;
+    Decoder dec;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--port") && v) { port = v; i++; }
+        else if (!strcmp(a, "--in") && v) { inPath = v; i++; }
+        else if (!strcmp(a, "--save") && v) { savePath = v; i++; }
+        else if (!strcmp(a, "--baud") && v) { baud = strtoul(v, nullptr, 10); i++; }
+        else if (!strcmp(a, "--from") && v) { dec.firstSeq = (uint32_t)strtoul(v, nullptr, 10); i++; }
+        else if (!strcmp(a, "--to") && v) { dec.lastSeq = (uint32_t)strtoul(v, nullptr, 10); i++; }
+        else if (!strcmp(a, "--timeout-s") && v) { timeoutS = atof(v); i++; }
+        else if (!strcmp(a, "--csv")) { dec.csv = true; }
+        else {
+            fprintf(stderr, "unknown argument: %s\n", a);
+            return 2;
+        }
+    }
+    if (!port == !inPath) {
+        fprintf(stderr, "need one of --port or --in\n");
+        return 2;
+    }
+
+    int fd;
+    if (port) {
+        fd = open(port, O_RDWR | O_NOCTTY);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", port, strerror(errno));
+            return 1;
+        }
+        termios tio;
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            speed_t sp = baudConstant(baud);
+            if (sp) {
+                cfsetispeed(&tio, sp);
+                cfsetospeed(&tio, sp);
+            }
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+        tcflush(fd, TCIFLUSH);
+        uint8_t cmd[9 + 2] = {SERIAL_CMD_DUMP};
+        for (int b = 0; b < 4; b++) {
+            cmd[1 + b] = (uint8_t)(dec.firstSeq >> (8 * b));
+            cmd[5 + b] = (uint8_t)(dec.lastSeq >> (8 * b));
+        }
+        serialWriteFrame(cmd, 9, [](const uint8_t *d, size_t n, void *ctx) {
+            if (write(*(int*)ctx, d, n) != (ssize_t)n) perror("write");
+        }, &fd);
+    } else {
+        fd = open(inPath, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", inPath, strerror(errno));
+            return 1;
+        }
+    }
+    FILE *save = savePath ? fopen(savePath, "wb") : nullptr;
+
+    if (dec.csv) {
+        char header[256];
+        if (payloadCsvHeader(recordFields, PAYLOAD_FIELD_COUNT(recordFields), header, sizeof(header))) puts(header);
+    }
+
+    static uint8_t frameBuf[SERIAL_FRAME_ENCODED_MAX];
+    SerialFrameReader reader(frameBuf, sizeof(frameBuf));
+    uint8_t buf[4096];
+    double start = wallSeconds();
+    double lastRx = start;
+    uint64_t rxBytes = 0;
+    uint64_t dataBytes = 0;
+    bool begun = false, ended = false;
+    int status = -1;
+    uint32_t sentFrames = 0, sentBytes = 0, dataFrames = 0;
+    while (!ended) {
+        if (port) {
+            pollfd p = {fd, POLLIN, 0};
+            if (poll(&p, 1, 100) <= 0) {
+                if (wallSeconds() - lastRx > timeoutS) break;
+                continue;
+            }
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            break;
+        }
+        lastRx = wallSeconds();
+        rxBytes += (uint64_t)n;
+        if (save) fwrite(buf, 1, (size_t)n, save);
+        for (ssize_t i = 0; i < n && !ended; i++) {
+            size_t len = reader.push(buf[i]);
+            if (len == 0) continue;
+            const uint8_t *f = reader.frame();
+            if (f[0] == SERIAL_DUMP_BEGIN && len >= 18) {
+                begun = true;
+                fprintf(stderr, "dumping seq %lu..%lu, flash holds %lu..%lu\n", (unsigned long)getU32(f + 1),
+                        (unsigned long)getU32(f + 5), (unsigned long)getU32(f + 9), (unsigned long)getU32(f + 13));
+                if (f[17] != sizeof(ArchiveRecord)) {
+                    fprintf(stderr, "record size %u, this decoder knows %u\n", f[17], (unsigned)sizeof(ArchiveRecord));
+                    return 1;
+                }
+            } else if (f[0] == SERIAL_DUMP_DATA && len > SERIAL_DUMP_DATA_HEADER && begun) {
+                dataFrames++;
+                dataBytes += len - SERIAL_DUMP_DATA_HEADER;
+                dec.data(getU32(f + 1), getU32(f + 5), f + SERIAL_DUMP_DATA_HEADER, len - SERIAL_DUMP_DATA_HEADER);
+            } else if (f[0] == SERIAL_DUMP_END && len >= 10 && begun) {
+                sentFrames = getU32(f + 1);
+                sentBytes = getU32(f + 5);
+                status = f[9];
+                ended = true;
+            }
+        }
+    }
+    double wall = wallSeconds() - start;
+    fflush(stdout);
+    if (save) fclose(save);
+    close(fd);
+
+    fprintf(stderr, "%llu records (%llu outside the range) from %llu bytes in %.2f s (%.0f KB/s)\n",
+            (unsigned long long)dec.records, (unsigned long long)dec.skipped, (unsigned long long)rxBytes, wall,
+            wall > 0 ? rxBytes / wall / 1024.0 : 0.0);
+    if (!ended) {
+        fprintf(stderr, "no end frame: %s\n", begun ? "timed out mid-dump" : "device did not answer");
+        return 1;
+    }
+    bool complete = dataFrames == sentFrames && dataBytes == sentBytes;
+    if (!complete || reader.badFrames() || dec.badSlots || status != 0) {
+        fprintf(stderr, "incomplete: %lu/%lu frames, %llu/%lu bytes, %lu bad frames, %lu bad slots, status %d\n",
+                (unsigned long)dataFrames, (unsigned long)sentFrames, (unsigned long long)dataBytes,
+                (unsigned long)sentBytes, (unsigned long)reader.badFrames(), (unsigned long)dec.badSlots, status);
+        return 1;
+    }
+    return 0;
+}
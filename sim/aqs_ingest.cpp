@@ -0,0 +1,115 @@
+// Ingest daemon: feeds notifications from any BLE central into the ingest
+// gateway (ingest.h).
+//
+// Reads one notification per line on stdin, as whatever collects them
+// writes it:
+//
+//   <unit id> {"seq":...}          a JSON sample as sent
+//   <unit id> x<hex>               a binary frame (batch or codec block)
+//
+// Lines are stored as they arrive; SIGINT/SIGTERM or the end of the input
+// flush the store and print per-unit seq statistics.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++17 -pthread -Isrc -Isim src/archive_codec.cpp src/payload_schema.cpp sim/ingest.cpp sim/aqs_ingest.cpp -o aqs-ingest
+//
+// Usage:
+//   aqs-ingest [--dir PATH | --ram] [--quiet] < notifications.txt
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "ingest.h"
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+static uint32_t monotonicMs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = "/tmp/aqs-ingest";
+    bool quiet = false;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--dir") && v) { dir = v; i++; }
+        else if (!strcmp(a, "--ram")) { dir = nullptr; }
+        else if (!strcmp(a, "--quiet")) { quiet = true; }
+        else {
+            fprintf(stderr, "unknown argument: %s\n", a);
+            return 2;
+        }
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    if (dir) mkdir(dir, 0755);
+    static ColumnStore store;
+    if (!store.open(dir)) return 1;
+    static IngestGateway gateway(store);
+
+    static char line[4096];
+    static uint8_t frame[2048];
+    uint32_t startMs = monotonicMs();
+    uint64_t badLines = 0;
+    while (!stopRequested && fgets(line, sizeof(line), stdin)) {
+        char *sp = strchr(line, ' ');
+        if (!sp) {
+            badLines++;
+            continue;
+        }
+        *sp = '\0';
+        const char *payload = sp + 1;
+        size_t len = strcspn(payload, "\r\n");
+        int handle = gateway.unit(line);
+        if (handle < 0) {
+            badLines++;
+            continue;
+        }
+        const uint8_t *data = (const uint8_t*)payload;
+        if (payload[0] == 'x') {
+            size_t n = 0;
+            for (size_t i = 1; i + 1 < len && n < sizeof(frame); i += 2) {
+                int hi = hexDigit(payload[i]), lo = hexDigit(payload[i + 1]);
+                if (hi < 0 || lo < 0) break;
+                frame[n++] = (uint8_t)(hi << 4 | lo);
+            }
+            data = frame;
+            len = n;
+        }
+        gateway.ingest(handle, data, len, monotonicMs() - startMs);
+    }
+    store.flush();
+
+    const IngestStats &st = gateway.stats();
+    fprintf(stderr, "%llu notifications, %llu records, %llu stored, %llu parse errors, %llu unsupported, %llu bad lines\n",
+            (unsigned long long)st.messages, (unsigned long long)st.records, (unsigned long long)st.stored,
+            (unsigned long long)st.parseErrors, (unsigned long long)st.unsupported, (unsigned long long)badLines);
+    if (!quiet) {
+        for (uint32_t u = 0; u < gateway.unitCount(); u++) {
+            const SeqTracker &t = gateway.tracker((int)u);
+            fprintf(stderr, "  %-20s newest %lu, %llu stored, %llu missing, %llu late, %llu duplicates, %llu earlier\n",
+                    gateway.unitId((int)u), (unsigned long)t.recent.newest, (unsigned long long)t.accepted,
+                    (unsigned long long)t.missing, (unsigned long long)t.late, (unsigned long long)t.duplicates,
+                    (unsigned long long)t.earlier);
+        }
+    }
+    return 0;
+}
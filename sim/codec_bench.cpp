@@ -0,0 +1,164 @@
+// Compression ratio and speed of the archive codec on recorded data.
+//
+// Input is any text file with one payload JSON per line, e.g. a serial
+// capture containing the "Sending via BLE: {...}" lines; everything before
+// the first '{' on a line is ignored. Without a file a day of synthetic
+// samples is generated instead.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++17 -Isrc src/archive_codec.cpp src/payload_schema.cpp sim/codec_bench.cpp -o codec-bench
+//
+// Usage:
+//   codec-bench [capture.txt] [--block N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "archive_record.h"
+#include "archive_codec.h"
+#include "payload_schema.h"
+
+static double wallSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool parsePayload(const char *line, ArchiveRecord &rec) {
+    const char *p = strchr(line, '{');
+    if (!p) return false;
+    unsigned long seq = 0, ts = 0;
+    unsigned co2 = 0, voc = 0, pm25 = 0, pm10 = 0;
+    AirMeasurement m;
+    int n = sscanf(p, "{\"seq\":%lu,\"ts\":%lu,\"co2\":%u,\"temp_c\":%f,\"humidity_rh\":%f,\"voc\":%u,\"pm25\":%u,\"pm10\":%u}",
+                   &seq, &ts, &co2, &m.temp, &m.rh, &voc, &pm25, &pm10);
+    if (n != 8) return false;
+    m.ts = ts;
+    m.co2 = (uint16_t)co2;
+    m.srawVoc = (uint16_t)voc;
+    m.mc2p5 = (uint16_t)pm25;
+    m.mc10p0 = (uint16_t)pm10;
+    m.haveSps30 = m.haveSgp40 = m.haveScd41 = true;
+    rec = makeArchiveRecord(m, (uint32_t)seq);
+    return true;
+}
+
+static void synthesize(std::vector<ArchiveRecord> &out) {
+    AirMeasurement m;
+    m.haveSps30 = m.haveSgp40 = m.haveScd41 = true;
+    float co2 = 600, temp = 22, rh = 45, voc = 28000, pm25 = 8, pm10 = 12;
+    srand(1);
+    for (uint32_t i = 1; i <= 2880; i++) {
+        co2 += (rand() % 31 - 15);
+        temp += (rand() % 11 - 5) * 0.01f;
+        rh += (rand() % 21 - 10) * 0.02f;
+        voc += (rand() % 301 - 150);
+        pm25 += (rand() % 3 - 1) * 0.5f;
+        pm10 = pm25 + 4 + (rand() % 3);
+        if (pm25 < 0) pm25 = 0;
+        m.co2 = (uint16_t)co2;
+        m.temp = temp;
+        m.rh = rh;
+        m.srawVoc = (uint16_t)voc;
+        m.mc2p5 = (uint16_t)pm25;
+        m.mc10p0 = (uint16_t)pm10;
+        m.ts = i * 30000UL + (uint32_t)(rand() % 20);
+        out.push_back(makeArchiveRecord(m, i));
+    }
+}
+
+static uint32_t decoded = 0;
+static void countRecord(const ArchiveRecord &, void *) {
+    decoded++;
+}
+
+int main(int argc, char **argv) {
+    const char *path = nullptr;
+    size_t blockSize = 244;  // MTU 247 notification
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--block") && i + 1 < argc) blockSize = (size_t)atoi(argv[++i]);
+        else path = argv[i];
+    }
+    if (blockSize < CODEC_HEADER_SIZE + sizeof(ArchiveRecord) || blockSize > 4096) {
+        fprintf(stderr, "block size out of range\n");
+        return 2;
+    }
+
+    std::vector<ArchiveRecord> recs;
+    if (path) {
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            perror(path);
+            return 1;
+        }
+        char line[512];
+        ArchiveRecord rec;
+        while (fgets(line, sizeof(line), f)) {
+            if (parsePayload(line, rec)) recs.push_back(rec);
+        }
+        fclose(f);
+    } else {
+        synthesize(recs);
+    }
+    if (recs.empty()) {
+        fprintf(stderr, "no payloads found\n");
+        return 1;
+    }
+
+    size_t jsonBytes = 0;
+    char json[192];
+    for (const ArchiveRecord &r : recs) jsonBytes += formatRecordJson(r, json, sizeof(json));
+    size_t rawBytes = recs.size() * sizeof(ArchiveRecord);
+
+    // encode into blocks, repeat to get a stable timing
+    std::vector<uint8_t> blocks(recs.size() * (CODEC_DELTA_MAX + CODEC_HEADER_SIZE) + blockSize);
+    std::vector<size_t> blockLens;
+    const int rounds = 200;
+    size_t codecBytes = 0;
+    double t0 = wallSeconds();
+    for (int r = 0; r < rounds; r++) {
+        blockLens.clear();
+        codecBytes = 0;
+        size_t i = 0;
+        while (i < recs.size()) {
+            CodecBlockWriter w;
+            w.begin(&blocks[codecBytes], blockSize);
+            while (i < recs.size() && w.add(recs[i])) i++;
+            size_t len = w.finish();
+            blockLens.push_back(len);
+            codecBytes += len;
+        }
+    }
+    double encodeS = (wallSeconds() - t0) / rounds;
+
+    t0 = wallSeconds();
+    for (int r = 0; r < rounds; r++) {
+        decoded = 0;
+        size_t off = 0;
+        for (size_t len : blockLens) {
+            if (codecDecodeBlock(&blocks[off], len, countRecord, nullptr) < 0) {
+                fprintf(stderr, "decode failed at offset %zu\n", off);
+                return 1;
+            }
+            off += len;
+        }
+    }
+    double decodeS = (wallSeconds() - t0) / rounds;
+    if (decoded != recs.size()) {
+        fprintf(stderr, "decoded %u of %zu records\n", decoded, recs.size());
+        return 1;
+    }
+
+    printf("records        %zu (%s)\n", recs.size(), path ? path : "synthetic");
+    printf("json           %zu bytes (%.1f B/rec)\n", jsonBytes, (double)jsonBytes / recs.size());
+    printf("raw binary     %zu bytes (%.1f B/rec)\n", rawBytes, (double)rawBytes / recs.size());
+    printf("codec blocks   %zu bytes in %zu blocks (%.1f B/rec)\n",
+           codecBytes, blockLens.size(), (double)codecBytes / recs.size());
+    printf("ratio          %.1fx vs json, %.1fx vs raw\n",
+           (double)jsonBytes / codecBytes, (double)rawBytes / codecBytes);
+    printf("encode         %.1f Mrec/s\n", recs.size() / encodeS / 1e6);
+    printf("decode         %.1f Mrec/s\n", recs.size() / decodeS / 1e6);
+    return 0;
+}
@@ -0,0 +1,325 @@
+#include "ingest.h"
+
+#include <string.h>
+#include "archive_codec.h"
+#include "batch_frame.h"
+#include "payload_schema.h"
+
+// --- seq tracking ---
+
+bool SeqWindow::seen(uint32_t seq) const {
+    if (!covers(seq)) return false;
+    uint32_t k = newest - seq;
+    return bits[k / 64] & (1ULL << (k % 64));
+}
+
+void SeqWindow::mark(uint32_t seq) {
+    const uint32_t words = INGEST_SEQ_WINDOW / 64;
+    if (!started || seq > newest || !covers(seq)) {
+        // bit k moves to k + d; starting over clears everything
+        uint32_t d = started && seq > newest ? seq - newest : INGEST_SEQ_WINDOW;
+        uint32_t q = d / 64, r = d % 64;
+        for (int w = (int)words - 1; w >= 0; w--) {
+            uint64_t v = 0;
+            int src = w - (int)q;
+            if (d < INGEST_SEQ_WINDOW && src >= 0) {
+                v = bits[src] << r;
+                if (r && src > 0) v |= bits[src - 1] >> (64 - r);
+            }
+            bits[w] = v;
+        }
+        newest = seq;
+        started = true;
+    }
+    uint32_t k = newest - seq;
+    bits[k / 64] |= 1ULL << (k % 64);
+}
+
+bool SeqTracker::accept(uint32_t seq) {
+    if (!recent.started || seq > recent.newest) {
+        if (recent.started) missing += seq - recent.newest - 1;
+        else first = seq;
+        recent.mark(seq);
+        accepted++;
+        return true;
+    }
+    SeqWindow &w = recent.covers(seq) ? recent : older;
+    if (w.seen(seq)) {
+        duplicates++;
+        return false;
+    }
+    w.mark(seq);
+    accepted++;
+    if (seq < first) {
+        earlier++;
+    } else {
+        // only what was counted as skipped comes off again
+        late++;
+        if (missing > 0) missing--;
+    }
+    return true;
+}
+
+// --- column store ---
+
+// bytes per row over all columns
+#define INGEST_ROW_BYTES (2 + 4 + 4 + 4 + 2 + 2 + 2 + 2 + 2 + 2 + 1)
+
+ColumnStore::ColumnStore() {
+    // the only allocation: every chunk's columns in one block
+    memory = new uint8_t[(size_t)INGEST_CHUNKS * INGEST_CHUNK_ROWS * INGEST_ROW_BYTES];
+    uint8_t *p = memory;
+    for (uint32_t i = 0; i < INGEST_CHUNKS; i++) {
+        Chunk &c = chunks[i];
+        c.rows = 0;
+        c.sealed = false;
+        c.onDisk = false;
+        // widest columns first keeps every column aligned
+        c.seq = (uint32_t*)p;  p += INGEST_CHUNK_ROWS * 4;
+        c.ts = (uint32_t*)p;   p += INGEST_CHUNK_ROWS * 4;
+        c.rxMs = (uint32_t*)p; p += INGEST_CHUNK_ROWS * 4;
+        c.unit = (uint16_t*)p; p += INGEST_CHUNK_ROWS * 2;
+        c.co2 = (uint16_t*)p;  p += INGEST_CHUNK_ROWS * 2;
+        c.temp = (int16_t*)p;  p += INGEST_CHUNK_ROWS * 2;
+        c.rh = (uint16_t*)p;   p += INGEST_CHUNK_ROWS * 2;
+        c.voc = (uint16_t*)p;  p += INGEST_CHUNK_ROWS * 2;
+        c.pm25 = (uint16_t*)p; p += INGEST_CHUNK_ROWS * 2;
+        c.pm10 = (uint16_t*)p; p += INGEST_CHUNK_ROWS * 2;
+        c.flags = p;           p += INGEST_CHUNK_ROWS;
+    }
+    dir[0] = '\0';
+}
+
+ColumnStore::~ColumnStore() {
+    flush();
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+    if (segment) fclose(segment);
+    delete[] memory;
+}
+
+bool ColumnStore::open(const char *path) {
+    if (!path) return true;
+    snprintf(dir, sizeof(dir), "%s", path);
+    toDisk = true;
+    writer = std::thread([this] { writerLoop(); });
+    return true;
+}
+
+void ColumnStore::append(uint16_t unit, const ArchiveRecord &rec, uint32_t rxMs) {
+    Chunk &c = chunks[current];
+    uint32_t r = c.rows++;
+    c.unit[r] = unit;
+    c.seq[r] = rec.seq;
+    c.ts[r] = rec.ts;
+    c.rxMs[r] = rxMs;
+    c.co2[r] = rec.co2;
+    c.temp[r] = rec.temp;
+    c.rh[r] = rec.rh;
+    c.voc[r] = rec.voc;
+    c.pm25[r] = rec.pm25;
+    c.pm10[r] = rec.pm10;
+    c.flags[r] = rec.flags;
+    rowCount++;
+    if (c.rows == INGEST_CHUNK_ROWS) seal();
+}
+
+void ColumnStore::seal() {
+    Chunk &c = chunks[current];
+    if (c.rows == 0) return;
+    uint32_t next = (current + 1) % INGEST_CHUNKS;
+    {
+        std::unique_lock<std::mutex> lk(lock);
+        c.sealed = true;
+        if (toDisk) {
+            pendingWrites++;
+            wake.notify_one();
+        } else {
+            c.onDisk = true;
+        }
+        // the next buffer is reused only once it is on disk
+        Chunk &n = chunks[next];
+        if (n.sealed && !n.onDisk) {
+            stallCount++;
+            done.wait(lk, [&] { return n.onDisk; });
+        }
+    }
+    Chunk &n = chunks[next];
+    n.rows = 0;
+    n.sealed = false;
+    n.onDisk = false;
+    current = next;
+}
+
+void ColumnStore::flush() {
+    seal();
+    std::unique_lock<std::mutex> lk(lock);
+    done.wait(lk, [&] { return pendingWrites == 0; });
+    if (segment) fflush(segment);
+}
+
+void ColumnStore::writerLoop() {
+    std::unique_lock<std::mutex> lk(lock);
+    for (;;) {
+        wake.wait(lk, [&] { return stopping || pendingWrites > 0; });
+        if (pendingWrites == 0) return;
+        Chunk &c = chunks[writeNext];
+        lk.unlock();
+        writeChunk(c);
+        lk.lock();
+        c.onDisk = true;
+        pendingWrites--;
+        writeNext = (writeNext + 1) % INGEST_CHUNKS;
+        done.notify_all();
+    }
+}
+
+void ColumnStore::writeChunk(Chunk &c) {
+    if (!segment || segmentChunks >= INGEST_CHUNKS_PER_SEGMENT) {
+        if (segment) fclose(segment);
+        char path[256];
+        snprintf(path, sizeof(path), "%s/seg_%05u.col", dir, (unsigned)segmentIndex++);
+        segment = fopen(path, "wb");
+        segmentChunks = 0;
+        if (!segment) {
+            fprintf(stderr, "%s: cannot create\n", path);
+            return;
+        }
+    }
+    uint32_t header[2] = {INGEST_CHUNK_MAGIC, c.rows};
+    fwrite(header, sizeof(header), 1, segment);
+    fwrite(c.unit, 2, c.rows, segment);
+    fwrite(c.seq, 4, c.rows, segment);
+    fwrite(c.ts, 4, c.rows, segment);
+    fwrite(c.rxMs, 4, c.rows, segment);
+    fwrite(c.co2, 2, c.rows, segment);
+    fwrite(c.temp, 2, c.rows, segment);
+    fwrite(c.rh, 2, c.rows, segment);
+    fwrite(c.voc, 2, c.rows, segment);
+    fwrite(c.pm25, 2, c.rows, segment);
+    fwrite(c.pm10, 2, c.rows, segment);
+    fwrite(c.flags, 1, c.rows, segment);
+    segmentChunks++;
+    written += sizeof(header) + (uint64_t)c.rows * INGEST_ROW_BYTES;
+}
+
+size_t ColumnStore::scan(uint16_t unit, uint32_t fromTs, uint32_t toTs, ArchiveRecord *out, size_t max) {
+    size_t n = 0;
+    for (uint32_t k = 1; k <= INGEST_CHUNKS && n < max; k++) {
+        const Chunk &c = chunks[(current + k) % INGEST_CHUNKS];
+        for (uint32_t r = 0; r < c.rows && n < max; r++) {
+            if (c.unit[r] != unit || c.ts[r] < fromTs || c.ts[r] > toTs) continue;
+            ArchiveRecord &rec = out[n++];
+            rec.seq = c.seq[r];
+            rec.ts = c.ts[r];
+            rec.co2 = c.co2[r];
+            rec.temp = c.temp[r];
+            rec.rh = c.rh[r];
+            rec.voc = c.voc[r];
+            rec.pm25 = c.pm25[r];
+            rec.pm10 = c.pm10[r];
+            rec.flags = c.flags[r];
+        }
+    }
+    return n;
+}
+
+// --- gateway ---
+
+static uint32_t hashId(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+    return h;
+}
+
+int IngestGateway::unit(const char *id) {
+    const uint32_t slotCount = INGEST_MAX_UNITS * 2;
+    if (!slotsReady) {
+        for (uint32_t i = 0; i < slotCount; i++) slots[i] = -1;
+        slotsReady = true;
+    }
+    for (uint32_t i = hashId(id) % slotCount;; i = (i + 1) % slotCount) {
+        if (slots[i] < 0) {
+            if (units == INGEST_MAX_UNITS) return -1;
+            snprintf(ids[units], INGEST_UNIT_ID_MAX, "%s", id);
+            slots[i] = (int16_t)units;
+            return (int)units++;
+        }
+        if (strncmp(ids[slots[i]], id, INGEST_UNIT_ID_MAX - 1) == 0) return slots[i];
+    }
+}
+
+bool IngestGateway::store1(int handle, const ArchiveRecord &rec, uint32_t rxMs) {
+    st.records++;
+    if (!trackers[handle].accept(rec.seq)) return false;
+    store.append((uint16_t)handle, rec, rxMs);
+    st.stored++;
+    return true;
+}
+
+struct IngestGateway::BlockCtx {
+    IngestGateway *gw;
+    int handle;
+    uint32_t rxMs;
+    size_t stored;
+};
+
+void IngestGateway::blockRecord(const ArchiveRecord &rec, void *ctx) {
+    BlockCtx &bc = *(BlockCtx*)ctx;
+    if (bc.gw->store1(bc.handle, rec, bc.rxMs)) bc.stored++;
+}
+
+size_t IngestGateway::ingest(int handle, const uint8_t *data, size_t len, uint32_t rxMs) {
+    st.messages++;
+    if (handle < 0 || (uint32_t)handle >= units || len == 0) {
+        st.parseErrors++;
+        return 0;
+    }
+    switch (data[0]) {
+    case '{': {
+        // live samples carry more fields than archived ones, the live
+        // table reads both
+        LiveSample s;
+        s.seq = 0;
+        s.held = 0;
+        uint8_t present;
+        if (!payloadDecodeJson(liveFields, PAYLOAD_FIELD_COUNT(liveFields), (const char*)data, len, &s, present)) {
+            st.parseErrors++;
+            return 0;
+        }
+        s.m.haveSps30 = present & REC_HAVE_SPS30;
+        s.m.haveSgp40 = present & REC_HAVE_SGP40;
+        s.m.haveScd41 = present & REC_HAVE_SCD41;
+        ArchiveRecord rec = makeArchiveRecord(s.m, s.seq);
+        rec.flags |= (uint8_t)(s.held << REC_HELD_SHIFT);
+        return store1(handle, rec, rxMs) ? 1 : 0;
+    }
+    case BATCH_FRAME_TYPE: {
+        if (len < BATCH_HEADER_SIZE || len != BATCH_HEADER_SIZE + (size_t)data[7] * sizeof(ArchiveRecord)) {
+            st.parseErrors++;
+            return 0;
+        }
+        size_t stored = 0;
+        for (uint8_t i = 0; i < data[7]; i++) {
+            ArchiveRecord rec;
+            memcpy(&rec, data + BATCH_HEADER_SIZE + i * sizeof(ArchiveRecord), sizeof(rec));
+            if (store1(handle, rec, rxMs)) stored++;
+        }
+        return stored;
+    }
+    case CODEC_FRAME_TYPE: {
+        BlockCtx bc = {this, handle, rxMs, 0};
+        if (codecDecodeBlock(data, len, blockRecord, &bc) < 0) st.parseErrors++;
+        return bc.stored;
+    }
+    default:
+        st.unsupported++;
+        return 0;
+    }
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+// Host-side ingest of the sensor payload stream from many units.
+//
+// A gateway (one BLE central or several feeding it) hands every data
+// notification of a unit to IngestGateway::ingest() with the unit's handle.
+// Payloads are told apart by their first byte like the firmware sends them:
+// JSON samples ('{', parsed by the payload schema, payload_schema.h),
+// batch frames (batch_frame.h) and codec blocks (archive_codec.h).
+//
+// Per unit, a SeqTracker follows the seq counter. Seqs do not arrive in
+// order: live samples go out while a backlog drains, and range queries
+// resend old seqs to fill gaps. Seqs past the newest one count the skipped
+// ones as missing; an older seq fills a gap (late) or, when older than the
+// first seq the tracker saw (after a gateway restart), is counted as
+// earlier. Windows only catch duplicates, nothing is dropped for being old:
+// one covers the INGEST_SEQ_WINDOW seqs below the newest, a second one
+// follows the older seqs as they come in. A duplicate that neither window
+// covers any more is stored again. Accepted records go to a ColumnStore.
+//
+// The store keeps rows column by column in fixed chunks of
+// INGEST_CHUNK_ROWS, allocated once up front. A full chunk is sealed and
+// handed to a writer thread, which appends it to the current segment file
+// with one write per column, while ingest carries on in the next chunk;
+// only when every chunk is still waiting for the disk does ingest block.
+// Sealed chunks stay queryable until their buffer is reused.
+//
+// Segment file (/seg_NNNNN.col in the store dir), per chunk, little endian:
+//
+//   u32 magic | u32 rows | then each column for all rows:
+//   u16 unit | u32 seq | u32 ts | u32 rxMs | u16 co2 | i16 temp | u16 rh
+//   | u16 voc | u16 pm25 | u16 pm10 | u8 flags
+//
+// Nothing on the ingest path allocates; ingest() is for one thread.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "archive_record.h"
+
+#define INGEST_MAX_UNITS 4096
+#define INGEST_UNIT_ID_MAX 24          // e.g. a BLE address, NUL included
+#define INGEST_SEQ_WINDOW 256          // seqs per duplicate window
+#define INGEST_CHUNK_ROWS 16384
+#define INGEST_CHUNKS 8                // buffers, sealed ones included
+#define INGEST_CHUNKS_PER_SEGMENT 64
+#define INGEST_CHUNK_MAGIC 0x4C4F4341u // "ACOL"
+
+// which of the INGEST_SEQ_WINDOW seqs up to newest arrived
+struct SeqWindow {
+    uint32_t newest = 0;
+    bool started = false;
+    uint64_t bits[INGEST_SEQ_WINDOW / 64] = {};  // bit k: newest - k arrived
+
+    bool covers(uint32_t seq) const { return started && seq <= newest && newest - seq < INGEST_SEQ_WINDOW; }
+    bool seen(uint32_t seq) const;
+    // a seq past newest slides the window up to it, one below the window
+    // starts it over at seq
+    void mark(uint32_t seq);
+};
+
+struct SeqTracker {
+    SeqWindow recent;           // up to the newest seq
+    SeqWindow older;            // seqs below recent arriving later
+    uint32_t first = 0;         // missing is counted from here up
+    uint64_t accepted = 0;
+    uint64_t missing = 0;       // skipped seqs not filled in (yet)
+    uint64_t late = 0;          // gaps filled afterwards
+    uint64_t duplicates = 0;
+    uint64_t earlier = 0;       // below the first seq seen
+
+    // true if seq is new and the record should be stored
+    bool accept(uint32_t seq);
+};
+
+class ColumnStore {
+public:
+    ColumnStore();
+    ~ColumnStore();
+
+    // segment files go to dir (must exist); nullptr keeps everything in RAM
+    bool open(const char *dir);
+    void append(uint16_t unit, const ArchiveRecord &rec, uint32_t rxMs);
+    // seal the open chunk and wait until everything is on disk
+    void flush();
+
+    // rows of unit with fromTs <= ts <= toTs still in RAM, oldest chunk
+    // first; returns how many were copied
+    size_t scan(uint16_t unit, uint32_t fromTs, uint32_t toTs, ArchiveRecord *out, size_t max);
+
+    uint64_t rows() const { return rowCount; }
+    uint64_t bytesWritten() const { return written; }
+    uint64_t stalls() const { return stallCount; }   // appends that waited for the writer
+
+private:
+    struct Chunk {
+        uint32_t rows;
+        bool sealed;            // waiting for (or done with) the writer
+        bool onDisk;
+        uint16_t *unit;
+        uint32_t *seq;
+        uint32_t *ts;
+        uint32_t *rxMs;
+        uint16_t *co2;
+        int16_t *temp;
+        uint16_t *rh;
+        uint16_t *voc;
+        uint16_t *pm25;
+        uint16_t *pm10;
+        uint8_t *flags;
+    };
+
+    void seal();
+    void writerLoop();
+    void writeChunk(Chunk &c);
+
+    Chunk chunks[INGEST_CHUNKS];
+    uint8_t *memory = nullptr;
+    uint32_t current = 0;       // chunk being filled
+    uint32_t oldest = 0;        // oldest chunk with rows, for scans
+    uint64_t rowCount = 0;
+    uint64_t written = 0;
+    uint64_t stallCount = 0;
+
+    char dir[200];
+    bool toDisk = false;
+    FILE *segment = nullptr;
+    uint32_t segmentIndex = 0;
+    uint32_t segmentChunks = 0;
+
+    std::mutex lock;
+    std::condition_variable wake;       // writer: a chunk was sealed
+    std::condition_variable done;       // ingest: a chunk is on disk
+    uint32_t writeNext = 0;             // next chunk the writer takes
+    uint32_t pendingWrites = 0;
+    bool stopping = false;
+    std::thread writer;
+};
+
+struct IngestStats {
+    uint64_t messages = 0;
+    uint64_t records = 0;       // decoded, before seq tracking
+    uint64_t stored = 0;
+    uint64_t parseErrors = 0;
+    uint64_t unsupported = 0;   // CBOR/binary singles, alerts, tier frames
+};
+
+class IngestGateway {
+public:
+    explicit IngestGateway(ColumnStore &store) : store(store) {}
+
+    // handle for a unit id, registering it on first use; -1 when full
+    int unit(const char *id);
+    uint32_t unitCount() const { return units; }
+    const char *unitId(int handle) const { return ids[handle]; }
+
+    // one notification of unit; returns records stored
+    size_t ingest(int handle, const uint8_t *data, size_t len, uint32_t rxMs);
+
+    const SeqTracker &tracker(int handle) const { return trackers[handle]; }
+    const IngestStats &stats() const { return st; }
+
+private:
+    struct BlockCtx;
+    static void blockRecord(const ArchiveRecord &rec, void *ctx);
+    bool store1(int handle, const ArchiveRecord &rec, uint32_t rxMs);
+
+    ColumnStore &store;
+    char ids[INGEST_MAX_UNITS][INGEST_UNIT_ID_MAX];
+    SeqTracker trackers[INGEST_MAX_UNITS];
+    int16_t slots[INGEST_MAX_UNITS * 2];    // open addressing over ids, -1 = free
+    uint32_t units = 0;
+    bool slotsReady = false;
+    IngestStats st;
+};
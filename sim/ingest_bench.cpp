@@ -0,0 +1,293 @@
+// Load generator and benchmark for the ingest gateway (ingest.h).
+//
+// Simulates N units the way the firmware talks: a sample every 30 s sent
+// as a live JSON notification while connected, and after every outage the
+// backlog drained as codec blocks sized for an MTU 247 link, --drain-blocks
+// per sample slot after the live sample, so older seqs keep arriving behind
+// newer ones. Every unit drops out for --outage-min once every
+// --outage-every-h hours (random phase). --loss-every loses every Nth
+// notification on the way, --dup-every sends every Nth one twice (an ack
+// timeout resend). Every --refill-every-h hours the collector gets the
+// records it lost that are more than INGEST_SEQ_WINDOW seqs behind the
+// newest with range requests (range_query.h), one per run of consecutive
+// seqs, answered with codec blocks too.
+//
+// The whole stream is generated first, in arrival order over all units,
+// then pushed through one gateway as fast as it takes it. Reports sustained
+// ingest throughput, per-notification latency percentiles and the store's
+// disk writes, and checks the seq tracking against what was generated.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++17 -pthread -Isrc -Isim src/archive_codec.cpp src/payload_schema.cpp sim/ingest.cpp sim/ingest_bench.cpp -o ingest-bench
+//
+// Usage:
+//   ingest-bench [--units N] [--hours H] [--outage-every-h H] [--outage-min M]
+//                [--drain-blocks N] [--loss-every N] [--dup-every N]
+//                [--refill-every-h H] [--dir PATH | --ram]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+#include "archive_codec.h"
+#include "payload_schema.h"
+#include "ingest.h"
+
+#define SAMPLE_MS 30000
+#define NOTIFY_MAX 244      // MTU 247 - 3
+
+static double wallSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// xorshift32, deterministic
+static uint32_t rngState = 1;
+static uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+struct Message {
+    uint32_t rxMs;
+    uint32_t offset;    // into the arena
+    uint16_t len;
+    uint16_t unit;
+};
+
+struct Unit {
+    uint32_t seq;
+    uint32_t bootMs;    // device clock offset
+    uint32_t outagePhaseMs;
+    float co2, temp, rh, voc, pm25;
+    std::vector<ArchiveRecord> backlog;
+    size_t drained = 0;                 // backlog records already sent
+    std::vector<ArchiveRecord> lost;    // lost on the way, not refilled yet
+};
+
+static std::vector<uint8_t> arena;
+static std::vector<Message> messages;
+static std::vector<Unit> units;
+static uint32_t lossEvery = 0, dupEvery = 0, sent = 0;
+
+// one notification carrying recs[0..count)
+static void emit(uint16_t unit, uint32_t rxMs, const uint8_t *data, size_t len,
+                 const ArchiveRecord *recs, size_t count) {
+    sent++;
+    if (lossEvery && sent % lossEvery == 0) {
+        std::vector<ArchiveRecord> &lost = units[unit].lost;
+        lost.insert(lost.end(), recs, recs + count);
+        return;
+    }
+    Message m = {rxMs, (uint32_t)arena.size(), (uint16_t)len, unit};
+    arena.insert(arena.end(), data, data + len);
+    messages.push_back(m);
+    if (dupEvery && sent % dupEvery == 0) messages.push_back(m);
+}
+
+// recs[from..) as codec blocks, at most maxBlocks of them; returns the
+// index after the last record sent
+static size_t emitBlocks(uint16_t unit, uint32_t rxMs, const std::vector<ArchiveRecord> &recs,
+                         size_t from, uint32_t maxBlocks) {
+    uint8_t block[NOTIFY_MAX];
+    CodecBlockWriter w;
+    size_t i = from;
+    for (uint32_t b = 0; b < maxBlocks && i < recs.size(); b++) {
+        size_t start = i;
+        w.begin(block, sizeof(block));
+        while (i < recs.size() && w.add(recs[i])) i++;
+        emit(unit, rxMs, block, w.finish(), &recs[start], i - start);
+    }
+    return i;
+}
+
+static float walk(float v, float step, float lo, float hi) {
+    v += ((float)(nextRandom() % 2001) / 1000.0f - 1.0f) * step;
+    return std::min(std::max(v, lo), hi);
+}
+
+int main(int argc, char **argv) {
+    uint32_t unitCount = 200;
+    double hours = 24.0;
+    double outageEveryH = 6.0;
+    uint32_t outageMin = 30;
+    uint32_t drainBlocks = 1;
+    double refillEveryH = 6.0;
+    const char *dir = "/tmp/aqs-ingest";
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--units") && v) { unitCount = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--hours") && v) { hours = atof(v); i++; }
+        else if (!strcmp(a, "--outage-every-h") && v) { outageEveryH = atof(v); i++; }
+        else if (!strcmp(a, "--outage-min") && v) { outageMin = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--drain-blocks") && v) { drainBlocks = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--refill-every-h") && v) { refillEveryH = atof(v); i++; }
+        else if (!strcmp(a, "--loss-every") && v) { lossEvery = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--dup-every") && v) { dupEvery = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--dir") && v) { dir = v; i++; }
+        else if (!strcmp(a, "--ram")) { dir = nullptr; }
+        else {
+            fprintf(stderr, "unknown argument: %s\n", a);
+            return 2;
+        }
+    }
+    if (unitCount == 0 || unitCount > INGEST_MAX_UNITS || outageEveryH <= 0 || refillEveryH <= 0 ||
+        drainBlocks == 0) {
+        fprintf(stderr, "need 1..%u units, outage and refill periods > 0 and --drain-blocks > 0\n",
+                INGEST_MAX_UNITS);
+        return 2;
+    }
+
+    // --- generate the stream ---
+    double genStart = wallSeconds();
+    units.resize(unitCount);
+    const uint32_t periodMs = (uint32_t)(outageEveryH * 3600000.0);
+    const uint32_t refillMs = (uint32_t)(refillEveryH * 3600000.0);
+    for (uint32_t u = 0; u < unitCount; u++) {
+        Unit &d = units[u];
+        d.seq = nextRandom() % 100000;
+        d.bootMs = nextRandom() % 86400000;
+        d.outagePhaseMs = nextRandom() % periodMs;
+        d.co2 = 600; d.temp = 22; d.rh = 45; d.voc = 28000; d.pm25 = 8;
+    }
+    const uint32_t endMs = (uint32_t)(hours * 3600000.0);
+    uint64_t generated = 0, refilled = 0;
+    for (uint32_t t = 0; t < endMs; t += SAMPLE_MS) {
+        for (uint32_t u = 0; u < unitCount; u++) {
+            Unit &d = units[u];
+            // units sample at their own offset inside the slot
+            uint32_t rxMs = t + u * (SAMPLE_MS / unitCount);
+            AirMeasurement m;
+            d.co2 = walk(d.co2, 20, 400, 2500);
+            d.temp = walk(d.temp, 0.05f, 15, 30);
+            d.rh = walk(d.rh, 0.2f, 20, 80);
+            d.voc = walk(d.voc, 150, 20000, 45000);
+            d.pm25 = walk(d.pm25, 0.7f, 0, 150);
+            m.co2 = (uint16_t)d.co2;
+            m.temp = d.temp;
+            m.rh = d.rh;
+            m.srawVoc = (uint16_t)d.voc;
+            m.mc2p5 = (uint16_t)d.pm25;
+            m.mc10p0 = (uint16_t)(d.pm25 * 1.3f);
+            m.mc1p0 = (uint16_t)(d.pm25 * 0.7f);
+            m.mc4p0 = (uint16_t)(d.pm25 * 1.1f);
+            m.haveSps30 = m.haveSgp40 = m.haveScd41 = true;
+            m.ts = d.bootMs + t;
+            LiveSample s;
+            s.seq = ++d.seq;
+            s.held = 0;
+            s.m = m;
+            generated++;
+            ArchiveRecord rec = makeArchiveRecord(m, s.seq);
+            bool out = (t + d.outagePhaseMs) % periodMs < outageMin * 60000U;
+            if (out) {
+                d.backlog.push_back(rec);
+                continue;
+            }
+            // the live sample goes out right away, the backlog drains behind it
+            uint8_t json[PAYLOAD_MAX_SIZE];
+            size_t len = payloadEncode(PAYLOAD_JSON, liveFields, &s, REC_HAVE_MASK, json, sizeof(json));
+            emit((uint16_t)u, rxMs, json, len, &rec, 1);
+            if (d.drained < d.backlog.size()) {
+                d.drained = emitBlocks((uint16_t)u, rxMs, d.backlog, d.drained, drainBlocks);
+                if (d.drained == d.backlog.size()) {
+                    d.backlog.clear();
+                    d.drained = 0;
+                }
+            }
+            // the collector asks for the old gaps once per refill period,
+            // half a period away from the outage
+            if ((t + d.outagePhaseMs + refillMs / 2) % refillMs < SAMPLE_MS && !d.lost.empty()) {
+                std::vector<ArchiveRecord> range, keep;
+                for (const ArchiveRecord &r : d.lost) {
+                    (r.seq + INGEST_SEQ_WINDOW < d.seq ? range : keep).push_back(r);
+                }
+                std::sort(range.begin(), range.end(),
+                          [](const ArchiveRecord &a, const ArchiveRecord &b) { return a.seq < b.seq; });
+                d.lost.swap(keep);
+                refilled += range.size();
+                // one range request per run of consecutive seqs
+                size_t i = 0;
+                while (i < range.size()) {
+                    size_t j = i + 1;
+                    while (j < range.size() && range[j].seq == range[j - 1].seq + 1) j++;
+                    std::vector<ArchiveRecord> run(range.begin() + i, range.begin() + j);
+                    emitBlocks((uint16_t)u, rxMs, run, 0, UINT32_MAX);
+                    i = j;
+                }
+            }
+        }
+    }
+    // lost for good, or still offline or draining at the end
+    uint64_t lostRecords = 0;
+    for (const Unit &d : units) lostRecords += d.lost.size() + d.backlog.size() - d.drained;
+    double genWall = wallSeconds() - genStart;
+
+    // --- ingest ---
+    if (dir) mkdir(dir, 0755);
+    ColumnStore store;
+    if (!store.open(dir)) return 1;
+    static IngestGateway gateway(store);
+    char id[INGEST_UNIT_ID_MAX];
+    std::vector<int> handles(unitCount);
+    for (uint32_t u = 0; u < unitCount; u++) {
+        snprintf(id, sizeof(id), "aq:%02x:%02x:%02x", u >> 16 & 0xFF, u >> 8 & 0xFF, u & 0xFF);
+        handles[u] = gateway.unit(id);
+    }
+    std::vector<uint32_t> latencyNs(messages.size());
+    double start = wallSeconds();
+    for (size_t i = 0; i < messages.size(); i++) {
+        const Message &m = messages[i];
+        uint64_t t0 = nowNs();
+        gateway.ingest(handles[m.unit], arena.data() + m.offset, m.len, m.rxMs);
+        latencyNs[i] = (uint32_t)std::min<uint64_t>(nowNs() - t0, UINT32_MAX);
+    }
+    double ingestWall = wallSeconds() - start;
+    store.flush();
+    double wall = wallSeconds() - start;
+
+    // --- report ---
+    std::sort(latencyNs.begin(), latencyNs.end());
+    auto pct = [&](double p) { return latencyNs.empty() ? 0u : latencyNs[(size_t)(p * (latencyNs.size() - 1))]; };
+    const IngestStats &st = gateway.stats();
+    uint64_t missing = 0, dups = 0, late = 0, earlier = 0;
+    for (uint32_t u = 0; u < unitCount; u++) {
+        const SeqTracker &t = gateway.tracker(handles[u]);
+        missing += t.missing;
+        dups += t.duplicates;
+        late += t.late;
+        earlier += t.earlier;
+    }
+    printf("stream             %u units, %.1f h, %llu samples in %zu notifications (%zu bytes), generated in %.2f s\n",
+           unitCount, hours, (unsigned long long)generated, messages.size(), arena.size(), genWall);
+    printf("ingest             %llu records in %.3f s: %.0f records/s, %.0f notifications/s\n",
+           (unsigned long long)st.records, ingestWall, st.records / ingestWall, st.messages / ingestWall);
+    printf("                   with the final flush %.3f s (%.0f records/s sustained)\n", wall, st.records / wall);
+    printf("latency (ns)       p50 %u, p99 %u, p99.9 %u, max %u\n", pct(0.5), pct(0.99), pct(0.999),
+           latencyNs.empty() ? 0 : latencyNs.back());
+    printf("stored             %llu rows, %llu bytes to disk, %llu writer stalls\n",
+           (unsigned long long)store.rows(), (unsigned long long)store.bytesWritten(),
+           (unsigned long long)store.stalls());
+    printf("seq tracking       %llu missing, %llu late, %llu duplicates, %llu earlier, %llu parse errors\n",
+           (unsigned long long)missing, (unsigned long long)late, (unsigned long long)dups,
+           (unsigned long long)earlier, (unsigned long long)st.parseErrors);
+    printf("range refills      %llu records asked for again\n", (unsigned long long)refilled);
+    // every generated sample is either stored or was lost on the way
+    bool ok = store.rows() + lostRecords == generated && st.parseErrors == 0;
+    printf("check              %llu stored + %llu lost %s %llu generated\n", (unsigned long long)store.rows(),
+           (unsigned long long)lostRecords, ok ? "==" : "!=", (unsigned long long)generated);
+    return ok ? 0 : 1;
+}
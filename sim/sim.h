@@ -0,0 +1,113 @@
+#pragma once
+
+// Linux stand-in for the ESP32 platform (see src/hal.h).
+// Sensors are simulated with slow random walks, the clock is virtual and
+// only moves when simAdvance() is called, notifications are counted
+// instead of sent, and the archive log lives in plain files.
+//
+// The BLE link is a queue of linkBuffers packets that drains up to
+// linkPacketsPerEvent packets per connection event once a packet is
+// linkLatencyMs old; a notify with the queue full is refused, and every
+// drained packet is reported done through pipelineNotifyDone().
+//
+// For the duty-cycle estimate every wake and every platform call is charged
+// a fixed amount of CPU time (SimCosts), and sensor power states are
+// tracked; sim_main turns that into an average current.
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct SimConfig {
+    const char *storageDir = "/tmp/aqs-sim";  // must exist
+    uint16_t mtu = 247;                       // negotiated ATT MTU
+    uint32_t scd41ReadyEveryMs = 0;           // SCD41 data-ready interval (0 = per SENSOR_LOW_POWER)
+    uint32_t sps30FailEvery = 0;              // make every Nth SPS30 read fail (0 = never)
+    uint32_t sps30DeadFromMs = 0;             // SPS30 off the bus from here ...
+    uint32_t sps30DeadForMs = 0;              // ... for this long (0 = never)
+    bool calm = false;                        // a stable room: sensor walks at a tenth of the step
+    uint32_t co2SpikeEveryMs = 0;             // add CO2_SPIKE_PPM for 5 min every N ms (0 = never)
+    uint32_t lossEvery = 0;                   // lose every Nth notification in the air (0 = never)
+    uint32_t linkIntervalMs = 30;             // connection interval
+    uint32_t linkPacketsPerEvent = 4;         // packets the link carries per connection event
+    uint32_t linkBuffers = 8;                 // stack transmit buffers
+    uint32_t linkLatencyMs = 0;               // extra time before a queued packet can go
+    uint32_t wakeLateMs = 2;                  // a timed wake-up comes up to this late (light sleep exit, tick)
+    uint32_t seed = 1;
+    int serialFd = -1;                        // pty master standing in for the serial port (-1 = none)
+    bool verbose = false;                     // print log lines
+};
+
+// CPU time charged per event, in us (ESP32 at 240 MHz, I2C at 100 kHz)
+struct SimCosts {
+    uint32_t wake = 400;          // light sleep exit, scheduler, task switch
+    uint32_t readSps30 = 2500;
+    uint32_t readSgp40 = 1200;
+    uint32_t readScd41 = 1500;
+    uint32_t sensorOp = 300;      // one command or response transaction
+    uint32_t notify = 800;
+    uint32_t flashWrite = 3000;   // SPIFFS append or file write
+    uint32_t flashRead = 800;
+    uint32_t advertise = 300;     // advertising data update
+};
+
+struct SimCounters {
+    uint64_t notifies = 0;
+    uint64_t flashWrites = 0;      // storage appends and file writes
+    uint64_t notifyBytes = 0;
+    uint64_t sensorReads = 0;
+    uint64_t sensorOps = 0;
+    uint64_t logLines = 0;
+    uint64_t summaries = 0;
+    uint64_t summaryBytes = 0;
+    uint64_t notifiesLost = 0;
+    uint64_t notifyRejected = 0;   // refused with every stack buffer in use
+    uint64_t indications = 0;      // notifies sent as confirmed indications
+    uint64_t serialBytes = 0;      // written to the serial port
+    uint64_t wakes = 0;
+    uint64_t activeUs = 0;         // charged CPU time
+    uint64_t sps30OnMs = 0;        // fan running
+    uint64_t sgp40HeaterMs = 0;
+    // what the simulated client made of the data notifications
+    uint64_t received = 0;         // records decoded
+    uint64_t singles = 0;          // single-sample notifications (any payload format)
+    uint64_t singleBytes = 0;
+    uint64_t alerts = 0;           // alert frames
+    uint32_t alertAgeMaxMs = 0;    // oldest measurement an alert frame carried
+    uint64_t tierBuckets = 0;      // buckets decoded from tier frames
+    uint64_t tierOutOfOrder = 0;   // tier buckets that did not follow the previous one
+    uint64_t burstRecords = 0;     // records decoded from burst frames
+    uint64_t burstGaps = 0;        // burst records that did not follow the previous one
+    uint32_t burstLastSeq = 0;
+    uint16_t vocIndexLast = 0;     // voc_index of the last JSON sample
+    uint16_t vocIndexMax = 0;
+    // what a listener scanning the advertisement made of it (broadcast.h)
+    uint64_t broadcasts = 0;       // updates decoded
+    uint64_t broadcastsConnected = 0;  // of those, while a client was connected
+    uint64_t broadcastBad = 0;     // not ours or too big for the advertisement
+    uint64_t broadcastGaps = 0;    // updates whose seq did not follow the previous one
+    uint16_t broadcastLastSeq = 0;
+    uint32_t broadcastLastMs = 0;
+    uint32_t broadcastGapMinMs = 0;    // time between two updates
+    uint32_t broadcastGapMaxMs = 0;
+    uint64_t heldRestored = 0;     // held samples the client can fill back in (not from CBOR)
+    uint64_t duplicates = 0;       // records at or below its watermark
+    uint32_t contiguous = 0;       // highest seq with nothing missing below
+};
+
+void simInit(const SimConfig &cfg);
+// move the virtual clock forward
+void simAdvance(uint32_t ms);
+uint32_t simNow();
+// charge one wake of the pipeline
+void simWake();
+// transport wake requested since the last call
+bool simTakeWake();
+// how late the next timed wake-up comes, 0..SimConfig::wakeLateMs
+uint32_t simWakeDelay();
+const SimCosts &simCosts();
+// the client connects; the first record it gets next sets where its
+// contiguous run resumes (see pipelineAck())
+void simClientConnected();
+const SimCounters &simCounters();
+// the config characteristic as the client reads it (runtime_config.h)
+const uint8_t *simConfigValue(size_t &len);
@@ -0,0 +1,453 @@
+// Host runner for the measurement pipeline on the simulated platform.
+//
+// Runs days of virtual time in seconds and reports loop throughput,
+// archive throughput, backlog drain time, heap high-water mark and an
+// estimated average current, so pipeline changes can be compared before
+// flashing a device.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++17 -Isrc -Isim src/pipeline.cpp src/archive_log.cpp src/archive_codec.cpp src/latency_stats.cpp src/logging.cpp src/rolling_stats.cpp src/scheduler.cpp src/history_tiers.cpp src/payload_schema.cpp src/notify_pacer.cpp src/alert_rules.cpp src/report_filter.cpp src/runtime_config.cpp src/serial_frame.cpp src/serial_dump.cpp src/voc_index.cpp sim/sim_platform.cpp sim/sim_main.cpp -o aqs-sim
+//
+// Usage:
+//   aqs-sim [--days N] [--tick-ms N] [--busy] [--connect-every-min N] [--connect-for-s N]
+//           [--mtu N] [--range-last-min N] [--ack] [--loss-every N]
+//           [--link-interval-ms N] [--link-packets N] [--link-buffers N] [--link-latency-ms N]
+//           [--wake-late-ms N]
+//           [--battery-mah N] [--sps30-dead-at-h H] [--sps30-dead-for-h D] [--tier N]
+//           [--format json|cbor|binary] [--co2-spike-every-min N] [--calm]
+//           [--config-at-h H] [--config-interval-s S] [--burst-at-h H] [--burst-s S] [--broadcast]
+//           [--serial-pty] [--serve-s N]
+//           [--dir PATH] [--verbose]
+//
+// By default the loop is event driven like the firmware: virtual time jumps
+// by the wait pipelineLoop() returns, or to the next connect/disconnect.
+// --tick-ms N polls every N ms instead, --busy charges the CPU as never
+// sleeping (the old polling loop). A timed wake-up comes up to
+// --wake-late-ms (default 2) late, like light sleep exit and the RTOS tick
+// make it on the device; the "wake late" latency stage shows it.
+//
+// --ack makes the client write its contiguous seq back on connect and after
+// every tick it is connected, which turns on acked delivery; without it
+// samples are dropped once sent. --loss-every drops every Nth notification
+// on the way.
+// --link-* shape the simulated BLE link (see sim.h): connection interval,
+// packets per connection event, stack buffers and queueing latency.
+// --range-last-min makes the client send a ts range request for the last N
+// minutes right after each connect instead of taking the whole backlog.
+// --format makes the client pick that payload format on every connect.
+// --tier N asks for all of history tier N (0 = 5 min, 1 = 1 h) instead.
+// --calm slows every simulated sensor to a tenth of its usual drift, a
+// stable room for change-only reporting (build with -DREPORT_DEADBAND=1).
+// --co2-spike-every-min adds 1200 ppm of CO2 for 5 min every N minutes to
+// trip the alert rules.
+// --config-at-h makes the client, on its first connect after hour H, read
+// the config characteristic and write it back with every sensor interval
+// set to --config-interval-s (default 10). The config is kept in the
+// storage dir, so a run without clearing it starts with the written one.
+// --burst-at-h makes the client, on its first connect after hour H, start
+// burst sampling for --burst-s seconds (default 300, burst_sampling.h);
+// give it a --connect-for-s that long to watch the whole burst live.
+// --broadcast makes the client turn the advertising broadcast on with a
+// config write on its first connect (broadcast.h; a build with
+// -DBROADCAST_ADV=1 has it on from boot); a listener checks every update.
+// --serial-pty puts the serial port on a pseudo terminal and prints its
+// name; after the simulated days the pipeline keeps serving it in real
+// time for --serve-s seconds (default 60), so sim/aqs_dump.cpp can pull the
+// archive end to end:  aqs-sim --serial-pty &  aqs-dump --port /dev/pts/N
+// --sps30-dead-at-h takes the SPS30 off the bus for --sps30-dead-for-h
+// hours (default 1) to exercise recovery and its backoff.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "pipeline.h"
+#include "latency_stats.h"
+#include "logging.h"
+#include "range_query.h"
+#include "payload_schema.h"
+#include "runtime_config.h"
+#include "burst_sampling.h"
+#include "broadcast.h"
+#include "sim.h"
+
+static double wallSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#if LATENCY_STATS
+static const char *const stageNames[LAT_STAGE_COUNT] = {
+    "read sps30", "read sgp40", "read scd41", "diag sps30", "diag sgp40", "diag scd41",
+    "payload", "send", "flush step", "archive", "wake late",
+};
+
+// upper bound of the bucket holding the given fraction of samples, in us
+static double bucketQuantileUs(const LatencySummary &s, double q) {
+    uint32_t total = 0, seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++) total += s.buckets[b];
+    uint32_t want = (uint32_t)(total * q);
+    for (int b = 0; b < LAT_BUCKETS - 1; b++) {
+        seen += s.buckets[b];
+        uint32_t bound = 1UL << (latencyBucketShift() + 1 + b);
+        if (seen > want) return (double)(bound < s.max ? bound : s.max) / halCyclesPerUs();
+    }
+    return (double)s.max / halCyclesPerUs();
+}
+
+static void printLatency() {
+    printf("latency (us)       count      min      p50<     p99<      max\n");
+    for (int i = 0; i < LAT_STAGE_COUNT; i++) {
+        LatencySummary s;
+        latencyRead((LatencyStage)i, s);
+        if (s.count == 0) continue;
+        printf("  %-16s %7lu %8.1f %8.1f %8.1f %8.1f\n", stageNames[i], (unsigned long)s.count,
+               (double)s.min / halCyclesPerUs(), bucketQuantileUs(s, 0.5), bucketQuantileUs(s, 0.99),
+               (double)s.max / halCyclesPerUs());
+    }
+}
+#endif
+
+// typical datasheet currents, mA
+static const double MA_CPU_ACTIVE = 40.0;
+static const double MA_LIGHT_SLEEP = 0.8;
+static const double MA_BLE_CONNECTED = 2.0;
+static const double MA_BLE_ADVERTISING = 1.0;
+static const double MA_SPS30_ON = 55.0;
+static const double MA_SPS30_SLEEP = 0.038;
+static const double MA_SCD41 = SENSOR_LOW_POWER ? 3.2 : 15.0;
+static const double MA_SGP40_HEATER = 2.6;
+
+static size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// open a pty pair in raw mode; returns the non-blocking master, -1 on error.
+// The slave stays open here too, so the master never sees a hangup
+// between two clients.
+static int openSerialPty() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) return -1;
+    const char *name = ptsname(master);
+    int slave = name ? open(name, O_RDWR | O_NOCTTY) : -1;
+    if (slave < 0) return -1;
+    termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    fprintf(stderr, "serial port on %s\n", name);
+    return master;
+}
+
+int main(int argc, char **argv) {
+    SimConfig cfg;
+    double days = 1.0;
+    uint32_t tickMs = 0;            // 0 = event driven
+    bool busy = false;
+    double batteryMah = 2000.0;
+    uint32_t connectEveryMin = 60;  // a phone shows up once an hour
+    uint32_t connectForS = 20;      // and stays for 20 s
+    uint32_t rangeLastMin = 0;      // 0 = take the full backlog
+    int tierRequest = -1;           // -1 = no tier request
+    int payloadFormat = -1;         // -1 = leave the default (JSON)
+    bool clientAcks = false;
+    bool deadSet = false;
+    bool serialPty = false;
+    uint32_t serveS = 60;
+    double configAtH = -1.0;        // < 0 = never write the config
+    uint32_t configIntervalS = 10;
+    double burstAtH = -1.0;         // < 0 = no burst
+    uint32_t burstS = 300;
+    bool broadcast = false;         // turn the broadcast on at the first connect
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--days") && v) { days = atof(v); i++; }
+        else if (!strcmp(a, "--tick-ms") && v) { tickMs = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--busy")) { busy = true; }
+        else if (!strcmp(a, "--battery-mah") && v) { batteryMah = atof(v); i++; }
+        else if (!strcmp(a, "--connect-every-min") && v) { connectEveryMin = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--connect-for-s") && v) { connectForS = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--mtu") && v) { cfg.mtu = (uint16_t)atoi(v); i++; }
+        else if (!strcmp(a, "--range-last-min") && v) { rangeLastMin = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--tier") && v) { tierRequest = atoi(v); i++; }
+        else if (!strcmp(a, "--format") && v) {
+            payloadFormat = !strcmp(v, "json") ? PAYLOAD_JSON : !strcmp(v, "cbor") ? PAYLOAD_CBOR
+                          : !strcmp(v, "binary") ? PAYLOAD_BINARY : PAYLOAD_FORMAT_COUNT;
+            i++;
+        }
+        else if (!strcmp(a, "--ack")) { clientAcks = true; }
+        else if (!strcmp(a, "--calm")) { cfg.calm = true; }
+        else if (!strcmp(a, "--co2-spike-every-min") && v) { cfg.co2SpikeEveryMs = (uint32_t)atoi(v) * 60000UL; i++; }
+        else if (!strcmp(a, "--config-at-h") && v) { configAtH = atof(v); i++; }
+        else if (!strcmp(a, "--config-interval-s") && v) { configIntervalS = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--burst-at-h") && v) { burstAtH = atof(v); i++; }
+        else if (!strcmp(a, "--burst-s") && v) { burstS = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--broadcast")) { broadcast = true; }
+        else if (!strcmp(a, "--loss-every") && v) { cfg.lossEvery = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--link-interval-ms") && v) { cfg.linkIntervalMs = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--link-packets") && v) { cfg.linkPacketsPerEvent = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--link-buffers") && v) { cfg.linkBuffers = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--link-latency-ms") && v) { cfg.linkLatencyMs = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--wake-late-ms") && v) { cfg.wakeLateMs = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--sps30-dead-at-h") && v) { cfg.sps30DeadFromMs = (uint32_t)(atof(v) * 3600000.0); deadSet = true; i++; }
+        else if (!strcmp(a, "--sps30-dead-for-h") && v) { cfg.sps30DeadForMs = (uint32_t)(atof(v) * 3600000.0); i++; }
+        else if (!strcmp(a, "--serial-pty")) { serialPty = true; }
+        else if (!strcmp(a, "--serve-s") && v) { serveS = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--dir") && v) { cfg.storageDir = v; i++; }
+        else if (!strcmp(a, "--verbose")) { cfg.verbose = true; }
+        else {
+            fprintf(stderr, "unknown argument: %s\n", a);
+            return 2;
+        }
+    }
+    if (deadSet && cfg.sps30DeadForMs == 0) cfg.sps30DeadForMs = 3600000;
+    if (connectEveryMin == 0) {
+        fprintf(stderr, "connect period must be > 0\n");
+        return 2;
+    }
+
+    if (serialPty && (cfg.serialFd = openSerialPty()) < 0) {
+        fprintf(stderr, "cannot open a pty\n");
+        return 1;
+    }
+    simInit(cfg);
+    size_t heapBase = heapInUse();
+    size_t heapPeak = 0;
+    double beginStart = wallSeconds();
+    pipelineBegin();
+    double beginWall = wallSeconds() - beginStart;
+
+    const uint64_t simEndMs = (uint64_t)(days * 24.0 * 3600.0 * 1000.0);
+    const uint64_t periodMs = (uint64_t)connectEveryMin * 60000ULL;
+    const uint64_t connectMs = (uint64_t)connectForS * 1000ULL;
+    uint64_t simMs = 0;
+    uint64_t iterations = 0;
+    uint64_t connectedMs = 0;
+    uint32_t lastAck = 0;
+    uint32_t zeroWaits = 0;
+    double start = wallSeconds();
+    while (simMs < simEndMs) {
+        bool wantConnected = (simMs % periodMs) < connectMs;
+        if (wantConnected != pipelineConnected()) {
+            pipelineSetConnected(wantConnected);
+            if (wantConnected) simClientConnected();
+            // an acking client says so right away
+            if (wantConnected && clientAcks) {
+                lastAck = simCounters().contiguous;
+                pipelineAck(lastAck);
+            }
+            if (wantConnected && rangeLastMin > 0) {
+                uint32_t now = simNow();
+                uint32_t span = rangeLastMin * 60000UL;
+                uint32_t from = now > span ? now - span : 0;
+                uint8_t cmd[9] = {RANGE_CMD_TS};
+                for (int b = 0; b < 4; b++) {
+                    cmd[1 + b] = (uint8_t)(from >> (8 * b));
+                    cmd[5 + b] = (uint8_t)(now >> (8 * b));
+                }
+                pipelineControl(cmd, sizeof(cmd));
+            }
+            if (wantConnected && payloadFormat >= 0) {
+                uint8_t cmd[2] = {CONTROL_CMD_FORMAT, (uint8_t)payloadFormat};
+                pipelineControl(cmd, sizeof(cmd));
+            }
+            if (wantConnected && configAtH >= 0 && simMs >= (uint64_t)(configAtH * 3600000.0)) {
+                // read-modify-write of the config characteristic
+                size_t len;
+                const uint8_t *value = simConfigValue(len);
+                RuntimeConfig rc;
+                if (configDecode(value, len, rc)) {
+                    for (int s = 0; s < 3; s++) rc.intervalMs[s] = configIntervalS * 1000UL;
+                    uint8_t block[CONFIG_BLOCK_SIZE];
+                    configEncode(rc, block);
+                    pipelineConfigure(block, sizeof(block));
+                }
+                configAtH = -1.0;
+            }
+            if (wantConnected && broadcast) {
+                size_t len;
+                const uint8_t *value = simConfigValue(len);
+                RuntimeConfig rc;
+                if (configDecode(value, len, rc) && !rc.broadcast) {
+                    rc.broadcast = 1;
+                    uint8_t block[CONFIG_BLOCK_SIZE];
+                    configEncode(rc, block);
+                    pipelineConfigure(block, sizeof(block));
+                }
+                broadcast = false;
+            }
+            if (wantConnected && burstAtH >= 0 && simMs >= (uint64_t)(burstAtH * 3600000.0)) {
+                uint8_t cmd[BURST_CMD_SIZE] = {CONTROL_CMD_BURST, (uint8_t)burstS, (uint8_t)(burstS >> 8)};
+                pipelineControl(cmd, sizeof(cmd));
+                burstAtH = -1.0;
+            }
+            if (wantConnected && tierRequest >= 0) {
+                uint8_t cmd[10] = {RANGE_CMD_TIER, (uint8_t)tierRequest, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF};
+                pipelineControl(cmd, sizeof(cmd));
+            }
+        }
+        // the client acks whenever its contiguous seq moved
+        if (clientAcks && wantConnected && simCounters().contiguous != lastAck) {
+            lastAck = simCounters().contiguous;
+            pipelineAck(lastAck);
+        }
+        simWake();
+        uint32_t wait = pipelineLoop();
+        logDrain();
+        uint64_t step = tickMs;
+        if (tickMs == 0) {
+            step = simTakeWake() ? 0 : wait;
+            if (step > 0) step += simWakeDelay();
+            // stop at the next connect or disconnect
+            uint64_t inPeriod = simMs % periodMs;
+            uint64_t edge = inPeriod < connectMs ? connectMs - inPeriod : periodMs - inPeriod;
+            if (step > edge) step = edge;
+            // a pipeline that keeps asking for 0 ms would hang virtual time
+            if (step == 0 && ++zeroWaits > 1000) step = 1;
+            if (step > 0) zeroWaits = 0;
+        }
+        if (wantConnected) connectedMs += step;
+        simAdvance((uint32_t)step);
+        simMs += step;
+        iterations++;
+        if ((iterations & 0xFFF) == 0) {
+            size_t h = heapInUse();
+            if (h > heapPeak) heapPeak = h;
+        }
+    }
+    double wall = wallSeconds() - start;
+    size_t h = heapInUse();
+    if (h > heapPeak) heapPeak = h;
+
+    if (serialPty) {
+        // virtual time now follows the wall clock
+        fprintf(stderr, "serving the serial port for %lu s\n", (unsigned long)serveS);
+        double serveStart = wallSeconds();
+        uint32_t baseMs = simNow();
+        while (wallSeconds() - serveStart < serveS) {
+            simWake();
+            uint32_t wait = pipelineLoop();
+            logDrain();
+            if (simTakeWake()) wait = 0;
+            pollfd p = {cfg.serialFd, POLLIN, 0};
+            poll(&p, 1, wait < 100 ? (int)wait : 100);
+            uint32_t target = baseMs + (uint32_t)((wallSeconds() - serveStart) * 1000.0);
+            if ((int32_t)(target - simNow()) > 0) simAdvance(target - simNow());
+        }
+    }
+
+    const PipelineStats &ps = pipelineStats();
+    const AcquireStats &as = pipelineAcquireStats();
+    const SimCounters &sc = simCounters();
+    printf("simulated          %.2f days in %.3f s wall (%.0fx)\n",
+           days, wall, wall > 0 ? simMs / 1000.0 / wall : 0.0);
+    printf("loop iterations    %llu (%.0f /s)\n",
+           (unsigned long long)iterations, wall > 0 ? iterations / wall : 0.0);
+    printf("measurements       %lu (live %lu, archived %lu, held %lu)\n",
+           (unsigned long)ps.measurements, (unsigned long)ps.sentLive, (unsigned long)ps.archived,
+           (unsigned long)ps.held);
+    printf("archive throughput %.0f appends/s wall\n", wall > 0 ? ps.archived / wall : 0.0);
+    printf("backlog delivered  %lu samples in %lu notifies (%llu bytes)\n",
+           (unsigned long)ps.archiveSent, (unsigned long)ps.notifies,
+           (unsigned long long)sc.notifyBytes);
+    printf("link               %lu done, %lu dropped, %lu congested, %llu refused by the stack, %llu indications\n",
+           (unsigned long)ps.notifyDone, (unsigned long)ps.notifyDrops, (unsigned long)ps.notifyCongested,
+           (unsigned long long)sc.notifyRejected, (unsigned long long)sc.indications);
+    printf("                   pacing at %lu ms, %lu bytes/s at the end\n",
+           (unsigned long)pipelineNotifyIntervalMs(), (unsigned long)pipelineNotifyBytesPerSec());
+    printf("single payloads    %llu (%.1f bytes avg)\n", (unsigned long long)sc.singles,
+           sc.singles ? (double)sc.singleBytes / sc.singles : 0.0);
+    printf("client             %llu records, %llu duplicates, contiguous to seq %lu, %llu notifies lost\n",
+           (unsigned long long)sc.received, (unsigned long long)sc.duplicates,
+           (unsigned long)sc.contiguous, (unsigned long long)sc.notifiesLost);
+    printf("held restored      %llu samples from held counts\n", (unsigned long long)sc.heldRestored);
+    printf("config             %lu applied, %lu rejected\n", (unsigned long)ps.configApplied,
+           (unsigned long)ps.configRejected);
+    printf("acked              %lu samples (%lu ack timeouts)\n", (unsigned long)ps.acked, (unsigned long)ps.resent);
+    printf("alerts             %lu raised, %lu sent, %lu dropped, client got %llu\n",
+           (unsigned long)ps.alertsRaised, (unsigned long)ps.alertsSent, (unsigned long)ps.alertsDropped,
+           (unsigned long long)sc.alerts);
+    printf("                   latency avg %lu ms, max %lu ms (client saw max %lu ms)\n",
+           (unsigned long)(ps.alertsSent ? ps.alertLatencySumMs / ps.alertsSent : 0),
+           (unsigned long)ps.alertLatencyMaxMs, (unsigned long)sc.alertAgeMaxMs);
+    printf("burst              %lu records, %lu sent, %lu dropped, client got %llu (%llu gaps)\n",
+           (unsigned long)as.burstRecords, (unsigned long)ps.burstSent, (unsigned long)as.burstDropped,
+           (unsigned long long)sc.burstRecords, (unsigned long long)sc.burstGaps);
+    printf("                   last burst %lu readings in %.1f s, %.2f readings/s\n",
+           (unsigned long)as.burstReads, as.burstMs / 1000.0,
+           as.burstMs ? as.burstReads * 1000.0 / as.burstMs : 0.0);
+    printf("voc index          last %u, max %u in JSON samples; %lu checkpoints stored%s\n",
+           (unsigned)sc.vocIndexLast, (unsigned)sc.vocIndexMax, (unsigned long)ps.vocCheckpoints,
+           ps.vocRestored ? ", restored at boot" : "");
+    printf("broadcast          %lu updates, listener got %llu (%llu while connected, %llu seq gaps, %llu bad)\n",
+           (unsigned long)ps.broadcasts, (unsigned long long)sc.broadcasts,
+           (unsigned long long)sc.broadcastsConnected, (unsigned long long)sc.broadcastGaps,
+           (unsigned long long)sc.broadcastBad);
+    if (sc.broadcasts > 1) {
+        printf("                   every %.1f .. %.1f s, %u bytes of manufacturer data\n",
+               sc.broadcastGapMinMs / 1000.0, sc.broadcastGapMaxMs / 1000.0, (unsigned)BROADCAST_DATA_SIZE);
+    }
+    printf("range delivered    %lu samples\n", (unsigned long)ps.rangeSent);
+    printf("tier delivered     %lu buckets (client %llu, %llu out of order)\n", (unsigned long)ps.tierSent,
+           (unsigned long long)sc.tierBuckets, (unsigned long long)sc.tierOutOfOrder);
+    printf("flush drain        %lu complete, last took %lu ms\n",
+           (unsigned long)ps.flushesDone, (unsigned long)ps.lastFlushMs);
+    printf("flash writes       %llu\n", (unsigned long long)sc.flashWrites);
+    if (serialPty) printf("serial             %llu bytes written\n", (unsigned long long)sc.serialBytes);
+    printf("summaries          %llu published (%llu bytes)\n",
+           (unsigned long long)sc.summaries, (unsigned long long)sc.summaryBytes);
+    printf("archive left       %lu samples\n", (unsigned long)pipelineArchiveCount());
+    printf("history tiers      %lu x 5 min, %lu x 1 h\n",
+           (unsigned long)pipelineHistoryCount(0), (unsigned long)pipelineHistoryCount(1));
+    printf("boot               archive attached in %.2f ms wall, first measurement at %lu ms\n",
+           beginWall * 1000.0, (unsigned long)as.bootMs[BOOT_FIRST_MEASUREMENT]);
+    printf("                   sensors started at %lu ms\n", (unsigned long)as.bootMs[BOOT_SENSORS]);
+    static const char *const healthNames[PIPELINE_SENSORS] = {"sps30", "sgp40", "scd41"};
+    for (int i = 0; i < PIPELINE_SENSORS; i++) {
+        const SensorHealth &h = as.sensors[i];
+        printf("%-18s %lu reads, %lu misses, %lu errors, %lu recoveries, backoff %u\n",
+               healthNames[i], (unsigned long)h.reads, (unsigned long)h.misses,
+               (unsigned long)h.errors, (unsigned long)h.recoveries, (unsigned)h.backoff);
+    }
+    printf("log lines          %llu (dropped %lu)\n",
+           (unsigned long long)sc.logLines, (unsigned long)logDropped());
+    double hours = simMs / 3600000.0;
+    double activeS = busy ? simMs / 1000.0 : sc.activeUs / 1e6;
+    if (activeS > simMs / 1000.0) activeS = simMs / 1000.0;
+    double duty = simMs > 0 ? activeS * 1000.0 / simMs : 0.0;
+    double connFrac = simMs > 0 ? (double)connectedMs / simMs : 0.0;
+    double sps30Frac = simMs > 0 ? (double)sc.sps30OnMs / simMs : 0.0;
+    double heaterFrac = simMs > 0 ? (double)sc.sgp40HeaterMs / simMs : 0.0;
+    if (heaterFrac > 1.0) heaterFrac = 1.0;
+    double avgMa = duty * MA_CPU_ACTIVE + (1.0 - duty) * MA_LIGHT_SLEEP
+                 + connFrac * MA_BLE_CONNECTED + (1.0 - connFrac) * MA_BLE_ADVERTISING
+                 + (sc.broadcasts ? connFrac * MA_BLE_ADVERTISING : 0.0)
+                 + sps30Frac * MA_SPS30_ON + (1.0 - sps30Frac) * MA_SPS30_SLEEP
+                 + MA_SCD41 + heaterFrac * MA_SGP40_HEATER;
+    printf("wakes              %llu (%.0f /h)\n", (unsigned long long)sc.wakes,
+           hours > 0 ? sc.wakes / hours : 0.0);
+    printf("cpu duty cycle     %.3f %%%s\n", duty * 100.0, busy ? " (busy loop)" : "");
+    printf("sps30 on           %.1f %% of the time\n", sps30Frac * 100.0);
+    printf("average current    %.2f mA, %.1f days on %.0f mAh\n",
+           avgMa, avgMa > 0 ? batteryMah / avgMa / 24.0 : 0.0, batteryMah);
+    printf("heap high-water    %lu bytes above baseline\n",
+           (unsigned long)(heapPeak > heapBase ? heapPeak - heapBase : 0));
+#if LATENCY_STATS
+    printLatency();
+#endif
+    return 0;
+}
@@ -0,0 +1,549 @@
+// hal.h implementation for Linux: simulated Sps30/Sgp40/Scd41, virtual
+// clock, counting transport and file-backed archive storage.
+
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <deque>
+#include <vector>
+#include "hal.h"
+#include "pipeline.h"
+#include "storage_file.h"
+#include "archive_codec.h"
+#include "batch_frame.h"
+#include "history_tiers.h"
+#include "payload_schema.h"
+#include "alert_rules.h"
+#include "burst_sampling.h"
+#include "broadcast.h"
+
+static SimConfig config;
+static SimCounters counters;
+static uint32_t nowMs = 0;
+static SimCosts costs;
+
+// file storage that charges flash time
+class SimStorage : public FileLogStorage {
+public:
+    explicit SimStorage(const char *rootDir) : FileLogStorage(rootDir) {}
+    bool append(const char *path, const void *data, size_t len) override {
+        counters.flashWrites++;
+        counters.activeUs += costs.flashWrite;
+        return FileLogStorage::append(path, data, len);
+    }
+    bool writeFile(const char *path, const void *data, size_t len) override {
+        counters.flashWrites++;
+        counters.activeUs += costs.flashWrite;
+        return FileLogStorage::writeFile(path, data, len);
+    }
+    size_t readAt(const char *path, uint32_t offset, void *buf, size_t len) override {
+        counters.activeUs += costs.flashRead;
+        return FileLogStorage::readAt(path, offset, buf, len);
+    }
+};
+
+static SimStorage *storage = nullptr;
+static bool wakePending = false;
+static bool clientResuming = false;
+static std::vector<bool> clientSeen;
+static uint32_t clientTierSeq = 0;
+// config characteristic value
+static uint8_t configValue[64];
+static size_t configValueLen = 0;
+// packets in the stack's transmit buffers, by the time they may go out
+static std::deque<uint32_t> linkQueue;
+
+// xorshift32, deterministic for a given seed
+static uint32_t rngState = 1;
+static uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+// bounded random walk, step in [-maxStep, maxStep]
+static float walk(float v, float maxStep, float lo, float hi) {
+    float r = (float)(nextRandom() % 2001) / 1000.0f - 1.0f;
+    if (config.calm) r *= 0.1f;
+    v += r * maxStep;
+    if (v < lo) v = lo;
+    if (v > hi) v = hi;
+    return v;
+}
+
+// simulated device state
+static float pm25 = 8.0f, pm10 = 12.0f;
+static float voc = 28000.0f;
+static float co2 = 600.0f, temp = 22.0f, rh = 45.0f;
+static uint32_t sps30Reads = 0;
+static uint32_t scd41LastReady = 0;
+static uint32_t scd41ReadyMs = 0;    // current periodic mode
+static bool sps30On = true;
+static bool sgp40HeaterOn = false;
+
+void simInit(const SimConfig &cfg) {
+    config = cfg;
+    counters = SimCounters();
+    clientSeen.clear();
+    clientResuming = false;
+    if (config.scd41ReadyEveryMs == 0) config.scd41ReadyEveryMs = SENSOR_LOW_POWER ? 30000 : 5000;
+    scd41ReadyMs = config.scd41ReadyEveryMs;
+    nowMs = 0;
+    rngState = cfg.seed ? cfg.seed : 1;
+    sps30On = true;
+    sgp40HeaterOn = false;
+    wakePending = false;
+    configValueLen = 0;
+    linkQueue.clear();
+    delete storage;
+    storage = new SimStorage(cfg.storageDir);
+}
+
+// drain the link queue at every connection event in (nowMs, until]
+static void linkEvents(uint32_t until) {
+    uint32_t iv = config.linkIntervalMs ? config.linkIntervalMs : 1;
+    for (uint32_t ev = (nowMs / iv + 1) * iv; ev <= until && !linkQueue.empty(); ev += iv) {
+        for (uint32_t n = 0; n < config.linkPacketsPerEvent && !linkQueue.empty(); n++) {
+            if ((int32_t)(linkQueue.front() - ev) > 0) break;
+            linkQueue.pop_front();
+            pipelineNotifyDone(true);
+        }
+    }
+}
+
+void simAdvance(uint32_t ms) {
+    linkEvents(nowMs + ms);
+    nowMs += ms;
+    if (sps30On) counters.sps30OnMs += ms;
+    if (sgp40HeaterOn) counters.sgp40HeaterMs += ms;
+}
+
+void simWake() {
+    counters.wakes++;
+    counters.activeUs += costs.wake;
+}
+
+bool simTakeWake() {
+    bool w = wakePending;
+    wakePending = false;
+    return w;
+}
+
+uint32_t simWakeDelay() {
+    return config.wakeLateMs ? nextRandom() % (config.wakeLateMs + 1) : 0;
+}
+
+const SimCosts &simCosts() {
+    return costs;
+}
+
+void halWakeTransport() {
+    wakePending = true;
+}
+
+// one loop runs both sides
+void halWakeAcquire() {
+    wakePending = true;
+}
+
+uint32_t simNow() {
+    return nowMs;
+}
+
+const SimCounters &simCounters() {
+    return counters;
+}
+
+uint32_t halMillis() {
+    return nowMs;
+}
+
+// latency probes measure real host time, in 100 ns ticks so a duration
+// of several minutes still fits 32 bits
+uint32_t halCycles() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 10000000ULL + ts.tv_nsec / 100);
+}
+
+uint32_t halCyclesPerUs() {
+    return 10;
+}
+
+// the SPS30 is unplugged for a while (SimConfig::sps30DeadFromMs)
+static bool sps30Dead() {
+    return config.sps30DeadForMs && nowMs - config.sps30DeadFromMs < config.sps30DeadForMs;
+}
+
+static bool sps30Sample(AirMeasurement &m) {
+    if (!sps30On || sps30Dead()) return false;
+    sps30Reads++;
+    if (config.sps30FailEvery && sps30Reads % config.sps30FailEvery == 0) return false;
+    pm25 = walk(pm25, 0.5f, 0.0f, 500.0f);
+    pm10 = walk(pm10, 0.7f, pm25, 600.0f);
+    m.mc1p0 = (uint16_t)(pm25 * 0.8f);
+    m.mc2p5 = (uint16_t)pm25;
+    m.mc4p0 = (uint16_t)((pm25 + pm10) * 0.5f);
+    m.mc10p0 = (uint16_t)pm10;
+    m.nc0p5 = (uint16_t)(pm25 * 6.5f);
+    m.nc1p0 = (uint16_t)(pm25 * 7.6f);
+    m.nc2p5 = (uint16_t)(pm25 * 7.8f);
+    m.nc4p0 = (uint16_t)(pm25 * 7.9f);
+    m.nc10p0 = (uint16_t)(pm10 * 6.0f);
+    m.typicalParticleSize = 600;
+    return true;
+}
+
+bool halReadSps30(AirMeasurement &m) {
+    counters.sensorReads++;
+    counters.activeUs += costs.readSps30;
+    return sps30Sample(m);
+}
+
+// the raw signal moves with humidity unless the sensor is told the real
+// humidity (0x8000 = 50 %RH is what it assumes without)
+static uint16_t sgp40RhTicks = 0x8000;
+
+void halSetSgp40Compensation(uint16_t rhTicks, uint16_t) {
+    sgp40RhTicks = rhTicks;
+}
+
+static void sgp40Sample(AirMeasurement &m) {
+    voc = walk(voc, 150.0f, 20000.0f, 40000.0f);
+    float assumedRh = sgp40RhTicks * 100.0f / 65535.0f;
+    m.srawVoc = (uint16_t)(voc - (rh - assumedRh) * 60.0f);
+}
+
+bool halReadSgp40(AirMeasurement &m) {
+    counters.sensorReads++;
+    counters.activeUs += costs.readSgp40;
+    // a measurement heats for 30 ms; without low power the heater stays on
+    counters.sgp40HeaterMs += 30;
+    sgp40HeaterOn = !SENSOR_LOW_POWER;
+    sgp40Sample(m);
+    return true;
+}
+
+static bool scd41Sample(AirMeasurement &m) {
+    // data-ready only once per periodic measurement interval
+    if (nowMs - scd41LastReady < scd41ReadyMs && scd41LastReady != 0) return false;
+    scd41LastReady = nowMs;
+    co2 = walk(co2, 15.0f, 400.0f, 5000.0f);
+    temp = walk(temp, 0.05f, 10.0f, 35.0f);
+    rh = walk(rh, 0.2f, 10.0f, 90.0f);
+    m.co2 = (uint16_t)co2;
+    // someone breathing on it
+    if (config.co2SpikeEveryMs && nowMs % config.co2SpikeEveryMs < 5 * 60000UL) m.co2 += 1200;
+    m.temp = temp;
+    m.rh = rh;
+    return true;
+}
+
+bool halReadScd41(AirMeasurement &m) {
+    counters.sensorReads++;
+    counters.activeUs += costs.readScd41;
+    return scd41Sample(m);
+}
+
+bool halSensorOp(SensorOp op) {
+    counters.sensorOps++;
+    counters.activeUs += costs.sensorOp;
+    if (op <= SPS30_OP_READ_CMD && sps30Dead()) {
+        // a power cycle while unplugged leaves it idle
+        sps30On = false;
+        return false;
+    }
+    switch (op) {
+    case SPS30_OP_STOP:
+        sps30On = false;
+        break;
+    case SPS30_OP_START:
+        sps30On = true;
+        break;
+    case SGP40_OP_HEATER_OFF:
+        sgp40HeaterOn = false;
+        break;
+    case SGP40_OP_MEASURE_CMD:
+        sgp40HeaterOn = true;
+        break;
+    case SCD41_OP_START:
+        scd41ReadyMs = config.scd41ReadyEveryMs;
+        break;
+    case SCD41_OP_START_FAST:
+        scd41ReadyMs = 5000;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+// one response transaction, charged like a command
+bool halSensorFetch(SensorOp op, AirMeasurement &m) {
+    counters.sensorOps++;
+    counters.activeUs += costs.sensorOp;
+    switch (op) {
+    case SPS30_OP_READ_VALUES:
+        return sps30Sample(m);
+    case SGP40_OP_MEASURE_READ:
+        sgp40Sample(m);
+        return true;
+    case SCD41_OP_READ_VALUES:
+        return scd41Sample(m);
+    default:
+        return false;
+    }
+}
+
+void simClientConnected() {
+    // whatever is older than the first record of a resume is gone on the
+    // device (pipelineAck()), acking or not
+    clientResuming = true;
+    clientTierSeq = 0;
+    // the buffers of the last connection went with it
+    linkQueue.clear();
+}
+
+static void clientReceive(const ArchiveRecord &rec, void *) {
+    counters.received++;
+    if (rec.seq >= clientSeen.size()) clientSeen.resize(rec.seq + 1024);
+    if (clientSeen[rec.seq]) counters.duplicates++;
+    else counters.heldRestored += rec.flags >> REC_HELD_SHIFT;
+    clientSeen[rec.seq] = true;
+    if (clientResuming) {
+        clientResuming = false;
+        if (rec.seq > counters.contiguous + 1) counters.contiguous = rec.seq - 1;
+    }
+    while (counters.contiguous + 1 < clientSeen.size() && clientSeen[counters.contiguous + 1]) {
+        counters.contiguous++;
+    }
+}
+
+// decode a data notification the way a client would
+static void clientDecode(const uint8_t *data, size_t len) {
+    if (len == 0) return;
+    if (data[0] == '{' || data[0] == 0xD9 || data[0] == PAYLOAD_BINARY_TYPE) {
+        // one sample; seq is the first field of every payload format
+        unsigned long seq = 0;
+        unsigned held = 0;
+        if (data[0] == '{') {
+            char text[PAYLOAD_MAX_SIZE + 1];
+            size_t n = len < PAYLOAD_MAX_SIZE ? len : PAYLOAD_MAX_SIZE;
+            memcpy(text, data, n);
+            text[n] = '\0';
+            if (sscanf(text, "{\"seq\":%lu", &seq) != 1) return;
+            const char *h = strstr(text, "\"held\":");
+            if (h) held = (unsigned)atoi(h + 7);
+            const char *v = strstr(text, "\"voc_index\":");
+            if (v) {
+                counters.vocIndexLast = (uint16_t)atoi(v + 12);
+                if (counters.vocIndexLast > counters.vocIndexMax) counters.vocIndexMax = counters.vocIndexLast;
+            }
+        } else if (data[0] == PAYLOAD_BINARY_TYPE) {
+            if (len < 6) return;
+            seq = data[2] | (data[3] << 8) | (data[4] << 16) | ((unsigned long)data[5] << 24);
+            held = data[1] >> REC_HELD_SHIFT;
+        } else {
+            // tag, map header, key 0, then a uint head
+            if (len < 6 || data[5] > 0x1A) return;
+            uint8_t extra = data[5] < 24 ? 0 : (uint8_t)(1u << (data[5] - 24));
+            if (len < 6u + extra) return;
+            seq = data[5] < 24 ? data[5] : 0;
+            for (uint8_t b = 0; b < extra; b++) seq = (seq << 8) | data[6 + b];
+        }
+        counters.singles++;
+        counters.singleBytes += len;
+        ArchiveRecord rec = ArchiveRecord();
+        rec.seq = (uint32_t)seq;
+        rec.flags = (uint8_t)(held << REC_HELD_SHIFT);
+        clientReceive(rec, nullptr);
+    } else if (data[0] == CODEC_FRAME_TYPE) {
+        codecDecodeBlock(data, len, clientReceive, nullptr);
+    } else if (data[0] == ALERT_FRAME_TYPE && len == ALERT_FRAME_SIZE) {
+        uint32_t ts = data[8] | (data[9] << 8) | (data[10] << 16) | ((uint32_t)data[11] << 24);
+        counters.alerts++;
+        if (nowMs - ts > counters.alertAgeMaxMs) counters.alertAgeMaxMs = nowMs - ts;
+    } else if (data[0] == TIER_FRAME_TYPE && len >= TIER_FRAME_HEADER_SIZE) {
+        for (uint8_t i = 0; i < data[2] && TIER_FRAME_HEADER_SIZE + (i + 1) * sizeof(TierAggregate) <= len; i++) {
+            TierAggregate agg;
+            memcpy(&agg, data + TIER_FRAME_HEADER_SIZE + i * sizeof(TierAggregate), sizeof(agg));
+            counters.tierBuckets++;
+            if (agg.firstSeq <= clientTierSeq) counters.tierOutOfOrder++;
+            clientTierSeq = agg.firstSeq;
+        }
+    } else if (data[0] == BURST_FRAME_TYPE && len >= BATCH_HEADER_SIZE) {
+        // burst records have a seq of their own
+        for (uint8_t i = 0; i < data[7] && BATCH_HEADER_SIZE + (i + 1) * sizeof(ArchiveRecord) <= len; i++) {
+            ArchiveRecord rec;
+            memcpy(&rec, data + BATCH_HEADER_SIZE + i * sizeof(ArchiveRecord), sizeof(rec));
+            counters.burstRecords++;
+            if (rec.seq != counters.burstLastSeq + 1) counters.burstGaps++;
+            counters.burstLastSeq = rec.seq;
+        }
+    } else if (data[0] == BATCH_FRAME_TYPE && len >= BATCH_HEADER_SIZE) {
+        for (uint8_t i = 0; i < data[7] && BATCH_HEADER_SIZE + (i + 1) * sizeof(ArchiveRecord) <= len; i++) {
+            ArchiveRecord rec;
+            memcpy(&rec, data + BATCH_HEADER_SIZE + i * sizeof(ArchiveRecord), sizeof(rec));
+            clientReceive(rec, nullptr);
+        }
+    }
+}
+
+bool halNotify(const uint8_t *data, size_t len, bool confirm) {
+    counters.activeUs += costs.notify;
+    if (linkQueue.size() >= config.linkBuffers) {
+        counters.notifyRejected++;
+        return false;
+    }
+    counters.notifies++;
+    counters.notifyBytes += len;
+    if (confirm) counters.indications++;
+    linkQueue.push_back(nowMs + config.linkLatencyMs);
+    if (config.lossEvery && counters.notifies % config.lossEvery == 0) {
+        counters.notifiesLost++;
+        // a lost indication is never confirmed, the sender knows
+        return !confirm;
+    }
+    clientDecode(data, len);
+    return true;
+}
+
+int halNotifyCredits() {
+    return (int)(config.linkBuffers - linkQueue.size());
+}
+
+size_t halNotifyPayloadLimit() {
+    return config.mtu - 3;
+}
+
+void halSetStatus(const char *, size_t) {
+}
+
+void halSetConfig(const uint8_t *data, size_t len) {
+    configValueLen = len < sizeof(configValue) ? len : sizeof(configValue);
+    memcpy(configValue, data, configValueLen);
+}
+
+const uint8_t *simConfigValue(size_t &len) {
+    len = configValueLen;
+    return configValue;
+}
+
+// NVS stand-in: one file next to the archive, survives a rerun
+static void configPath(char *buf, size_t size) {
+    snprintf(buf, size, "%s/config.bin", config.storageDir);
+}
+
+bool halConfigLoad(uint8_t *data, size_t len) {
+    char path[256];
+    configPath(path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    size_t n = fread(data, 1, len, f);
+    bool more = fgetc(f) != EOF;
+    fclose(f);
+    return n == len && !more;
+}
+
+bool halConfigSave(const uint8_t *data, size_t len) {
+    counters.flashWrites++;
+    char path[256];
+    configPath(path, sizeof(path));
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && ok;
+}
+
+static void vocStatePath(char *buf, size_t size) {
+    snprintf(buf, size, "%s/voc.bin", config.storageDir);
+}
+
+bool halVocStateLoad(uint8_t *data, size_t len) {
+    char path[256];
+    vocStatePath(path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    size_t n = fread(data, 1, len, f);
+    bool more = fgetc(f) != EOF;
+    fclose(f);
+    return n == len && !more;
+}
+
+bool halVocStateSave(const uint8_t *data, size_t len) {
+    counters.flashWrites++;
+    char path[256];
+    vocStatePath(path, sizeof(path));
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && ok;
+}
+
+// a listener in range gets every update: it must fit the legacy
+// advertisement next to the flags, decode and carry the next seq
+void halSetAdvertisement(const uint8_t *data, size_t len) {
+    counters.activeUs += costs.advertise;
+    if (len == 0) return;
+    BroadcastPayload p;
+    if (ADV_FLAGS_SIZE + ADV_FIELD_HEADER_SIZE + len > ADV_PAYLOAD_MAX || !broadcastDecode(data, len, p)) {
+        counters.broadcastBad++;
+        return;
+    }
+    if (counters.broadcasts > 0) {
+        if (p.seq != (uint16_t)(counters.broadcastLastSeq + 1)) counters.broadcastGaps++;
+        uint32_t gap = nowMs - counters.broadcastLastMs;
+        if (counters.broadcasts == 1 || gap < counters.broadcastGapMinMs) counters.broadcastGapMinMs = gap;
+        if (gap > counters.broadcastGapMaxMs) counters.broadcastGapMaxMs = gap;
+    }
+    counters.broadcasts++;
+    if (pipelineConnected()) counters.broadcastsConnected++;
+    counters.broadcastLastSeq = p.seq;
+    counters.broadcastLastMs = nowMs;
+}
+
+void halPublishSummary(const uint8_t *, size_t len) {
+    counters.summaries++;
+    counters.summaryBytes += len;
+}
+
+LogStorage &halArchiveStorage() {
+    return *storage;
+}
+
+size_t halSerialRead(uint8_t *buf, size_t max) {
+    if (config.serialFd < 0) return 0;
+    ssize_t n = read(config.serialFd, buf, max);
+    return n > 0 ? (size_t)n : 0;
+}
+
+void halSerialWrite(const uint8_t *data, size_t len) {
+    if (config.serialFd < 0) return;
+    counters.serialBytes += len;
+    while (len > 0) {
+        ssize_t n = write(config.serialFd, data, len);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) return;
+        if (n <= 0) {
+            // the reader is behind, like a full UART FIFO
+            pollfd p = {config.serialFd, POLLOUT, 0};
+            poll(&p, 1, 100);
+            continue;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+void halConsoleWrite(const char *line) {
+    counters.logLines++;
+    if (!config.verbose) return;
+    printf("[%10lu] %s\n", (unsigned long)nowMs, line);
+}
@@ -0,0 +1,172 @@
+// Accuracy and speed of RollingStats against exact computation.
+//
+// Feeds a synthetic random-walk stream (30 s cadence with jitter and the
+// occasional gap) and after every sample compares each window's summary
+// with a brute-force recomputation over the same samples: mean, min and max
+// must match exactly, p95 is reported as error against the exact
+// nearest-rank value. Then times add() and encode() on their own.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++17 -Isrc src/rolling_stats.cpp sim/stats_bench.cpp -o stats-bench
+//
+// Usage:
+//   stats-bench [--samples N] [--interval-ms N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "rolling_stats.h"
+
+static double wallSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *const channelNames[STATS_CHANNELS] = {
+    "co2", "temp", "rh", "voc", "pm25", "pm10",
+};
+
+static int32_t channelValue(const ArchiveRecord &r, int c) {
+    switch (c) {
+    case STATS_CO2: return r.co2;
+    case STATS_TEMP: return r.temp;
+    case STATS_RH: return r.rh;
+    case STATS_VOC: return r.voc;
+    case STATS_PM25: return r.pm25;
+    default: return r.pm10;
+    }
+}
+
+static void generate(std::vector<ArchiveRecord> &out, size_t n, uint32_t intervalMs) {
+    srand(1);
+    float co2 = 600, temp = 2200, rh = 4500, voc = 30000, pm25 = 8;
+    uint32_t ts = 0;
+    for (size_t i = 0; i < n; i++) {
+        co2 += rand() % 41 - 20;
+        temp += rand() % 21 - 10;
+        rh += rand() % 41 - 20;
+        voc += rand() % 401 - 200;
+        pm25 += (rand() % 3 - 1) * 0.7f;
+        co2 = std::min(std::max(co2, 400.0f), 2500.0f);
+        temp = std::min(std::max(temp, 1000.0f), 3500.0f);
+        rh = std::min(std::max(rh, 1500.0f), 8500.0f);
+        voc = std::min(std::max(voc, 22000.0f), 50000.0f);
+        pm25 = std::min(std::max(pm25, 0.0f), 150.0f);
+        // short spikes so the upper tail is not just the random walk
+        float co2Spike = rand() % 50 == 0 ? 400.0f : 0.0f;
+        float pmSpike = rand() % 80 == 0 ? 60.0f : 0.0f;
+        ts += intervalMs + rand() % 200;
+        if (rand() % 500 == 0) ts += 20 * 60 * 1000;  // sensor outage
+        ArchiveRecord r;
+        memset(&r, 0, sizeof(r));
+        r.seq = (uint32_t)i + 1;
+        r.ts = ts;
+        r.co2 = (uint16_t)(co2 + co2Spike);
+        r.temp = (int16_t)temp;
+        r.rh = (uint16_t)rh;
+        r.voc = (uint16_t)voc;
+        r.pm25 = (uint16_t)(pm25 + pmSpike);
+        r.pm10 = (uint16_t)((pm25 + pmSpike) * 1.4f + 3);
+        r.flags = REC_HAVE_SPS30 | REC_HAVE_SGP40 | REC_HAVE_SCD41;
+        out.push_back(r);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t samples = 20000;
+    uint32_t intervalMs = 30000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--samples") && i + 1 < argc) samples = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "--interval-ms") && i + 1 < argc) intervalMs = (uint32_t)atol(argv[++i]);
+        else {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (samples == 0 || intervalMs == 0) {
+        fprintf(stderr, "samples and interval must be > 0\n");
+        return 2;
+    }
+
+    std::vector<ArchiveRecord> recs;
+    generate(recs, samples, intervalMs);
+
+    // accuracy: exact window contents are the newest samples younger than the
+    // window length, capped by the ring size
+    static RollingStats stats;
+    uint64_t mismatches = 0, checks = 0, countMismatch = 0;
+    double p95AbsSum[STATS_CHANNELS] = {0};
+    int32_t p95AbsMax[STATS_CHANNELS] = {0};
+    std::vector<int32_t> vals;
+    for (size_t i = 0; i < recs.size(); i++) {
+        stats.add(recs[i]);
+        for (uint8_t w = 0; w < STATS_WINDOWS; w++) {
+            StatsWindowSummary s;
+            stats.summarize(w, s);
+            size_t first = i;
+            while (first > 0 && i - (first - 1) < STATS_RING_SIZE &&
+                   recs[i].ts - recs[first - 1].ts < s.lengthMs) {
+                first--;
+            }
+            size_t n = i - first + 1;
+            if (n != s.count) {
+                countMismatch++;
+                continue;
+            }
+            for (int c = 0; c < STATS_CHANNELS; c++) {
+                vals.clear();
+                int64_t sum = 0;
+                for (size_t k = first; k <= i; k++) {
+                    vals.push_back(channelValue(recs[k], c));
+                    sum += vals.back();
+                }
+                std::sort(vals.begin(), vals.end());
+                int64_t half = (int64_t)n / 2;
+                int32_t mean = (int32_t)(sum >= 0 ? (sum + half) / (int64_t)n : (sum - half) / (int64_t)n);
+                int32_t exactP95 = vals[(n * 95 + 99) / 100 - 1];
+                if (mean != s.ch[c].mean || vals.front() != s.ch[c].min || vals.back() != s.ch[c].max) {
+                    mismatches++;
+                }
+                int32_t err = abs(s.ch[c].p95 - exactP95);
+                p95AbsSum[c] += err;
+                if (err > p95AbsMax[c]) p95AbsMax[c] = err;
+                checks++;
+            }
+        }
+    }
+
+    printf("samples            %zu every ~%lu ms, ring %d\n", recs.size(), (unsigned long)intervalMs, STATS_RING_SIZE);
+    printf("window counts      %llu mismatches\n", (unsigned long long)countMismatch);
+    printf("mean/min/max       %llu mismatches in %llu checks\n",
+           (unsigned long long)mismatches, (unsigned long long)checks);
+    printf("p95 error          channel: mean abs / max abs (record units)\n");
+    size_t perChannel = checks / STATS_CHANNELS;
+    for (int c = 0; c < STATS_CHANNELS; c++) {
+        printf("  %-6s           %.2f / %ld\n", channelNames[c],
+               perChannel ? p95AbsSum[c] / perChannel : 0.0, (long)p95AbsMax[c]);
+    }
+
+    // throughput
+    const int rounds = 50;
+    stats.clear();
+    double t0 = wallSeconds();
+    for (int r = 0; r < rounds; r++) {
+        for (const ArchiveRecord &rec : recs) stats.add(rec);
+    }
+    double addS = (wallSeconds() - t0) / rounds;
+    uint8_t blob[STATS_BLOB_SIZE];
+    size_t blobLen = 0;
+    t0 = wallSeconds();
+    const int encodes = 100000;
+    for (int r = 0; r < encodes; r++) blobLen += stats.encode(blob, sizeof(blob));
+    double encodeS = wallSeconds() - t0;
+
+    printf("add                %.1f M samples/s\n", recs.size() / addS / 1e6);
+    printf("encode             %.0f k summaries/s (%zu bytes)\n", encodes / encodeS / 1e3, blobLen / encodes);
+    printf("state              %zu bytes\n", sizeof(RollingStats));
+    return mismatches || countMismatch ? 1 : 0;
+}
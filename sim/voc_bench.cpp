@@ -0,0 +1,372 @@
+// Accuracy and speed of the fixed-point VOC index engine (voc_index.h)
+// against a floating-point reference.
+//
+// The reference is Sensirion's gas index algorithm (VOC mode, default
+// tuning) as published in float. Both run over the same raw trace: a
+// recorded one (CSV with a "voc" column, e.g. aqs-dump --csv; rows without
+// a voc value are skipped) or a synthetic one with a drifting baseline,
+// noise and VOC events every few hours. Reports the index error after every
+// sample and the time per sample of each.
+//
+// Then the checkpoint round trip: halfway through, the engine's state goes
+// through an encoded checkpoint block into a fresh engine (a reboot), and
+// the reference does the same with its own states. The restored pair is
+// compared over the rest of the trace, next to an engine that restarted
+// without a checkpoint. Exits 1 if any compared index is off by more than
+// --tolerance.
+//
+// Build from the repository root:
+//   g++ -O2 -std=c++17 -Isrc src/voc_index.cpp sim/voc_bench.cpp -o voc-bench
+//
+// Usage:
+//   voc-bench [--trace FILE] [--days D] [--interval-s N] [--tolerance N]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "voc_index.h"
+
+static double wallSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// --- float reference, VOC mode with default tuning ---
+
+struct RefVocIndex {
+    float si;
+    float uptime, sraw, gasIndex;
+    bool mveInitialized;
+    float mveMean, mveOffset, mveStd;
+    float gammaMeanLong, gammaVarianceLong, gammaMeanInitial, gammaVarianceInitial;
+    float gammaMean, gammaVariance;
+    float uptimeGamma, uptimeGating, gatingDuration;
+    float moxStd, moxMean;
+    bool lpInitialized;
+    float a1, a2, x1, x2, x3;
+
+    explicit RefVocIndex(float samplingInterval) {
+        si = samplingInterval;
+        uptime = sraw = gasIndex = 0;
+        mveInitialized = false;
+        mveMean = mveOffset = 0;
+        mveStd = 50;
+        gammaMeanLong = (8 * 64 * (si / 3600.f)) / (12 + si / 3600.f);
+        gammaVarianceLong = (64 * (si / 3600.f)) / (12 + si / 3600.f);
+        gammaMeanInitial = (8 * 64 * si) / (20 + si);
+        gammaVarianceInitial = (64 * si) / (2500 + si);
+        gammaMean = gammaVariance = 0;
+        uptimeGamma = uptimeGating = gatingDuration = 0;
+        moxStd = mveStd;
+        moxMean = 0;
+        lpInitialized = false;
+        a1 = si / (20 + si);
+        a2 = si / (500 + si);
+        x1 = x2 = x3 = 0;
+    }
+
+    static float sigmoid(float sample, float x0, float k) {
+        float x = k * (sample - x0);
+        if (x < -50.f) return 1.f;
+        if (x > 50.f) return 0.f;
+        return 1.f / (1.f + expf(x));
+    }
+
+    void calculateGamma() {
+        float limit = 32767 - si;
+        if (uptimeGamma < limit) uptimeGamma += si;
+        if (uptimeGating < limit) uptimeGating += si;
+        float sMean = sigmoid(uptimeGamma, 2700, 0.01f);
+        float gMean = gammaMeanLong + (gammaMeanInitial - gammaMeanLong) * sMean;
+        float thrMean = 340 + (510 - 340) * sigmoid(uptimeGating, 2700, 0.01f);
+        float gateMean = sigmoid(gasIndex, thrMean, 0.09f);
+        gammaMean = gateMean * gMean;
+        float sVariance = sigmoid(uptimeGamma, 5220, 0.01f);
+        float gVariance = gammaVarianceLong + (gammaVarianceInitial - gammaVarianceLong) * (sVariance - sMean);
+        float thrVariance = 340 + (510 - 340) * sigmoid(uptimeGating, 5220, 0.01f);
+        float gateVariance = sigmoid(gasIndex, thrVariance, 0.09f);
+        gammaVariance = gateVariance * gVariance;
+        gatingDuration += (si / 60.f) * ((1.f - gateMean) * 1.3f - 0.3f);
+        if (gatingDuration < 0) gatingDuration = 0;
+        if (gatingDuration > 180) uptimeGating = 0;
+    }
+
+    void estimate(float s) {
+        if (!mveInitialized) {
+            mveInitialized = true;
+            mveOffset = s;
+            mveMean = 0;
+            return;
+        }
+        if (mveMean >= 100.f || mveMean <= -100.f) {
+            mveOffset += mveMean;
+            mveMean = 0;
+        }
+        s -= mveOffset;
+        calculateGamma();
+        float delta = (s - mveMean) / 64;
+        float c = mveStd + fabsf(delta);
+        float scaling = c > 1440.f ? (c / 1440.f) * (c / 1440.f) : 1.f;
+        mveStd = sqrtf(scaling * (64 - gammaVariance)) *
+                 sqrtf(mveStd * (mveStd / (64 * scaling)) + ((gammaVariance * delta) / scaling) * delta);
+        mveMean += (gammaMean * delta) / 8;
+    }
+
+    int process(int raw) {
+        if (uptime <= 45.f) {
+            uptime += si;
+        } else {
+            if (raw > 0 && raw < 65000) {
+                raw = std::min(std::max(raw, 20001), 20000 + 32767);
+                sraw = (float)(raw - 20000);
+            }
+            float x = ((sraw - moxMean) / -(moxStd + 220)) * 230;
+            float k = -0.0065f * (x - 213);
+            float scaled = k < -50.f ? 500.f : k > 50.f ? 0.f : 500.f / (1.f + expf(k));
+            if (!lpInitialized) {
+                x1 = x2 = x3 = scaled;
+                lpInitialized = true;
+            }
+            x1 = (1 - a1) * x1 + a1 * scaled;
+            x2 = (1 - a2) * x2 + a2 * scaled;
+            float f1 = expf(-0.2f * fabsf(x1 - x2));
+            float tau = (500 - 20) * f1 + 20;
+            float a3 = si / (si + tau);
+            x3 = (1 - a3) * x3 + a3 * scaled;
+            gasIndex = std::max(x3, 0.5f);
+            if (sraw > 0) {
+                estimate(sraw);
+                moxStd = mveStd;
+                moxMean = mveMean + mveOffset;
+            }
+        }
+        return (int)(gasIndex + 0.5f);
+    }
+
+    void getStates(float &mean, float &std) const {
+        mean = mveMean + mveOffset;
+        std = mveStd;
+    }
+
+    void setStates(float mean, float std) {
+        mveMean = mean;
+        mveStd = std;
+        uptimeGamma = 3 * 3600;
+        mveInitialized = true;
+        moxStd = std;
+        moxMean = mean;
+        sraw = mean;
+    }
+};
+
+// --- traces ---
+
+// xorshift32, deterministic
+static uint32_t rngState = 1;
+static uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static float uniform() {
+    return (float)(nextRandom() % 100001) / 100000.0f;
+}
+
+// raw ticks: a baseline drifting over the day, noise, and an event every
+// few hours that pulls the raw signal down (more VOC, lower resistance)
+static void synthesize(std::vector<uint16_t> &out, double days, uint32_t intervalS) {
+    size_t n = (size_t)(days * 86400.0 / intervalS);
+    float eventLeft = 0, eventDepth = 0;
+    float nextEvent = 3 * 3600;
+    for (size_t i = 0; i < n; i++) {
+        float t = (float)i * intervalS;
+        float base = 30000 + 800 * sinf(t * 2 * (float)M_PI / 86400) + 300 * sinf(t / 9000);
+        if (t >= nextEvent && eventLeft <= 0) {
+            eventLeft = 1200 + uniform() * 2400;
+            eventDepth = 1500 + uniform() * 5000;
+            nextEvent = t + 2 * 3600 + uniform() * 6 * 3600;
+        }
+        float event = 0;
+        if (eventLeft > 0) {
+            event = eventDepth * (1 - expf(-(eventLeft) / 300));
+            eventLeft -= intervalS;
+        }
+        float noise = (uniform() - 0.5f) * 60;
+        out.push_back((uint16_t)std::min(std::max(base - event + noise, 0.0f), 65535.0f));
+    }
+}
+
+// the "voc" column of a CSV file with a header line
+static bool loadTrace(const char *path, std::vector<uint16_t> &out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+    static char line[1024];
+    int column = -1;
+    if (fgets(line, sizeof(line), f)) {
+        int c = 0;
+        for (char *tok = strtok(line, ",\r\n"); tok; tok = strtok(nullptr, ",\r\n"), c++) {
+            if (!strcmp(tok, "voc")) column = c;
+        }
+    }
+    if (column < 0) {
+        fprintf(stderr, "%s: no voc column\n", path);
+        fclose(f);
+        return false;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        // empty fields matter, so no strtok here
+        const char *p = line;
+        for (int c = 0; c < column && p; c++) {
+            p = strchr(p, ',');
+            if (p) p++;
+        }
+        if (!p || *p < '0' || *p > '9') continue;
+        long v = strtol(p, nullptr, 10);
+        if (v > 0 && v <= 65535) out.push_back((uint16_t)v);
+    }
+    fclose(f);
+    return true;
+}
+
+// --- comparison ---
+
+struct ErrorStats {
+    int max = 0;
+    double sum = 0;
+    size_t count = 0;
+    size_t over = 0;
+
+    void add(int a, int b, int tolerance) {
+        int e = abs(a - b);
+        max = std::max(max, e);
+        sum += e;
+        count++;
+        if (e > tolerance) over++;
+    }
+    double mean() const { return count ? sum / count : 0; }
+};
+
+int main(int argc, char **argv) {
+    const char *tracePath = nullptr;
+    double days = 7;
+    uint32_t intervalS = 30;
+    int tolerance = 1;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--trace") && v) { tracePath = v; i++; }
+        else if (!strcmp(a, "--days") && v) { days = atof(v); i++; }
+        else if (!strcmp(a, "--interval-s") && v) { intervalS = (uint32_t)atoi(v); i++; }
+        else if (!strcmp(a, "--tolerance") && v) { tolerance = atoi(v); i++; }
+        else {
+            fprintf(stderr, "unknown argument: %s\n", a);
+            return 2;
+        }
+    }
+    if (intervalS == 0) {
+        fprintf(stderr, "interval must be > 0\n");
+        return 2;
+    }
+    std::vector<uint16_t> trace;
+    if (tracePath) {
+        if (!loadTrace(tracePath, trace)) return 1;
+    } else {
+        synthesize(trace, days, intervalS);
+    }
+    size_t n = trace.size();
+    if (n < 4) {
+        fprintf(stderr, "trace too short (%zu samples)\n", n);
+        return 1;
+    }
+
+    // --- the whole trace, side by side ---
+    std::vector<uint16_t> fixed(n);
+    std::vector<int> reference(n);
+    VocIndexEngine engine;
+    engine.begin(intervalS * 1000);
+    RefVocIndex ref((float)intervalS);
+    ErrorStats whole;
+    int peak = 0;
+    for (size_t i = 0; i < n; i++) {
+        fixed[i] = engine.process(trace[i]);
+        reference[i] = ref.process(trace[i]);
+        whole.add(fixed[i], reference[i], tolerance);
+        peak = std::max(peak, reference[i]);
+    }
+
+    // --- speed, over enough passes for a stable number ---
+    size_t passes = std::max<size_t>(1, 2000000 / n);
+    // kept so the passes are not optimized away
+    volatile uint32_t sink = 0;
+    double t0 = wallSeconds();
+    for (size_t p = 0; p < passes; p++) {
+        VocIndexEngine e;
+        e.begin(intervalS * 1000);
+        for (size_t i = 0; i < n; i++) sink += e.process(trace[i]);
+    }
+    double fixedNs = (wallSeconds() - t0) * 1e9 / (passes * n);
+    t0 = wallSeconds();
+    for (size_t p = 0; p < passes; p++) {
+        RefVocIndex r((float)intervalS);
+        for (size_t i = 0; i < n; i++) sink += (uint32_t)r.process(trace[i]);
+    }
+    double floatNs = (wallSeconds() - t0) * 1e9 / (passes * n);
+
+    // --- checkpoint round trip halfway through ---
+    size_t half = n / 2;
+    VocIndexEngine before;
+    before.begin(intervalS * 1000);
+    RefVocIndex refBefore((float)intervalS);
+    for (size_t i = 0; i < half; i++) {
+        before.process(trace[i]);
+        refBefore.process(trace[i]);
+    }
+    bool settled = before.settled();
+    VocCheckpoint cp;
+    before.checkpoint(cp);
+    uint8_t block[VOC_CHECKPOINT_SIZE];
+    vocCheckpointEncode(cp, block);
+    VocCheckpoint loaded;
+    VocIndexEngine restored, cold;
+    restored.begin(intervalS * 1000);
+    cold.begin(intervalS * 1000);
+    bool roundTrip = vocCheckpointDecode(block, sizeof(block), loaded) && restored.restore(loaded);
+    float refMean, refStd;
+    refBefore.getStates(refMean, refStd);
+    RefVocIndex refRestored((float)intervalS);
+    refRestored.setStates(refMean, refStd);
+    ErrorStats afterRestore, afterCold;
+    for (size_t i = half; i < n; i++) {
+        int continuous = reference[i];
+        afterRestore.add(restored.process(trace[i]), refRestored.process(trace[i]), tolerance);
+        afterCold.add(cold.process(trace[i]), continuous, tolerance);
+    }
+
+    printf("trace              %zu samples every %u s (%.1f days), %s\n", n, (unsigned)intervalS,
+           n * intervalS / 86400.0, tracePath ? tracePath : "synthetic");
+    printf("index              reference peak %d, final %d (fixed point %u)\n", peak, reference[n - 1],
+           (unsigned)fixed[n - 1]);
+    printf("index error        max %d, mean %.3f, %zu samples off by more than %d\n", whole.max, whole.mean(),
+           whole.over, tolerance);
+    printf("time per sample    fixed point %.1f ns, float %.1f ns (%zu passes)\n", fixedNs, floatNs, passes);
+    printf("checkpoint         %s at sample %zu (mean %.1f, std %.2f; reference %.1f, %.2f)%s\n",
+           roundTrip ? "restored" : "NOT restored", half, cp.mean / 65536.0, cp.std / 65536.0, refMean, refStd,
+           settled ? "" : ", not settled yet");
+    printf("after restore      max error %d, mean %.3f against the restored reference\n", afterRestore.max,
+           afterRestore.mean());
+    printf("after cold restart max error %d, mean %.3f against the uninterrupted reference\n", afterCold.max,
+           afterCold.mean());
+    bool ok = roundTrip && whole.over == 0 && afterRestore.over == 0;
+    printf("check              %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
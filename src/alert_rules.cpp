@@ -0,0 +1,121 @@
+#include "alert_rules.h"
+
+// compiled-in rules: CO2 and PM2.5 limits, and a fast CO2 rise (a room
+// filling up, or the sensor in someone's breath)
+static const AlertRule defaultRules[] = {
+    {STATS_CO2, ALERT_ABOVE, 1500, 0, 100},
+    {STATS_PM25, ALERT_ABOVE, 35, 0, 5},
+    {STATS_CO2, ALERT_RISE, 300, 300, 100},
+};
+static_assert(sizeof(defaultRules) / sizeof(defaultRules[0]) <= ALERT_RULES, "too many default alert rules");
+
+// sensor a channel comes from, REC_HAVE_*
+static uint8_t channelGroup(uint8_t c) {
+    if (c == STATS_VOC) return REC_HAVE_SGP40;
+    if (c == STATS_PM25 || c == STATS_PM10) return REC_HAVE_SPS30;
+    return REC_HAVE_SCD41;
+}
+
+AlertEngine::AlertEngine() {
+    loadDefaults();
+}
+
+void AlertEngine::loadDefaults() {
+    for (uint8_t i = 0; i < ALERT_RULES; i++) {
+        rules[i] = AlertRule();
+        fired[i] = false;
+    }
+    for (uint8_t i = 0; i < sizeof(defaultRules) / sizeof(defaultRules[0]); i++) rules[i] = defaultRules[i];
+    historyHead = 0;
+    historyCount = 0;
+}
+
+bool AlertEngine::setRule(uint8_t index, const AlertRule &rule) {
+    if (index >= ALERT_RULES || rule.kind >= ALERT_KIND_COUNT || rule.channel >= STATS_CHANNELS) return false;
+    rules[index] = rule;
+    fired[index] = false;
+    return true;
+}
+
+int32_t AlertEngine::value(const Sample &s, uint8_t c) {
+    return c == STATS_TEMP ? (int32_t)(int16_t)s.v[c] : (int32_t)s.v[c];
+}
+
+size_t AlertEngine::evaluate(const ArchiveRecord &rec, AlertEvent *out, size_t max) {
+    Sample &cur = history[historyHead];
+    cur.ts = rec.ts;
+    cur.flags = rec.flags;
+    const uint16_t v[STATS_CHANNELS] = {rec.co2, (uint16_t)rec.temp, rec.rh, rec.voc, rec.pm25, rec.pm10};
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) cur.v[c] = v[c];
+    uint8_t curPos = historyHead;
+    historyHead = (uint8_t)((historyHead + 1) % ALERT_HISTORY);
+    if (historyCount < ALERT_HISTORY) historyCount++;
+
+    size_t n = 0;
+    for (uint8_t i = 0; i < ALERT_RULES; i++) {
+        const AlertRule &r = rules[i];
+        if (r.kind == ALERT_OFF || !(rec.flags & channelGroup(r.channel))) continue;
+        int32_t x = value(cur, r.channel);
+        if (r.kind == ALERT_RISE) {
+            // rise over the lowest reading still inside the window
+            int32_t lowest = x;
+            for (uint8_t k = 1; k < historyCount; k++) {
+                const Sample &s = history[(curPos + ALERT_HISTORY - k) % ALERT_HISTORY];
+                // older samples only get older; a ts jump back is a reboot
+                if (rec.ts - s.ts > (uint32_t)r.windowS * 1000 || s.ts > rec.ts) break;
+                if ((s.flags & channelGroup(r.channel)) && value(s, r.channel) < lowest) lowest = value(s, r.channel);
+            }
+            x -= lowest;
+        }
+        bool hit, clear;
+        if (r.kind == ALERT_BELOW) {
+            hit = x <= r.threshold;
+            clear = x > (int32_t)r.threshold + r.hysteresis;
+        } else {
+            hit = x >= r.threshold;
+            clear = x < (int32_t)r.threshold - r.hysteresis;
+        }
+        if (fired[i]) {
+            if (clear) fired[i] = false;
+            continue;
+        }
+        if (!hit) continue;
+        fired[i] = true;
+        if (n >= max) continue;
+        AlertEvent &ev = out[n++];
+        ev.rule = i;
+        ev.channel = r.channel;
+        ev.kind = r.kind;
+        ev.seq = rec.seq;
+        ev.ts = rec.ts;
+        ev.value = x;
+        ev.threshold = r.threshold;
+    }
+    return n;
+}
+
+bool alertParseRule(const uint8_t *data, size_t len, uint8_t &index, AlertRule &rule) {
+    if (!data || len != ALERT_RULE_CMD_SIZE || data[0] != CONTROL_CMD_ALERT_RULE) return false;
+    index = data[1];
+    rule.channel = data[2];
+    rule.kind = data[3];
+    rule.threshold = (int16_t)(data[4] | (data[5] << 8));
+    rule.windowS = (uint16_t)(data[6] | (data[7] << 8));
+    rule.hysteresis = (uint16_t)(data[8] | (data[9] << 8));
+    return index < ALERT_RULES && rule.channel < STATS_CHANNELS && rule.kind < ALERT_KIND_COUNT;
+}
+
+size_t alertFrame(const AlertEvent &ev, uint8_t *out) {
+    out[0] = ALERT_FRAME_TYPE;
+    out[1] = ev.rule;
+    out[2] = ev.channel;
+    out[3] = ev.kind;
+    for (int b = 0; b < 4; b++) {
+        out[4 + b] = (uint8_t)(ev.seq >> (8 * b));
+        out[8 + b] = (uint8_t)(ev.ts >> (8 * b));
+        out[12 + b] = (uint8_t)((uint32_t)ev.value >> (8 * b));
+    }
+    out[16] = (uint8_t)ev.threshold;
+    out[17] = (uint8_t)((uint16_t)ev.threshold >> 8);
+    return ALERT_FRAME_SIZE;
+}
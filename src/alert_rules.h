@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "archive_record.h"
+#include "rolling_stats.h"
+
+// Threshold and rate-of-change alerts on the measurement stream.
+//
+// Every combined sample is checked against a small table of rules, each on
+// one StatsChannel in ArchiveRecord units:
+//
+//   ALERT_ABOVE  value >= threshold
+//   ALERT_BELOW  value <= threshold
+//   ALERT_RISE   value - lowest value of the last windowS seconds >= threshold
+//
+// A rule fires once when its condition becomes true and re-arms when the
+// value (or the rise) is back hysteresis units on the other side of the
+// threshold, so a reading hovering at the limit doesn't flood the link.
+// Channels whose sensor is missing from a sample are not checked. Rises are
+// measured over the last ALERT_HISTORY samples, so windowS is capped by how
+// much time those cover.
+//
+// Hits go out on the data characteristic ahead of live and backlog data:
+//
+//   u8 ALERT_FRAME_TYPE | u8 rule | u8 channel | u8 kind | u32 seq | u32 ts
+//   | i32 value | i16 threshold                                (little endian)
+//
+// value is the reading, or the rise for ALERT_RISE; ts is when the sample
+// was measured. The client replaces a rule with a control write (see
+// range_query.h for the other commands):
+//
+//   0x06 u8 rule | u8 channel | u8 kind | i16 threshold | u16 windowS
+//        | u16 hysteresis                                  kind 0 disables
+
+#define ALERT_RULES 8
+#define ALERT_HISTORY 16
+#define ALERT_FRAME_TYPE 0xA1
+#define ALERT_FRAME_SIZE 18
+#define CONTROL_CMD_ALERT_RULE 0x06
+#define ALERT_RULE_CMD_SIZE 10
+
+enum AlertKind : uint8_t {
+    ALERT_OFF = 0,
+    ALERT_ABOVE,
+    ALERT_BELOW,
+    ALERT_RISE,
+    ALERT_KIND_COUNT,
+};
+
+// plain aggregate so rule tables can be brace-initialised; AlertRule() is off
+struct AlertRule {
+    uint8_t channel;       // StatsChannel
+    uint8_t kind;          // AlertKind
+    int16_t threshold;
+    uint16_t windowS;      // ALERT_RISE only
+    uint16_t hysteresis;
+};
+
+// one rule hit
+struct AlertEvent {
+    uint8_t rule;
+    uint8_t channel;
+    uint8_t kind;
+    uint32_t seq;
+    uint32_t ts;
+    int32_t value;
+    int16_t threshold;
+};
+
+class AlertEngine {
+public:
+    AlertEngine();
+
+    // back to the compiled-in rules, all armed
+    void loadDefaults();
+    // replace (and re-arm) rule index; false if index or rule is invalid
+    bool setRule(uint8_t index, const AlertRule &rule);
+    const AlertRule &rule(uint8_t index) const { return rules[index]; }
+
+    // check one sample; writes up to max hits to out and returns how many
+    size_t evaluate(const ArchiveRecord &rec, AlertEvent *out, size_t max);
+
+private:
+    struct Sample {
+        uint32_t ts;
+        uint8_t flags;
+        uint16_t v[STATS_CHANNELS];   // raw record fields, temp is signed
+    };
+
+    static int32_t value(const Sample &s, uint8_t c);
+
+    AlertRule rules[ALERT_RULES];
+    bool fired[ALERT_RULES];
+    Sample history[ALERT_HISTORY];
+    uint8_t historyHead;
+    uint8_t historyCount;
+};
+
+// decode a CONTROL_CMD_ALERT_RULE write; false if it is malformed
+bool alertParseRule(const uint8_t *data, size_t len, uint8_t &index, AlertRule &rule);
+// fill out[ALERT_FRAME_SIZE], returns its size
+size_t alertFrame(const AlertEvent &ev, uint8_t *out);
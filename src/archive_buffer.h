@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include "archive_record.h"
+
+// Circular buffer for offline archiving (fixed-size binary records, no heap).
+// Capacity is MAX_BUFFER_SIZE from archive_record.h; it holds the oldest
+// pending part of the archive log.
+struct CircularBuffer {
+    ArchiveRecord records[MAX_BUFFER_SIZE];
+    uint32_t head = 0;     // write position
+    uint32_t count = 0;    // number of stored samples (0 to MAX_BUFFER_SIZE)
+
+    void add(const ArchiveRecord &rec) {
+        records[head] = rec;
+        head = (head + 1) % MAX_BUFFER_SIZE;
+        if (count < MAX_BUFFER_SIZE) {
+            count++;
+        }
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    // i-th oldest record (0 = oldest), i must be < count
+    const ArchiveRecord &at(uint32_t i) const {
+        return records[(head + MAX_BUFFER_SIZE - count + i) % MAX_BUFFER_SIZE];
+    }
+
+    // peek at oldest record without removing (nullptr if empty)
+    const ArchiveRecord *peekFront() const {
+        if (count == 0) return nullptr;
+        uint32_t pos = (head + MAX_BUFFER_SIZE - count) % MAX_BUFFER_SIZE;
+        return &records[pos];
+    }
+
+    // drop oldest record(s)
+    void popFront(uint32_t n = 1) {
+        count = n < count ? count - n : 0;
+    }
+};
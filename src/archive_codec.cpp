@@ -0,0 +1,211 @@
+#include "archive_codec.h"
+
+#include <string.h>
+
+#define MASK_SEQ   0x01
+#define MASK_TS    0x02
+#define MASK_CO2   0x04
+#define MASK_TEMP  0x08
+#define MASK_RH    0x10
+#define MASK_VOC   0x20
+#define MASK_PM    0x40
+#define MASK_FLAGS 0x80
+
+static inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline size_t putVarint(uint8_t *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// returns bytes read or 0 on truncated/overlong input
+static inline size_t getVarint(const uint8_t *in, size_t len, uint32_t &v) {
+    v = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        v |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+size_t codecEncodeDelta(CodecState &st, const ArchiveRecord &rec, uint8_t *out) {
+    const ArchiveRecord &p = st.prev;
+    uint32_t tsDelta = rec.ts - p.ts;
+    int32_t dod = (int32_t)(tsDelta - st.prevTsDelta);
+    uint8_t mask = 0;
+    size_t n = 1;
+
+    if (rec.seq - p.seq != 1) {
+        mask |= MASK_SEQ;
+        n += putVarint(out + n, rec.seq - p.seq);
+    }
+    if (dod != 0) {
+        mask |= MASK_TS;
+        n += putVarint(out + n, zigzag(dod));
+    }
+    if (rec.co2 != p.co2) {
+        mask |= MASK_CO2;
+        n += putVarint(out + n, zigzag((int32_t)rec.co2 - (int32_t)p.co2));
+    }
+    if (rec.temp != p.temp) {
+        mask |= MASK_TEMP;
+        n += putVarint(out + n, zigzag((int32_t)rec.temp - (int32_t)p.temp));
+    }
+    if (rec.rh != p.rh) {
+        mask |= MASK_RH;
+        n += putVarint(out + n, zigzag((int32_t)rec.rh - (int32_t)p.rh));
+    }
+    if (rec.voc != p.voc) {
+        mask |= MASK_VOC;
+        n += putVarint(out + n, zigzag((int32_t)rec.voc - (int32_t)p.voc));
+    }
+    if (rec.pm25 != p.pm25 || rec.pm10 != p.pm10) {
+        mask |= MASK_PM;
+        n += putVarint(out + n, zigzag((int32_t)rec.pm25 - (int32_t)p.pm25));
+        n += putVarint(out + n, zigzag((int32_t)rec.pm10 - (int32_t)p.pm10));
+    }
+    if (rec.flags != p.flags) {
+        mask |= MASK_FLAGS;
+        out[n++] = rec.flags;
+    }
+    out[0] = mask;
+
+    st.prev = rec;
+    st.prevTsDelta = tsDelta;
+    return n;
+}
+
+size_t codecDecodeDelta(CodecState &st, const uint8_t *in, size_t len, ArchiveRecord &rec) {
+    if (!st.primed || len == 0) return 0;
+    const ArchiveRecord &p = st.prev;
+    uint8_t mask = in[0];
+    size_t n = 1;
+    uint32_t v = 0;
+    size_t used = 0;
+
+// read the next varint or bail out on malformed input
+#define NEXT_VARINT()                                   \
+    do {                                                \
+        used = getVarint(in + n, len - n, v);           \
+        if (used == 0) return 0;                        \
+        n += used;                                      \
+    } while (0)
+
+    rec = p;
+    rec.seq = p.seq + 1;
+    if (mask & MASK_SEQ) {
+        NEXT_VARINT();
+        rec.seq = p.seq + v;
+    }
+    uint32_t tsDelta = st.prevTsDelta;
+    if (mask & MASK_TS) {
+        NEXT_VARINT();
+        tsDelta += (uint32_t)unzigzag(v);
+    }
+    rec.ts = p.ts + tsDelta;
+    if (mask & MASK_CO2) {
+        NEXT_VARINT();
+        rec.co2 = (uint16_t)(p.co2 + unzigzag(v));
+    }
+    if (mask & MASK_TEMP) {
+        NEXT_VARINT();
+        rec.temp = (int16_t)(p.temp + unzigzag(v));
+    }
+    if (mask & MASK_RH) {
+        NEXT_VARINT();
+        rec.rh = (uint16_t)(p.rh + unzigzag(v));
+    }
+    if (mask & MASK_VOC) {
+        NEXT_VARINT();
+        rec.voc = (uint16_t)(p.voc + unzigzag(v));
+    }
+    if (mask & MASK_PM) {
+        NEXT_VARINT();
+        rec.pm25 = (uint16_t)(p.pm25 + unzigzag(v));
+        NEXT_VARINT();
+        rec.pm10 = (uint16_t)(p.pm10 + unzigzag(v));
+    }
+    if (mask & MASK_FLAGS) {
+        if (n >= len) return 0;
+        rec.flags = in[n++];
+    }
+#undef NEXT_VARINT
+
+    st.prev = rec;
+    st.prevTsDelta = tsDelta;
+    return n;
+}
+
+void CodecBlockWriter::begin(uint8_t *out, size_t capacity) {
+    buf = out;
+    cap = capacity;
+    len = CODEC_HEADER_SIZE;
+    count = 0;
+    state = CodecState();
+}
+
+bool CodecBlockWriter::add(const ArchiveRecord &rec) {
+    if (count == 255) return false;
+    if (count == 0) {
+        if (len + sizeof(ArchiveRecord) > cap) return false;
+        memcpy(buf + len, &rec, sizeof(ArchiveRecord));
+        len += sizeof(ArchiveRecord);
+        state.keyframe(rec);
+    } else {
+        uint8_t tmp[CODEC_DELTA_MAX];
+        CodecState next = state;
+        size_t n = codecEncodeDelta(next, rec, tmp);
+        if (len + n > cap) return false;
+        memcpy(buf + len, tmp, n);
+        len += n;
+        state = next;
+    }
+    count++;
+    return true;
+}
+
+size_t CodecBlockWriter::finish() {
+    uint16_t body = (uint16_t)(len - 3);
+    buf[0] = CODEC_FRAME_TYPE;
+    buf[1] = (uint8_t)(body);
+    buf[2] = (uint8_t)(body >> 8);
+    buf[3] = count;
+    return len;
+}
+
+int codecDecodeBlock(const uint8_t *buf, size_t len, CodecRecordSink sink, void *ctx) {
+    if (len < CODEC_HEADER_SIZE || buf[0] != CODEC_FRAME_TYPE) return -1;
+    size_t body = (size_t)buf[1] | ((size_t)buf[2] << 8);
+    if (body + 3 > len) return -1;
+    len = body + 3;
+    uint8_t count = buf[3];
+    if (count == 0) return 0;
+
+    size_t pos = CODEC_HEADER_SIZE;
+    if (pos + sizeof(ArchiveRecord) > len) return -1;
+    ArchiveRecord rec;
+    memcpy(&rec, buf + pos, sizeof(rec));
+    pos += sizeof(rec);
+    CodecState st;
+    st.keyframe(rec);
+    if (sink) sink(rec, ctx);
+
+    for (uint8_t i = 1; i < count; i++) {
+        size_t n = codecDecodeDelta(st, buf + pos, len - pos, rec);
+        if (n == 0) return -1;
+        pos += n;
+        if (sink) sink(rec, ctx);
+    }
+    return count;
+}
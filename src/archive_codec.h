@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "archive_record.h"
+
+// Delta + zig-zag varint codec for archive records.
+//
+// A run of records starts with a keyframe (the raw 21-byte ArchiveRecord);
+// every following record is stored as the difference to its predecessor:
+//
+//   u8 mask, then only the fields whose bit is set:
+//     bit0  seq delta != 1        varint(seq - prev.seq)
+//     bit1  ts delta-of-delta     zigzag varint((ts - prev.ts) - prevTsDelta)
+//     bit2  co2                   zigzag varint(co2 - prev.co2)
+//     bit3  temp                  zigzag varint(temp - prev.temp)
+//     bit4  rh                    zigzag varint(rh - prev.rh)
+//     bit5  voc                   zigzag varint(voc - prev.voc)
+//     bit6  pm25 + pm10           zigzag varint each
+//     bit7  flags                 raw byte
+//
+// Sensors sampled every 30 s move slowly, so a typical record is 5-8 bytes
+// instead of 21 (binary) or ~100 (JSON).
+
+// worst case size of one delta
+#define CODEC_DELTA_MAX (1 + 5 + 5 + 3 * 6 + 1)
+
+// decoding/encoding state carried from one record to the next
+struct CodecState {
+    ArchiveRecord prev;
+    uint32_t prevTsDelta = 0;
+    bool primed = false;     // false until a keyframe was seen
+
+    void keyframe(const ArchiveRecord &rec) {
+        prev = rec;
+        prevTsDelta = 0;
+        primed = true;
+    }
+};
+
+// encode rec relative to st.prev into out (>= CODEC_DELTA_MAX bytes), returns size
+size_t codecEncodeDelta(CodecState &st, const ArchiveRecord &rec, uint8_t *out);
+// decode one delta from in; returns bytes consumed or 0 if malformed
+size_t codecDecodeDelta(CodecState &st, const uint8_t *in, size_t len, ArchiveRecord &rec);
+
+// --- self-contained blocks (used as BLE frames) ---
+//
+//   offset  size  field
+//   0       1     frame type (CODEC_FRAME_TYPE)
+//   1       2     body length in bytes (everything after this field), LE
+//   3       1     record count
+//   4       21    keyframe (first record)
+//   25      ...   deltas
+//
+// Every block decodes on its own.
+#define CODEC_FRAME_TYPE 0xC1
+#define CODEC_HEADER_SIZE 4
+
+struct CodecBlockWriter {
+    uint8_t *buf = nullptr;
+    size_t cap = 0;
+    size_t len = 0;
+    uint8_t count = 0;
+    CodecState state;
+
+    void begin(uint8_t *out, size_t capacity);
+    // false if rec doesn't fit any more
+    bool add(const ArchiveRecord &rec);
+    // fill in the header, returns total block size
+    size_t finish();
+};
+
+typedef void (*CodecRecordSink)(const ArchiveRecord &rec, void *ctx);
+
+// decode a block, calling sink for every record; returns record count or
+// -1 if the block is malformed
+int codecDecodeBlock(const uint8_t *buf, size_t len, CodecRecordSink sink, void *ctx);
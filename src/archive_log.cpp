@@ -0,0 +1,575 @@
+#include "archive_log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "crc.h"
+
+#define LOG_CHECKPOINT_MAGIC 0x41524333UL  // "ARC3"
+// same as ARC3 without seqReserve
+#define LOG_CHECKPOINT_MAGIC_V2 0x41524332UL  // "ARC2"
+
+#define LOG_HEADER_MAGIC 0x41525348UL  // "ARSH"
+
+#pragma pack(push, 1)
+struct LogCheckpointV2 {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t headSeg;
+    uint32_t ackedSeq;
+    uint16_t crc;
+};
+
+// sealed segment metadata, written once when the segment is sealed
+struct LogSegmentHeader {
+    uint32_t magic;
+    uint32_t index;
+    uint32_t firstSeq;
+    uint32_t lastSeq;
+    uint32_t lastTs;
+    uint16_t count;
+    uint16_t bytes;
+    uint8_t keyCount;
+    LogIndexKey keys[ARCHIVE_INDEX_PER_SEGMENT];
+    uint16_t crc;         // crc16 over the fields above
+};
+#pragma pack(pop)
+
+static const char *checkpointPath(uint8_t slot) {
+    return slot ? "/arch_ckpt1" : "/arch_ckpt0";
+}
+
+void ArchiveLog::segmentPath(uint32_t index, char *buf, size_t size) const {
+    snprintf(buf, size, "/arch_%05lu.seg", (unsigned long)index);
+}
+
+void ArchiveLog::headerPath(uint32_t index, char *buf, size_t size) const {
+    snprintf(buf, size, "/arch_%05lu.hdr", (unsigned long)index);
+}
+
+bool ArchiveLog::readHeader(uint32_t index, LogSegment &seg) {
+    char path[24];
+    headerPath(index, path, sizeof(path));
+    LogSegmentHeader h;
+    if (storage.readAt(path, 0, &h, sizeof(h)) != sizeof(h)) return false;
+    if (h.magic != LOG_HEADER_MAGIC || h.crc != crc16(&h, offsetof(LogSegmentHeader, crc))) return false;
+    if (h.index != index || h.count == 0 || h.keyCount > ARCHIVE_INDEX_PER_SEGMENT) return false;
+    seg.index = index;
+    seg.firstSeq = h.firstSeq;
+    seg.lastSeq = h.lastSeq;
+    seg.lastTs = h.lastTs;
+    seg.count = h.count;
+    seg.bytes = h.bytes;
+    seg.keyCount = h.keyCount;
+    memcpy(seg.keys, h.keys, sizeof(seg.keys));
+    return true;
+}
+
+void ArchiveLog::sealTail() {
+    tailSealed = true;
+    if (segCount == 0) return;
+    const LogSegment &seg = segs[segCount - 1];
+    if (seg.count == 0) return;
+    LogSegmentHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = LOG_HEADER_MAGIC;
+    h.index = seg.index;
+    h.firstSeq = seg.firstSeq;
+    h.lastSeq = seg.lastSeq;
+    h.lastTs = seg.lastTs;
+    h.count = seg.count;
+    h.bytes = seg.bytes;
+    h.keyCount = seg.keyCount;
+    memcpy(h.keys, seg.keys, sizeof(h.keys));
+    h.crc = crc16(&h, offsetof(LogSegmentHeader, crc));
+    char path[24];
+    headerPath(seg.index, path, sizeof(path));
+    // without a header the next boot just scans the segment
+    storage.writeFile(path, &h, sizeof(h));
+}
+
+bool ArchiveLog::readCheckpoint(uint8_t slot, LogCheckpoint &cp) {
+    size_t n = storage.readAt(checkpointPath(slot), 0, &cp, sizeof(cp));
+    if (n == sizeof(LogCheckpointV2) && cp.magic == LOG_CHECKPOINT_MAGIC_V2) {
+        LogCheckpointV2 old;
+        memcpy(&old, &cp, sizeof(old));
+        if (old.crc != crc16(&old, offsetof(LogCheckpointV2, crc))) return false;
+        cp.seqReserve = old.ackedSeq;
+        return true;
+    }
+    if (n != sizeof(cp) || cp.magic != LOG_CHECKPOINT_MAGIC) return false;
+    return cp.crc == crc16(&cp, offsetof(LogCheckpoint, crc));
+}
+
+bool ArchiveLog::checkpoint() {
+    LogCheckpoint cp;
+    cp.magic = LOG_CHECKPOINT_MAGIC;
+    cp.generation = ++generation;
+    cp.headSeg = headSegment();
+    cp.ackedSeq = acked;
+    cp.seqReserve = reserved;
+    cp.crc = crc16(&cp, offsetof(LogCheckpoint, crc));
+    return storage.writeFile(checkpointPath(generation & 1), &cp, sizeof(cp));
+}
+
+ArchiveLog::ScanResult ArchiveLog::scanSegment(uint32_t index, uint32_t start, SlotVisitor visit, void *ctx) {
+    ScanResult res;
+    char path[24];
+    segmentPath(index, path, sizeof(path));
+    CodecState st;
+    uint32_t offset = start;
+    for (;;) {
+        size_t n = storage.readAt(path, offset, chunk, sizeof(chunk));
+        size_t pos = 0;
+        while (pos < n) {
+            size_t len = chunk[pos];
+            size_t slot = 1 + len + 2;
+            if (len == 0 || len > sizeof(ArchiveRecord)) {
+                res.torn = true;
+                return res;
+            }
+            if (pos + slot > n) break;  // slot continues in the next chunk
+            const uint8_t *payload = chunk + pos + 1;
+            uint16_t crc = (uint16_t)(payload[len] | (payload[len + 1] << 8));
+            if (crc != crc16(chunk + pos, 1 + len)) {
+                res.torn = true;
+                return res;
+            }
+            ArchiveRecord rec;
+            SlotInfo info;
+            info.offset = offset + pos;
+            info.keyframe = len == sizeof(ArchiveRecord);
+            info.state = &st;
+            if (info.keyframe) {
+                memcpy(&rec, payload, sizeof(rec));
+                st.keyframe(rec);
+            } else if (!st.primed || codecDecodeDelta(st, payload, len, rec) != len) {
+                // a scan always starts at a keyframe
+                res.torn = true;
+                return res;
+            }
+            res.count++;
+            res.bytes += slot;
+            pos += slot;
+            if (visit && !visit(rec, info, ctx)) return res;
+            if (res.count >= ARCHIVE_SEGMENT_RECORDS) return res;
+        }
+        if (n < sizeof(chunk)) {
+            // end of file; leftover bytes are a partial slot
+            if (pos < n) res.torn = true;
+            return res;
+        }
+        offset += pos;
+    }
+}
+
+struct RecoverCtx {
+    ArchiveLog *log;
+    LogRecordSink sink;
+    void *sinkCtx;
+    LogRecoveryStats *stats;
+    LogSegment *seg;
+    CodecState state;   // delta base after the last record, for appends
+};
+
+void ArchiveLog::addKey(LogSegment &seg, const ArchiveRecord &rec, uint32_t offset) {
+    if (seg.keyCount >= ARCHIVE_INDEX_PER_SEGMENT) return;
+    LogIndexKey &key = seg.keys[seg.keyCount++];
+    key.seq = rec.seq;
+    key.ts = rec.ts;
+    key.offset = (uint16_t)offset;
+}
+
+bool ArchiveLog::recoverVisit(const ArchiveRecord &rec, const SlotInfo &slot, void *ctx) {
+    RecoverCtx &rc = *(RecoverCtx*)ctx;
+    ArchiveLog &log = *rc.log;
+    LogSegment &seg = *rc.seg;
+    if (seg.count == 0) seg.firstSeq = rec.seq;
+    // only stride keyframes are indexed, like append() does
+    if (slot.keyframe && seg.count % ARCHIVE_INDEX_STRIDE == 0) addKey(seg, rec, slot.offset);
+    rc.state = *slot.state;
+    seg.lastSeq = rec.seq;
+    seg.lastTs = rec.ts;
+    seg.count++;
+    if (rec.seq > log.maxSeq) log.maxSeq = rec.seq;
+    if (rec.seq > log.acked) {
+        seg.unconsumed++;
+        log.pending++;
+        rc.stats->records++;
+        if (rc.sink) rc.sink(rec, rc.sinkCtx);
+    } else {
+        rc.stats->consumed++;
+    }
+    return true;
+}
+
+LogRecoveryStats ArchiveLog::recover(LogRecordSink sink, void *ctx) {
+    LogRecoveryStats stats;
+    LogCheckpoint cp0, cp1;
+    bool ok0 = readCheckpoint(0, cp0);
+    bool ok1 = readCheckpoint(1, cp1);
+    uint32_t head = 0;
+    acked = 0;
+    reserved = 0;
+    generation = 0;
+    pending = 0;
+    if (ok0 || ok1) {
+        const LogCheckpoint &cp = (ok0 && (!ok1 || cp0.generation > cp1.generation)) ? cp0 : cp1;
+        head = cp.headSeg;
+        acked = cp.ackedSeq;
+        reserved = cp.seqReserve;
+        generation = cp.generation;
+    }
+    maxSeq = acked;
+
+    char path[24];
+    // a reclaimed segment is deleted right after the checkpoint that skips it;
+    // clean it up if we lost power in between
+    if (head > 0) {
+        segmentPath(head - 1, path, sizeof(path));
+        if (storage.exists(path)) storage.remove(path);
+        headerPath(head - 1, path, sizeof(path));
+        if (storage.exists(path)) storage.remove(path);
+    }
+
+    segCount = 0;
+    tailSealed = true;
+    uint32_t index = head;
+    uint32_t prevLastSeq = acked;
+    uint32_t prevLastTs = 0;
+    for (;;) {
+        segmentPath(index, path, sizeof(path));
+        if (!storage.exists(path)) break;
+        stats.segments++;
+        if (segCount == ARCHIVE_LOG_MAX_SEGMENTS) {
+            // more history on flash than we can track, keep the newest
+            dropHeadSegment();
+        }
+        LogSegment &seg = segs[segCount];
+        // a sealed segment that is either fully consumed or fully pending
+        // needs no decoding when nobody wants its records
+        if (!sink && readHeader(index, seg) && (seg.lastSeq <= acked || seg.firstSeq > acked)) {
+            seg.unconsumed = seg.firstSeq > acked ? seg.count : 0;
+            pending += seg.unconsumed;
+            if (seg.lastSeq > maxSeq) maxSeq = seg.lastSeq;
+            stats.attached++;
+            stats.records += seg.unconsumed;
+            stats.consumed += seg.count - seg.unconsumed;
+            stats.bytes += seg.bytes;
+            prevLastSeq = seg.lastSeq;
+            prevLastTs = seg.lastTs;
+            segCount++;
+            tailSealed = true;
+            index++;
+            continue;
+        }
+        seg.index = index;
+        seg.firstSeq = prevLastSeq;
+        seg.lastSeq = prevLastSeq;
+        seg.lastTs = prevLastTs;
+        seg.count = 0;
+        seg.unconsumed = 0;
+        seg.keyCount = 0;
+        RecoverCtx rc;
+        rc.log = this;
+        rc.sink = sink;
+        rc.sinkCtx = ctx;
+        rc.stats = &stats;
+        rc.seg = &seg;
+        ScanResult res = scanSegment(index, 0, recoverVisit, &rc);
+        if (res.torn) stats.tornSegments++;
+        stats.bytes += res.bytes;
+        seg.bytes = (uint16_t)res.bytes;
+        prevLastSeq = seg.lastSeq;
+        prevLastTs = seg.lastTs;
+        // an empty torn segment is kept too: deleting it would leave a hole in
+        // the numbering; it is reclaimed with the next consumed record
+        segCount++;
+        tailState = rc.state;
+        // a torn or full segment is never appended to again; its header is
+        // missing if power went before sealing finished
+        tailSealed = false;
+        if (res.torn || res.count == 0 || res.count >= ARCHIVE_SEGMENT_RECORDS) {
+            headerPath(index, path, sizeof(path));
+            if (storage.exists(path)) tailSealed = true;
+            else sealTail();
+        }
+        index++;
+    }
+    nextSegIndex = index;
+    return stats;
+}
+
+bool ArchiveLog::append(const ArchiveRecord &rec) {
+    if (segCount == 0 || tailSealed) {
+        if (segCount == ARCHIVE_LOG_MAX_SEGMENTS) {
+            // archive full, the oldest segment is overwritten like the RAM ring
+            dropHeadSegment();
+        }
+        LogSegment &seg = segs[segCount++];
+        seg.index = nextSegIndex++;
+        // a header left over from a reclaimed segment of the same number
+        char hdr[24];
+        headerPath(seg.index, hdr, sizeof(hdr));
+        if (storage.exists(hdr)) storage.remove(hdr);
+        seg.firstSeq = rec.seq;
+        seg.lastSeq = rec.seq;
+        seg.lastTs = rec.ts;
+        seg.count = 0;
+        seg.unconsumed = 0;
+        seg.bytes = 0;
+        seg.keyCount = 0;
+        tailSealed = false;
+    }
+
+    LogSegment &tail = segs[segCount - 1];
+    uint8_t slot[ARCHIVE_SLOT_MAX];
+    size_t len = 0;
+    CodecState next = tailState;
+    bool stride = tail.count % ARCHIVE_INDEX_STRIDE == 0;
+    bool keyframe = stride;
+    if (!keyframe) {
+        uint8_t delta[CODEC_DELTA_MAX];
+        len = codecEncodeDelta(next, rec, delta);
+        // a keyframe-sized delta would read back as a keyframe
+        if (len >= sizeof(ArchiveRecord)) keyframe = true;
+        else memcpy(slot + 1, delta, len);
+    }
+    if (keyframe) {
+        memcpy(slot + 1, &rec, sizeof(rec));
+        len = sizeof(rec);
+        next.keyframe(rec);
+    }
+    slot[0] = (uint8_t)len;
+    uint16_t crc = crc16(slot, 1 + len);
+    slot[1 + len] = (uint8_t)crc;
+    slot[2 + len] = (uint8_t)(crc >> 8);
+
+    char path[24];
+    segmentPath(tail.index, path, sizeof(path));
+    if (!storage.append(path, slot, 3 + len)) {
+        if (tail.count == 0 && !storage.exists(path)) {
+            // segment was never created, reuse its index so numbering stays contiguous
+            segCount--;
+            nextSegIndex--;
+            tailSealed = true;
+            return false;
+        }
+        // anything written may be a partial slot, don't append behind it
+        sealTail();
+        return false;
+    }
+    tailState = next;
+    if (tail.count == 0) tail.firstSeq = rec.seq;
+    if (stride) addKey(tail, rec, tail.bytes);
+    tail.bytes += 3 + len;
+    tail.lastSeq = rec.seq;
+    tail.lastTs = rec.ts;
+    tail.count++;
+    tail.unconsumed++;
+    pending++;
+    if (rec.seq > maxSeq) maxSeq = rec.seq;
+    if (tail.count >= ARCHIVE_SEGMENT_RECORDS) sealTail();
+    return true;
+}
+
+uint16_t ArchiveLog::keyOffset(const LogSegment &seg, uint32_t value, bool byTs) {
+    // keys are in seq (and, within a boot, ts) order
+    uint32_t lo = 0, hi = seg.keyCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        uint32_t key = byTs ? seg.keys[mid].ts : seg.keys[mid].seq;
+        if (key <= value) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? seg.keys[lo - 1].offset : 0;
+}
+
+struct ReadCtx {
+    ArchiveRecord *out;
+    size_t max;
+    size_t n;
+    uint32_t firstSeq;
+    uint32_t lastSeq;
+    bool done;
+};
+
+bool ArchiveLog::readVisit(const ArchiveRecord &rec, const SlotInfo &, void *ctx) {
+    ReadCtx &rc = *(ReadCtx*)ctx;
+    if (rec.seq > rc.lastSeq) {
+        rc.done = true;
+        return false;
+    }
+    if (rec.seq >= rc.firstSeq) rc.out[rc.n++] = rec;
+    return rc.n < rc.max;
+}
+
+size_t ArchiveLog::readRange(uint32_t firstSeq, uint32_t lastSeq, ArchiveRecord *out, size_t max) {
+    ReadCtx rc;
+    rc.out = out;
+    rc.max = max;
+    rc.n = 0;
+    rc.firstSeq = firstSeq;
+    rc.lastSeq = lastSeq;
+    rc.done = max == 0 || firstSeq > lastSeq;
+    // first segment that can hold firstSeq
+    uint32_t lo = 0, hi = segCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (segs[mid].lastSeq < firstSeq) lo = mid + 1;
+        else hi = mid;
+    }
+    for (uint32_t i = lo; i < segCount && !rc.done && rc.n < max; i++) {
+        if (segs[i].count == 0) continue;
+        // resume from the newest keyframe at or before the wanted seq
+        uint32_t from = rc.n == 0 ? keyOffset(segs[i], firstSeq, false) : 0;
+        scanSegment(segs[i].index, from, readVisit, &rc);
+    }
+    return rc.n;
+}
+
+size_t ArchiveLog::readAfter(uint32_t afterSeq, ArchiveRecord *out, size_t max) {
+    if (afterSeq < acked) afterSeq = acked;
+    if (afterSeq == UINT32_MAX) return 0;
+    return readRange(afterSeq + 1, UINT32_MAX, out, max);
+}
+
+uint32_t ArchiveLog::oldestSeq() const {
+    for (uint32_t i = 0; i < segCount; i++) {
+        if (segs[i].count) return segs[i].firstSeq;
+    }
+    return 0;
+}
+
+void ArchiveLog::seekRaw(LogRawCursor &c, uint32_t firstSeq, uint32_t lastSeq) {
+    c = LogRawCursor();
+    c.lastSeq = lastSeq;
+    c.done = firstSeq > lastSeq;
+    // first segment that can hold firstSeq
+    uint32_t lo = 0, hi = segCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (segs[mid].lastSeq < firstSeq) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == segCount) {
+        c.done = true;
+        return;
+    }
+    c.segIndex = segs[lo].index;
+    c.offset = keyOffset(segs[lo], firstSeq, false);
+}
+
+size_t ArchiveLog::readRaw(LogRawCursor &c, uint8_t *out, size_t max, uint32_t &segIndex, uint32_t &offset) {
+    while (!c.done && max > 0) {
+        // the cursor's segment, or the next one if it was reclaimed meanwhile
+        uint32_t i = 0;
+        while (i < segCount && segs[i].index < c.segIndex) i++;
+        if (i == segCount || (segs[i].count && segs[i].firstSeq > c.lastSeq)) {
+            c.done = true;
+            break;
+        }
+        if (segs[i].index != c.segIndex) {
+            c.segIndex = segs[i].index;
+            c.offset = 0;
+        }
+        uint32_t end = segs[i].bytes;
+        size_t n = 0;
+        if (c.offset < end) {
+            char path[24];
+            segmentPath(c.segIndex, path, sizeof(path));
+            n = storage.readAt(path, c.offset, out, end - c.offset < max ? end - c.offset : max);
+        }
+        if (n == 0) {
+            c.segIndex++;
+            c.offset = 0;
+            continue;
+        }
+        segIndex = c.segIndex;
+        offset = c.offset;
+        c.offset += (uint32_t)n;
+        return n;
+    }
+    return 0;
+}
+
+struct TsCtx {
+    uint32_t ts;
+    uint32_t seq;
+};
+
+bool ArchiveLog::tsVisit(const ArchiveRecord &rec, const SlotInfo &, void *ctx) {
+    TsCtx &tc = *(TsCtx*)ctx;
+    if (rec.ts < tc.ts) return true;
+    tc.seq = rec.seq;
+    return false;
+}
+
+uint32_t ArchiveLog::seqAtOrAfterTs(uint32_t ts) {
+    // first segment whose newest record is recent enough
+    uint32_t lo = 0, hi = segCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (segs[mid].lastTs < ts) lo = mid + 1;
+        else hi = mid;
+    }
+    TsCtx tc;
+    tc.ts = ts;
+    tc.seq = 0;
+    for (uint32_t i = lo; i < segCount && tc.seq == 0; i++) {
+        if (segs[i].count == 0) continue;
+        scanSegment(segs[i].index, keyOffset(segs[i], ts, true), tsVisit, &tc);
+    }
+    return tc.seq;
+}
+
+void ArchiveLog::reserveSeq(uint32_t seq) {
+    if (seq <= reserved) return;
+    reserved = seq + ARCHIVE_SEQ_RESERVE - 1;
+    checkpoint();
+}
+
+void ArchiveLog::markConsumed(uint32_t seq, uint32_t n) {
+    if (seq > acked) acked = seq;
+    if (seq > maxSeq) maxSeq = seq;
+    // found by seq, not by order: the run may start in a segment that was
+    // overwritten meanwhile, or in records that never made it to flash.
+    // Segments up to seq are consumed whole; the one holding seq keeps its
+    // records above seq and gives up the rest of the run.
+    for (uint32_t i = 0; i < segCount; i++) {
+        LogSegment &seg = segs[i];
+        if (seg.count == 0) continue;
+        if (seg.firstSeq > seq) break;
+        uint32_t take = seg.unconsumed;
+        if (seg.lastSeq > seq) {
+            uint32_t atOrBelow = seq - seg.firstSeq + 1;
+            if (take > n) take = n;
+            if (take > atOrBelow) take = atOrBelow;
+            if (take >= seg.unconsumed) take = seg.unconsumed ? seg.unconsumed - 1 : 0;
+        }
+        seg.unconsumed -= take;
+        pending -= take;
+        n = take < n ? n - take : 0;
+    }
+    while (segCount > 0 && segs[0].lastSeq <= acked) {
+        dropHeadSegment();
+    }
+}
+
+void ArchiveLog::dropHeadSegment() {
+    if (segCount == 0) return;
+    uint32_t index = segs[0].index;
+    pending -= segs[0].unconsumed;
+    // overwritten before it was consumed: the records are gone, so the
+    // watermark moves past them or an acking client could never catch up
+    if (segs[0].unconsumed && segs[0].lastSeq > acked) acked = segs[0].lastSeq;
+    memmove(&segs[0], &segs[1], (segCount - 1) * sizeof(LogSegment));
+    segCount--;
+    if (segCount == 0) tailSealed = true;
+    // checkpoint first so recovery never starts at a deleted segment
+    checkpoint();
+    char path[24];
+    segmentPath(index, path, sizeof(path));
+    storage.remove(path);
+    headerPath(index, path, sizeof(path));
+    storage.remove(path);
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "archive_record.h"
+#include "archive_codec.h"
+#include "log_storage.h"
+
+// Segmented append-only archive log.
+//
+// Every archived record is persisted with one append of a CRC-protected
+// slot to the current segment file. Every ARCHIVE_INDEX_STRIDE-th slot of a
+// segment (including the first) is a keyframe (raw record), the rest are
+// deltas (archive_codec.h), so every segment decodes on its own and a
+// typical slot is ~10 bytes. A slot whose payload is exactly one record long
+// is a keyframe; a delta that would not be shorter is written as one.
+//
+//   slot: u8 len | len bytes payload | u16 crc16(len + payload)
+//
+// The stride keyframes form a sparse seq/ts -> file offset index kept in
+// RAM (rebuilt by recover()), so a range read binary-searches the segment
+// table and then the keys and decodes at most one stride of records it
+// does not need.
+//
+// Segments hold a fixed number of slots; a full (or torn) segment is sealed
+// and the next append opens a new one. Sealing writes a small header file
+// next to the segment (seq/ts bounds, count, bytes, index keys), so
+// recover() attaches sealed segments without decoding them and only scans
+// the open tail and a partly consumed head. Segments whose records are all
+// consumed are reclaimed by deleting the file; when the log is full the
+// oldest segment is overwritten consumed or not, and the consumed seq moves
+// past it. A small checkpoint (head segment, consumed seq, seq reservation)
+// is written to one of two alternating slots so a torn checkpoint write
+// never loses the previous one.
+// The reservation lets the sequence counter survive a reboot without a
+// flash write per sample: seqs are handed out ARCHIVE_SEQ_RESERVE at a
+// time and numbering resumes after the last reserved one.
+//
+// The log is the source of truth for the archive and holds far more than
+// the RAM ring; readAfter() streams records back in order, readRange()
+// serves any seq range still on flash.
+//
+// Files: /arch_NNNNN.seg for segments, /arch_NNNNN.hdr for their headers,
+// /arch_ckpt0 and /arch_ckpt1.
+
+// records kept on flash, set at compile time (-DARCHIVE_LOG_CAPACITY=...)
+#ifndef ARCHIVE_LOG_CAPACITY
+#define ARCHIVE_LOG_CAPACITY 40000
+#endif
+#define ARCHIVE_SEGMENT_RECORDS 512
+// enough segments to hold ARCHIVE_LOG_CAPACITY records plus the partially filled tail
+#define ARCHIVE_LOG_MAX_SEGMENTS ((ARCHIVE_LOG_CAPACITY + ARCHIVE_SEGMENT_RECORDS - 1) / ARCHIVE_SEGMENT_RECORDS + 1)
+// len byte + keyframe + crc
+#define ARCHIVE_SLOT_MAX (1 + sizeof(ArchiveRecord) + 2)
+// slots between index keyframes
+#define ARCHIVE_INDEX_STRIDE 128
+#define ARCHIVE_INDEX_PER_SEGMENT ((ARCHIVE_SEGMENT_RECORDS + ARCHIVE_INDEX_STRIDE - 1) / ARCHIVE_INDEX_STRIDE)
+// seqs reserved per checkpoint write
+#define ARCHIVE_SEQ_RESERVE 256
+
+#pragma pack(push, 1)
+struct LogCheckpoint {
+    uint32_t magic;
+    uint32_t generation;  // higher wins when both slots are valid
+    uint32_t headSeg;     // oldest live segment index
+    uint32_t ackedSeq;    // records with seq <= ackedSeq are consumed
+    uint32_t seqReserve;  // no seq above this has been handed out
+    uint16_t crc;         // crc16 over the fields above
+};
+#pragma pack(pop)
+
+// sparse index entry: where a keyframe starts
+struct LogIndexKey {
+    uint32_t seq;
+    uint32_t ts;
+    uint16_t offset;      // byte offset of the slot in the segment file
+};
+
+struct LogSegment {
+    uint32_t index;
+    uint32_t firstSeq;
+    uint32_t lastSeq;     // an empty segment carries its predecessor's
+    uint32_t lastTs;      // so both stay sorted across the table
+    uint16_t count;
+    uint16_t unconsumed;  // records with seq > ackedSeq
+    uint16_t bytes;       // valid bytes in the file
+    uint8_t keyCount;
+    LogIndexKey keys[ARCHIVE_INDEX_PER_SEGMENT];
+};
+
+struct LogRecoveryStats {
+    uint32_t segments = 0;      // segment files found
+    uint32_t attached = 0;      // of those, taken from their header without a scan
+    uint32_t records = 0;       // valid, unconsumed records handed to the sink
+    uint32_t consumed = 0;      // valid records skipped because already consumed
+    uint32_t tornSegments = 0;  // segments that ended in a torn/corrupt slot
+    uint32_t bytes = 0;         // bytes of valid slots on flash
+};
+
+typedef void (*LogRecordSink)(const ArchiveRecord &rec, void *ctx);
+
+// position of a raw export, see ArchiveLog::seekRaw()
+struct LogRawCursor {
+    uint32_t segIndex = 0;    // segment file being read
+    uint32_t offset = 0;      // next byte in it
+    uint32_t lastSeq = 0;
+    bool done = false;
+};
+
+class ArchiveLog {
+public:
+    explicit ArchiveLog(LogStorage &storage) : storage(storage) {}
+
+    // Read the checkpoint and rebuild the segment table, passing every valid
+    // unconsumed record to sink in order. Each segment is trusted up to its
+    // first bad slot, so a torn write only costs the record being written.
+    // With a null sink sealed segments come from their headers and nothing
+    // is decoded there; records are then read on demand with readAfter().
+    LogRecoveryStats recover(LogRecordSink sink, void *ctx);
+
+    // persist one record with a single append
+    bool append(const ArchiveRecord &rec);
+
+    // copy up to max unconsumed records with seq > afterSeq into out, oldest
+    // first; returns how many were read
+    size_t readAfter(uint32_t afterSeq, ArchiveRecord *out, size_t max);
+
+    // copy up to max records with firstSeq <= seq <= lastSeq into out, oldest
+    // first, consumed or not, as long as they are still on flash
+    size_t readRange(uint32_t firstSeq, uint32_t lastSeq, ArchiveRecord *out, size_t max);
+
+    // Raw export: segments are copied as stored (slots, keyframes and
+    // deltas) without decoding anything. seekRaw() positions c on the
+    // keyframe at or before firstSeq; readRaw() then copies up to max bytes
+    // of the current segment into out, sets segIndex/offset to where they
+    // came from and moves c on. Whole segments are read up to the one
+    // holding lastSeq, consumed records included, so the reader drops
+    // records outside the range. A read at offset 0 or right after seekRaw()
+    // starts with a keyframe; returns 0 when the range is exhausted.
+    void seekRaw(LogRawCursor &c, uint32_t firstSeq, uint32_t lastSeq);
+    size_t readRaw(LogRawCursor &c, uint8_t *out, size_t max, uint32_t &segIndex, uint32_t &offset);
+
+    // seq of the oldest record on flash with ts >= ts, 0 if there is none.
+    // ts is ms since boot, so this assumes ts grows with seq; it does within
+    // one boot.
+    uint32_t seqAtOrAfterTs(uint32_t ts);
+
+    // the oldest n unconsumed records, ending at seq, are no longer needed;
+    // segments are charged by seq range, fully consumed ones are deleted
+    void markConsumed(uint32_t seq, uint32_t n);
+
+    // write head/consumed state to the next checkpoint slot
+    bool checkpoint();
+
+    // seq is about to be used; checkpoints a new reservation when it runs
+    // past the current one
+    void reserveSeq(uint32_t seq);
+    // first seq that is safe to hand out after recover()
+    uint32_t nextFreeSeq() const { return (reserved > lastSeq() ? reserved : lastSeq()) + 1; }
+
+    uint32_t ackedSeq() const { return acked; }
+    // highest seq ever seen by the log (appended, recovered or consumed)
+    uint32_t lastSeq() const { return maxSeq > acked ? maxSeq : acked; }
+    // records on flash not yet consumed
+    uint32_t pendingCount() const { return pending; }
+    // oldest record still on flash, consumed or not; 0 if there is none
+    uint32_t oldestSeq() const;
+    uint32_t segmentCount() const { return segCount; }
+
+private:
+    struct ScanResult {
+        uint16_t count = 0;
+        uint32_t bytes = 0;
+        bool torn = false;
+    };
+    struct SlotInfo {
+        uint32_t offset;          // of the slot in the segment file
+        bool keyframe;
+        const CodecState *state;  // decoder state after this slot
+    };
+    // visitor returns false to stop the scan early
+    typedef bool (*SlotVisitor)(const ArchiveRecord &rec, const SlotInfo &slot, void *ctx);
+
+    static bool recoverVisit(const ArchiveRecord &rec, const SlotInfo &slot, void *ctx);
+    static bool readVisit(const ArchiveRecord &rec, const SlotInfo &slot, void *ctx);
+    static bool tsVisit(const ArchiveRecord &rec, const SlotInfo &slot, void *ctx);
+
+    void segmentPath(uint32_t index, char *buf, size_t size) const;
+    void headerPath(uint32_t index, char *buf, size_t size) const;
+    bool readHeader(uint32_t index, LogSegment &seg);
+    // no more appends to the tail; persists its header
+    void sealTail();
+    uint32_t headSegment() const { return segCount ? segs[0].index : nextSegIndex; }
+    bool readCheckpoint(uint8_t slot, LogCheckpoint &cp);
+    // start must be the offset of a keyframe slot
+    ScanResult scanSegment(uint32_t index, uint32_t start, SlotVisitor visit, void *ctx);
+    // offset of the last index key with key field <= value (0 if none)
+    static uint16_t keyOffset(const LogSegment &seg, uint32_t value, bool byTs);
+    static void addKey(LogSegment &seg, const ArchiveRecord &rec, uint32_t offset);
+    void dropHeadSegment();
+
+    LogStorage &storage;
+    LogSegment segs[ARCHIVE_LOG_MAX_SEGMENTS];  // live segments, oldest first
+    uint32_t segCount = 0;
+    uint32_t nextSegIndex = 0;
+    bool tailSealed = true;     // next append opens a new segment
+    CodecState tailState;       // delta base for the next append
+    uint32_t acked = 0;
+    uint32_t maxSeq = 0;
+    uint32_t pending = 0;
+    uint32_t reserved = 0;
+    uint32_t generation = 0;
+    uint8_t chunk[256];         // scratch for segment reads
+};
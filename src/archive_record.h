@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "measurement.h"
+
+// records held in the RAM archive window, set at compile time
+// (-DMAX_BUFFER_SIZE=...); the full archive lives in the flash log
+#ifndef MAX_BUFFER_SIZE
+#define MAX_BUFFER_SIZE 256
+#endif
+
+// validity flags stored with every archived record
+#define REC_HAVE_SPS30 0x01
+#define REC_HAVE_SGP40 0x02
+#define REC_HAVE_SCD41 0x04
+#define REC_HAVE_MASK  0x07
+// samples held back before this one by change-only reporting (report_filter.h)
+#define REC_HELD_SHIFT 3
+#define REC_HELD_MASK  0xF8
+#define REC_HELD_MAX   31
+
+// Packed fixed-size archive record (21 bytes instead of a ~150 byte JSON String).
+// Temperature and humidity are kept as fixed point (hundredths) so the record
+// renders back to exactly the same values the live path sends
+// (payload_schema.h).
+#pragma pack(push, 1)
+struct ArchiveRecord {
+    uint32_t seq;       // packet sequence number
+    uint32_t ts;        // ms since boot
+    uint16_t co2;       // ppm
+    int16_t  temp;      // 0.01 °C
+    uint16_t rh;        // 0.01 %RH
+    uint16_t voc;       // SRAW_VOC ticks
+    uint16_t pm25;      // µg/m³
+    uint16_t pm10;      // µg/m³
+    uint8_t  flags;     // REC_HAVE_* | held << REC_HELD_SHIFT
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ArchiveRecord) == 21, "ArchiveRecord must stay packed");
+
+// round a float to hundredths, clamped to the target range
+inline int32_t toCenti(float v, int32_t lo, int32_t hi) {
+    float scaled = v * 100.0f;
+    int32_t c = (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+    if (c < lo) c = lo;
+    if (c > hi) c = hi;
+    return c;
+}
+
+inline ArchiveRecord makeArchiveRecord(const AirMeasurement &m, uint32_t seq) {
+    ArchiveRecord rec;
+    rec.seq = seq;
+    rec.ts = (uint32_t)m.ts;
+    rec.co2 = m.co2;
+    rec.temp = (int16_t)toCenti(m.temp, INT16_MIN, INT16_MAX);
+    rec.rh = (uint16_t)toCenti(m.rh, 0, UINT16_MAX);
+    rec.voc = m.srawVoc;
+    rec.pm25 = m.mc2p5;
+    rec.pm10 = m.mc10p0;
+    rec.flags = (m.haveSps30 ? REC_HAVE_SPS30 : 0) |
+                (m.haveSgp40 ? REC_HAVE_SGP40 : 0) |
+                (m.haveScd41 ? REC_HAVE_SCD41 : 0);
+    return rec;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "archive_record.h"
+
+// Batch frame used to drain the archive several records per notification.
+//
+//   offset  size  field
+//   0       1     frame type (BATCH_FRAME_TYPE)
+//   1       2     body length in bytes (everything after this field), LE
+//   3       4     seq of the first record, LE
+//   7       1     record count
+//   8       21*n  packed ArchiveRecord entries, oldest first
+//
+// JSON payloads always start with '{', so clients can tell the two apart
+// by the first byte.
+#define BATCH_FRAME_TYPE 0xB1
+#define BATCH_HEADER_SIZE 8
+// largest ATT payload allowed by the spec (MTU 517 - 3)
+#define BATCH_FRAME_MAX 514
+
+struct BatchFrameWriter {
+    uint8_t *buf = nullptr;
+    size_t cap = 0;
+    size_t len = 0;
+    uint8_t count = 0;
+
+    void begin(uint8_t *out, size_t capacity) {
+        buf = out;
+        cap = capacity;
+        len = BATCH_HEADER_SIZE;
+        count = 0;
+    }
+
+    // how many records fit in a frame of the given size
+    static size_t capacityFor(size_t frameSize) {
+        if (frameSize <= BATCH_HEADER_SIZE) return 0;
+        size_t n = (frameSize - BATCH_HEADER_SIZE) / sizeof(ArchiveRecord);
+        return n > 255 ? 255 : n;
+    }
+
+    bool add(const ArchiveRecord &rec) {
+        if (count == 255 || len + sizeof(ArchiveRecord) > cap) return false;
+        if (count == 0) {
+            buf[3] = (uint8_t)(rec.seq);
+            buf[4] = (uint8_t)(rec.seq >> 8);
+            buf[5] = (uint8_t)(rec.seq >> 16);
+            buf[6] = (uint8_t)(rec.seq >> 24);
+        }
+        memcpy(buf + len, &rec, sizeof(ArchiveRecord));
+        len += sizeof(ArchiveRecord);
+        count++;
+        return true;
+    }
+
+    // fill in type/length/count, returns total frame size
+    size_t finish(uint8_t type = BATCH_FRAME_TYPE) {
+        uint16_t body = (uint16_t)(len - 3);
+        buf[0] = type;
+        buf[1] = (uint8_t)(body);
+        buf[2] = (uint8_t)(body >> 8);
+        buf[7] = count;
+        return len;
+    }
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "measurement.h"
+#include "archive_record.h"
+
+// Connectionless broadcast: the newest measurement in the manufacturer
+// specific data of the advertisement, so any number of gateways and phones
+// can read it by scanning, without connecting. It is turned on by the
+// runtime config (runtime_config.h) or BROADCAST_ADV, updated once per
+// measurement cycle and keeps advertising, non-connectable, while a client
+// is connected; the GATT service works as before.
+//
+// Manufacturer data, little endian, packed:
+//
+//   u16 company id (BROADCAST_COMPANY_ID) | u8 format (BROADCAST_FORMAT)
+//   u16 seq                    +1 per update, wraps; a listener sees every
+//                              update several times, the seq tells repeats
+//                              from new ones and counts the ones it missed
+//   u8  flags                  REC_HAVE_*
+//   u16 pm1.0 | pm2.5 | pm4.0 | pm10      µg/m³
+//   u16 co2 ppm | i16 temp 0.01 °C | u16 rh 0.01 %RH
+//   u16 voc index (voc_index.h) | u16 SRAW_VOC ticks
+//
+// With the flags AD in front it takes 29 of the 31 legacy advertising
+// bytes; the service UUID moves to the scan response.
+
+// on at boot unless the stored config says otherwise
+#ifndef BROADCAST_ADV
+#define BROADCAST_ADV 0
+#endif
+
+// 0xFFFF is the Bluetooth SIG id for tests and unassigned use
+#ifndef BROADCAST_COMPANY_ID
+#define BROADCAST_COMPANY_ID 0xFFFF
+#endif
+#define BROADCAST_FORMAT 1
+// legacy advertising payload, and what the flags AD and the manufacturer
+// data AD header take of it
+#define ADV_PAYLOAD_MAX 31
+#define ADV_FLAGS_SIZE 3
+#define ADV_FIELD_HEADER_SIZE 2
+
+#pragma pack(push, 1)
+struct BroadcastPayload {
+    uint16_t company;
+    uint8_t format;
+    uint16_t seq;
+    uint8_t flags;
+    uint16_t pm1p0;
+    uint16_t pm2p5;
+    uint16_t pm4p0;
+    uint16_t pm10p0;
+    uint16_t co2;
+    int16_t temp;
+    uint16_t rh;
+    uint16_t vocIndex;
+    uint16_t voc;
+};
+#pragma pack(pop)
+
+#define BROADCAST_DATA_SIZE sizeof(BroadcastPayload)
+static_assert(sizeof(BroadcastPayload) == 24, "BroadcastPayload must stay packed");
+static_assert(ADV_FLAGS_SIZE + ADV_FIELD_HEADER_SIZE + sizeof(BroadcastPayload) <= ADV_PAYLOAD_MAX,
+              "BroadcastPayload does not fit the advertisement");
+
+inline void broadcastEncode(const AirMeasurement &m, uint16_t seq, BroadcastPayload &p) {
+    p.company = BROADCAST_COMPANY_ID;
+    p.format = BROADCAST_FORMAT;
+    p.seq = seq;
+    p.flags = (m.haveSps30 ? REC_HAVE_SPS30 : 0) |
+              (m.haveSgp40 ? REC_HAVE_SGP40 : 0) |
+              (m.haveScd41 ? REC_HAVE_SCD41 : 0);
+    p.pm1p0 = m.mc1p0;
+    p.pm2p5 = m.mc2p5;
+    p.pm4p0 = m.mc4p0;
+    p.pm10p0 = m.mc10p0;
+    p.co2 = m.co2;
+    p.temp = (int16_t)toCenti(m.temp, INT16_MIN, INT16_MAX);
+    p.rh = (uint16_t)toCenti(m.rh, 0, UINT16_MAX);
+    p.vocIndex = m.vocIndex;
+    p.voc = m.srawVoc;
+}
+
+// decode manufacturer data seen by a listener; false if it is not ours
+inline bool broadcastDecode(const uint8_t *data, size_t len, BroadcastPayload &p) {
+    if (!data || len != BROADCAST_DATA_SIZE) return false;
+    memcpy(&p, data, sizeof(p));
+    return p.company == BROADCAST_COMPANY_ID && p.format == BROADCAST_FORMAT;
+}
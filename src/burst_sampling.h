@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "batch_frame.h"
+
+// Burst sampling: ~1 Hz PM/VOC data for a bounded time, e.g. while tracing
+// an emission source. The client starts it with a control write (see
+// range_query.h for the other commands), little endian:
+//
+//   0x07 u16 seconds          burst for that long, capped at BURST_MAX_S;
+//                             a burst already running is extended or cut
+//                             short, 0 ends it at the next tick
+//
+// While it runs the SPS30 and SGP40 are read every BURST_TICK_MS, at their
+// own update rate, and a low-power SCD41 (SENSOR_LOW_POWER) is switched
+// to periodic mode (a sample every 5 s) and asked every tick. Within a tick
+// every sensor's command goes out first and each response is read back once
+// that sensor is done, so no sensor waits on the bus for another one's
+// execution time and there are no separate data-ready polls. The regular
+// read slots keep their cadence and take the newest burst reading.
+//
+// Every tick with a reading becomes one record in a RAM ring, streamed on
+// the data characteristic in batches, ahead of the backlog flush:
+//
+//   batch frame layout (batch_frame.h) with type BURST_FRAME_TYPE
+//
+// seq counts burst records since boot (a gap is a record dropped with the
+// ring full), ts is the start of the tick and the REC_HAVE_* flags mark the
+// sensors read in that tick; the other fields repeat their last reading.
+// The status characteristic reports the sustained readings per second.
+
+#define CONTROL_CMD_BURST 0x07
+#define BURST_CMD_SIZE 3
+#define BURST_FRAME_TYPE 0xB2
+#define BURST_MAX_S 1800
+#define BURST_TICK_MS 1000
+// records in the RAM ring (one slot stays free); four minutes at 1 Hz
+#ifndef BURST_RING_SIZE
+#define BURST_RING_SIZE 256
+#endif
+// the transport is woken to send once this many records are waiting
+#define BURST_BATCH_RECORDS 8
+// most records one burst frame can carry
+#define BURST_FRAME_RECORDS ((BATCH_FRAME_MAX - BATCH_HEADER_SIZE) / sizeof(ArchiveRecord))
+
+// decode a CONTROL_CMD_BURST write; false if it is malformed
+static inline bool burstParse(const uint8_t *data, size_t len, uint16_t &seconds) {
+    if (!data || len != BURST_CMD_SIZE || data[0] != CONTROL_CMD_BURST) return false;
+    seconds = (uint16_t)(data[1] | (data[2] << 8));
+    if (seconds > BURST_MAX_S) seconds = BURST_MAX_S;
+    return true;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+// Platform seams for the measurement pipeline.
+//
+// pipeline.cpp only talks to the outside world through these functions.
+// main.cpp implements them on the ESP32 (Sensirion drivers, BLE, SPIFFS,
+// millis()); sim/sim_platform.cpp implements them on Linux with simulated
+// sensors, a recording transport, file storage and a virtual clock.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "measurement.h"
+#include "log_storage.h"
+
+// --- clock ---
+// ms since boot (wraps like millis())
+uint32_t halMillis();
+// free-running counter for latency measurements (wraps); it must tick at a
+// constant halCyclesPerUs() per us, whatever the CPU clock does
+uint32_t halCycles();
+uint32_t halCyclesPerUs();
+
+// --- sensors ---
+// low-power sensor modes: SCD41 low-power periodic measurement (one sample
+// per 30 s), SGP40 heater off between samples, SPS30 asleep between samples
+// when the sample interval leaves room for its warm-up
+#ifndef SENSOR_LOW_POWER
+#define SENSOR_LOW_POWER 1
+#endif
+
+// read one sample into the sensor's fields of m; false if no new data
+bool halReadSps30(AirMeasurement &m);
+bool halReadSgp40(AirMeasurement &m);
+bool halReadScd41(AirMeasurement &m);
+// humidity and temperature the SGP40 compensates its next raw signals for,
+// as its command arguments (vocRhTicks()/vocTempTicks() in voc_index.h);
+// until the first call compensation is off (0x8000, 0x6666)
+void halSetSgp40Compensation(uint16_t rhTicks, uint16_t tTicks);
+
+// Startup, recovery and power steps. Each op is one I2C command, or the read
+// of a command issued earlier, and never waits: the caller gives the sensor
+// its execution time before the next op (step tables in pipeline.cpp).
+// false on a bus or CRC error, or a failed self-test.
+enum SensorOp : uint8_t {
+    SPS30_OP_WAKE = 0,       // wake-up (sent twice, the first only wakes the interface)
+    SPS30_OP_STOP,           // stop measurement, back to idle
+    SPS30_OP_SLEEP,          // idle -> sleep, fan off
+    SPS30_OP_SERIAL_CMD,
+    SPS30_OP_SERIAL_READ,    // logs the serial number
+    SPS30_OP_START,          // start measurement, uint16 output
+    SPS30_OP_READ_CMD,       // read measured values
+    SPS30_OP_READ_VALUES,    // its response (halSensorFetch())
+    SGP40_OP_SERIAL_CMD,
+    SGP40_OP_SERIAL_READ,
+    SGP40_OP_SELFTEST_CMD,
+    SGP40_OP_SELFTEST_READ,  // false unless the result is 0xD400
+    SGP40_OP_HEATER_OFF,
+    SGP40_OP_MEASURE_CMD,    // measure raw signal (30 ms heater pulse)
+    SGP40_OP_MEASURE_READ,   // its response (halSensorFetch())
+    SCD41_OP_WAKE,           // not acknowledged by the sensor, never fails
+    SCD41_OP_STOP,           // stop periodic measurement
+    SCD41_OP_REINIT,
+    SCD41_OP_SERIAL_CMD,
+    SCD41_OP_SERIAL_READ,
+    SCD41_OP_START,          // low-power periodic with SENSOR_LOW_POWER
+    SCD41_OP_START_FAST,     // periodic, one sample per 5 s (burst mode)
+    SCD41_OP_READ_CMD,       // read measurement
+    SCD41_OP_READ_VALUES,    // its response, NACKed until a new sample is ready (halSensorFetch())
+    SENSOR_OP_COUNT,
+};
+bool halSensorOp(SensorOp op);
+// read the response to a measurement command issued with halSensorOp()
+// (the *_READ_VALUES / *_MEASURE_READ ops) into the sensor's fields of m;
+// false on a bus or CRC error or when there is no new data
+bool halSensorFetch(SensorOp op, AirMeasurement &m);
+
+// --- transport ---
+// push one notification on the data characteristic; false if it didn't go
+// out. With confirm it is sent as an indication if the client enabled them
+// and returns whether the client confirmed it (blocks for the round trip).
+// Completion is also reported through pipelineNotifyDone().
+bool halNotify(const uint8_t *data, size_t len, bool confirm);
+// notifications the stack can queue right now, -1 if it doesn't say
+int halNotifyCredits();
+// largest notification payload for the current connection
+size_t halNotifyPayloadLimit();
+// update the read-only status characteristic
+void halSetStatus(const char *json, size_t len);
+// update the rolling statistics characteristic and notify a subscribed client
+void halPublishSummary(const uint8_t *data, size_t len);
+// update the config characteristic with the active block (runtime_config.h)
+void halSetConfig(const uint8_t *data, size_t len);
+// put data into the advertisement as manufacturer specific data, company
+// id first (broadcast.h), and keep advertising while a client is
+// connected; len 0 goes back to the plain connectable advertisement
+void halSetAdvertisement(const uint8_t *data, size_t len);
+
+// --- scheduling ---
+// the transport side has new work (queued measurement, link event, client
+// write); wakes it early from its sleep. Any task context.
+void halWakeTransport();
+// the acquisition side has new work (a config change); wakes it early
+void halWakeAcquire();
+
+// --- storage ---
+// backing store for the archive log
+LogStorage &halArchiveStorage();
+// the stored runtime config block (NVS on the ESP32); load is false unless
+// exactly len bytes were stored
+bool halConfigLoad(uint8_t *data, size_t len);
+bool halConfigSave(const uint8_t *data, size_t len);
+// the VOC index engine's checkpoint (voc_index.h), same rules
+bool halVocStateLoad(uint8_t *data, size_t len);
+bool halVocStateSave(const uint8_t *data, size_t len);
+
+// --- console ---
+// write one formatted log line (newline appended); only called from
+// logDrain(), see logging.h
+void halConsoleWrite(const char *line);
+// raw bytes on the same serial port, for the archive dump (serial_dump.h):
+// read returns what has arrived without waiting, write blocks until it is
+// queued. Arriving bytes should wake the transport (halWakeTransport()).
+size_t halSerialRead(uint8_t *buf, size_t max);
+void halSerialWrite(const uint8_t *data, size_t len);
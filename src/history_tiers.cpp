@@ -0,0 +1,232 @@
+#include "history_tiers.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "crc.h"
+
+#define TIER_SLOT_SIZE (sizeof(TierAggregate) + 2)
+// slots read from flash per storage call
+#define TIER_READ_SLOTS 5
+
+uint32_t HistoryTiers::bucketMs(uint8_t tier) {
+    return tier == TIER_5MIN ? 5 * 60 * 1000UL : 60 * 60 * 1000UL;
+}
+
+// one chunk short of the ring still has to hold the capacity
+uint16_t HistoryTiers::chunkSlots(uint8_t tier) {
+    uint32_t cap = tier == TIER_5MIN ? TIER_5MIN_CAPACITY : TIER_1H_CAPACITY;
+    return (uint16_t)((cap + TIER_CHUNKS - 2) / (TIER_CHUNKS - 1));
+}
+
+void HistoryTiers::chunkPath(uint8_t tier, uint8_t chunk, char *buf, size_t size) const {
+    snprintf(buf, size, "/tier%u_%02u.agg", (unsigned)tier, (unsigned)chunk);
+}
+
+static bool decodeSlot(const uint8_t *p, TierAggregate &agg) {
+    uint16_t crc = (uint16_t)(p[sizeof(TierAggregate)] | (p[sizeof(TierAggregate) + 1] << 8));
+    if (crc != crc16(p, sizeof(TierAggregate))) return false;
+    memcpy(&agg, p, sizeof(agg));
+    return agg.count > 0;
+}
+
+bool HistoryTiers::readSlot(uint8_t tier, uint8_t chunk, uint16_t slot, TierAggregate &agg) {
+    char path[24];
+    chunkPath(tier, chunk, path, sizeof(path));
+    uint8_t buf[TIER_SLOT_SIZE];
+    if (storage.readAt(path, (uint32_t)slot * TIER_SLOT_SIZE, buf, sizeof(buf)) != sizeof(buf)) return false;
+    return decodeSlot(buf, agg);
+}
+
+void HistoryTiers::findHead(uint8_t tier) {
+    Tier &t = tiers[tier];
+    int8_t newest = -1;
+    for (uint8_t c = 0; c < TIER_CHUNKS; c++) {
+        TierAggregate agg;
+        t.chunkFirstSeq[c] = readSlot(tier, c, 0, agg) ? agg.firstSeq : 0;
+        if (t.chunkFirstSeq[c] && (newest < 0 || t.chunkFirstSeq[c] > t.chunkFirstSeq[newest])) newest = (int8_t)c;
+    }
+    // nothing yet: the first append opens chunk 0
+    t.head = newest < 0 ? TIER_CHUNKS - 1 : (uint8_t)newest;
+    t.headCount = chunkSlots(tier);
+    if (newest < 0) return;
+
+    // slots only ever get appended, so the full slots form a prefix whose
+    // length a binary search over "is slot n there" finds
+    char path[24];
+    chunkPath(tier, t.head, path, sizeof(path));
+    uint8_t buf[TIER_SLOT_SIZE];
+    uint16_t lo = 1, hi = chunkSlots(tier);
+    while (lo < hi) {
+        uint16_t mid = (uint16_t)((lo + hi + 1) / 2);
+        if (storage.readAt(path, (uint32_t)(mid - 1) * TIER_SLOT_SIZE, buf, sizeof(buf)) == sizeof(buf)) lo = mid;
+        else hi = (uint16_t)(mid - 1);
+    }
+    // a torn last slot or a partial one behind it: leave the chunk as it is
+    TierAggregate agg;
+    bool torn = !readSlot(tier, t.head, (uint16_t)(lo - 1), agg) ||
+                storage.readAt(path, (uint32_t)lo * TIER_SLOT_SIZE, buf, 1) != 0;
+    if (!torn) t.headCount = lo;
+}
+
+void HistoryTiers::begin() {
+    for (uint8_t i = 0; i < TIER_COUNT; i++) {
+        memset(&tiers[i].open, 0, sizeof(tiers[i].open));
+        findHead(i);
+    }
+}
+
+void HistoryTiers::persist(uint8_t tier, const TierAggregate &agg) {
+    Tier &t = tiers[tier];
+    uint8_t slot[TIER_SLOT_SIZE];
+    memcpy(slot, &agg, sizeof(agg));
+    uint16_t crc = crc16(&agg, sizeof(agg));
+    slot[sizeof(agg)] = (uint8_t)crc;
+    slot[sizeof(agg) + 1] = (uint8_t)(crc >> 8);
+    char path[24];
+    if (t.headCount >= chunkSlots(tier)) {
+        // the oldest chunk makes room for a new one
+        t.head = (uint8_t)((t.head + 1) % TIER_CHUNKS);
+        chunkPath(tier, t.head, path, sizeof(path));
+        bool ok = storage.writeFile(path, slot, sizeof(slot));
+        t.chunkFirstSeq[t.head] = ok ? agg.firstSeq : 0;
+        t.headCount = ok ? 1 : chunkSlots(tier);
+        return;
+    }
+    chunkPath(tier, t.head, path, sizeof(path));
+    // a failed append may have left part of a slot, so the chunk is done
+    if (storage.append(path, slot, sizeof(slot))) t.headCount++;
+    else t.headCount = chunkSlots(tier);
+}
+
+void HistoryTiers::fold(Bucket &b, const Bucket &in) {
+    b.count += in.count;
+    for (uint8_t c = 0; c < TIER_CHANNELS; c++) {
+        b.sum[c] += in.sum[c];
+        if (in.min[c] < b.min[c]) b.min[c] = in.min[c];
+        if (in.max[c] > b.max[c]) b.max[c] = in.max[c];
+    }
+}
+
+void HistoryTiers::close(uint8_t tier) {
+    Bucket b = tiers[tier].open;
+    tiers[tier].open.count = 0;
+    TierAggregate agg;
+    agg.firstSeq = b.firstSeq;
+    agg.startTs = b.startTs;
+    agg.count = b.count > UINT16_MAX ? UINT16_MAX : (uint16_t)b.count;
+    int32_t n = (int32_t)b.count;
+    for (uint8_t c = 0; c < TIER_CHANNELS; c++) {
+        int32_t s = b.sum[c];
+        agg.mean[c] = (uint16_t)(s >= 0 ? (s + n / 2) / n : (s - n / 2) / n);
+        agg.min[c] = (uint16_t)b.min[c];
+        agg.max[c] = (uint16_t)b.max[c];
+    }
+    persist(tier, agg);
+    if (tier + 1 < TIER_COUNT) feed((uint8_t)(tier + 1), b);
+}
+
+void HistoryTiers::feed(uint8_t tier, const Bucket &in) {
+    Bucket &open = tiers[tier].open;
+    uint32_t len = bucketMs(tier);
+    uint32_t start = in.startTs - in.startTs % len;
+    if (open.count && start != open.startTs) close(tier);
+    if (open.count == 0) {
+        open = in;
+        open.startTs = start;
+        return;
+    }
+    fold(open, in);
+}
+
+void HistoryTiers::add(const ArchiveRecord &rec) {
+    Bucket s;
+    s.firstSeq = rec.seq;
+    s.startTs = rec.ts;
+    s.count = 1;
+    const int32_t v[TIER_CHANNELS] = {rec.co2, rec.temp, rec.rh, rec.voc, rec.pm25, rec.pm10};
+    for (uint8_t c = 0; c < TIER_CHANNELS; c++) {
+        s.sum[c] = v[c];
+        s.min[c] = v[c];
+        s.max[c] = v[c];
+    }
+    feed(TIER_5MIN, s);
+}
+
+bool HistoryTiers::seek(TierCursor &c, uint8_t tier, uint32_t firstSeq, uint32_t lastSeq) {
+    if (tier >= TIER_COUNT) return false;
+    const Tier &t = tiers[tier];
+    c = TierCursor();
+    c.tier = tier;
+    c.nextSeq = firstSeq;
+    c.lastSeq = lastSeq;
+    // chunks oldest first start after the head; begin at the newest chunk
+    // that starts at or before firstSeq, else at the oldest one
+    int8_t start = -1;
+    for (uint8_t k = 0; k < TIER_CHUNKS; k++) {
+        uint32_t first = t.chunkFirstSeq[(t.head + 1 + k) % TIER_CHUNKS];
+        if (first == 0) continue;
+        if (start < 0 || first <= firstSeq) start = (int8_t)k;
+        if (first > firstSeq) break;
+    }
+    if (start < 0) start = TIER_CHUNKS - 1;
+    c.chunk = (uint8_t)((t.head + 1 + start) % TIER_CHUNKS);
+    c.chunksLeft = (uint8_t)(TIER_CHUNKS - 1 - start);
+    return true;
+}
+
+size_t HistoryTiers::read(TierCursor &c, TierAggregate *out, size_t max) {
+    if (c.tier >= TIER_COUNT) return 0;
+    const Tier &t = tiers[c.tier];
+    uint8_t buf[TIER_READ_SLOTS * TIER_SLOT_SIZE];
+    char path[24];
+    size_t n = 0;
+    while (n < max && !c.done) {
+        uint16_t limit = c.chunk == t.head ? t.headCount : chunkSlots(c.tier);
+        if (t.chunkFirstSeq[c.chunk] == 0) limit = 0;
+        size_t got = 0;
+        if (c.slot < limit) {
+            uint16_t want = limit - c.slot < TIER_READ_SLOTS ? (uint16_t)(limit - c.slot) : TIER_READ_SLOTS;
+            chunkPath(c.tier, c.chunk, path, sizeof(path));
+            got = storage.readAt(path, (uint32_t)c.slot * TIER_SLOT_SIZE, buf, want * TIER_SLOT_SIZE) / TIER_SLOT_SIZE;
+        }
+        if (got == 0) {
+            // end of this chunk (or of its valid part), go on with the next
+            if (c.chunksLeft == 0) {
+                c.done = true;
+                break;
+            }
+            c.chunk = (uint8_t)((c.chunk + 1) % TIER_CHUNKS);
+            c.chunksLeft--;
+            c.slot = 0;
+            continue;
+        }
+        for (size_t i = 0; i < got && n < max; i++) {
+            TierAggregate agg;
+            c.slot++;
+            if (!decodeSlot(buf + i * TIER_SLOT_SIZE, agg)) {
+                c.slot = limit;
+                break;
+            }
+            // also skips what an overwritten chunk now holds out of order
+            if (agg.firstSeq < c.nextSeq) continue;
+            if (agg.firstSeq > c.lastSeq) {
+                c.done = true;
+                break;
+            }
+            out[n++] = agg;
+            c.nextSeq = agg.firstSeq + 1;
+        }
+    }
+    return n;
+}
+
+uint32_t HistoryTiers::count(uint8_t tier) const {
+    if (tier >= TIER_COUNT) return 0;
+    const Tier &t = tiers[tier];
+    uint32_t n = 0;
+    for (uint8_t c = 0; c < TIER_CHUNKS; c++) {
+        if (t.chunkFirstSeq[c] == 0) continue;
+        n += c == t.head ? t.headCount : chunkSlots(tier);
+    }
+    return n;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "archive_record.h"
+#include "log_storage.h"
+
+// Downsampled history tiers next to the full-resolution archive log.
+//
+// Every sample is folded into a 5 min bucket as it arrives; a closed 5 min
+// bucket is persisted and folded into the current 1 h bucket, which is
+// persisted when it closes. A bucket keeps count, sum, min and max per
+// channel, so rolling up never rescans anything. Buckets are aligned to
+// multiples of their length in ms since boot, so twelve 5 min buckets make
+// one hour; a ts that goes backwards (reboot) or jumps past the bucket
+// closes it early. The open buckets live in RAM only, a reboot loses at
+// most one bucket per tier.
+//
+// Each tier is a ring of TIER_CHUNKS chunk files of fixed-size CRC slots:
+//
+//   slot: TierAggregate | u16 crc16(aggregate)
+//
+// Appends go to the newest chunk; when it is full the oldest chunk is
+// replaced by a new one, so a tier holds between (TIER_CHUNKS - 1) and
+// TIER_CHUNKS chunks worth of buckets. begin() reads the first slot of
+// every chunk and finds the end of the newest one by probing, no chunk is
+// scanned. A chunk whose last append was torn is never appended to again.
+//
+// Files: /tierT_CC.agg (T = tier, CC = chunk).
+
+#define TIER_5MIN 0
+#define TIER_1H   1
+#define TIER_COUNT 2
+#define TIER_CHANNELS 6   // co2, temp, rh, voc, pm25, pm10 (StatsChannel order)
+
+// buckets kept per tier, set at compile time; the defaults cover 21 days
+// at 5 min and 180 days at 1 h in about 500 KB of flash
+#ifndef TIER_5MIN_CAPACITY
+#define TIER_5MIN_CAPACITY 6048
+#endif
+#ifndef TIER_1H_CAPACITY
+#define TIER_1H_CAPACITY 4320
+#endif
+#define TIER_CHUNKS 16
+
+// tier frame sent for tier requests (range_query.h), little endian:
+//   u8 TIER_FRAME_TYPE | u8 tier | u8 count | count x TierAggregate
+#define TIER_FRAME_TYPE 0xE1
+#define TIER_FRAME_HEADER_SIZE 3
+
+// one closed bucket, values in ArchiveRecord units (temp is signed)
+#pragma pack(push, 1)
+struct TierAggregate {
+    uint32_t firstSeq;    // first sample in the bucket
+    uint32_t startTs;     // bucket start, ms since boot
+    uint16_t count;       // samples in the bucket
+    uint16_t mean[TIER_CHANNELS];
+    uint16_t min[TIER_CHANNELS];
+    uint16_t max[TIER_CHANNELS];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(TierAggregate) == 46, "TierAggregate must stay packed");
+
+// read position inside a tier, see HistoryTiers::seek()
+struct TierCursor {
+    uint8_t tier = 0;
+    uint8_t chunk = 0;
+    uint8_t chunksLeft = 0;   // chunks after the current one still to read
+    uint16_t slot = 0;
+    uint32_t nextSeq = 0;     // aggregates with firstSeq < nextSeq are skipped
+    uint32_t lastSeq = 0;
+    bool done = false;
+};
+
+class HistoryTiers {
+public:
+    explicit HistoryTiers(LogStorage &storage) : storage(storage) {}
+
+    // find the chunk files of every tier
+    void begin();
+
+    // fold one sample into the open buckets, persisting any that close
+    void add(const ArchiveRecord &rec);
+
+    // position c on the oldest aggregate of tier with
+    // firstSeq <= aggregate.firstSeq <= lastSeq; false if tier is unknown
+    bool seek(TierCursor &c, uint8_t tier, uint32_t firstSeq, uint32_t lastSeq);
+    // copy up to max aggregates at c into out, oldest first, and move c on;
+    // returns how many were read, 0 when the range is exhausted
+    size_t read(TierCursor &c, TierAggregate *out, size_t max);
+
+    // aggregates on flash in tier (approximate after a torn chunk)
+    uint32_t count(uint8_t tier) const;
+
+    static uint32_t bucketMs(uint8_t tier);
+
+private:
+    struct Bucket {
+        uint32_t firstSeq;
+        uint32_t startTs;
+        uint32_t count;       // 0 = no open bucket
+        int32_t sum[TIER_CHANNELS];
+        int32_t min[TIER_CHANNELS];
+        int32_t max[TIER_CHANNELS];
+    };
+
+    struct Tier {
+        uint32_t chunkFirstSeq[TIER_CHUNKS];   // 0 = empty chunk
+        uint8_t head;         // newest chunk
+        uint16_t headCount;   // slots in the newest chunk
+        Bucket open;
+    };
+
+    static uint16_t chunkSlots(uint8_t tier);
+    void chunkPath(uint8_t tier, uint8_t chunk, char *buf, size_t size) const;
+    bool readSlot(uint8_t tier, uint8_t chunk, uint16_t slot, TierAggregate &agg);
+    void findHead(uint8_t tier);
+    void fold(Bucket &b, const Bucket &in);
+    // add a sample or a closed bucket of the tier below to tier
+    void feed(uint8_t tier, const Bucket &in);
+    void close(uint8_t tier);
+    void persist(uint8_t tier, const TierAggregate &agg);
+
+    LogStorage &storage;
+    Tier tiers[TIER_COUNT];
+};
@@ -0,0 +1,114 @@
+#include "latency_stats.h"
+
+#if LATENCY_STATS
+
+#include <atomic>
+
+// single writer per stage, so plain load + store instead of read-modify-write;
+// the atomics only keep a concurrent snapshot well defined
+struct StageStats {
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> min{0};
+    std::atomic<uint32_t> max{0};
+    std::atomic<uint16_t> buckets[LAT_BUCKETS];
+};
+
+static StageStats stages[LAT_STAGE_COUNT];
+static std::atomic<uint8_t> resetPending{0};
+
+uint8_t latencyBucketShift() {
+    static uint8_t shift = 0;
+    if (shift == 0) {
+        uint32_t perUs = halCyclesPerUs();
+        shift = (uint8_t)(LAT_BUCKET_SHIFT_US + (perUs > 1 ? 31 - __builtin_clz(perUs) : 0));
+    }
+    return shift;
+}
+
+uint32_t latencyTicksFromMs(uint32_t ms) {
+    uint64_t ticks = (uint64_t)ms * 1000 * halCyclesPerUs();
+    return ticks > UINT32_MAX ? UINT32_MAX : (uint32_t)ticks;
+}
+
+static uint8_t bucketFor(uint32_t cycles) {
+    uint8_t shift = latencyBucketShift();
+    if (cycles < (1UL << (shift + 1))) return 0;
+    int log2 = 31 - __builtin_clz(cycles);
+    int b = log2 - shift;
+    return b >= LAT_BUCKETS ? LAT_BUCKETS - 1 : (uint8_t)b;
+}
+
+void latencyRecord(LatencyStage stage, uint32_t cycles) {
+    StageStats &s = stages[stage];
+    uint32_t n = s.count.load(std::memory_order_relaxed);
+    if (n == 0 || cycles < s.min.load(std::memory_order_relaxed)) s.min.store(cycles, std::memory_order_relaxed);
+    if (cycles > s.max.load(std::memory_order_relaxed)) s.max.store(cycles, std::memory_order_relaxed);
+    std::atomic<uint16_t> &b = s.buckets[bucketFor(cycles)];
+    uint16_t v = b.load(std::memory_order_relaxed);
+    if (v == 0xFFFF) {
+        // halve the whole histogram so its shape survives long uptimes
+        for (auto &h : s.buckets) h.store(h.load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+        v = b.load(std::memory_order_relaxed);
+    }
+    b.store(v + 1, std::memory_order_relaxed);
+    s.count.store(n + 1, std::memory_order_relaxed);
+}
+
+void latencyPoll(uint8_t side) {
+    if (!(resetPending.load(std::memory_order_relaxed) & side)) return;
+    resetPending.fetch_and((uint8_t)~side, std::memory_order_relaxed);
+    uint8_t from = side == LAT_SIDE_ACQUIRE ? 0 : LAT_FIRST_TRANSPORT_STAGE;
+    uint8_t to = side == LAT_SIDE_ACQUIRE ? LAT_FIRST_TRANSPORT_STAGE : LAT_STAGE_COUNT;
+    for (uint8_t i = from; i < to; i++) {
+        StageStats &s = stages[i];
+        s.count.store(0, std::memory_order_relaxed);
+        s.min.store(0, std::memory_order_relaxed);
+        s.max.store(0, std::memory_order_relaxed);
+        for (auto &b : s.buckets) b.store(0, std::memory_order_relaxed);
+    }
+}
+
+void latencyRequestReset() {
+    resetPending.fetch_or(LAT_SIDE_ACQUIRE | LAT_SIDE_TRANSPORT, std::memory_order_relaxed);
+}
+
+void latencyRead(LatencyStage stage, LatencySummary &out) {
+    const StageStats &s = stages[stage];
+    out.count = s.count.load(std::memory_order_relaxed);
+    out.min = s.min.load(std::memory_order_relaxed);
+    out.max = s.max.load(std::memory_order_relaxed);
+    for (int i = 0; i < LAT_BUCKETS; i++) out.buckets[i] = s.buckets[i].load(std::memory_order_relaxed);
+}
+
+static uint8_t *putU16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *putU32(uint8_t *p, uint32_t v) {
+    p = putU16(p, (uint16_t)v);
+    return putU16(p, (uint16_t)(v >> 16));
+}
+
+size_t latencySnapshot(uint8_t *out, size_t cap) {
+    if (cap < LATENCY_BLOB_SIZE) return 0;
+    uint8_t *p = out;
+    *p++ = LATENCY_BLOB_VERSION;
+    *p++ = LAT_STAGE_COUNT;
+    *p++ = LAT_BUCKETS;
+    *p++ = latencyBucketShift();
+    p = putU16(p, (uint16_t)halCyclesPerUs());
+    p = putU16(p, 0);
+    for (uint8_t i = 0; i < LAT_STAGE_COUNT; i++) {
+        LatencySummary s;
+        latencyRead((LatencyStage)i, s);
+        p = putU32(p, s.count);
+        p = putU32(p, s.min);
+        p = putU32(p, s.max);
+        for (int b = 0; b < LAT_BUCKETS; b++) p = putU16(p, s.buckets[b]);
+    }
+    return p - out;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+
+// Latency histograms for the pipeline hot path.
+//
+// Every stage keeps count/min/max and a log2 histogram of its duration in
+// halCycles() ticks, halCyclesPerUs() of them per us. Each stage is written by exactly one side of
+// the pipeline; a snapshot may be taken from any thread. Build with
+// -DLATENCY_STATS=0 to compile every probe, the storage and the BLE
+// diagnostics characteristic out.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef LATENCY_STATS
+#define LATENCY_STATS 1
+#endif
+
+enum LatencyStage : uint8_t {
+    // acquisition side
+    LAT_READ_SPS30 = 0,
+    LAT_READ_SGP40,
+    LAT_READ_SCD41,
+    LAT_DIAG_SPS30,
+    LAT_DIAG_SGP40,
+    LAT_DIAG_SCD41,
+    // transport side
+    LAT_PAYLOAD,       // JSON payload / batch frame build
+    LAT_SEND,          // one notification
+    LAT_FLUSH_STEP,    // processFlushStep()
+    LAT_ARCHIVE,       // log append / checkpoint
+    LAT_WAKE_LATE,     // transport wake-up after its earliest deadline
+    LAT_STAGE_COUNT
+};
+#define LAT_FIRST_TRANSPORT_STAGE LAT_PAYLOAD
+
+// which side of the pipeline owns (writes) a stage
+#define LAT_SIDE_ACQUIRE    0x01
+#define LAT_SIDE_TRANSPORT  0x02
+
+// bucket 0: < 2^(s+1) ticks, bucket i: [2^(s+i), 2^(s+i+1)), last: open
+// ended, with s = latencyBucketShift(): LAT_BUCKET_SHIFT_US plus log2 of the
+// ticks per us, so bucket 0 is ~16 us whatever the clock (2^11 cycles at
+// 240 MHz, 2^4 ticks of a us timer)
+#define LAT_BUCKETS         16
+#define LAT_BUCKET_SHIFT_US 3
+
+// snapshot blob, little endian:
+//   u8 version | u8 stages | u8 buckets | u8 bucketShift | u16 cyclesPerUs | u16 reserved
+//   per stage: u32 count | u32 min | u32 max | u16 bucket[LAT_BUCKETS]
+// buckets are halved together when one would overflow, so they give the
+// distribution; count is exact
+#define LATENCY_BLOB_VERSION     1
+#define LATENCY_BLOB_HEADER      8
+#define LATENCY_BLOB_STAGE       (12 + 2 * LAT_BUCKETS)
+#define LATENCY_BLOB_SIZE        (LATENCY_BLOB_HEADER + LAT_STAGE_COUNT * LATENCY_BLOB_STAGE)
+// reset command written to the diagnostics characteristic
+#define LATENCY_CMD_RESET        0x01
+
+// a GATT attribute value is at most 512 bytes
+static_assert(LATENCY_BLOB_SIZE <= 512, "latency blob does not fit one characteristic");
+
+struct LatencySummary {
+    uint32_t count = 0;
+    uint32_t min = 0;
+    uint32_t max = 0;
+    uint16_t buckets[LAT_BUCKETS] = {0};
+};
+
+#if LATENCY_STATS
+
+#include "hal.h"
+
+void latencyRecord(LatencyStage stage, uint32_t cycles);
+// a duration measured with halMillis() in ticks, saturated at UINT32_MAX
+uint32_t latencyTicksFromMs(uint32_t ms);
+uint8_t latencyBucketShift();
+// clear the stages owned by this side if a reset was requested; call at
+// the start of each iteration of that side
+void latencyPoll(uint8_t side);
+// ask both sides to clear their stages (any thread)
+void latencyRequestReset();
+void latencyRead(LatencyStage stage, LatencySummary &out);
+// serialize all stages, returns bytes written (0 if cap is too small)
+size_t latencySnapshot(uint8_t *out, size_t cap);
+
+// records the lifetime of the enclosing block
+class LatencyScope {
+public:
+    explicit LatencyScope(LatencyStage stage) : stage(stage), start(halCycles()) {}
+    ~LatencyScope() { latencyRecord(stage, halCycles() - start); }
+
+private:
+    LatencyStage stage;
+    uint32_t start;
+};
+
+#define LATENCY_SCOPE(stage) LatencyScope latencyScope_(stage)
+
+#else
+
+inline void latencyRecord(LatencyStage, uint32_t) {}
+inline void latencyPoll(uint8_t) {}
+inline void latencyRequestReset() {}
+inline void latencyRead(LatencyStage, LatencySummary &) {}
+inline size_t latencySnapshot(uint8_t *, size_t) { return 0; }
+
+#define LATENCY_SCOPE(stage) ((void)0)
+
+#endif
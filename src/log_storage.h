@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Minimal file interface used by the archive log so it can run on SPIFFS
+// on the device and on plain files on a Linux host.
+class LogStorage {
+public:
+    virtual ~LogStorage() {}
+    // append len bytes to the end of path (creating it if needed)
+    virtual bool append(const char *path, const void *data, size_t len) = 0;
+    // replace the whole content of path
+    virtual bool writeFile(const char *path, const void *data, size_t len) = 0;
+    // read up to len bytes starting at offset, returns bytes read (0 if missing)
+    virtual size_t readAt(const char *path, uint32_t offset, void *buf, size_t len) = 0;
+    virtual bool exists(const char *path) = 0;
+    virtual bool remove(const char *path) = 0;
+};
@@ -0,0 +1,132 @@
+#include "logging.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "spsc_queue.h"
+
+// log sites run on several tasks, so producers take a try-lock around the
+// push; a busy lock counts as a drop instead of waiting
+static SpscQueue<LogEntry, LOG_RING_SIZE> ring;
+static std::atomic_flag pushLock = ATOMIC_FLAG_INIT;
+static std::atomic<uint32_t> dropped{0};
+static uint32_t droppedReported = 0;
+
+void LogEntry::add(const char *s) {
+    types[argc] = LOG_ARG_STR;
+    args[argc++].u = strUsed;
+    if (!s) s = "(null)";
+    size_t room = sizeof(str) - strUsed;
+    if (room == 0) return;  // offset == size reads back as ""
+    size_t n = strlen(s);
+    if (n >= room) n = room - 1;
+    memcpy(str + strUsed, s, n);
+    str[strUsed + n] = '\0';
+    strUsed += n + 1;
+}
+
+void logPush(const LogEntry &e) {
+    if (pushLock.test_and_set(std::memory_order_acquire)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    bool ok = ring.push(e);
+    pushLock.clear(std::memory_order_release);
+    if (!ok) dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t logDropped() {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+// printf for one entry: each conversion is rendered on its own with the
+// stored argument, so the entry never has to rebuild a va_list
+static void formatEntry(const LogEntry &e, char *out, size_t cap) {
+    size_t len = 0;
+    uint8_t arg = 0;
+    const char *p = e.fmt;
+    while (*p && len + 1 < cap) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+        // %[flags][width][.precision][length]conversion
+        char spec[16];
+        size_t s = 0;
+        spec[s++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && s < sizeof(spec) - 3) spec[s++] = *p++;
+        while (*p && strchr("hlLzjt", *p)) p++;  // the stored width is fixed
+        char conv = *p;
+        if (!conv) break;
+        p++;
+        int n = 0;
+        size_t room = cap - len;
+        if (arg >= e.argc) {
+            n = snprintf(out + len, room, "?");
+        } else {
+            uint8_t type = e.types[arg];
+            uint32_t raw = e.args[arg].u;
+            arg++;
+            switch (conv) {
+            case 'd': case 'i':
+                spec[s++] = 'l';
+                spec[s++] = conv;
+                spec[s] = '\0';
+                n = snprintf(out + len, room, spec, type == LOG_ARG_INT ? (long)(int32_t)raw : (long)raw);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                spec[s++] = 'l';
+                spec[s++] = conv;
+                spec[s] = '\0';
+                n = snprintf(out + len, room, spec, (unsigned long)raw);
+                break;
+            case 'c':
+                spec[s++] = 'c';
+                spec[s] = '\0';
+                n = snprintf(out + len, room, spec, (int)raw);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                spec[s++] = conv;
+                spec[s] = '\0';
+                n = snprintf(out + len, room, spec, type == LOG_ARG_FLOAT ? (double)e.args[arg - 1].f : (double)raw);
+                break;
+            case 's':
+                spec[s++] = 's';
+                spec[s] = '\0';
+                n = snprintf(out + len, room, spec,
+                             type == LOG_ARG_STR && raw < sizeof(e.str) ? e.str + raw : "");
+                break;
+            default:
+                n = snprintf(out + len, room, "?");
+                break;
+            }
+        }
+        if (n < 0) break;
+        len += (size_t)n < room ? (size_t)n : room - 1;
+    }
+    out[len] = '\0';
+}
+
+size_t logDrain(size_t max) {
+    char line[LOG_LINE_MAX];
+    uint32_t lost = dropped.load(std::memory_order_relaxed);
+    if (lost != droppedReported) {
+        snprintf(line, sizeof(line), "log: %lu records dropped", (unsigned long)(lost - droppedReported));
+        droppedReported = lost;
+        halConsoleWrite(line);
+    }
+    size_t n = 0;
+    LogEntry e;
+    while (n < max && ring.pop(e)) {
+        formatEntry(e, line, sizeof(line));
+        halConsoleWrite(line);
+        n++;
+    }
+    return n;
+}
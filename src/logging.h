@@ -0,0 +1,124 @@
+#pragma once
+
+// Compile-time log levels with deferred formatting.
+//
+// LOG_ERROR/WARN/INFO/DEBUG(fmt, ...) above LOG_LEVEL compile to nothing.
+// Enabled ones copy the format pointer and the raw arguments into a small
+// entry in a RAM ring; logDrain(), called from a low-priority context,
+// formats the entries and writes them with halConsoleWrite(). A log site
+// never waits for the console: when the ring is full the entry is dropped
+// and counted.
+//
+// Rules for log sites: fmt must be a string literal (only its pointer is
+// kept), at most LOG_MAX_ARGS arguments, integers are stored as 32 bits,
+// %s arguments are copied (LOG_STRING_BYTES shared per entry, truncated).
+// Width/precision/flags work, '*' does not.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// entries in the ring, power of two
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 32
+#endif
+#define LOG_MAX_ARGS      8
+#define LOG_STRING_BYTES  128
+// longest formatted line
+#define LOG_LINE_MAX      256
+
+enum LogArgType : uint8_t {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_FLOAT,
+    LOG_ARG_STR,     // value is the offset into LogEntry::str
+};
+
+struct LogEntry {
+    const char *fmt;
+    uint8_t level;
+    uint8_t argc;
+    uint8_t strUsed;
+    uint8_t types[LOG_MAX_ARGS];
+    union {
+        int32_t i;
+        uint32_t u;
+        float f;
+    } args[LOG_MAX_ARGS];
+    char str[LOG_STRING_BYTES];
+
+    void add(int v) { addInt(v); }
+    void add(long v) { addInt((int32_t)v); }
+    void add(long long v) { addInt((int32_t)v); }
+    void add(unsigned v) { addUint(v); }
+    void add(unsigned long v) { addUint((uint32_t)v); }
+    void add(unsigned long long v) { addUint((uint32_t)v); }
+    void add(double v) {
+        types[argc] = LOG_ARG_FLOAT;
+        args[argc++].f = (float)v;
+    }
+    void add(const char *s);
+
+private:
+    void addInt(int32_t v) {
+        types[argc] = LOG_ARG_INT;
+        args[argc++].i = v;
+    }
+    void addUint(uint32_t v) {
+        types[argc] = LOG_ARG_UINT;
+        args[argc++].u = v;
+    }
+};
+
+// hand a filled entry to the ring (any thread, never blocks)
+void logPush(const LogEntry &e);
+// format and write up to max queued entries; call from one thread only
+size_t logDrain(size_t max = LOG_RING_SIZE);
+// entries lost because the ring was full or busy
+uint32_t logDropped();
+
+template <typename... Args>
+inline void logWrite(uint8_t level, const char *fmt, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    LogEntry e;
+    e.fmt = fmt;
+    e.level = level;
+    e.argc = 0;
+    e.strUsed = 0;
+    int expand[] = {0, (e.add(args), 0)...};
+    (void)expand;
+    logPush(e);
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
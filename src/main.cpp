@@ -6,7 +6,19 @@
     #include <BLEDevice.h>  // Main library BLE
     #include <BLEServer.h>  // Library for creating Server
     #include <BLEUtils.h>   // Tools helpers
+    #include <BLE2902.h>    // client characteristic configuration descriptor
+    #include "esp_gap_ble_api.h"
     #include <SPIFFS.h>
+    #include <Preferences.h>  // NVS, keeps the runtime config and the VOC checkpoint
+    #include "hal.h"
+    #include "pipeline.h"
+    #include "storage_spiffs.h"
+    #include "batch_frame.h"
+    #include "broadcast.h"
+    #include "latency_stats.h"
+    #include "logging.h"
+    #include "esp_pm.h"
+    #include "esp_timer.h"
 
     // macro definitions
     // make sure that we use the proper definition of NO_ERROR
@@ -17,348 +29,394 @@
     #define SERVICE_UUID        "50106842-26c7-4e08-a41e-dda4319c2fc5"
     #define CHARACTERISTIC_UUID "2c5d2e0b-51ae-470e-8a4a-657207292a04"
     #define STATUS_UUID         "9f1d2e0b-51ae-470e-8a4a-657207292a05"
-    
-    // Circular buffer for offline archiving (500 last samples)
-    #define MAX_BUFFER_SIZE 500
-    #define ARCHIVE_PATH "/archive.log"
-    
-    // Circular buffer structure
-    struct CircularBuffer {
-        String samples[MAX_BUFFER_SIZE];
-        uint32_t head = 0;     // write position
-        uint32_t count = 0;    // number of stored samples (0 to MAX_BUFFER_SIZE)
-        
-        void add(const String &payload) {
-            samples[head] = payload;
-            head = (head + 1) % MAX_BUFFER_SIZE;
-            if (count < MAX_BUFFER_SIZE) {
-                count++;
-            }
-        }
-        
-        void flush() {
-            if (count == 0) return;
-            // write all samples to file
-            SPIFFS.remove(ARCHIVE_PATH);
-            File f = SPIFFS.open(ARCHIVE_PATH, FILE_WRITE);
-            if (!f) return;
-            
-            uint32_t pos = (head - count + MAX_BUFFER_SIZE) % MAX_BUFFER_SIZE;
-            for (uint32_t i = 0; i < count; i++) {
-                f.println(samples[pos]);
-                pos = (pos + 1) % MAX_BUFFER_SIZE;
-            }
-            f.close();
-            Serial.println("Buffer flushed to SPIFFS");
-        }
-        
-        void clear() {
-            head = 0;
-            count = 0;
-        }
-        
-        // peek at oldest sample without removing
-        String peekFront() const {
-            if (count == 0) return String();
-            uint32_t pos = (head + MAX_BUFFER_SIZE - count) % MAX_BUFFER_SIZE;
-            return samples[pos];
-        }
+    #define DIAG_UUID           "9f1d2e0b-51ae-470e-8a4a-657207292a06"
+    #define SUMMARY_UUID        "9f1d2e0b-51ae-470e-8a4a-657207292a07"
+    #define CONTROL_UUID        "9f1d2e0b-51ae-470e-8a4a-657207292a08"
+    #define ACK_UUID            "9f1d2e0b-51ae-470e-8a4a-657207292a09"
+    #define CONFIG_UUID         "9f1d2e0b-51ae-470e-8a4a-657207292a0a"
+    #define DEVICE_NAME         "MojCzujnikPowietrza"
+
+    // let the idle task put the chip into light sleep between deadlines; the
+    // BLE controller keeps the connection through its own sleep clock
+    #ifndef LIGHT_SLEEP
+    #define LIGHT_SLEEP 1
+    #endif
 
-        // remove and return oldest sample
-        String popFront() {
-            if (count == 0) return String();
-            uint32_t pos = (head + MAX_BUFFER_SIZE - count) % MAX_BUFFER_SIZE;
-            String s = samples[pos];
-            // optional: clear stored String to free memory
-            samples[pos] = String();
-            count--;
-            return s;
-        }
-    };
-    
-    static CircularBuffer archiveBuffer;
+    // console and archive dump share the port; 921600 bd moves the whole
+    // archive in seconds, most USB serial bridges keep up
+    #ifndef SERIAL_BAUD
+    #define SERIAL_BAUD 921600
+    #endif
+    #define SERIAL_TX_BUFFER 4096
 
-    // Packet sequence counter (for tracking)
-    static uint32_t packetSeq = 0;
+    // advertising interval with the broadcast on (broadcast.h); scanners pick
+    // up each update a few times over a measurement interval. Non-connectable
+    // advertising can't go below 100 ms.
+    #ifndef BROADCAST_INTERVAL_MS
+    #define BROADCAST_INTERVAL_MS 1000
+    #endif
+
+    // run acquisition and transport as two FreeRTOS tasks (0 = both from loop())
+    #ifndef PIPELINE_TASKS
+    #define PIPELINE_TASKS 1
+    #endif
+    // sensors on the app core, transport next to the BLE host on the protocol core
+    #define ACQUIRE_TASK_CORE     1
+    #define TRANSPORT_TASK_CORE   0
+    #define ACQUIRE_TASK_STACK    6144
+    #define TRANSPORT_TASK_STACK  6144
+    // the log drain only runs when nothing else wants the CPU
+    #define LOG_TASK_CORE         1
+    #define LOG_TASK_STACK        4096
+    #define LOG_TASK_PRIORITY     0
+    // the log task polls faster while lines are coming in and backs off to this
+    #define LOG_TASK_IDLE_MAX_MS  640
 
     BLECharacteristic *pCharacteristic;
     BLECharacteristic *pStatusCharacteristic; // read-only status
-    static bool deviceConnected = false;
+    BLECharacteristic *pSummaryCharacteristic = nullptr; // rolling statistics (rolling_stats.h)
     // global advertising pointer so we can restart advertising after disconnect
     BLEAdvertising *pAdvertising = nullptr;
+    // server pointer so the flush can query the negotiated MTU
+    BLEServer *pBleServer = nullptr;
+    // the advertisement carries a measurement (halSetAdvertisement())
+    static volatile bool broadcasting = false;
+    static volatile bool bleConnected = false;
+
+    // (re)start advertising: connectable while nobody is connected, and with
+    // the broadcast on also during a connection, non-connectable so a second
+    // central can't take the link
+    static void startAdvertising() {
+        if (!pAdvertising) return;
+        bool connected = bleConnected;
+        if (connected && !broadcasting) return;
+        pAdvertising->stop();
+        pAdvertising->setAdvertisementType(connected ? ADV_TYPE_NONCONN_IND : ADV_TYPE_IND);
+        pAdvertising->start();
+    }
+
+    #if LATENCY_STATS
+    // diagnostics characteristic: read returns the latency blob (latency_stats.h),
+    // writing LATENCY_CMD_RESET clears it
+    BLECharacteristic *pDiagCharacteristic = nullptr;
+
+    class DiagCallbacks : public BLECharacteristicCallbacks {
+        void onRead(BLECharacteristic *c) override {
+            static uint8_t blob[LATENCY_BLOB_SIZE];
+            size_t n = latencySnapshot(blob, sizeof(blob));
+            c->setValue(blob, n);
+        }
+        void onWrite(BLECharacteristic *c) override {
+            if (c->getLength() >= 1 && c->getData()[0] == LATENCY_CMD_RESET) latencyRequestReset();
+        }
+    };
+    #endif
 
-    // BLE notify throttle
-    static unsigned long lastNotifyTs = 0;
-    const unsigned long NOTIFY_INTERVAL_MS = 100; // 100ms between notifies (~10/sec)
+    // control characteristic: range requests (range_query.h), answered on the
+    // data characteristic
+    BLECharacteristic *pControlCharacteristic = nullptr;
 
-    // Flushing state (non-blocking flush)
-    static bool flushing = false;
-    static uint32_t flushPos = 0; // position index for incremental flush
+    class ControlCallbacks : public BLECharacteristicCallbacks {
+        void onWrite(BLECharacteristic *c) override {
+            pipelineControl(c->getData(), c->getLength());
+        }
+    };
 
-    // Sensor recovery timestamps
-    static unsigned long lastSuccessSps30 = 0;
-    static unsigned long lastSuccessSgp40 = 0;
-    static unsigned long lastSuccessScd41 = 0;
-    const unsigned long SENSOR_RECOVERY_TIMEOUT = 2 * 60 * 1000UL; // 2 minutes
+    // config characteristic: the runtime config block (runtime_config.h);
+    // reads return the active config, writes replace it
+    BLECharacteristic *pConfigCharacteristic = nullptr;
 
-    // status update interval
-    unsigned long lastStatusUpdate = 0;
-    const unsigned long STATUS_UPDATE_INTERVAL = 10000; // 10s
+    class ConfigCallbacks : public BLECharacteristicCallbacks {
+        void onWrite(BLECharacteristic *c) override {
+            pipelineConfigure(c->getData(), c->getLength());
+        }
+    };
 
-    // forward declarations
-    void flushArchive();
-    void loadArchiveFromDisk();
-    void startFlushArchive();
-    void processFlushStep();
+    // ack characteristic: the client writes its highest contiguous seq, u32 LE
+    BLECharacteristic *pAckCharacteristic = nullptr;
+
+    class AckCallbacks : public BLECharacteristicCallbacks {
+        void onWrite(BLECharacteristic *c) override {
+            if (c->getLength() != 4) return;
+            const uint8_t *d = c->getData();
+            pipelineAck((uint32_t)d[0] | ((uint32_t)d[1] << 8) | ((uint32_t)d[2] << 16) | ((uint32_t)d[3] << 24));
+        }
+    };
+
+    // data characteristic: the client enables notifications or indications
+    // through its CCCD; completions drive the notify pacing (notify_pacer.h)
+    BLE2902 *pDataCccd = nullptr;
+    // set while halNotify() waits for an indication to be confirmed
+    static volatile bool indicatePending = false;
+    static volatile bool indicateOk = false;
+
+    class DataCallbacks : public BLECharacteristicCallbacks {
+        void onStatus(BLECharacteristic *c, Status s, uint32_t code) override {
+            if (indicatePending) {
+                // halNotify() reports the outcome of its own indication
+                indicateOk = s == SUCCESS_INDICATE;
+                if (indicateOk) pipelineNotifyDone(true);
+                return;
+            }
+            if (s == SUCCESS_NOTIFY) pipelineNotifyDone(true);
+            else if (s == ERROR_GATT) pipelineNotifyDone(false);
+        }
+    };
+
+    // archive log storage on the SPIFFS partition
+    static SpiffsLogStorage archiveStorage;
 
     class MyServerCallbacks : public BLEServerCallbacks {
         void onConnect(BLEServer* pServer) override {
-            deviceConnected = true;
-            // start non-blocking flush of archived data when a client connects
-            startFlushArchive();
+            bleConnected = true;
+            // the pipeline starts a non-blocking flush of archived data
+            pipelineSetConnected(true);
+            // the stack stops advertising on connect; listeners keep the broadcast
+            if (broadcasting) startAdvertising();
         }
         void onDisconnect(BLEServer* pServer) override {
-            deviceConnected = false;
+            bleConnected = false;
+            pipelineSetConnected(false);
             // restart advertising so the device is visible again after a disconnect
             if (pAdvertising) {
-                pAdvertising->start();
-                Serial.println("Advertising restarted after disconnect");
+                startAdvertising();
+                LOG_INFO("Advertising restarted after disconnect");
             }
         }
     };
 
-    // send via BLE characteristic if connected
-    bool sendDataNow(const String &payload) {
+    // --- hal.h implementation for the ESP32 ---
+    uint32_t halMillis() {
+        return millis();
+    }
+
+    // with light sleep the power manager scales the CPU clock (40-240 MHz),
+    // so the cycle counter is no time base; the esp_timer counts us
+    uint32_t halCycles() {
+    #if LIGHT_SLEEP
+        return (uint32_t)esp_timer_get_time();
+    #else
+        return ESP.getCycleCount();
+    #endif
+    }
+
+    uint32_t halCyclesPerUs() {
+    #if LIGHT_SLEEP
+        return 1;
+    #else
+        return getCpuFrequencyMhz();
+    #endif
+    }
+
+    bool halNotify(const uint8_t *data, size_t len, bool confirm) {
         if (!pCharacteristic) return false;
-        if (!deviceConnected) return false;
-        unsigned long now = millis();
-        if (now - lastNotifyTs < NOTIFY_INTERVAL_MS) {
-            // too soon to notify again, caller should retry later
-            return false;
+        pCharacteristic->setValue((uint8_t*)data, len);
+        if (confirm && pDataCccd && pDataCccd->getIndications()) {
+            // indicate() blocks until the client confirms or it times out
+            indicatePending = true;
+            indicateOk = false;
+            pCharacteristic->indicate();
+            indicatePending = false;
+            return indicateOk;
         }
-        // print payload to serial so we can see what is being sent over BLE
-        Serial.print("Sending via BLE: ");
-        Serial.println(payload);
-        pCharacteristic->setValue((uint8_t*)payload.c_str(), payload.length());
         pCharacteristic->notify();
-        lastNotifyTs = now;
         return true;
     }
 
-    // Load archived data from disk into buffer on startup
-    void loadArchiveFromDisk() {
-        if (!SPIFFS.exists(ARCHIVE_PATH)) {
-            Serial.println("No archive file to load");
-            return;
-        }
-        File f = SPIFFS.open(ARCHIVE_PATH, FILE_READ);
-        if (!f) {
-            Serial.println("Failed to open archive");
-            return;
-        }
-        uint32_t loaded = 0;
-        while (f.available() && archiveBuffer.count < MAX_BUFFER_SIZE) {
-            String line = f.readStringUntil('\n');
-            line.trim();
-            if (line.length() > 0) {
-                archiveBuffer.add(line);
-                loaded++;
-            }
-        }
-        f.close();
-        Serial.print("Loaded ");
-        Serial.print(loaded);
-        Serial.println(" samples from disk");
+    int halNotifyCredits() {
+        if (!pBleServer) return -1;
+        return esp_ble_get_cur_sendable_packets_num(pBleServer->getConnId());
     }
 
-    // Save buffer to disk immediately (used when we cannot send right now)
-    void flushArchive() {
-        archiveBuffer.flush();
+    // the measurement goes in the advertisement, the service UUID (16 bytes
+    // more than fit next to it) and the name in the scan response
+    void halSetAdvertisement(const uint8_t *data, size_t len) {
+        if (!pAdvertising) return;
+        bool was = broadcasting;
+        BLEAdvertisementData adv;
+        BLEAdvertisementData scan;
+        adv.setFlags(ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT);
+        if (len > 0) {
+            adv.setManufacturerData(std::string((const char*)data, len));
+            scan.setCompleteServices(BLEUUID(SERVICE_UUID));
+            scan.setName(DEVICE_NAME);
+        } else {
+            adv.setCompleteServices(BLEUUID(SERVICE_UUID));
+        }
+        pAdvertising->setAdvertisementData(adv);
+        pAdvertising->setScanResponseData(scan);
+        broadcasting = len > 0;
+        if (broadcasting == was) return;
+        // units of 0.625 ms; off goes back to the stack's defaults
+        uint16_t units = broadcasting ? BROADCAST_INTERVAL_MS * 8 / 5 : 0x20;
+        pAdvertising->setMinInterval(units);
+        pAdvertising->setMaxInterval(broadcasting ? units : 0x40);
+        if (bleConnected && !broadcasting) pAdvertising->stop();
+        else startAdvertising();
     }
 
-    // Start non-blocking flush: initialize position pointer
-    void startFlushArchive() {
-        if (archiveBuffer.count == 0) {
-            Serial.println("Nothing to flush (buffer empty)");
-            return;
-        }
-        flushPos = (archiveBuffer.head + MAX_BUFFER_SIZE - archiveBuffer.count) % MAX_BUFFER_SIZE;
-        flushing = true;
-        Serial.print("Starting non-blocking flush of ");
-        Serial.print(archiveBuffer.count);
-        Serial.println(" samples");
-    }
-
-    // Called periodically from loop() to send one archived sample at a time
-    void processFlushStep() {
-        if (!flushing) return;
-        if (archiveBuffer.count == 0) {
-            Serial.println("Flush complete (buffer empty)");
-            flushing = false;
-            SPIFFS.remove(ARCHIVE_PATH);
-            return;
-        }
-        if (!deviceConnected) {
-            Serial.println("Client disconnected during flush, saving buffer to disk");
-            archiveBuffer.flush();
-            flushing = false;
-            return;
+    // largest notification payload for the current connection (ATT MTU - 3)
+    size_t halNotifyPayloadLimit() {
+        uint16_t mtu = 23;  // default ATT MTU before any exchange
+        if (pBleServer) {
+            uint16_t peer = pBleServer->getPeerMTU(pBleServer->getConnId());
+            if (peer > mtu) mtu = peer;
         }
+        return mtu - 3;
+    }
 
-        // peek oldest sample and try to send once
-        String &sample = archiveBuffer.samples[flushPos];
-        if (sample.length() == 0) {
-            // shouldn't happen but be robust
-            archiveBuffer.popFront();
-            flushPos = (flushPos + 1) % MAX_BUFFER_SIZE;
-            return;
-        }
+    void halSetStatus(const char *json, size_t len) {
+        if (pStatusCharacteristic) pStatusCharacteristic->setValue((uint8_t*)json, len);
+    }
 
-        bool ok = sendDataNow(sample);
-        if (ok) {
-            // remove the sent sample
-            archiveBuffer.popFront();
-            // flushPos already points to oldest; after popFront oldest is next pos
-            flushPos = (flushPos) % MAX_BUFFER_SIZE; // remain correct
-            // continue next iteration (but we only do one per loop call)
-        } else {
-            // send failed - likely throttled; try again later
-            // do not remove sample; just return and try next loop
-            return;
-        }
+    void halPublishSummary(const uint8_t *data, size_t len) {
+        if (!pSummaryCharacteristic) return;
+        pSummaryCharacteristic->setValue((uint8_t*)data, len);
+        if (pipelineConnected()) pSummaryCharacteristic->notify();
     }
 
+    void halSetConfig(const uint8_t *data, size_t len) {
+        if (pConfigCharacteristic) pConfigCharacteristic->setValue((uint8_t*)data, len);
+    }
 
-    SensirionI2cSps30 sps30;
-    SensirionI2CSgp40 sgp40;
-    SensirionI2cScd4x scd41;
+    // the config block and the VOC checkpoint live in NVS, away from the
+    // SPIFFS archive
+    static bool nvsLoad(const char *key, uint8_t *data, size_t len) {
+        Preferences prefs;
+        if (!prefs.begin("aqs", true)) return false;
+        bool ok = prefs.getBytesLength(key) == len && prefs.getBytes(key, data, len) == len;
+        prefs.end();
+        return ok;
+    }
 
-    static char errorMessage_sps30[64];
-    static int16_t error_sps30;
+    static bool nvsSave(const char *key, const uint8_t *data, size_t len) {
+        Preferences prefs;
+        if (!prefs.begin("aqs", false)) return false;
+        bool ok = prefs.putBytes(key, data, len) == len;
+        prefs.end();
+        return ok;
+    }
 
-    static char errorMessage_scd41[64];
-    static int16_t error_scd41;
+    bool halConfigLoad(uint8_t *data, size_t len) {
+        return nvsLoad("cfg", data, len);
+    }
 
-    // --- Timing variables for non-blocking sensor reads ---
-    unsigned long lastReadSps30 = 0;
-    unsigned long lastReadSgp40 = 0;
-    unsigned long lastReadScd41 = 0;
-    const unsigned long INTERVAL_SPS30 = 30000;   // 30 seconds
-    const unsigned long INTERVAL_SGP40 = 30000;   // 30 seconds
-    const unsigned long INTERVAL_SCD41 = 30000;   // 30 seconds
+    bool halConfigSave(const uint8_t *data, size_t len) {
+        return nvsSave("cfg", data, len);
+    }
 
-    void PrintUint64(uint64_t& value) {
-    Serial.print("0x");
-    Serial.print((uint32_t)(value >> 32), HEX);
-    Serial.print((uint32_t)(value & 0xFFFFFFFF), HEX);
-}
+    bool halVocStateLoad(uint8_t *data, size_t len) {
+        return nvsLoad("voc", data, len);
+    }
 
-    // --- Diagnostics and read helpers for each sensor ---
-    // consolidated data structure for a full measurement
-    struct AirMeasurement {
-        // SPS30
-        uint16_t mc1p0 = 0;
-        uint16_t mc2p5 = 0;
-        uint16_t mc4p0 = 0;
-        uint16_t mc10p0 = 0;
-        // optional number concentrations
-        uint16_t nc0p5 = 0;
-        uint16_t nc1p0 = 0;
-        uint16_t nc2p5 = 0;
-        uint16_t nc4p0 = 0;
-        uint16_t nc10p0 = 0;
-        uint16_t typicalParticleSize = 0;
-        bool haveSps30 = false;
+    bool halVocStateSave(const uint8_t *data, size_t len) {
+        return nvsSave("voc", data, len);
+    }
 
-        // SGP40
-        uint16_t srawVoc = 0;
-        bool haveSgp40 = false;
+    LogStorage &halArchiveStorage() {
+        return archiveStorage;
+    }
 
-        // SCD41
-        uint16_t co2 = 0;
-        float temp = 0.0f;
-        float rh = 0.0f;
-        bool haveScd41 = false;
+    void halConsoleWrite(const char *line) {
+        Serial.println(line);
+    }
 
-        // timestamp for the combined payload (ms since boot)
-        unsigned long ts = 0;
-    };
+    size_t halSerialRead(uint8_t *buf, size_t max) {
+        int n = Serial.available();
+        if (n <= 0) return 0;
+        return Serial.read(buf, (size_t)n < max ? (size_t)n : max);
+    }
 
-    static AirMeasurement latestMeasurement;
-    void diagSgp40() {
-        uint16_t error_sgp40 = 0;
-        char errorMessage_sgp40[128];
-        uint16_t serialNumber_sgp40[3] = {0};
+    void halSerialWrite(const uint8_t *data, size_t len) {
+        Serial.write(data, len);
+    }
 
-        error_sgp40 = sgp40.getSerialNumber(serialNumber_sgp40, 3);
-        if (error_sgp40) {
-            Serial.print("SGP40 getSerialNumber error: ");
-            errorToString(error_sgp40, errorMessage_sgp40, sizeof errorMessage_sgp40);
-            Serial.println(errorMessage_sgp40);
-        } else {
-            Serial.print("SGP40 SerialNumber: 0x");
-            for (size_t i = 0; i < 3; i++) {
-                uint16_t value = serialNumber_sgp40[i];
-                if (value < 4096) Serial.print("0");
-                if (value < 256) Serial.print("0");
-                if (value < 16) Serial.print("0");
-                Serial.print(value, HEX);
+    // formats queued log entries and writes them to Serial
+    static void logTask(void *) {
+        uint32_t idleMs = 20;
+        for (;;) {
+            // lines wait while an archive dump owns the port
+            if (!pipelineSerialBusy() && logDrain() > 0) {
+                idleMs = 20;
+                continue;
             }
-            Serial.println();
+            vTaskDelay(pdMS_TO_TICKS(idleMs));
+            if (idleMs < LOG_TASK_IDLE_MAX_MS) idleMs *= 2;
         }
+    }
 
-        uint16_t testResult_sgp40 = 0;
-        error_sgp40 = sgp40.executeSelfTest(testResult_sgp40);
-        if (error_sgp40) {
-            Serial.print("SGP40 executeSelfTest error: ");
-            errorToString(error_sgp40, errorMessage_sgp40, sizeof errorMessage_sgp40);
-            Serial.println(errorMessage_sgp40);
-        } else if (testResult_sgp40 != 0xD400) {
-            Serial.print("SGP40 self-test failed, result: 0x");
-            Serial.println(testResult_sgp40, HEX);
+    // task that runs the transport side (or everything, without PIPELINE_TASKS)
+    static TaskHandle_t transportWaiter = nullptr;
+
+    void halWakeTransport() {
+        if (transportWaiter) xTaskNotifyGive(transportWaiter);
+    }
+
+    #if PIPELINE_TASKS
+    static TaskHandle_t acquireWaiter = nullptr;
+
+    void halWakeAcquire() {
+        if (acquireWaiter) xTaskNotifyGive(acquireWaiter);
+    }
+
+    static void acquireTask(void *) {
+        for (;;) {
+            uint32_t wait = pipelineAcquire();
+            // sleeps until the next read or until halWakeAcquire()
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait) > 0 ? pdMS_TO_TICKS(wait) : 1);
+        }
+    }
+
+    static void transportTask(void *) {
+        for (;;) {
+            uint32_t wait = pipelineTransport();
+            // sleeps until the next deadline or until halWakeTransport()
+            if (wait > 0) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
         }
     }
+    #else
+    // one loop runs both sides
+    void halWakeAcquire() {
+        halWakeTransport();
+    }
+    #endif
+
+    SensirionI2cSps30 sps30;
+    SensirionI2CSgp40 sgp40;
+    SensirionI2cScd4x scd41;
+
+    // SGP40 compensation arguments; the defaults turn it off
+    static uint16_t sgp40RhTicks = 0x8000;
+    static uint16_t sgp40TTicks = 0x6666;
+
+    void halSetSgp40Compensation(uint16_t rhTicks, uint16_t tTicks) {
+        sgp40RhTicks = rhTicks;
+        sgp40TTicks = tTicks;
+    }
 
-    void readSgp40() {
+    // --- Diagnostics and read helpers for each sensor ---
+    bool halReadSgp40(AirMeasurement &m) {
         uint16_t error_sgp40 = 0;
         char errorMessage_sgp40[128];
-        const uint16_t defaultRh = 0x8000; // disable humidity compensation
-        const uint16_t defaultT  = 0x6666; // disable temperature compensation
         uint16_t srawVoc = 0;
 
-        error_sgp40 = sgp40.measureRawSignal(defaultRh, defaultT, srawVoc);
+        error_sgp40 = sgp40.measureRawSignal(sgp40RhTicks, sgp40TTicks, srawVoc);
         if (error_sgp40) {
-            Serial.print("SGP40 measureRawSignal error: ");
             errorToString(error_sgp40, errorMessage_sgp40, sizeof errorMessage_sgp40);
-            Serial.println(errorMessage_sgp40);
-            latestMeasurement.haveSgp40 = false;
-            return;
+            LOG_WARN("SGP40 measureRawSignal error: %s", errorMessage_sgp40);
+            return false;
         }
-        Serial.print("SRAW_VOC: ");
-        Serial.println(srawVoc);
-        // store reading in latestMeasurement (no sending here)
-        latestMeasurement.srawVoc = srawVoc;
-        latestMeasurement.haveSgp40 = true;
-        latestMeasurement.ts = millis();
-        lastSuccessSgp40 = millis();
-    }
-
-    void diagSps30() {
-        // Use existing global sps30 object to read metadata and start measurement
-        sps30.stopMeasurement();
-        int8_t serialNumber_sps30[32] = {0};
-        int8_t productType_sps30[8] = {0};
-        sps30.readSerialNumber(serialNumber_sps30, 32);
-        Serial.print("SPS30 serialNumber: ");
-        Serial.println((const char*)serialNumber_sps30);
-        sps30.readProductType(productType_sps30, 8);
-        Serial.print("SPS30 productType: ");
-        Serial.println((const char*)productType_sps30);
-        sps30.startMeasurement(SPS30_OUTPUT_FORMAT_OUTPUT_FORMAT_UINT16);
-        delay(100);
-    }
-
-    void readSps30() {
+        LOG_DEBUG("SRAW_VOC: %u", srawVoc);
+    #if SENSOR_LOW_POWER
+        // the heater stays on after a measurement until told otherwise
+        sgp40.turnHeaterOff();
+    #endif
+        // store reading in m (no sending here)
+        m.srawVoc = srawVoc;
+        return true;
+    }
+
+    bool halReadSps30(AirMeasurement &m) {
         uint16_t dataReadyFlag = 0;
         uint16_t mc1p0 = 0, mc2p5 = 0, mc4p0 = 0, mc10p0 = 0;
         uint16_t nc0p5 = 0, nc1p0 = 0, nc2p5 = 0, nc4p0 = 0, nc10p0 = 0;
@@ -366,95 +424,42 @@
         char errorMessage[64];
         int16_t error = sps30.readDataReadyFlag(dataReadyFlag);
         if (error != NO_ERROR) {
-            Serial.print("SPS30 readDataReadyFlag error: ");
             errorToString(error, errorMessage, sizeof errorMessage);
-            Serial.println(errorMessage);
-            return;
+            LOG_WARN("SPS30 readDataReadyFlag error: %s", errorMessage);
+            return false;
+        }
+        if (!dataReadyFlag) {
+            LOG_DEBUG("SPS30 data not ready, skipping read");
+            return false;
         }
-        Serial.print("SPS30 dataReadyFlag: "); Serial.println(dataReadyFlag);
 
         error = sps30.readMeasurementValuesUint16(mc1p0, mc2p5, mc4p0, mc10p0,
                                                    nc0p5, nc1p0, nc2p5, nc4p0,
                                                    nc10p0, typicalParticleSize);
         if (error != NO_ERROR) {
-            Serial.print("SPS30 readMeasurementValuesUint16 error: ");
             errorToString(error, errorMessage, sizeof errorMessage);
-            Serial.println(errorMessage);
-            return;
-        }
-
-    Serial.print("mc1p0: "); Serial.print(mc1p0); Serial.print("\t");
-        Serial.print("mc2p5: "); Serial.print(mc2p5); Serial.print("\t");
-        Serial.print("mc4p0: "); Serial.print(mc4p0); Serial.print("\t");
-        Serial.print("mc10p0: "); Serial.print(mc10p0); Serial.print("\t");
-        Serial.print("nc0p5: "); Serial.print(nc0p5); Serial.print("\t");
-        Serial.print("nc1p0: "); Serial.print(nc1p0); Serial.print("\t");
-        Serial.print("nc2p5: "); Serial.print(nc2p5); Serial.print("\t");
-        Serial.print("nc4p0: "); Serial.print(nc4p0); Serial.print("\t");
-        Serial.print("nc10p0: "); Serial.print(nc10p0); Serial.print("\t");
-        Serial.print("typicalParticleSize: "); Serial.print(typicalParticleSize);
-        Serial.println();
-        // store SPS30 readings into latestMeasurement (do not send individually)
-        latestMeasurement.mc1p0 = mc1p0;
-        latestMeasurement.mc2p5 = mc2p5;
-        latestMeasurement.mc4p0 = mc4p0;
-        latestMeasurement.mc10p0 = mc10p0;
-        latestMeasurement.nc0p5 = nc0p5;
-        latestMeasurement.nc1p0 = nc1p0;
-        latestMeasurement.nc2p5 = nc2p5;
-        latestMeasurement.nc4p0 = nc4p0;
-        latestMeasurement.nc10p0 = nc10p0;
-        latestMeasurement.typicalParticleSize = typicalParticleSize;
-        latestMeasurement.haveSps30 = true;
-        latestMeasurement.ts = millis();
-        lastSuccessSps30 = millis();
-    }
-
-    void diagScd41() {
-        uint16_t error_scd41 = 0;
-        char errorMessage_scd41[128];
-        uint64_t serialNumber_scd41 = 0;
-
-        delay(30);
-        // Ensure sensor is in clean state
-        error_scd41 = scd41.wakeUp();
-        if (error_scd41 != NO_ERROR) {
-            Serial.print("SCD41 wakeUp error: ");
-            errorToString(error_scd41, errorMessage_scd41, sizeof errorMessage_scd41);
-            Serial.println(errorMessage_scd41);
-        }
-        error_scd41 = scd41.stopPeriodicMeasurement();
-        if (error_scd41 != NO_ERROR) {
-            Serial.print("SCD41 stopPeriodicMeasurement error: ");
-            errorToString(error_scd41, errorMessage_scd41, sizeof errorMessage_scd41);
-            Serial.println(errorMessage_scd41);
-        }
-        error_scd41 = scd41.reinit();
-        if (error_scd41 != NO_ERROR) {
-            Serial.print("SCD41 reinit error: ");
-            errorToString(error_scd41, errorMessage_scd41, sizeof errorMessage_scd41);
-            Serial.println(errorMessage_scd41);
-        }
-
-        error_scd41 = scd41.getSerialNumber(serialNumber_scd41);
-        if (error_scd41 != NO_ERROR) {
-            Serial.print("SCD41 getSerialNumber error: ");
-            errorToString(error_scd41, errorMessage_scd41, sizeof errorMessage_scd41);
-            Serial.println(errorMessage_scd41);
-            return;
+            LOG_WARN("SPS30 readMeasurementValuesUint16 error: %s", errorMessage);
+            return false;
         }
-        Serial.print("SCD41 serial number: "); PrintUint64(serialNumber_scd41); Serial.println();
 
-        error_scd41 = scd41.startPeriodicMeasurement();
-        if (error_scd41 != NO_ERROR) {
-            Serial.print("SCD41 startPeriodicMeasurement error: ");
-            errorToString(error_scd41, errorMessage_scd41, sizeof errorMessage_scd41);
-            Serial.println(errorMessage_scd41);
-            return;
-        }
+        LOG_DEBUG("mc1p0: %u\tmc2p5: %u\tmc4p0: %u\tmc10p0: %u", mc1p0, mc2p5, mc4p0, mc10p0);
+        LOG_DEBUG("nc0p5: %u\tnc1p0: %u\tnc2p5: %u\tnc4p0: %u\tnc10p0: %u\ttypicalParticleSize: %u",
+                  nc0p5, nc1p0, nc2p5, nc4p0, nc10p0, typicalParticleSize);
+        // store SPS30 readings into m (do not send individually)
+        m.mc1p0 = mc1p0;
+        m.mc2p5 = mc2p5;
+        m.mc4p0 = mc4p0;
+        m.mc10p0 = mc10p0;
+        m.nc0p5 = nc0p5;
+        m.nc1p0 = nc1p0;
+        m.nc2p5 = nc2p5;
+        m.nc4p0 = nc4p0;
+        m.nc10p0 = nc10p0;
+        m.typicalParticleSize = typicalParticleSize;
+        return true;
     }
 
-    void readScd41() {
+    bool halReadScd41(AirMeasurement &m) {
         uint16_t error_scd41 = 0;
         char errorMessage_scd41[128];
         bool dataReady = false;
@@ -465,62 +470,216 @@
         // Check data ready status (non-blocking)
         error_scd41 = scd41.getDataReadyStatus(dataReady);
         if (error_scd41 != NO_ERROR) {
-            Serial.print("SCD41 getDataReadyStatus error: ");
             errorToString(error_scd41, errorMessage_scd41, sizeof errorMessage_scd41);
-            Serial.println(errorMessage_scd41);
-            return;
+            LOG_WARN("SCD41 getDataReadyStatus error: %s", errorMessage_scd41);
+            return false;
         }
 
         // Only read if data is ready
         if (!dataReady) {
-            Serial.println("SCD41 data not ready, skipping read");
-            return;
+            LOG_DEBUG("SCD41 data not ready, skipping read");
+            return false;
         }
 
         error_scd41 = scd41.readMeasurement(co2, temp, rh);
         if (error_scd41 != NO_ERROR) {
-            Serial.print("SCD41 readMeasurement error: ");
             errorToString(error_scd41, errorMessage_scd41, sizeof errorMessage_scd41);
-            Serial.println(errorMessage_scd41);
-            return;
+            LOG_WARN("SCD41 readMeasurement error: %s", errorMessage_scd41);
+            return false;
         }
 
-        Serial.print("CO2 concentration [ppm]: "); Serial.println(co2);
-        Serial.print("Temperature [°C]: "); Serial.println(temp);
-        Serial.print("Relative Humidity [RH]: "); Serial.println(rh);
-        // store reading in latestMeasurement (no sending here)
-        latestMeasurement.co2 = co2;
-        latestMeasurement.temp = temp;
-        latestMeasurement.rh = rh;
-        latestMeasurement.haveScd41 = true;
-        latestMeasurement.ts = millis();
-        lastSuccessScd41 = millis();
+        LOG_DEBUG("CO2 concentration [ppm]: %u", co2);
+        LOG_DEBUG("Temperature [°C]: %.2f", temp);
+        LOG_DEBUG("Relative Humidity [RH]: %.2f", rh);
+        // store reading in m (no sending here)
+        m.co2 = co2;
+        m.temp = temp;
+        m.rh = rh;
+        return true;
     }
 
-    void setup() {
+    // --- sensor startup/recovery ops (hal.h) ---
+    // Raw Sensirion I2C framing instead of the driver calls, which sleep for
+    // the command execution time inside every call: 16-bit command, then
+    // 16-bit words each followed by a CRC-8. The pipeline waits between ops.
+    #define SGP40_I2C_ADDR 0x59
 
-        Serial.begin(115200);
-        while (!Serial) {
-            delay(100);
+    static uint8_t sensirionCrc(const uint8_t *data, size_t len) {
+        uint8_t crc = 0xFF;
+        for (size_t i = 0; i < len; i++) {
+            crc ^= data[i];
+            for (int b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
         }
+        return crc;
+    }
 
-        // init SPIFFS for archive
-        if (!SPIFFS.begin(true)) {
-            Serial.println("SPIFFS Mount Failed");
-        } else {
-            Serial.println("SPIFFS initialized, loading archive...");
-            loadArchiveFromDisk();
+    // command with count argument words; false if not acknowledged
+    static bool sensirionCommand(uint8_t addr, uint16_t cmd, const uint16_t *args = nullptr, size_t count = 0) {
+        Wire.beginTransmission(addr);
+        Wire.write((uint8_t)(cmd >> 8));
+        Wire.write((uint8_t)cmd);
+        for (size_t i = 0; i < count; i++) {
+            uint8_t word[2] = {(uint8_t)(args[i] >> 8), (uint8_t)args[i]};
+            Wire.write(word, 2);
+            Wire.write(sensirionCrc(word, 2));
+        }
+        return Wire.endTransmission() == 0;
+    }
+
+    // read the response of the last command; false on a short read or bad CRC
+    static bool sensirionRead(uint8_t addr, uint16_t *words, size_t count) {
+        size_t len = count * 3;
+        if (Wire.requestFrom(addr, (uint8_t)len) != len) return false;
+        for (size_t i = 0; i < count; i++) {
+            uint8_t b[3];
+            for (int j = 0; j < 3; j++) b[j] = (uint8_t)Wire.read();
+            if (sensirionCrc(b, 2) != b[2]) return false;
+            words[i] = (uint16_t)((b[0] << 8) | b[1]);
         }
+        return true;
+    }
 
-        Wire.begin();
-        sps30.begin(Wire, SPS30_I2C_ADDR_69);
-        sgp40.begin(Wire);
-        scd41.begin(Wire, SCD41_I2C_ADDR_62);
+    static void logSerial(const char *name, const uint16_t *words, size_t count) {
+        char hex[4 * 16 + 1];
+        size_t n = 0;
+        for (size_t i = 0; i < count && i < 16; i++) n += snprintf(hex + n, sizeof(hex) - n, "%04X", words[i]);
+        LOG_INFO("%s serial number: 0x%s", name, hex);
+    }
+
+    bool halSensorOp(SensorOp op) {
+        uint16_t words[16];
+        switch (op) {
+        case SPS30_OP_WAKE:
+            // the first write only wakes the interface and is not acknowledged
+            sensirionCommand(SPS30_I2C_ADDR_69, 0x1103);
+            return sensirionCommand(SPS30_I2C_ADDR_69, 0x1103);
+        case SPS30_OP_STOP:
+            return sensirionCommand(SPS30_I2C_ADDR_69, 0x0104);
+        case SPS30_OP_SLEEP:
+            return sensirionCommand(SPS30_I2C_ADDR_69, 0x1001);
+        case SPS30_OP_SERIAL_CMD:
+            return sensirionCommand(SPS30_I2C_ADDR_69, 0xD033);
+        case SPS30_OP_SERIAL_READ: {
+            // 32 ASCII characters, two per word
+            if (!sensirionRead(SPS30_I2C_ADDR_69, words, 16)) return false;
+            char serial[33];
+            for (int i = 0; i < 16; i++) {
+                serial[2 * i] = (char)(words[i] >> 8);
+                serial[2 * i + 1] = (char)words[i];
+            }
+            serial[32] = 0;
+            LOG_INFO("SPS30 serial number: %s", serial);
+            return true;
+        }
+        case SPS30_OP_START: {
+            const uint16_t format = 0x0500;  // uint16 output
+            return sensirionCommand(SPS30_I2C_ADDR_69, 0x0010, &format, 1);
+        }
+        case SPS30_OP_READ_CMD:
+            return sensirionCommand(SPS30_I2C_ADDR_69, 0x0300);
+        case SGP40_OP_SERIAL_CMD:
+            return sensirionCommand(SGP40_I2C_ADDR, 0x3682);
+        case SGP40_OP_SERIAL_READ:
+            if (!sensirionRead(SGP40_I2C_ADDR, words, 3)) return false;
+            logSerial("SGP40", words, 3);
+            return true;
+        case SGP40_OP_SELFTEST_CMD:
+            return sensirionCommand(SGP40_I2C_ADDR, 0x280E);
+        case SGP40_OP_SELFTEST_READ:
+            if (!sensirionRead(SGP40_I2C_ADDR, words, 1)) return false;
+            if (words[0] != 0xD400) {
+                LOG_WARN("SGP40 self-test failed, result: 0x%X", words[0]);
+                return false;
+            }
+            return true;
+        case SGP40_OP_HEATER_OFF:
+            return sensirionCommand(SGP40_I2C_ADDR, 0x3615);
+        case SGP40_OP_MEASURE_CMD: {
+            // compensated like halReadSgp40()
+            const uint16_t args[2] = {sgp40RhTicks, sgp40TTicks};
+            return sensirionCommand(SGP40_I2C_ADDR, 0x260F, args, 2);
+        }
+        case SCD41_OP_WAKE:
+            sensirionCommand(SCD41_I2C_ADDR_62, 0x36F6);
+            return true;
+        case SCD41_OP_STOP:
+            return sensirionCommand(SCD41_I2C_ADDR_62, 0x3F86);
+        case SCD41_OP_REINIT:
+            return sensirionCommand(SCD41_I2C_ADDR_62, 0x3646);
+        case SCD41_OP_SERIAL_CMD:
+            return sensirionCommand(SCD41_I2C_ADDR_62, 0x3682);
+        case SCD41_OP_SERIAL_READ:
+            if (!sensirionRead(SCD41_I2C_ADDR_62, words, 3)) return false;
+            logSerial("SCD41", words, 3);
+            return true;
+        case SCD41_OP_START:
+        #if SENSOR_LOW_POWER
+            // one sample every 30 s instead of every 5 s, a fifth of the current
+            return sensirionCommand(SCD41_I2C_ADDR_62, 0x21AC);
+        #else
+            return sensirionCommand(SCD41_I2C_ADDR_62, 0x21B1);
+        #endif
+        case SCD41_OP_START_FAST:
+            return sensirionCommand(SCD41_I2C_ADDR_62, 0x21B1);
+        case SCD41_OP_READ_CMD:
+            return sensirionCommand(SCD41_I2C_ADDR_62, 0xEC05);
+        default:
+            return false;
+        }
+    }
+
+    bool halSensorFetch(SensorOp op, AirMeasurement &m) {
+        uint16_t words[10];
+        switch (op) {
+        case SPS30_OP_READ_VALUES:
+            // uint16 output: mass and number concentrations, typical size
+            if (!sensirionRead(SPS30_I2C_ADDR_69, words, 10)) return false;
+            m.mc1p0 = words[0];
+            m.mc2p5 = words[1];
+            m.mc4p0 = words[2];
+            m.mc10p0 = words[3];
+            m.nc0p5 = words[4];
+            m.nc1p0 = words[5];
+            m.nc2p5 = words[6];
+            m.nc4p0 = words[7];
+            m.nc10p0 = words[8];
+            m.typicalParticleSize = words[9];
+            return true;
+        case SGP40_OP_MEASURE_READ:
+            if (!sensirionRead(SGP40_I2C_ADDR, words, 1)) return false;
+            m.srawVoc = words[0];
+            return true;
+        case SCD41_OP_READ_VALUES:
+            if (!sensirionRead(SCD41_I2C_ADDR_62, words, 3)) return false;
+            m.co2 = words[0];
+            m.temp = -45.0f + 175.0f * words[1] / 65535.0f;
+            m.rh = 100.0f * words[2] / 65535.0f;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void setup() {
+
+        // boot order: advertising first, then the archive; the sensor startup
+        // sequences run from the pipeline's scheduler. Nothing waits for a
+        // serial monitor; boot messages sit in the log ring until drained.
+        // the archive dump (serial_dump.h) wants a fast port and room to queue
+        Serial.setRxBufferSize(256);
+        Serial.setTxBufferSize(SERIAL_TX_BUFFER);
+        Serial.begin(SERIAL_BAUD);
+        Serial.onReceive([]() { halWakeTransport(); });
+        // start draining early so the boot messages don't overflow the log ring
+        xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY, nullptr, LOG_TASK_CORE);
 
         // 1. Start BLE and give your device a name
-        BLEDevice::init("MojCzujnikPowietrza");
+        BLEDevice::init(DEVICE_NAME);
+        // allow the client to negotiate a large MTU so backlog batches are big
+        BLEDevice::setMTU(BATCH_FRAME_MAX + 3);
         // 2. create BLE Server
     BLEServer *pServer = BLEDevice::createServer();
+    pBleServer = pServer;
     pServer->setCallbacks(new MyServerCallbacks());
         // 3. Create a "Service" on that server
         BLEService *pService = pServer->createService(SERVICE_UUID);
@@ -528,112 +687,101 @@
         pCharacteristic = pService->createCharacteristic(
                             CHARACTERISTIC_UUID,
                             BLECharacteristic::PROPERTY_READ |  // Ta charakterystyka jest CZYTELNA
-                            BLECharacteristic::PROPERTY_NOTIFY // Można ją "subskrybować" (dostawać powiadomienia)
+                            BLECharacteristic::PROPERTY_NOTIFY | // Można ją "subskrybować" (dostawać powiadomienia)
+                            BLECharacteristic::PROPERTY_INDICATE // or confirmed, see NOTIFY_CONFIRM_SAMPLES
                             );
+        pDataCccd = new BLE2902();
+        pCharacteristic->addDescriptor(pDataCccd);
+        pCharacteristic->setCallbacks(new DataCallbacks());
     // Status characteristic (read-only) - returns buffer and device state
     pStatusCharacteristic = pService->createCharacteristic(
                 STATUS_UUID,
                 BLECharacteristic::PROPERTY_READ
                 );
-    // initial status
-    pStatusCharacteristic->setValue("{\"buffer\":0,\"connected\":false,\"seq\":0}");
+    // initial status, same format as the periodic updates
+    pipelinePublishStatus();
+    // Summary characteristic - mean/min/max/p95 per channel over 1 min, 15 min and 1 h
+    pSummaryCharacteristic = pService->createCharacteristic(
+                SUMMARY_UUID,
+                BLECharacteristic::PROPERTY_READ |
+                BLECharacteristic::PROPERTY_NOTIFY
+                );
+    // Control characteristic - the client asks for a seq or ts range of the archive
+    pControlCharacteristic = pService->createCharacteristic(
+                CONTROL_UUID,
+                BLECharacteristic::PROPERTY_WRITE
+                );
+    pControlCharacteristic->setCallbacks(new ControlCallbacks());
+    // Ack characteristic - samples stay archived until the client acks them
+    pAckCharacteristic = pService->createCharacteristic(
+                ACK_UUID,
+                BLECharacteristic::PROPERTY_WRITE
+                );
+    pAckCharacteristic->setCallbacks(new AckCallbacks());
+    // Config characteristic - intervals, pacing and reporting, kept in NVS
+    pConfigCharacteristic = pService->createCharacteristic(
+                CONFIG_UUID,
+                BLECharacteristic::PROPERTY_READ |
+                BLECharacteristic::PROPERTY_WRITE
+                );
+    pConfigCharacteristic->setCallbacks(new ConfigCallbacks());
+    #if LATENCY_STATS
+    pDiagCharacteristic = pService->createCharacteristic(
+                DIAG_UUID,
+                BLECharacteristic::PROPERTY_READ |
+                BLECharacteristic::PROPERTY_WRITE
+                );
+    pDiagCharacteristic->setCallbacks(new DiagCallbacks());
+    #endif
         // 5. Start the service
         pService->start();
         // 6. Start "Advertising" and keep global pointer so callbacks can restart it
         pAdvertising = pServer->getAdvertising();
         pAdvertising->addServiceUUID(SERVICE_UUID);
         pAdvertising->start();
+        // connect and client writes before pipelineBegin() only queue up
+        pipelineBootMark(BOOT_ADVERTISING);
 
+        Wire.begin();
+        sps30.begin(Wire, SPS30_I2C_ADDR_69);
+        sgp40.begin(Wire);
+        scd41.begin(Wire, SCD41_I2C_ADDR_62);
+
+        // init SPIFFS for archive
+        if (!SPIFFS.begin(true)) {
+            LOG_ERROR("SPIFFS Mount Failed");
+        } else {
+            LOG_INFO("SPIFFS initialized, attaching archive...");
+        }
+        // the archive stays RAM-only if the mount failed
+        pipelineBegin();
+
+    #if LIGHT_SLEEP
+        esp_pm_config_esp32_t pm = {};
+        pm.max_freq_mhz = 240;
+        pm.min_freq_mhz = 40;
+        pm.light_sleep_enable = true;
+        esp_err_t pmErr = esp_pm_configure(&pm);
+        // needs CONFIG_PM_ENABLE and tickless idle in the core's sdkconfig
+        if (pmErr != ESP_OK) LOG_WARN("Light sleep not available (esp_pm_configure %d)", (int)pmErr);
+    #endif
 
-        // Run diagnostics / startup checks for each sensor
-        diagSgp40();
-        diagSps30();
-        diagScd41();
+    #if PIPELINE_TASKS
+        // transport gets the higher priority so a slow sensor read never delays a notify
+        xTaskCreatePinnedToCore(acquireTask, "acquire", ACQUIRE_TASK_STACK, nullptr, 1, &acquireWaiter, ACQUIRE_TASK_CORE);
+        xTaskCreatePinnedToCore(transportTask, "transport", TRANSPORT_TASK_STACK, nullptr, 2, &transportWaiter, TRANSPORT_TASK_CORE);
+    #else
+        transportWaiter = xTaskGetCurrentTaskHandle();
+    #endif
     }
 
 
     void loop() {
-        unsigned long now = millis();
-
-        // process one archival flush step if in progress (non-blocking)
-        processFlushStep();
-
-        // periodic status update characteristic
-        if (now - lastStatusUpdate >= STATUS_UPDATE_INTERVAL) {
-            lastStatusUpdate = now;
-            char statusBuf[128];
-            int n = snprintf(statusBuf, sizeof(statusBuf), "{\"buffer\":%u,\"connected\":%s,\"seq\":%u}",
-                             (unsigned)archiveBuffer.count, deviceConnected ? "true" : "false", packetSeq);
-            if (n > 0) pStatusCharacteristic->setValue((uint8_t*)statusBuf, n);
-        }
-
-        // sensor recovery: if a sensor hasn't reported for SENSOR_RECOVERY_TIMEOUT, run its diag
-        if ((now - lastSuccessSps30) > SENSOR_RECOVERY_TIMEOUT) {
-            Serial.println("SPS30 not responding - running diagSps30()");
-            diagSps30();
-            lastSuccessSps30 = now; // avoid repeating too fast
-        }
-        if ((now - lastSuccessSgp40) > SENSOR_RECOVERY_TIMEOUT) {
-            Serial.println("SGP40 not responding - running diagSgp40()");
-            diagSgp40();
-            lastSuccessSgp40 = now;
-        }
-        if ((now - lastSuccessScd41) > SENSOR_RECOVERY_TIMEOUT) {
-            Serial.println("SCD41 not responding - running diagScd41()");
-            diagScd41();
-            lastSuccessScd41 = now;
-        }
-
-        // Read SPS30 every INTERVAL_SPS30 ms
-        if (now - lastReadSps30 >= INTERVAL_SPS30) {
-            lastReadSps30 = now;
-            readSps30();
-        }
-
-        // Read SGP40 every INTERVAL_SGP40 ms
-        if (now - lastReadSgp40 >= INTERVAL_SGP40) {
-            lastReadSgp40 = now;
-            readSgp40();
-        }
-
-        // Read SCD41 every INTERVAL_SCD41 ms
-        if (now - lastReadScd41 >= INTERVAL_SCD41) {
-            lastReadScd41 = now;
-            readScd41();
-        }
-
-        // If we have fresh readings from all sensors, send one combined JSON
-        if (latestMeasurement.haveSps30 && latestMeasurement.haveSgp40 && latestMeasurement.haveScd41) {
-            // build improved combined JSON payload with readable names
-            // seq = sequence number (for tracking), ts = timestamp(ms)
-            // co2 = CO2 [ppm], temp_c = temperature [°C], humidity_rh = humidity [%]
-            // voc = SRAW_VOC, pm25 = PM2.5 [µg/m³], pm10 = PM10 [µg/m³]
-            unsigned long ts = latestMeasurement.ts;
-            packetSeq++;  // increment sequence counter
-            char payloadBuf[192];
-            int len = snprintf(payloadBuf, sizeof(payloadBuf), "{\"seq\":%u,\"ts\":%lu,\"co2\":%u,\"temp_c\":%.2f,\"humidity_rh\":%.2f,\"voc\":%u,\"pm25\":%u,\"pm10\":%u}",
-                               packetSeq, ts, latestMeasurement.co2, latestMeasurement.temp, latestMeasurement.rh,
-                               latestMeasurement.srawVoc, latestMeasurement.mc2p5, latestMeasurement.mc10p0);
-
-            String payload;
-            if (len > 0 && len < (int)sizeof(payloadBuf)) payload = String(payloadBuf);
-            else payload = String("{}");
-
-            bool sent = false;
-            if (deviceConnected) sent = sendDataNow(payload);
-            if (!sent) {
-                // add to circular buffer (no SPIFFS write yet)
-                archiveBuffer.add(payload);
-                Serial.print("Combined data archived to buffer (");
-                Serial.print(archiveBuffer.count);
-                Serial.println("/500 samples)");
-            } else {
-                Serial.println("Combined data sent via BLE");
-            }
-
-            // reset measurement flags so next cycle waits for new readings
-            latestMeasurement.haveSps30 = false;
-            latestMeasurement.haveSgp40 = false;
-            latestMeasurement.haveScd41 = false;
-        }
-    }
\ No newline at end of file
+    #if PIPELINE_TASKS
+        // all work happens in the pipeline tasks
+        vTaskDelete(nullptr);
+    #else
+        uint32_t wait = pipelineLoop();
+        if (wait > 0) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    #endif
+    }
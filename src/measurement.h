@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+// consolidated data structure for a full measurement
+struct AirMeasurement {
+    // SPS30
+    uint16_t mc1p0 = 0;
+    uint16_t mc2p5 = 0;
+    uint16_t mc4p0 = 0;
+    uint16_t mc10p0 = 0;
+    // optional number concentrations
+    uint16_t nc0p5 = 0;
+    uint16_t nc1p0 = 0;
+    uint16_t nc2p5 = 0;
+    uint16_t nc4p0 = 0;
+    uint16_t nc10p0 = 0;
+    uint16_t typicalParticleSize = 0;
+    bool haveSps30 = false;
+
+    // SGP40
+    uint16_t srawVoc = 0;
+    uint16_t vocIndex = 0;   // 1..500, 0 while the engine starts (voc_index.h)
+    bool haveSgp40 = false;
+
+    // SCD41
+    uint16_t co2 = 0;
+    float temp = 0.0f;
+    float rh = 0.0f;
+    bool haveScd41 = false;
+
+    // timestamp for the combined payload (ms since boot)
+    unsigned long ts = 0;
+};
@@ -0,0 +1,60 @@
+#include "notify_pacer.h"
+
+void NotifyPacer::setLimits(uint16_t min, uint16_t max) {
+    rateMin16 = (uint32_t)min * 16;
+    rateMax16 = (uint32_t)max * 16;
+    if (rate16 < rateMin16) rate16 = rateMin16;
+    if (rate16 > rateMax16) rate16 = rateMax16;
+}
+
+void NotifyPacer::reset(uint32_t now) {
+    rate16 = NOTIFY_RATE_START * 16;
+    if (rate16 < rateMin16) rate16 = rateMin16;
+    if (rate16 > rateMax16) rate16 = rateMax16;
+    nextAt = now;
+    lastDecrease = 0;
+    decreased = false;
+    limited = false;
+    windowStart = now;
+    windowBytes = 0;
+    bps = 0;
+}
+
+uint32_t NotifyPacer::waitMs(uint32_t now) const {
+    int32_t wait = (int32_t)(nextAt - now);
+    return wait > 0 ? (uint32_t)wait : 0;
+}
+
+void NotifyPacer::sent(uint32_t now, size_t len) {
+    // a send within one interval of the earliest allowed time means the
+    // sender has more to say than the rate lets out
+    limited = (int32_t)(now - nextAt) <= (int32_t)intervalMs();
+    nextAt = now + intervalMs();
+    if (now - windowStart >= NOTIFY_THROUGHPUT_WINDOW_MS) {
+        bps = (uint32_t)((uint64_t)windowBytes * 1000 / (now - windowStart));
+        windowStart = now;
+        windowBytes = 0;
+    }
+    windowBytes += len;
+}
+
+void NotifyPacer::completed(uint32_t n) {
+    // an idle sender learns nothing about the link
+    if (!limited) return;
+    while (n-- && rate16 < rateMax16) {
+        uint32_t step = NOTIFY_RATE_STEP * 256 / rate16;
+        rate16 += step ? step : 1;
+    }
+    if (rate16 > rateMax16) rate16 = rateMax16;
+}
+
+void NotifyPacer::congested(uint32_t now) {
+    if (!decreased || now - lastDecrease >= NOTIFY_DECREASE_HOLD_MS) {
+        rate16 /= 2;
+        if (rate16 < rateMin16) rate16 = rateMin16;
+        lastDecrease = now;
+        decreased = true;
+    }
+    // give the stack one interval to drain
+    nextAt = now + intervalMs();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Adaptive pacing of notifications on the data characteristic.
+//
+// The send rate follows AIMD. Every notification the stack reports as done
+// while the sender is rate limited adds NOTIFY_RATE_STEP / rate notifies/s,
+// so the rate climbs by about NOTIFY_RATE_STEP per second of clean sending.
+// A congestion signal halves it: a send the stack refused, a failed or
+// unconfirmed indication, or no free stack buffer when a send is due. After
+// a decrease further signals are ignored for NOTIFY_DECREASE_HOLD_MS, so one
+// burst of rejections halves the rate once. The rate stays within
+// NOTIFY_RATE_MIN..NOTIFY_RATE_MAX (or the limits set at runtime) and
+// starts at NOTIFY_RATE_START on every connect. Achieved throughput is measured over windows of about a second.
+// Transport side only.
+
+// notifies per second
+#ifndef NOTIFY_RATE_MIN
+#define NOTIFY_RATE_MIN 2
+#endif
+#ifndef NOTIFY_RATE_MAX
+#define NOTIFY_RATE_MAX 200
+#endif
+#ifndef NOTIFY_RATE_START
+#define NOTIFY_RATE_START 10
+#endif
+// additive increase, notifies/s gained per second of clean sending
+#ifndef NOTIFY_RATE_STEP
+#define NOTIFY_RATE_STEP 10
+#endif
+#define NOTIFY_DECREASE_HOLD_MS 250
+#define NOTIFY_THROUGHPUT_WINDOW_MS 1000
+
+class NotifyPacer {
+public:
+    NotifyPacer() : rateMin16(NOTIFY_RATE_MIN * 16), rateMax16(NOTIFY_RATE_MAX * 16) { reset(0); }
+
+    // rate limits in notifies/s, 1 <= min <= max; the current rate is clamped
+    void setLimits(uint16_t min, uint16_t max);
+
+    // new connection: back to the start rate
+    void reset(uint32_t now);
+
+    // ms until the next notification may go, 0 if now
+    uint32_t waitMs(uint32_t now) const;
+    // a notification went to the stack
+    void sent(uint32_t now, size_t len);
+    // n notifications the stack reported as done
+    void completed(uint32_t n);
+    // the link is congested: halve the rate (at most once per hold time)
+    void congested(uint32_t now);
+
+    uint32_t intervalMs() const { return 16000 / rate16; }
+    // bytes handed to the stack per second over the last full window
+    uint32_t bytesPerSec() const { return bps; }
+
+private:
+    uint32_t rateMin16;
+    uint32_t rateMax16;
+    uint32_t rate16;        // notifies/s in 1/16
+    uint32_t nextAt;        // earliest time for the next send
+    uint32_t lastDecrease;
+    bool decreased;         // lastDecrease is valid
+    bool limited;           // the last send went as soon as the pacer allowed
+    uint32_t windowStart;
+    uint32_t windowBytes;
+    uint32_t bps;
+};
@@ -0,0 +1,294 @@
+#include "payload_schema.h"
+
+static const uint32_t pow10s[] = {1, 10, 100, 1000, 10000};
+
+// the wire value of a field as sign and magnitude
+static bool fieldValue(const PayloadField &f, const void *rec, uint32_t &mag) {
+    const uint8_t *p = (const uint8_t*)rec + f.offset;
+    int32_t v;
+    switch (f.kind) {
+    case PAYLOAD_U8:
+        mag = (uint32_t)(*p >> f.shift);
+        return false;
+    case PAYLOAD_U32: {
+        uint32_t u;
+        memcpy(&u, p, sizeof(u));
+        mag = u;
+        return false;
+    }
+    case PAYLOAD_ULONG: {
+        unsigned long u;
+        memcpy(&u, p, sizeof(u));
+        mag = (uint32_t)u;
+        return false;
+    }
+    case PAYLOAD_U16: {
+        uint16_t u;
+        memcpy(&u, p, sizeof(u));
+        mag = u;
+        return false;
+    }
+    case PAYLOAD_I16: {
+        int16_t i;
+        memcpy(&i, p, sizeof(i));
+        v = i;
+        break;
+    }
+    default: {
+        float x;
+        memcpy(&x, p, sizeof(x));
+        // same rounding and clamping as the archive, fits the 16 bit layout
+        v = toCenti(x * (float)pow10s[f.decimals] / 100.0f, INT16_MIN, INT16_MAX);
+        break;
+    }
+    }
+    mag = v < 0 ? (uint32_t)-(int64_t)v : (uint32_t)v;
+    return v < 0;
+}
+
+static char *putDigits(char *p, uint32_t v, uint8_t minDigits) {
+    char tmp[10];
+    uint8_t n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v || n < minDigits);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+// a field as decimal text, fixed point when it has decimals
+static char *putValue(char *p, const PayloadField &f, const void *rec) {
+    uint32_t mag;
+    if (fieldValue(f, rec, mag)) *p++ = '-';
+    if (f.decimals == 0) return putDigits(p, mag, 1);
+    uint32_t scale = pow10s[f.decimals];
+    p = putDigits(p, mag / scale, 1);
+    *p++ = '.';
+    return putDigits(p, mag % scale, f.decimals);
+}
+
+size_t payloadEncodeJson(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                         char *out, size_t cap) {
+    char *p = out;
+    char *end = out + cap;
+    if (cap < 3) return 0;
+    *p++ = '{';
+    bool first = true;
+    for (size_t i = 0; i < n; i++) {
+        const PayloadField &f = fields[i];
+        if (f.group && !(present & f.group)) continue;
+        size_t keyLen = strlen(f.key);
+        // separator, quoted key, colon, sign, 10 digits, point, closing brace, NUL
+        if ((size_t)(end - p) < keyLen + 18) return 0;
+        if (!first) *p++ = ',';
+        first = false;
+        *p++ = '"';
+        memcpy(p, f.key, keyLen);
+        p += keyLen;
+        *p++ = '"';
+        *p++ = ':';
+        p = putValue(p, f, rec);
+    }
+    *p++ = '}';
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+// store a scaled value into the field; false if it does not fit its type
+static bool storeValue(const PayloadField &f, void *rec, int64_t v) {
+    uint8_t *p = (uint8_t*)rec + f.offset;
+    switch (f.kind) {
+    case PAYLOAD_U8: {
+        if (v < 0 || v > (0xFF >> f.shift)) return false;
+        uint8_t mask = (uint8_t)(0xFF << f.shift);
+        *p = (uint8_t)((*p & ~mask) | (v << f.shift));
+        return true;
+    }
+    case PAYLOAD_U32: {
+        if (v < 0 || v > UINT32_MAX) return false;
+        uint32_t u = (uint32_t)v;
+        memcpy(p, &u, sizeof(u));
+        return true;
+    }
+    case PAYLOAD_ULONG: {
+        if (v < 0 || v > UINT32_MAX) return false;
+        unsigned long u = (unsigned long)v;
+        memcpy(p, &u, sizeof(u));
+        return true;
+    }
+    case PAYLOAD_U16: {
+        if (v < 0 || v > UINT16_MAX) return false;
+        uint16_t u = (uint16_t)v;
+        memcpy(p, &u, sizeof(u));
+        return true;
+    }
+    case PAYLOAD_I16: {
+        if (v < INT16_MIN || v > INT16_MAX) return false;
+        int16_t i = (int16_t)v;
+        memcpy(p, &i, sizeof(i));
+        return true;
+    }
+    default: {
+        float x = (float)v / (float)pow10s[f.decimals];
+        memcpy(p, &x, sizeof(x));
+        return true;
+    }
+    }
+}
+
+bool payloadDecodeJson(const PayloadField *fields, size_t n, const char *text, size_t len, void *rec,
+                       uint8_t &present) {
+    const char *p = text;
+    const char *end = text + len;
+    present = 0;
+    while (p < end && *p == ' ') p++;
+    if (p == end || *p++ != '{') return false;
+    size_t next = 0;   // table position the key most likely has
+    for (bool first = true;; first = false) {
+        if (!first && (p == end || *p++ != ',')) return false;
+        if (p == end || *p++ != '"') return false;
+        const char *key = p;
+        while (p < end && *p != '"') p++;
+        if (p == end) return false;
+        size_t keyLen = (size_t)(p - key);
+        p++;
+        if (p == end || *p++ != ':') return false;
+        size_t i = 0;
+        for (; i < n; i++) {
+            const PayloadField &f = fields[(next + i) % n];
+            if (strncmp(f.key, key, keyLen) == 0 && f.key[keyLen] == '\0') break;
+        }
+        if (i == n) return false;
+        const PayloadField &f = fields[(next + i) % n];
+        next = (next + i + 1) % n;
+        bool neg = p < end && *p == '-';
+        if (neg) p++;
+        if (p == end || *p < '0' || *p > '9') return false;
+        int64_t v = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            v = v * 10 + (*p++ - '0');
+            if (v > 0xFFFFFFFFLL * 10000) return false;
+        }
+        uint8_t digits = 0;
+        if (p < end && *p == '.') {
+            p++;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (++digits > f.decimals) return false;
+                v = v * 10 + (*p++ - '0');
+            }
+            if (digits == 0) return false;
+        }
+        while (digits < f.decimals) {
+            v *= 10;
+            digits++;
+        }
+        if (!storeValue(f, rec, neg ? -v : v)) return false;
+        present |= f.group;
+        if (p < end && *p == '}') {
+            p++;
+            while (p < end && (*p == ' ' || *p == '\n' || *p == '\r')) p++;
+            return p == end;
+        }
+    }
+}
+
+size_t payloadCsvHeader(const PayloadField *fields, size_t n, char *out, size_t cap) {
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t keyLen = strlen(fields[i].key);
+        if (len + keyLen + 2 > cap) return 0;
+        if (i) out[len++] = ',';
+        memcpy(out + len, fields[i].key, keyLen);
+        len += keyLen;
+    }
+    if (cap == 0) return 0;
+    out[len] = '\0';
+    return len;
+}
+
+size_t payloadEncodeCsv(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                        char *out, size_t cap) {
+    char *p = out;
+    char *end = out + cap;
+    for (size_t i = 0; i < n; i++) {
+        const PayloadField &f = fields[i];
+        // separator, sign, 10 digits, point, NUL
+        if (end - p < 14) return 0;
+        if (i) *p++ = ',';
+        if (!f.group || (present & f.group)) p = putValue(p, f, rec);
+    }
+    if (p == end) return 0;
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+// CBOR initial byte plus argument, shortest form
+static uint8_t *cborHead(uint8_t *p, uint8_t major, uint32_t v) {
+    major <<= 5;
+    if (v < 24) {
+        *p++ = (uint8_t)(major | v);
+    } else if (v <= 0xFF) {
+        *p++ = (uint8_t)(major | 24);
+        *p++ = (uint8_t)v;
+    } else if (v <= 0xFFFF) {
+        *p++ = (uint8_t)(major | 25);
+        *p++ = (uint8_t)(v >> 8);
+        *p++ = (uint8_t)v;
+    } else {
+        *p++ = (uint8_t)(major | 26);
+        *p++ = (uint8_t)(v >> 24);
+        *p++ = (uint8_t)(v >> 16);
+        *p++ = (uint8_t)(v >> 8);
+        *p++ = (uint8_t)v;
+    }
+    return p;
+}
+
+size_t payloadEncodeCbor(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                         uint8_t *out, size_t cap) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!fields[i].group || (present & fields[i].group)) count++;
+    }
+    // worst case: tag, map header, then key + 5 byte value per field
+    if (cap < 4 + 6 * (size_t)count || n > 23) return 0;
+    uint8_t *p = out;
+    // self-describe tag 55799
+    *p++ = 0xD9;
+    *p++ = 0xD9;
+    *p++ = 0xF7;
+    p = cborHead(p, 5, count);
+    for (size_t i = 0; i < n; i++) {
+        const PayloadField &f = fields[i];
+        if (f.group && !(present & f.group)) continue;
+        *p++ = (uint8_t)i;
+        uint32_t mag;
+        // negative integers carry -1 - value
+        if (fieldValue(f, rec, mag)) p = cborHead(p, 1, mag - 1);
+        else p = cborHead(p, 0, mag);
+    }
+    return (size_t)(p - out);
+}
+
+size_t payloadEncodeBinary(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                           uint8_t *out, size_t cap) {
+    if (cap < payloadBinarySize(fields, n)) return 0;
+    uint8_t *p = out;
+    *p++ = PAYLOAD_BINARY_TYPE;
+    *p++ = present;
+    for (size_t i = 0; i < n; i++) {
+        const PayloadField &f = fields[i];
+        uint32_t mag = 0;
+        bool neg = false;
+        if (!f.group || (present & f.group)) neg = fieldValue(f, rec, mag);
+        uint32_t v = neg ? (uint32_t)0 - mag : mag;
+        *p++ = (uint8_t)v;
+        *p++ = (uint8_t)(v >> 8);
+        if (payloadFieldBytes(f.kind) == 4) {
+            *p++ = (uint8_t)(v >> 16);
+            *p++ = (uint8_t)(v >> 24);
+        }
+    }
+    return (size_t)(p - out);
+}
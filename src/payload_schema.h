@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "measurement.h"
+#include "archive_record.h"
+
+// Schema-driven sample payloads.
+//
+// A payload is described once by a constexpr table of fields (key, offset,
+// kind, decimals, presence group). PAYLOAD_FIELD() takes the field kind from
+// the member's declared type, so changing a member's type either still
+// encodes correctly or fails to compile. One set of encoders renders any
+// table as:
+//
+//   JSON    {"key":value,...} in table order; values with decimals are fixed
+//           point (temp_c 2251 with 2 decimals -> 22.51), no float formatting
+//   CBOR    tag 55799 (d9 d9 f7) | map of field index -> integer, decimal
+//           fields scaled by 10^decimals like the binary layout
+//   binary  u8 PAYLOAD_BINARY_TYPE | u8 present | every field in table order,
+//           little endian: 32 bit for seq/ts, 16 bit for the rest (floats as
+//           signed hundredths etc.)
+//
+// Fields whose presence group (REC_HAVE_*) is not set are left out of JSON
+// and CBOR and zero in the binary layout; "held" (report_filter.h) uses
+// REC_HELD_MASK as its group, so it only shows up when samples were held.
+// Nothing is allocated. The encoders are not generated per table: they walk
+// the table at runtime and switch on each field's kind. The table being
+// constexpr buys compile-time checks (payloadTableValid()) and the buffer
+// bounds (payloadJsonMax()/payloadCborMax()).
+//
+// Live samples and archived records use different tables. pm1, pm4, the
+// number concentrations, the typical particle size and the VOC index are
+// in liveFields only, because ArchiveRecord does not store them. A sample
+// sent from the archive (backlog flush, range query, small-MTU fallback)
+// carries the recordFields subset.
+//
+// The client picks the format of the data characteristic with a control
+// write (range_query.h lists the commands):
+//
+//   0x05 u8 format     PayloadFormat, for the rest of the connection
+//
+// Every connection starts with JSON. The format applies to single-sample
+// notifications (live samples and the small-MTU fallback for archived ones);
+// batch, codec and tier frames are binary already.
+
+enum PayloadFormat : uint8_t {
+    PAYLOAD_JSON = 0,
+    PAYLOAD_CBOR,
+    PAYLOAD_BINARY,
+    PAYLOAD_FORMAT_COUNT,
+};
+
+#define CONTROL_CMD_FORMAT 0x05
+#define PAYLOAD_BINARY_TYPE 0xD1
+
+enum PayloadKind : uint8_t {
+    PAYLOAD_U8 = 0,  // sent as 16 bit, after shifting right by shift
+    PAYLOAD_U16,
+    PAYLOAD_I16,
+    PAYLOAD_U32,
+    PAYLOAD_ULONG,   // unsigned long, sent as 32 bit
+    PAYLOAD_FLOAT,   // sent as signed 16 bit, scaled by 10^decimals
+};
+
+struct PayloadField {
+    const char *key;
+    uint8_t kind;
+    uint8_t decimals;
+    uint8_t group;     // REC_HAVE_* the field depends on, 0 = always there
+    uint8_t shift;     // PAYLOAD_U8 only
+    uint16_t offset;
+};
+
+// member type -> kind; a member of any other type does not compile
+template <typename T> struct PayloadKindOf;
+template <> struct PayloadKindOf<uint8_t> { static constexpr uint8_t value = PAYLOAD_U8; };
+template <> struct PayloadKindOf<uint16_t> { static constexpr uint8_t value = PAYLOAD_U16; };
+template <> struct PayloadKindOf<int16_t> { static constexpr uint8_t value = PAYLOAD_I16; };
+template <> struct PayloadKindOf<float> { static constexpr uint8_t value = PAYLOAD_FLOAT; };
+// uint32_t is one of these two depending on the toolchain
+template <> struct PayloadKindOf<unsigned int> { static constexpr uint8_t value = PAYLOAD_U32; };
+template <> struct PayloadKindOf<unsigned long> {
+    static constexpr uint8_t value = sizeof(unsigned long) == 4 ? PAYLOAD_U32 : PAYLOAD_ULONG;
+};
+
+#define PAYLOAD_FIELD(T, member, key, decimals, group) \
+    { key, PayloadKindOf<decltype(((T*)nullptr)->member)>::value, decimals, group, 0, (uint16_t)offsetof(T, member) }
+// the bits of a uint8_t member from shift up
+#define PAYLOAD_BITS(T, member, key, shift, group) \
+    { key, PayloadKindOf<decltype(((T*)nullptr)->member)>::value, 0, group, shift, (uint16_t)offsetof(T, member) }
+
+// a live sample before it is packed into an ArchiveRecord
+struct LiveSample {
+    uint32_t seq;
+    uint8_t held;      // samples held back before this one (report_filter.h)
+    AirMeasurement m;
+};
+
+// --- compile-time checks and sizes over a table ---
+
+constexpr size_t payloadKeyLen(const char *s) {
+    return *s ? 1 + payloadKeyLen(s + 1) : 0;
+}
+
+constexpr size_t payloadFieldBytes(uint8_t kind) {
+    return kind == PAYLOAD_U32 || kind == PAYLOAD_ULONG ? 4 : 2;
+}
+
+// bytes of the binary layout, header included
+constexpr size_t payloadBinarySize(const PayloadField *f, size_t n) {
+    return n == 0 ? 2 : payloadFieldBytes(f->kind) + payloadBinarySize(f + 1, n - 1);
+}
+
+// longest JSON rendering, terminating NUL included
+constexpr size_t payloadJsonMax(const PayloadField *f, size_t n) {
+    // "key": plus sign, 10 digits, point and separator
+    return n == 0 ? 3 : payloadKeyLen(f->key) + 3 + 13 + payloadJsonMax(f + 1, n - 1);
+}
+
+// longest CBOR rendering: tag, map header, then key + 5 byte integer per field
+constexpr size_t payloadCborMax(const PayloadField *f, size_t n) {
+    return n == 0 ? 4 : 7 + payloadCborMax(f + 1, n - 1);
+}
+
+// decimals only on 16 bit values, and floats always have some
+constexpr bool payloadTableValid(const PayloadField *f, size_t n) {
+    return n == 0 ||
+           ((f->kind == PAYLOAD_FLOAT ? f->decimals >= 1 && f->decimals <= 4
+                                      : f->decimals == 0 || f->kind == PAYLOAD_I16 || f->kind == PAYLOAD_U16) &&
+            payloadTableValid(f + 1, n - 1));
+}
+
+// --- the encoders; fields and count come from a table ---
+
+size_t payloadEncodeJson(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                         char *out, size_t cap);
+size_t payloadEncodeCbor(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                         uint8_t *out, size_t cap);
+size_t payloadEncodeBinary(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                           uint8_t *out, size_t cap);
+
+// parse JSON in the form payloadEncodeJson() writes back into rec: every
+// key must be in the table (tried in table order first), values are
+// integers or fixed point with at most the field's decimals. Fields not in
+// the text are left alone; present gets the groups of those that were.
+// PAYLOAD_U8 fields replace the bits from shift up. No allocation, no
+// strings or nesting; false if anything does not fit.
+bool payloadDecodeJson(const PayloadField *fields, size_t n, const char *text, size_t len, void *rec,
+                       uint8_t &present);
+
+// CSV for host tools (not a BLE format): the keys as a header line, and one
+// row per record with the fields in table order, absent ones left empty.
+// Both are NUL terminated (not counted) and return 0 if cap is too small.
+size_t payloadCsvHeader(const PayloadField *fields, size_t n, char *out, size_t cap);
+size_t payloadEncodeCsv(const PayloadField *fields, size_t n, const void *rec, uint8_t present,
+                        char *out, size_t cap);
+
+// encode rec in format; returns bytes written, 0 if cap is too small or the
+// format is unknown. JSON output is NUL terminated (not counted).
+template <size_t N>
+size_t payloadEncode(uint8_t format, const PayloadField (&fields)[N], const void *rec, uint8_t present,
+                     uint8_t *out, size_t cap) {
+    switch (format) {
+    case PAYLOAD_JSON:
+        return payloadEncodeJson(fields, N, rec, present, (char*)out, cap);
+    case PAYLOAD_CBOR:
+        return payloadEncodeCbor(fields, N, rec, present, out, cap);
+    case PAYLOAD_BINARY:
+        return payloadEncodeBinary(fields, N, rec, present, out, cap);
+    default:
+        return 0;
+    }
+}
+
+// live samples: the archived fields first, in the same order and with the
+// same keys, then the SPS30 fields and the VOC index the archive does not keep
+static constexpr PayloadField liveFields[] = {
+    PAYLOAD_FIELD(LiveSample, seq, "seq", 0, 0),
+    PAYLOAD_FIELD(LiveSample, m.ts, "ts", 0, 0),
+    PAYLOAD_FIELD(LiveSample, m.co2, "co2", 0, REC_HAVE_SCD41),
+    PAYLOAD_FIELD(LiveSample, m.temp, "temp_c", 2, REC_HAVE_SCD41),
+    PAYLOAD_FIELD(LiveSample, m.rh, "humidity_rh", 2, REC_HAVE_SCD41),
+    PAYLOAD_FIELD(LiveSample, m.srawVoc, "voc", 0, REC_HAVE_SGP40),
+    PAYLOAD_FIELD(LiveSample, m.mc2p5, "pm25", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.mc10p0, "pm10", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.mc1p0, "pm1", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.mc4p0, "pm4", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.nc0p5, "nc05", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.nc1p0, "nc1", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.nc2p5, "nc25", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.nc4p0, "nc4", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.nc10p0, "nc10", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.typicalParticleSize, "tps", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(LiveSample, m.vocIndex, "voc_index", 0, REC_HAVE_SGP40),
+    PAYLOAD_BITS(LiveSample, held, "held", 0, REC_HELD_MASK),
+};
+
+// archived records (temp and rh are hundredths already)
+static constexpr PayloadField recordFields[] = {
+    PAYLOAD_FIELD(ArchiveRecord, seq, "seq", 0, 0),
+    PAYLOAD_FIELD(ArchiveRecord, ts, "ts", 0, 0),
+    PAYLOAD_FIELD(ArchiveRecord, co2, "co2", 0, REC_HAVE_SCD41),
+    PAYLOAD_FIELD(ArchiveRecord, temp, "temp_c", 2, REC_HAVE_SCD41),
+    PAYLOAD_FIELD(ArchiveRecord, rh, "humidity_rh", 2, REC_HAVE_SCD41),
+    PAYLOAD_FIELD(ArchiveRecord, voc, "voc", 0, REC_HAVE_SGP40),
+    PAYLOAD_FIELD(ArchiveRecord, pm25, "pm25", 0, REC_HAVE_SPS30),
+    PAYLOAD_FIELD(ArchiveRecord, pm10, "pm10", 0, REC_HAVE_SPS30),
+    PAYLOAD_BITS(ArchiveRecord, flags, "held", REC_HELD_SHIFT, REC_HELD_MASK),
+};
+
+#define PAYLOAD_FIELD_COUNT(table) (sizeof(table) / sizeof(table[0]))
+static_assert(payloadTableValid(liveFields, PAYLOAD_FIELD_COUNT(liveFields)), "bad live payload table");
+static_assert(payloadTableValid(recordFields, PAYLOAD_FIELD_COUNT(recordFields)), "bad record payload table");
+static_assert(PAYLOAD_FIELD_COUNT(liveFields) <= 23, "CBOR keys must stay single byte");
+
+// buffer large enough for any format of either table
+#define PAYLOAD_MAX_SIZE payloadJsonMax(liveFields, PAYLOAD_FIELD_COUNT(liveFields))
+static_assert(payloadJsonMax(liveFields, PAYLOAD_FIELD_COUNT(liveFields)) >=
+              payloadCborMax(liveFields, PAYLOAD_FIELD_COUNT(liveFields)), "PAYLOAD_MAX_SIZE too small for CBOR");
+
+// Render a record as the JSON payload sent over BLE.
+// seq = sequence number (for tracking), ts = timestamp(ms)
+// co2 = CO2 [ppm], temp_c = temperature [°C], humidity_rh = humidity [%]
+// voc = SRAW_VOC, pm25 = PM2.5 [µg/m³], pm10 = PM10 [µg/m³]
+// held = samples held back before this one, only when there were any
+// Returns the number of characters written, or 0 if buf is too small.
+inline size_t formatRecordJson(const ArchiveRecord &rec, char *buf, size_t size) {
+    return payloadEncode(PAYLOAD_JSON, recordFields, &rec, rec.flags, (uint8_t*)buf, size);
+}
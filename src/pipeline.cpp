@@ -0,0 +1,1876 @@
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "measurement.h"
+#include "archive_record.h"
+#include "archive_buffer.h"
+#include "archive_log.h"
+#include "batch_frame.h"
+#include "archive_codec.h"
+#include "spsc_queue.h"
+#include "latency_stats.h"
+#include "logging.h"
+#include "rolling_stats.h"
+#include "range_query.h"
+#include "history_tiers.h"
+#include "payload_schema.h"
+#include "notify_pacer.h"
+#include "alert_rules.h"
+#include "burst_sampling.h"
+#include "voc_index.h"
+#include "broadcast.h"
+#include "report_filter.h"
+#include "runtime_config.h"
+#include "serial_dump.h"
+#include "scheduler.h"
+
+// older single-file archives (text, then flat binary) are dropped at boot
+#define LEGACY_TEXT_ARCHIVE_PATH "/archive.log"
+#define LEGACY_BIN_ARCHIVE_PATH  "/archive.bin"
+
+// drain the backlog as binary batch frames (see batch_frame.h) packed up to
+// the negotiated MTU; set to 0 to send one JSON sample per notify instead
+#ifndef FLUSH_BATCHED
+#define FLUSH_BATCHED 1
+#endif
+// batches are delta-compressed blocks (archive_codec.h) instead of raw records
+#ifndef FLUSH_COMPRESSED
+#define FLUSH_COMPRESSED 1
+#endif
+
+// at-least-once delivery for clients that ack: every sample is archived,
+// and once the client has written an ack this connection (pipelineAck())
+// sent samples stay in the log until it acks their seq. A client that never
+// acks gets them dropped as soon as they are notified, like with 0, and a
+// sample it gets live with nothing older pending is not archived at all.
+#ifndef DELIVERY_ACKED
+#define DELIVERY_ACKED 1
+#endif
+// the ack watermark is checkpointed at most this often while acks stream in
+#define ACK_CHECKPOINT_INTERVAL_MS 10000
+// sent records with no ack progress for this long are sent again (go-back-N)
+#ifndef ACK_TIMEOUT_MS
+#define ACK_TIMEOUT_MS 3000
+#endif
+
+// without acks nothing checks that a sample arrived, so samples that are
+// dropped once sent (live and archived) go out as indications when the client
+// enabled them; range and tier data stay on flash and are only notified
+#ifndef NOTIFY_CONFIRM_SAMPLES
+#define NOTIFY_CONFIRM_SAMPLES 1
+#endif
+
+// alert hits waiting for the link; an alert that can't go out for this long
+// is dropped (the sample itself is still archived or sent)
+#define ALERT_QUEUE_SIZE 8
+#ifndef ALERT_MAX_AGE_MS
+#define ALERT_MAX_AGE_MS 600000
+#endif
+
+#if FLUSH_COMPRESSED
+typedef CodecBlockWriter FlushFrameWriter;
+#else
+typedef BatchFrameWriter FlushFrameWriter;
+#endif
+
+// RAM window onto the oldest unconsumed part of the archive log. It is
+// refilled from flash as the flush drains it.
+static CircularBuffer archiveBuffer;
+static bool windowComplete = true;   // every pending record is in the RAM ring
+static uint32_t windowLastSeq = 0;   // newest seq loaded into the RAM ring
+// records at the front of the RAM ring already notified and waiting for an ack
+static uint32_t sendOffset = 0;
+#define REFILL_CHUNK 32
+static ArchiveRecord refillBuf[REFILL_CHUNK];
+static_assert(MAX_BUFFER_SIZE >= 2 * REFILL_CHUNK, "RAM window too small for refills");
+static_assert(CONFIG_WINDOW_MIN >= 2 * REFILL_CHUNK, "config allows a RAM window too small for refills");
+// records the RAM window may hold, set by the runtime config
+static uint32_t windowLimit = MAX_BUFFER_SIZE;
+
+// persistent copy of the archive: one CRC-protected append per sample
+static ArchiveLog *archiveLog = nullptr;
+
+// 5 min / 1 h rollups of every sample, kept far longer than the log
+static HistoryTiers *history = nullptr;
+
+// bulk archive download on the serial port, run by the transport side
+static SerialDump *serialDump = nullptr;
+static std::atomic<bool> serialBusy{false};
+
+// Packet sequence counter (for tracking)
+static uint32_t packetSeq = 0;
+
+// --- transport side state (only touched by pipelineTransport) ---
+static bool deviceConnected = false;
+
+// --- hand-off between the contexts ---
+// combined measurements from the acquisition side
+static SpscQueue<AirMeasurement, 16> measurementQueue;
+// connect/disconnect events from the BLE callback
+static SpscQueue<bool, 8> linkEvents;
+// last state reported by the callback, used to resync if linkEvents overflowed
+static std::atomic<bool> linkRequested{false};
+static std::atomic<bool> linkResync{false};
+// highest contiguous seq the client reported (0 = none this connection)
+static std::atomic<uint32_t> ackRequested{0};
+// the client wrote an ack this connection, any seq: it gets acked delivery
+static std::atomic<bool> ackClient{false};
+// range requests from the control characteristic
+static SpscQueue<RangeRequest, 4> controlQueue;
+// PayloadFormat of single-sample notifications, set by the client per connection
+static std::atomic<uint8_t> payloadFormat{PAYLOAD_JSON};
+// alert rule changes from the control characteristic
+struct AlertRuleWrite {
+    uint8_t index;
+    AlertRule rule;
+};
+static SpscQueue<AlertRuleWrite, 4> alertRuleQueue;
+// burst requests (seconds) for the acquisition side, and the burst records
+// coming back
+static SpscQueue<uint16_t, 4> burstQueue;
+static SpscQueue<ArchiveRecord, BURST_RING_SIZE> burstRing;
+static std::atomic<bool> burstRunning{false};
+// VOC index engine checkpoints on their way to flash
+static SpscQueue<VocCheckpoint, 2> vocStateQueue;
+
+// runtime config blocks written by the client, and the accepted ones on
+// their way to the acquisition side
+static SpscQueue<RuntimeConfig, 2> configQueue;
+static SpscQueue<RuntimeConfig, 2> acquireConfigQueue;
+// the block in effect (transport side)
+static RuntimeConfig activeConfig;
+
+// threshold/rise rules (alert_rules.h) and their hits not sent yet, oldest first
+static AlertEngine alertEngine;
+// change-only reporting: which samples get a seq and go out or to flash
+static ReportFilter reportFilter;
+static AlertEvent alertQueue[ALERT_QUEUE_SIZE];
+static uint8_t alertHead = 0;
+static uint8_t alertCount = 0;
+
+// connectionless broadcast (broadcast.h), from the runtime config
+static bool broadcastOn = false;
+static uint16_t broadcastSeq = 0;
+
+// BLE notify pacing (notify_pacer.h); completions come from the BLE callback
+static NotifyPacer pacer;
+static std::atomic<uint32_t> notifyDoneOk{0};
+static std::atomic<uint32_t> notifyDoneFailed{0};
+static uint32_t notifyDoneOkSeen = 0;
+static uint32_t notifyDoneFailedSeen = 0;
+
+// Flushing state (non-blocking flush)
+static bool flushing = false;
+static uint32_t flushStartTs = 0;
+static uint8_t frameBuf[BATCH_FRAME_MAX];
+// burst records taken off the ring and not sent yet
+static ArchiveRecord burstBuf[BURST_FRAME_RECORDS];
+static size_t burstBufLen = 0;
+
+// Range request state (range_query.h); a running range pauses the flush
+struct RangeState {
+    bool active = false;
+    bool endPending = false;   // end frame still has to go out
+    uint8_t status = RANGE_STATUS_DONE;
+    uint32_t nextSeq = 0;
+    uint32_t lastSeq = 0;
+    uint32_t toTs = UINT32_MAX;
+    uint32_t sent = 0;
+    bool tiered = false;       // tier request, read through cursor
+    TierCursor cursor;
+};
+static RangeState range;
+static ArchiveRecord rangeBuf[REFILL_CHUNK];
+static TierAggregate tierBuf[8];
+static size_t rangeBufLen = 0;
+static size_t rangeBufPos = 0;
+static RangeRequest deferredRequest;
+static bool haveDeferredRequest = false;
+
+// status update interval (runtime config)
+const uint32_t STATUS_UPDATE_INTERVAL = 10000; // 10s
+static uint32_t statusIntervalMs = STATUS_UPDATE_INTERVAL;
+
+// timed transport work: status updates and flush/range steps; events from
+// the other contexts wake the transport through halWakeTransport()
+static DeadlineScheduler transportSched;
+static int8_t statusJob = -1;
+static int8_t stepJob = -1;
+static int8_t ackTimeoutJob = -1;
+static int8_t dumpJob = -1;
+
+// longest either side sleeps when nothing is scheduled
+const uint32_t MAX_WAIT_MS = 60000;
+
+// --- acquisition side state (only touched by pipelineAcquire) ---
+#ifndef SAMPLE_INTERVAL_MS
+#define SAMPLE_INTERVAL_MS 30000
+#endif
+const uint32_t INTERVAL_SPS30 = SAMPLE_INTERVAL_MS;
+const uint32_t INTERVAL_SGP40 = SAMPLE_INTERVAL_MS;
+const uint32_t INTERVAL_SCD41 = SAMPLE_INTERVAL_MS;
+const uint32_t SENSOR_RECOVERY_TIMEOUT = 2 * 60 * 1000UL; // 2 minutes
+// the intervals and the recovery timeout are defaults for the runtime config
+static uint32_t recoveryTimeoutMs = SENSOR_RECOVERY_TIMEOUT;
+// each recovery that brings no good read doubles the wait before the next,
+// up to SENSOR_RECOVERY_TIMEOUT << SENSOR_BACKOFF_MAX (32 min)
+const uint8_t SENSOR_BACKOFF_MAX = 4;
+// the first read after a sensor (re)start, instead of a full interval later
+const uint32_t SENSOR_FIRST_READ_MS = 2000;
+// a read that found no new data is retried a few times before waiting for
+// the next interval (the SCD41 has data at its own 30 s cadence)
+const uint32_t SENSOR_RETRY_MS = 1000;
+const uint8_t SENSOR_RETRIES = 5;
+// the SPS30 needs this long after starting for stable readings, so it only
+// sleeps between samples when that still leaves SPS30_SLEEP_MIN_MS of sleep
+const uint32_t SPS30_WARMUP_MS = 30000;
+const uint32_t SPS30_SLEEP_MIN_MS = 30000;
+
+enum SensorId : uint8_t {
+    SENSOR_SPS30 = 0,
+    SENSOR_SGP40,
+    SENSOR_SCD41,
+    SENSOR_COUNT,
+};
+static_assert(SENSOR_COUNT == PIPELINE_SENSORS, "SensorHealth table out of sync");
+static const char *const sensorNames[SENSOR_COUNT] = {"SPS30", "SGP40", "SCD41"};
+
+// One step of a sensor command sequence: a single halSensorOp(), then the
+// sensor's execution time before the next step (datasheet values). The
+// sequence runs from the scheduler, so nothing ever blocks on a sensor.
+struct SensorStep {
+    SensorOp op;
+    uint16_t waitMs;
+    bool required;     // a failure ends the sequence
+};
+
+// startup and recovery; the wake and stop steps only matter when the
+// sensor was asleep or measuring
+static const SensorStep sps30Restart[] = {
+    {SPS30_OP_WAKE, 5, false},
+    {SPS30_OP_STOP, 20, false},
+    {SPS30_OP_SERIAL_CMD, 20, true},
+    {SPS30_OP_SERIAL_READ, 0, true},
+    {SPS30_OP_START, 20, true},
+};
+static const SensorStep sgp40Restart[] = {
+    {SGP40_OP_SERIAL_CMD, 1, true},
+    {SGP40_OP_SERIAL_READ, 0, true},
+    {SGP40_OP_SELFTEST_CMD, 320, true},
+    {SGP40_OP_SELFTEST_READ, 0, true},
+    {SGP40_OP_HEATER_OFF, 1, false},
+};
+static const SensorStep scd41Restart[] = {
+    {SCD41_OP_WAKE, 30, false},
+    {SCD41_OP_STOP, 500, false},
+    {SCD41_OP_REINIT, 20, false},
+    {SCD41_OP_SERIAL_CMD, 1, true},
+    {SCD41_OP_SERIAL_READ, 0, true},
+    {SCD41_OP_START, 0, true},
+};
+// SPS30 duty cycling between samples
+static const SensorStep sps30Wake[] = {
+    {SPS30_OP_WAKE, 5, true},
+    {SPS30_OP_START, 20, true},
+};
+static const SensorStep sps30Sleep[] = {
+    {SPS30_OP_STOP, 20, true},
+    {SPS30_OP_SLEEP, 0, true},
+};
+// SCD41 into and out of its 5 s periodic mode around a burst
+static const SensorStep scd41Fast[] = {
+    {SCD41_OP_STOP, 500, true},
+    {SCD41_OP_START_FAST, 0, true},
+};
+static const SensorStep scd41Slow[] = {
+    {SCD41_OP_STOP, 500, true},
+    {SCD41_OP_START, 0, true},
+};
+
+enum SequenceKind : uint8_t {
+    SEQ_NONE = 0,
+    SEQ_RESTART,
+    SEQ_WAKE,
+    SEQ_SLEEP,
+    SEQ_FAST,
+    SEQ_SLOW,
+};
+
+// One step of a burst tick (burst_sampling.h), at atMs into the tick: every
+// command first, then each response once its sensor is done. A sensor
+// running a sequence is left out.
+struct BurstStep {
+    uint16_t atMs;
+    uint8_t sensor;
+    SensorOp op;
+    bool fetch;        // a response, read with halSensorFetch()
+};
+static const BurstStep burstSteps[] = {
+    {0, SENSOR_SGP40, SGP40_OP_MEASURE_CMD, false},
+    {0, SENSOR_SPS30, SPS30_OP_READ_CMD, false},
+    {0, SENSOR_SCD41, SCD41_OP_READ_CMD, false},
+    {1, SENSOR_SCD41, SCD41_OP_READ_VALUES, true},
+    {20, SENSOR_SPS30, SPS30_OP_READ_VALUES, true},
+    {30, SENSOR_SGP40, SGP40_OP_MEASURE_READ, true},
+};
+static const uint8_t BURST_STEPS = sizeof(burstSteps) / sizeof(burstSteps[0]);
+// sensor id bits double as the record's REC_HAVE_* flags
+static_assert(REC_HAVE_SPS30 == 1 << SENSOR_SPS30 && REC_HAVE_SGP40 == 1 << SENSOR_SGP40 &&
+              REC_HAVE_SCD41 == 1 << SENSOR_SCD41, "sensor bits out of sync with REC_HAVE_*");
+
+// read, recovery and command sequence state of one sensor
+struct SensorSlot {
+    uint8_t id;
+    uint32_t interval;
+    uint32_t slot;         // when the current read was due
+    uint8_t retries;       // no-data retries in this slot
+    int8_t readJob;
+    int8_t recoveryJob;    // watchdog, moved on by every good read
+    int8_t seqJob;
+    uint8_t seqKind;
+    const SensorStep *seq;
+    uint8_t seqLen;
+    uint8_t seqPos;
+};
+
+static DeadlineScheduler acquireSched;
+static SensorSlot sensors[SENSOR_COUNT];
+// sensors whose boot-time startup sequence hasn't finished
+static uint8_t sensorsStarting = 0;
+
+static AirMeasurement latestMeasurement;
+static PipelineStats stats;
+static AcquireStats acqStats;
+
+// a counter's only writer bumps it without a locked read-modify-write
+template <typename T>
+static inline void bump(std::atomic<T> &c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// VOC index from the SGP40 raw signal (acquisition side)
+static VocIndexEngine vocEngine;
+static uint32_t vocCheckpointMs = 0;   // last checkpoint, or boot
+
+// burst state (acquisition side)
+static int8_t burstJob = -1;
+static uint32_t burstStartMs = 0;
+static uint32_t burstEndMs = 0;
+static uint32_t burstTickMs = 0;     // start of the current tick
+static uint8_t burstPos = 0;         // next step in the tick
+static uint8_t burstIssued = 0;      // sensors whose command went out this tick
+static uint8_t burstFresh = 0;       // sensors read this tick
+static uint8_t burstUnclaimed = 0;   // read by the burst, not yet taken by a read slot
+static uint32_t burstSeq = 0;
+
+// 1 min / 15 min / 1 h summaries, fed on the transport side
+static RollingStats rollingStats;
+static uint8_t summaryBuf[STATS_BLOB_SIZE];
+
+static void kickStep();
+
+// feed completions reported by the stack since the last call to the pacer
+static void takeNotifyFeedback(uint32_t now) {
+    uint32_t ok = notifyDoneOk.load(std::memory_order_relaxed);
+    uint32_t failed = notifyDoneFailed.load(std::memory_order_relaxed);
+    if (ok != notifyDoneOkSeen) {
+        pacer.completed(ok - notifyDoneOkSeen);
+        stats.notifyDone += ok - notifyDoneOkSeen;
+        notifyDoneOkSeen = ok;
+    }
+    if (failed != notifyDoneFailedSeen) {
+        stats.notifyDrops += failed - notifyDoneFailedSeen;
+        notifyDoneFailedSeen = failed;
+        pacer.congested(now);
+    }
+}
+
+// paced notify of raw bytes; false if not connected, too soon or the link
+// is congested, the caller retries later. confirm asks for an indication,
+// urgent sends don't wait for the pacer (a full stack still stops them).
+static bool notifyNow(const uint8_t *data, size_t len, bool confirm = false, bool urgent = false) {
+    if (!deviceConnected) return false;
+    uint32_t now = halMillis();
+    takeNotifyFeedback(now);
+    if (!urgent && pacer.waitMs(now) > 0) return false;
+    // a full stack queue drops notifications silently on some stacks
+    if (halNotifyCredits() == 0) {
+        stats.notifyCongested++;
+        pacer.congested(now);
+        return false;
+    }
+    bool ok;
+    {
+        LATENCY_SCOPE(LAT_SEND);
+        ok = halNotify(data, len, confirm);
+    }
+    if (!ok) {
+        stats.notifyDrops++;
+        pacer.congested(now);
+        return false;
+    }
+    pacer.sent(now, len);
+    stats.notifies++;
+    return true;
+}
+
+// send via BLE characteristic if connected
+static bool sendDataNow(const char *payload, size_t len, bool confirm) {
+    if (!notifyNow((const uint8_t*)payload, len, confirm)) return false;
+    // print payload to serial so we can see what is being sent over BLE
+    LOG_DEBUG("Sending via BLE: %s", payload);
+    return true;
+}
+
+// notify one sample encoded with payloadEncode() in format
+static bool sendPayloadNow(uint8_t format, const uint8_t *payload, size_t len, bool confirm) {
+    if (format == PAYLOAD_JSON) return sendDataNow((const char*)payload, len, confirm);
+    return notifyNow(payload, len, confirm);
+}
+
+// put a record that is (or failed to get) on flash into the RAM window
+static bool addToWindow(const ArchiveRecord &rec, bool onFlash) {
+    if (windowComplete && archiveBuffer.count < windowLimit) {
+        archiveBuffer.add(rec);
+        windowLastSeq = rec.seq;
+        return true;
+    }
+    // newer records wait on flash until the flush gets to them
+    if (onFlash) windowComplete = false;
+    return onFlash;
+}
+
+// top the RAM window up from flash
+static void refillWindow() {
+    if (windowComplete || archiveBuffer.count - sendOffset >= REFILL_CHUNK) return;
+    // sent records wait for their ack, the ring must not overwrite them
+    if (archiveBuffer.count + REFILL_CHUNK > windowLimit) return;
+    size_t n = archiveLog->readAfter(windowLastSeq, refillBuf, REFILL_CHUNK);
+    for (size_t i = 0; i < n; i++) archiveBuffer.add(refillBuf[i]);
+    if (n > 0) windowLastSeq = refillBuf[n - 1].seq;
+    if (n < REFILL_CHUNK) windowComplete = true;
+}
+
+// archived samples not delivered yet (RAM window + flash)
+static uint32_t archivePending() {
+    if (!archiveLog) return archiveBuffer.count;
+    return windowComplete ? archiveBuffer.count : archiveLog->pendingCount();
+}
+
+// Attach the archive on startup. The RAM window starts empty and the flush
+// fills it from flash, so boot time doesn't grow with the backlog.
+static void loadArchiveFromDisk() {
+    LogStorage &storage = halArchiveStorage();
+    if (storage.exists(LEGACY_TEXT_ARCHIVE_PATH)) storage.remove(LEGACY_TEXT_ARCHIVE_PATH);
+    if (storage.exists(LEGACY_BIN_ARCHIVE_PATH)) storage.remove(LEGACY_BIN_ARCHIVE_PATH);
+
+    uint32_t start = halMillis();
+    LogRecoveryStats rs = archiveLog->recover(nullptr, nullptr);
+    // keep seq monotonic across reboots so consumed records stay consumed
+    // and the client never sees a seq twice. With acks, numbering continues
+    // after the last record on flash while some are pending, without the gap
+    // a reservation leaves: a client acking its contiguous seq could never
+    // get past one. Only live samples that skipped the log (emitMeasurement())
+    // use the reservation, and those are only sent with nothing pending.
+#if DELIVERY_ACKED
+    packetSeq = archiveLog->pendingCount() > 0 ? archiveLog->lastSeq() : archiveLog->nextFreeSeq() - 1;
+#else
+    packetSeq = archiveLog->nextFreeSeq() - 1;
+#endif
+    windowLastSeq = archiveLog->ackedSeq();
+    windowComplete = archiveLog->pendingCount() == 0;
+
+    LOG_INFO("Attached %lu samples (%lu bytes on flash) from %lu segments (%lu from headers) in %lu ms",
+             (unsigned long)rs.records, (unsigned long)rs.bytes, (unsigned long)rs.segments,
+             (unsigned long)rs.attached, (unsigned long)(halMillis() - start));
+    if (rs.tornSegments > 0) {
+        LOG_WARN("Recovered valid prefix of %lu torn segment(s)", (unsigned long)rs.tornSegments);
+    }
+}
+
+// Persist archive state (used when we cannot send right now). Records are
+// already on flash, so this only writes the small checkpoint.
+static void flushArchive() {
+    LATENCY_SCOPE(LAT_ARCHIVE);
+    archiveLog->checkpoint();
+}
+
+// Start non-blocking flush
+static void startFlushArchive() {
+    if (archivePending() == 0) {
+        LOG_INFO("Nothing to flush (buffer empty)");
+        return;
+    }
+    flushing = true;
+    flushStartTs = halMillis();
+    kickStep();
+    LOG_INFO("Starting non-blocking flush of %lu samples", (unsigned long)archivePending());
+}
+
+// drop the oldest n records of the RAM ring, they are delivered
+static void consumeFront(uint32_t n) {
+    uint32_t lastSeq = archiveBuffer.at(n - 1).seq;
+    archiveBuffer.popFront(n);
+    archiveLog->markConsumed(lastSeq, n);
+}
+
+// the connected client acks what it gets (DELIVERY_ACKED)
+static bool acking() {
+    return DELIVERY_ACKED && ackClient.load(std::memory_order_relaxed);
+}
+
+// sent samples are only checked when they are dropped right away
+static bool confirmSamples() {
+    return NOTIFY_CONFIRM_SAMPLES && !acking();
+}
+
+// the next n unsent records of the RAM ring went out
+static void releaseSent(uint32_t n) {
+#if DELIVERY_ACKED
+    if (acking()) {
+        // they stay until the client acks them
+        sendOffset += n;
+        if (!transportSched.armed(ackTimeoutJob)) transportSched.at(ackTimeoutJob, halMillis() + ACK_TIMEOUT_MS);
+        return;
+    }
+#endif
+    consumeFront(n);
+}
+
+static void markSent(uint32_t n) {
+    releaseSent(n);
+    stats.archiveSent += n;
+}
+
+#if DELIVERY_ACKED
+static uint32_t lastAckCheckpoint = 0;
+
+// the client has everything up to seq
+static void applyAck(uint32_t seq) {
+    // only records that were actually sent can be acked
+    uint32_t n = 0;
+    while (n < sendOffset && archiveBuffer.at(n).seq <= seq) n++;
+    if (n == 0) return;
+    consumeFront(n);
+    sendOffset -= n;
+    stats.acked += n;
+    if (sendOffset > 0) transportSched.at(ackTimeoutJob, halMillis() + ACK_TIMEOUT_MS);
+    else transportSched.cancel(ackTimeoutJob);
+    // room in the window again if the flush was waiting for acks
+    if (flushing) kickStep();
+    uint32_t now = halMillis();
+    if (now - lastAckCheckpoint >= ACK_CHECKPOINT_INTERVAL_MS) {
+        lastAckCheckpoint = now;
+        flushArchive();
+    }
+}
+
+// the acks stopped: a notification was probably lost, so everything after
+// the ack goes out again. A client that never acked this connection is not
+// resent to; it gets the rest on the next connect.
+static void ackTimeoutJobFn(void *) {
+    if (!deviceConnected || sendOffset == 0 || !acking()) return;
+    LOG_INFO("No ack for %lu sent samples, resending", (unsigned long)sendOffset);
+    sendOffset = 0;
+    stats.resent++;
+    if (!flushing) {
+        flushing = true;
+        flushStartTs = halMillis();
+    }
+    kickStep();
+}
+#endif
+
+// send one archived sample in the client's payload format; true if it went out
+static bool sendSingleArchived() {
+    const ArchiveRecord &rec = archiveBuffer.at(sendOffset);
+    uint8_t payloadBuf[PAYLOAD_MAX_SIZE];
+    uint8_t format = payloadFormat.load(std::memory_order_relaxed);
+    size_t len;
+    {
+        LATENCY_SCOPE(LAT_PAYLOAD);
+        len = payloadEncode(format, recordFields, &rec, rec.flags, payloadBuf, sizeof(payloadBuf));
+    }
+    if (len == 0) {
+        // shouldn't happen but be robust
+        markSent(1);
+        return false;
+    }
+    if (!sendPayloadNow(format, payloadBuf, len, confirmSamples())) return false;
+    markSent(1);
+    return true;
+}
+
+// pack as many archived samples as fit into one notification
+static bool sendArchivedBatch(size_t frameLimit) {
+    uint32_t n = 0;
+    size_t len;
+    {
+        LATENCY_SCOPE(LAT_PAYLOAD);
+        FlushFrameWriter frame;
+        frame.begin(frameBuf, frameLimit);
+        while (sendOffset + n < archiveBuffer.count && frame.add(archiveBuffer.at(sendOffset + n))) n++;
+        len = frame.finish();
+    }
+    if (!notifyNow(frameBuf, len, confirmSamples())) return false;
+    // only the records inside the sent frame count as sent
+    markSent(n);
+    LOG_DEBUG("Sent batch of %lu archived samples via BLE", (unsigned long)n);
+    return true;
+}
+
+// Send one notification of archived data; false when there is nothing to do
+// until something changes (flush over, or waiting for acks)
+static bool processFlushStep() {
+    if (!flushing) return false;
+    LATENCY_SCOPE(LAT_FLUSH_STEP);
+    refillWindow();
+    if (archiveBuffer.count == sendOffset && windowComplete) {
+        LOG_INFO("Flush complete (buffer empty)");
+        flushing = false;
+        stats.flushesDone++;
+        stats.lastFlushMs = halMillis() - flushStartTs;
+        flushArchive();
+        return false;
+    }
+    if (!deviceConnected) {
+        LOG_INFO("Client disconnected during flush, saving checkpoint");
+        flushArchive();
+        flushing = false;
+        return false;
+    }
+    // everything loaded is sent; the rest of the flash waits for acks to make room
+    if (archiveBuffer.count == sendOffset) return false;
+
+    // a failed send is likely throttled; records stay put and we retry next loop
+#if FLUSH_BATCHED
+    size_t limit = halNotifyPayloadLimit();
+    if (limit > sizeof(frameBuf)) limit = sizeof(frameBuf);
+    // with a default-size MTU not even two raw records fit, fall back to JSON
+    if (BatchFrameWriter::capacityFor(limit) >= 2) {
+        sendArchivedBatch(limit);
+        return true;
+    }
+#endif
+    sendSingleArchived();
+    return true;
+}
+
+static void finishRange(uint8_t status) {
+    LOG_INFO("Range request finished (status %u, %lu samples)", (unsigned)status, (unsigned long)range.sent);
+    range.active = false;
+    range.endPending = true;
+    range.status = status;
+}
+
+static void startRange(const RangeRequest &req) {
+    range = RangeState();
+    range.active = true;
+    rangeBufLen = 0;
+    rangeBufPos = 0;
+    if (req.cmd == RANGE_CMD_SEQ) {
+        range.nextSeq = req.first;
+        range.lastSeq = req.last;
+    } else if (req.cmd == RANGE_CMD_TIER) {
+        range.tiered = true;
+        LOG_INFO("Tier %u request from seq %lu", (unsigned)req.tier, (unsigned long)req.first);
+        return;
+    } else {
+        // the sparse index finds the first record, the ts bound ends the stream
+        range.nextSeq = archiveLog->seqAtOrAfterTs(req.first);
+        range.lastSeq = range.nextSeq ? UINT32_MAX : 0;
+        range.toTs = req.last;
+    }
+    if (range.nextSeq == 0) LOG_INFO("Range request matches no archived samples");
+    else LOG_INFO("Range request from seq %lu", (unsigned long)range.nextSeq);
+}
+
+static void handleControl(const RangeRequest &req) {
+    if (range.active) {
+        // the running range ends as cancelled; a new request waits for its end frame
+        finishRange(RANGE_STATUS_CANCELLED);
+        if (req.cmd != RANGE_CMD_CANCEL) {
+            deferredRequest = req;
+            haveDeferredRequest = true;
+        }
+        return;
+    }
+    if (req.cmd == RANGE_CMD_SEQ || req.cmd == RANGE_CMD_TS) {
+        startRange(req);
+        return;
+    }
+    if (req.cmd == RANGE_CMD_TIER) {
+        TierCursor cursor;
+        if (history->seek(cursor, req.tier, req.first, req.last)) {
+            startRange(req);
+            range.cursor = cursor;
+            return;
+        }
+    }
+    range = RangeState();
+    finishRange(req.cmd == RANGE_CMD_CANCEL ? RANGE_STATUS_CANCELLED : RANGE_STATUS_BAD_REQUEST);
+}
+
+// take queued control commands; a finished range first gets its end frame out
+static void applyControl() {
+    if (range.endPending) return;
+    if (haveDeferredRequest) {
+        haveDeferredRequest = false;
+        handleControl(deferredRequest);
+    }
+    RangeRequest req;
+    while (!range.endPending && controlQueue.pop(req)) {
+        if (flushing) {
+            // the client takes over, the backlog stays for the next connect
+            LOG_INFO("Flush stopped by range request");
+            flushing = false;
+            flushArchive();
+        }
+        handleControl(req);
+    }
+    if (range.active || range.endPending) kickStep();
+}
+
+// refill the range buffer from flash, false when the range is exhausted
+static bool rangeRefill() {
+    if (rangeBufPos < rangeBufLen) return true;
+    rangeBufPos = 0;
+    rangeBufLen = 0;
+    if (range.tiered) {
+        rangeBufLen = history->read(range.cursor, tierBuf, sizeof(tierBuf) / sizeof(tierBuf[0]));
+        return rangeBufLen > 0;
+    }
+    if (range.nextSeq == 0 || range.nextSeq > range.lastSeq) return false;
+    rangeBufLen = archiveLog->readRange(range.nextSeq, range.lastSeq, rangeBuf, REFILL_CHUNK);
+    // records past toTs end the range
+    for (size_t i = 0; i < rangeBufLen; i++) {
+        if (rangeBuf[i].ts > range.toTs) {
+            rangeBufLen = i;
+            range.lastSeq = 0;
+            break;
+        }
+    }
+    return rangeBufLen > 0;
+}
+
+// render a bucket as JSON, for MTUs too small for a tier frame
+static size_t formatTierJson(uint8_t tier, const TierAggregate &a, char *buf, size_t size) {
+    int16_t t[3] = {(int16_t)a.mean[1], (int16_t)a.min[1], (int16_t)a.max[1]};
+    int n = snprintf(buf, size,
+                     "{\"tier\":%u,\"seq\":%lu,\"ts\":%lu,\"n\":%u,\"co2\":[%u,%u,%u],\"temp_c100\":[%d,%d,%d],"
+                     "\"rh100\":[%u,%u,%u],\"voc\":[%u,%u,%u],\"pm25\":[%u,%u,%u],\"pm10\":[%u,%u,%u]}",
+                     (unsigned)tier, (unsigned long)a.firstSeq, (unsigned long)a.startTs, (unsigned)a.count,
+                     a.mean[0], a.min[0], a.max[0], t[0], t[1], t[2],
+                     a.mean[2], a.min[2], a.max[2], a.mean[3], a.min[3], a.max[3],
+                     a.mean[4], a.min[4], a.max[4], a.mean[5], a.min[5], a.max[5]);
+    if (n <= 0 || (size_t)n >= size) return 0;
+    return (size_t)n;
+}
+
+// one tier frame (or one JSON bucket) of a tier request
+static void sendTierStep() {
+    size_t limit = halNotifyPayloadLimit();
+    if (limit > sizeof(frameBuf)) limit = sizeof(frameBuf);
+    size_t n = limit > TIER_FRAME_HEADER_SIZE ? (limit - TIER_FRAME_HEADER_SIZE) / sizeof(TierAggregate) : 0;
+    if (n > rangeBufLen - rangeBufPos) n = rangeBufLen - rangeBufPos;
+    size_t len;
+    {
+        LATENCY_SCOPE(LAT_PAYLOAD);
+        if (n > 0) {
+            frameBuf[0] = TIER_FRAME_TYPE;
+            frameBuf[1] = range.cursor.tier;
+            frameBuf[2] = (uint8_t)n;
+            memcpy(frameBuf + TIER_FRAME_HEADER_SIZE, tierBuf + rangeBufPos, n * sizeof(TierAggregate));
+            len = TIER_FRAME_HEADER_SIZE + n * sizeof(TierAggregate);
+        } else {
+            len = formatTierJson(range.cursor.tier, tierBuf[rangeBufPos], (char*)frameBuf, sizeof(frameBuf));
+            n = 1;
+        }
+    }
+    if (len == 0 || !notifyNow(frameBuf, len)) return;
+    rangeBufPos += n;
+    range.sent += n;
+    stats.tierSent += n;
+}
+
+// send one notification of range data (or the end frame)
+static void processRangeStep() {
+    if (!range.active && !range.endPending) return;
+    LATENCY_SCOPE(LAT_FLUSH_STEP);
+    if (!deviceConnected) {
+        LOG_INFO("Client disconnected during range request");
+        range = RangeState();
+        haveDeferredRequest = false;
+        return;
+    }
+    if (!range.active) {
+        uint8_t end[RANGE_END_FRAME_SIZE];
+        size_t len = rangeEndFrame(range.status, range.sent, end);
+        if (notifyNow(end, len)) range.endPending = false;
+        return;
+    }
+    if (!rangeRefill()) {
+        finishRange(RANGE_STATUS_DONE);
+        return;
+    }
+
+    if (range.tiered) {
+        sendTierStep();
+        return;
+    }
+
+    size_t n = 0;
+    size_t len = 0;
+#if FLUSH_BATCHED
+    size_t limit = halNotifyPayloadLimit();
+    if (limit > sizeof(frameBuf)) limit = sizeof(frameBuf);
+    if (BatchFrameWriter::capacityFor(limit) >= 2) {
+        LATENCY_SCOPE(LAT_PAYLOAD);
+        FlushFrameWriter frame;
+        frame.begin(frameBuf, limit);
+        while (rangeBufPos + n < rangeBufLen && frame.add(rangeBuf[rangeBufPos + n])) n++;
+        len = frame.finish();
+    }
+#endif
+    if (n == 0) {
+        LATENCY_SCOPE(LAT_PAYLOAD);
+        const ArchiveRecord &rec = rangeBuf[rangeBufPos];
+        len = payloadEncode(payloadFormat.load(std::memory_order_relaxed), recordFields, &rec, rec.flags,
+                            frameBuf, sizeof(frameBuf));
+        n = 1;
+    }
+    // a throttled send is retried next loop with the same records
+    if (len == 0 || !notifyNow(frameBuf, len)) return;
+    range.nextSeq = rangeBuf[rangeBufPos + n - 1].seq + 1;
+    rangeBufPos += n;
+    range.sent += n;
+    stats.rangeSent += n;
+}
+
+// send queued alerts, oldest first; true once none is left
+static bool sendAlerts() {
+    while (alertCount > 0) {
+        const AlertEvent &ev = alertQueue[alertHead];
+        uint32_t now = halMillis();
+        if (now - ev.ts > ALERT_MAX_AGE_MS) {
+            stats.alertsDropped++;
+            LOG_WARN("Alert for seq %lu dropped, not sent in time", (unsigned long)ev.seq);
+        } else {
+            uint8_t frame[ALERT_FRAME_SIZE];
+            size_t len = alertFrame(ev, frame);
+            // confirmed when the client enabled indications: an alert is not archived
+            if (!notifyNow(frame, len, true, true)) return false;
+            uint32_t latency = halMillis() - ev.ts;
+            stats.alertsSent++;
+            stats.alertLatencyLastMs = latency;
+            stats.alertLatencySumMs += latency;
+            if (latency > stats.alertLatencyMaxMs) stats.alertLatencyMaxMs = latency;
+        }
+        alertHead = (uint8_t)((alertHead + 1) % ALERT_QUEUE_SIZE);
+        alertCount--;
+    }
+    return true;
+}
+
+// check a new sample against the alert rules and get any hit out before
+// whatever else is waiting for the link; true if a rule fired
+static bool raiseAlerts(const ArchiveRecord &rec) {
+    AlertEvent hits[ALERT_RULES];
+    size_t n = alertEngine.evaluate(rec, hits, ALERT_RULES);
+    for (size_t i = 0; i < n; i++) {
+        stats.alertsRaised++;
+        LOG_INFO("Alert: rule %u on seq %lu, value %ld", (unsigned)hits[i].rule, (unsigned long)hits[i].seq,
+                 (long)hits[i].value);
+        if (alertCount == ALERT_QUEUE_SIZE) {
+            // keep the newest
+            alertHead = (uint8_t)((alertHead + 1) % ALERT_QUEUE_SIZE);
+            alertCount--;
+            stats.alertsDropped++;
+        }
+        alertQueue[(alertHead + alertCount) % ALERT_QUEUE_SIZE] = hits[i];
+        alertCount++;
+    }
+    if (n > 0 && deviceConnected && !sendAlerts()) kickStep();
+    return n > 0;
+}
+
+// a batch of burst records is waiting, or the burst is over and the rest
+// goes without waiting for a full one
+static bool burstReady() {
+    size_t n = burstBufLen + burstRing.size();
+    return n >= BURST_BATCH_RECORDS || (n > 0 && !burstRunning.load(std::memory_order_acquire));
+}
+
+// one burst frame with as many records as the link takes
+static void sendBurstFrame() {
+    size_t limit = halNotifyPayloadLimit();
+    if (limit > sizeof(frameBuf)) limit = sizeof(frameBuf);
+    while (burstBufLen < BURST_FRAME_RECORDS && burstRing.pop(burstBuf[burstBufLen])) burstBufLen++;
+    size_t n = 0, len;
+    {
+        LATENCY_SCOPE(LAT_PAYLOAD);
+        BatchFrameWriter frame;
+        frame.begin(frameBuf, limit);
+        while (n < burstBufLen && frame.add(burstBuf[n])) n++;
+        len = frame.finish(BURST_FRAME_TYPE);
+    }
+    // a throttled send is retried with the same records
+    if (n == 0 || !notifyNow(frameBuf, len)) return;
+    stats.burstSent += n;
+    burstBufLen -= n;
+    memmove(burstBuf, burstBuf + n, burstBufLen * sizeof(ArchiveRecord));
+}
+
+// one flush or range notification whenever the pacer allows while there is
+// work; pending alerts go first, then burst data someone is watching live
+static void stepJobFn(void *) {
+    bool more;
+    if (deviceConnected && !sendAlerts()) {
+        more = true;
+    } else if (deviceConnected && burstReady()) {
+        sendBurstFrame();
+        more = true;
+    } else if (range.active || range.endPending) {
+        processRangeStep();
+        // a request that waited for the end frame can start now
+        applyControl();
+        more = range.active || range.endPending || flushing;
+    } else {
+        more = processFlushStep();
+    }
+    if (!more) return;
+    uint32_t now = halMillis();
+    uint32_t wait = pacer.waitMs(now);
+    transportSched.at(stepJob, now + (wait ? wait : 1));
+}
+
+static void kickStep() {
+    if (!transportSched.armed(stepJob)) transportSched.at(stepJob, halMillis());
+}
+
+// also before pipelineBegin(), with the archive and the tiers still empty
+static void updateStatus() {
+    char statusBuf[640];
+    uint32_t boot[BOOT_PHASE_COUNT];
+    for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) boot[i] = acqStats.bootMs[i].load(std::memory_order_relaxed);
+    // hundredths of a reading per second
+    uint32_t burstReads = acqStats.burstReads.load(std::memory_order_relaxed);
+    uint32_t burstMs = acqStats.burstMs.load(std::memory_order_relaxed);
+    uint32_t burstRate = burstMs ? (uint32_t)((uint64_t)burstReads * 100000 / burstMs) : 0;
+    int n = snprintf(statusBuf, sizeof(statusBuf),
+                     "{\"buffer\":%u,\"cfg\":[%lu,%lu],\"connected\":%s,\"seq\":%lu,\"acked\":%lu,\"held\":%lu,\"boot\":[%lu,%lu,%lu,%lu],\"tiers\":[%lu,%lu]"
+                     ",\"link\":[%lu,%lu,%lu,%lu,%lu,%lu],\"alerts\":[%lu,%lu,%lu,%lu,%lu]"
+                     ",\"burst\":[%lu,%lu,%lu,%lu,%lu.%02lu],\"voc\":[%lu,%u],\"bcast\":%lu",
+                     (unsigned)archivePending(), (unsigned long)stats.configApplied,
+                     (unsigned long)stats.configRejected, deviceConnected ? "true" : "false",
+                     (unsigned long)packetSeq, (unsigned long)(archiveLog ? archiveLog->ackedSeq() : 0),
+                     (unsigned long)stats.held,
+                     (unsigned long)boot[BOOT_ADVERTISING], (unsigned long)boot[BOOT_ARCHIVE],
+                     (unsigned long)boot[BOOT_SENSORS], (unsigned long)boot[BOOT_FIRST_MEASUREMENT],
+                     (unsigned long)(history ? history->count(TIER_5MIN) : 0),
+                     (unsigned long)(history ? history->count(TIER_1H) : 0),
+                     // [interval ms, bytes/s, notifies, done, dropped, congested]
+                     (unsigned long)pacer.intervalMs(), (unsigned long)pacer.bytesPerSec(),
+                     (unsigned long)stats.notifies, (unsigned long)stats.notifyDone,
+                     (unsigned long)stats.notifyDrops, (unsigned long)stats.notifyCongested,
+                     // [raised, sent, dropped, last latency ms, max latency ms]
+                     (unsigned long)stats.alertsRaised, (unsigned long)stats.alertsSent,
+                     (unsigned long)stats.alertsDropped, (unsigned long)stats.alertLatencyLastMs,
+                     (unsigned long)stats.alertLatencyMaxMs,
+                     // [records, sent, dropped, readings, readings/s] of the current or last burst
+                     (unsigned long)acqStats.burstRecords.load(std::memory_order_relaxed),
+                     (unsigned long)stats.burstSent,
+                     (unsigned long)acqStats.burstDropped.load(std::memory_order_relaxed),
+                     (unsigned long)burstReads,
+                     (unsigned long)(burstRate / 100), (unsigned long)(burstRate % 100),
+                     // [checkpoints stored, restored at boot]
+                     (unsigned long)stats.vocCheckpoints, stats.vocRestored ? 1u : 0u,
+                     // advertisement updates (broadcast.h)
+                     (unsigned long)stats.broadcasts);
+    // per sensor: [reads, misses, errors, recoveries, backoff]
+    for (uint8_t i = 0; i < SENSOR_COUNT && n > 0 && n < (int)sizeof(statusBuf); i++) {
+        const SensorHealth &h = acqStats.sensors[i];
+        n += snprintf(statusBuf + n, sizeof(statusBuf) - n, "%s[%lu,%lu,%lu,%lu,%u]%s",
+                      i == 0 ? ",\"health\":[" : ",", (unsigned long)h.reads.load(std::memory_order_relaxed),
+                      (unsigned long)h.misses.load(std::memory_order_relaxed),
+                      (unsigned long)h.errors.load(std::memory_order_relaxed),
+                      (unsigned long)h.recoveries.load(std::memory_order_relaxed),
+                      (unsigned)h.backoff.load(std::memory_order_relaxed),
+                      i == SENSOR_COUNT - 1 ? "]}" : "");
+    }
+    if (n > 0 && n < (int)sizeof(statusBuf)) halSetStatus(statusBuf, n);
+}
+
+// notify one sample right away, with every SPS30 field the archive drops
+static bool sendLive(const LiveSample &sample, uint8_t present) {
+    if (!deviceConnected) return false;
+    uint8_t payloadBuf[PAYLOAD_MAX_SIZE];
+    uint8_t format = payloadFormat.load(std::memory_order_relaxed);
+    size_t len;
+    {
+        LATENCY_SCOPE(LAT_PAYLOAD);
+        len = payloadEncode(format, liveFields, &sample, present, payloadBuf, sizeof(payloadBuf));
+    }
+    return len > 0 && sendPayloadNow(format, payloadBuf, len, confirmSamples());
+}
+
+// the log overwrote its oldest segment to make room: what the RAM window
+// still holds of it is gone from flash and counts as consumed, sent or not
+static void dropOverwritten() {
+    uint32_t acked = archiveLog->ackedSeq();
+    uint32_t n = 0;
+    while (n < archiveBuffer.count && archiveBuffer.at(n).seq <= acked) n++;
+    if (n == 0) return;
+    archiveBuffer.popFront(n);
+    sendOffset = n < sendOffset ? sendOffset - n : 0;
+    LOG_WARN("Archive full, %lu undelivered samples overwritten", (unsigned long)n);
+}
+
+// append a sample to the on-flash log and the RAM window
+static bool archiveSample(const ArchiveRecord &rec) {
+    bool onFlash;
+    {
+        LATENCY_SCOPE(LAT_ARCHIVE);
+        onFlash = archiveLog->append(rec);
+    }
+    if (!onFlash) LOG_ERROR("Archive append failed");
+    dropOverwritten();
+    if (!addToWindow(rec, onFlash)) {
+        LOG_WARN("Archive full, sample dropped");
+        return false;
+    }
+    return true;
+}
+
+// every measurement goes into the advertisement, reported or not
+static void broadcastMeasurement(const AirMeasurement &m) {
+    if (!broadcastOn) return;
+    BroadcastPayload p;
+    broadcastEncode(m, ++broadcastSeq, p);
+    halSetAdvertisement((const uint8_t*)&p, sizeof(p));
+    stats.broadcasts++;
+}
+
+// send or archive one combined sample
+static void emitMeasurement(const AirMeasurement &m) {
+    // build a compact record; JSON is only rendered when it is actually sent.
+    // The seq is only taken if the sample gets reported.
+    ArchiveRecord rec = makeArchiveRecord(m, packetSeq + 1);
+    stats.measurements++;
+    broadcastMeasurement(m);
+
+    // an alert always refers to a reported sample
+    bool alert = raiseAlerts(rec);
+    rollingStats.add(rec);
+    history->add(rec);
+    if (!reportFilter.check(rec, alert)) {
+        stats.held++;
+        return;
+    }
+    packetSeq++;  // increment sequence counter
+#if !DELIVERY_ACKED
+    archiveLog->reserveSeq(packetSeq);
+#endif
+    LiveSample live;
+    live.seq = packetSeq;
+    live.held = reportFilter.held();
+    live.m = m;
+    rec.flags |= (uint8_t)(live.held << REC_HELD_SHIFT);
+    reportFilter.reported(rec);
+
+    // the summary goes out with reported samples only, it is radio traffic too
+    size_t summaryLen = rollingStats.encode(summaryBuf, sizeof(summaryBuf));
+    if (summaryLen > 0) halPublishSummary(summaryBuf, summaryLen);
+
+#if DELIVERY_ACKED
+    // A client that doesn't ack drops what it gets anyway, so with nothing
+    // older pending a sample it gets live is never written to the log. Its
+    // seq comes from the reservation; the first one of a run checkpoints the
+    // consumed seq, so a reboot never finds those records pending again and
+    // resumes numbering after the reservation (loadArchiveFromDisk()).
+    static bool skippingLog = false;
+    bool idle = !flushing && windowComplete && archiveBuffer.count == 0;
+    if (!acking() && idle && sendLive(live, rec.flags)) {
+        if (!skippingLog) archiveLog->checkpoint();
+        skippingLog = true;
+        archiveLog->reserveSeq(packetSeq);
+        stats.sentLive++;
+        LOG_DEBUG("Combined data sent via BLE");
+        return;
+    }
+    skippingLog = false;
+    // everything else is archived and, for an acking client, kept until
+    // acked; a live send only gets it out before the flush would, and only
+    // when nothing older is still unsent
+    if (!archiveSample(rec)) return;
+    bool caughtUp = !flushing && windowComplete && archiveBuffer.count - sendOffset == 1;
+    if (caughtUp && sendLive(live, rec.flags)) {
+        releaseSent(1);
+        stats.sentLive++;
+        LOG_DEBUG("Combined data sent via BLE");
+        return;
+    }
+    stats.archived++;
+    LOG_DEBUG("Combined data archived (%lu/%u samples)",
+              (unsigned long)archivePending(), (unsigned)ARCHIVE_LOG_CAPACITY);
+    if (deviceConnected && !flushing) startFlushArchive();
+#else
+    if (sendLive(live, rec.flags)) {
+        stats.sentLive++;
+        LOG_DEBUG("Combined data sent via BLE");
+    } else if (archiveSample(rec)) {
+        stats.archived++;
+        LOG_DEBUG("Combined data archived (%lu/%u samples)",
+                  (unsigned long)archivePending(), (unsigned)ARCHIVE_LOG_CAPACITY);
+    }
+#endif
+}
+
+static void serialWrite(const uint8_t *data, size_t len, void *) {
+    halSerialWrite(data, len);
+}
+
+// one frame per step, so BLE work gets in between
+static void dumpJobFn(void *) {
+    static uint32_t startMs = 0;
+    if (!serialBusy.load(std::memory_order_relaxed)) {
+        startMs = halMillis();
+        serialBusy.store(true, std::memory_order_relaxed);
+    }
+    if (serialDump->step()) {
+        transportSched.at(dumpJob, halMillis());
+        return;
+    }
+    serialBusy.store(false, std::memory_order_relaxed);
+    LOG_INFO("Serial dump done in %lu ms", (unsigned long)(halMillis() - startMs));
+}
+
+static void statusJobFn(void *) {
+    updateStatus();
+    transportSched.at(statusJob, halMillis() + statusIntervalMs);
+}
+
+// --- acquisition side jobs ---
+// the SGP40 measures against the newest SCD41 humidity and temperature
+static void compensateSgp40() {
+    halSetSgp40Compensation(vocRhTicks(latestMeasurement.rh), vocTempTicks(latestMeasurement.temp));
+}
+
+// one engine step per SGP40 read slot, so it runs at the read interval; once
+// it has learned enough its state is stored every VOC_CHECKPOINT_MS
+static void updateVocIndex() {
+    latestMeasurement.vocIndex = vocEngine.process(latestMeasurement.srawVoc);
+    uint32_t now = halMillis();
+    if (!vocEngine.settled() || now - vocCheckpointMs < VOC_CHECKPOINT_MS) return;
+    vocCheckpointMs = now;
+    VocCheckpoint cp;
+    vocEngine.checkpoint(cp);
+    if (!vocStateQueue.push(cp)) LOG_WARN("VOC index checkpoint dropped, queue full");
+    halWakeTransport();
+}
+
+static bool readSensor(uint8_t id) {
+    // a burst has the bus; the slot takes its newest reading instead
+    if (burstRunning.load(std::memory_order_relaxed)) {
+        uint8_t bit = (uint8_t)(1u << id);
+        if (!(burstUnclaimed & bit)) return false;
+        burstUnclaimed &= (uint8_t)~bit;
+        if (id == SENSOR_SPS30) {
+            latestMeasurement.haveSps30 = true;
+        } else if (id == SENSOR_SGP40) {
+            latestMeasurement.haveSgp40 = true;
+            updateVocIndex();
+        } else {
+            latestMeasurement.haveScd41 = true;
+        }
+        return true;
+    }
+    bool ok = false;
+    switch (id) {
+    case SENSOR_SPS30: {
+        LATENCY_SCOPE(LAT_READ_SPS30);
+        ok = halReadSps30(latestMeasurement);
+        if (ok) latestMeasurement.haveSps30 = true;
+        break;
+    }
+    case SENSOR_SGP40: {
+        LATENCY_SCOPE(LAT_READ_SGP40);
+        ok = halReadSgp40(latestMeasurement);
+        latestMeasurement.haveSgp40 = ok;
+        if (ok) updateVocIndex();
+        break;
+    }
+    case SENSOR_SCD41: {
+        LATENCY_SCOPE(LAT_READ_SCD41);
+        ok = halReadScd41(latestMeasurement);
+        if (ok) {
+            latestMeasurement.haveScd41 = true;
+            compensateSgp40();
+        }
+        break;
+    }
+    }
+    return ok;
+}
+
+static bool runSensorOp(uint8_t id, SensorOp op) {
+    switch (id) {
+    case SENSOR_SPS30: {
+        LATENCY_SCOPE(LAT_DIAG_SPS30);
+        return halSensorOp(op);
+    }
+    case SENSOR_SGP40: {
+        LATENCY_SCOPE(LAT_DIAG_SGP40);
+        return halSensorOp(op);
+    }
+    default: {
+        LATENCY_SCOPE(LAT_DIAG_SCD41);
+        return halSensorOp(op);
+    }
+    }
+}
+
+// the response to a burst command, into latestMeasurement
+static bool fetchSensor(uint8_t id, SensorOp op) {
+    switch (id) {
+    case SENSOR_SPS30: {
+        LATENCY_SCOPE(LAT_READ_SPS30);
+        return halSensorFetch(op, latestMeasurement);
+    }
+    case SENSOR_SGP40: {
+        LATENCY_SCOPE(LAT_READ_SGP40);
+        return halSensorFetch(op, latestMeasurement);
+    }
+    default: {
+        LATENCY_SCOPE(LAT_READ_SCD41);
+        return halSensorFetch(op, latestMeasurement);
+    }
+    }
+}
+
+// start a command sequence at due, replacing whatever sequence was running
+static void startSequence(SensorSlot &s, uint8_t kind, uint32_t due) {
+    s.seqKind = kind;
+    s.seqPos = 0;
+    if (kind == SEQ_FAST) {
+        s.seq = scd41Fast;
+        s.seqLen = sizeof(scd41Fast) / sizeof(scd41Fast[0]);
+    } else if (kind == SEQ_SLOW) {
+        s.seq = scd41Slow;
+        s.seqLen = sizeof(scd41Slow) / sizeof(scd41Slow[0]);
+    } else if (kind == SEQ_WAKE) {
+        s.seq = sps30Wake;
+        s.seqLen = sizeof(sps30Wake) / sizeof(sps30Wake[0]);
+    } else if (kind == SEQ_SLEEP) {
+        s.seq = sps30Sleep;
+        s.seqLen = sizeof(sps30Sleep) / sizeof(sps30Sleep[0]);
+    } else if (s.id == SENSOR_SPS30) {
+        s.seq = sps30Restart;
+        s.seqLen = sizeof(sps30Restart) / sizeof(sps30Restart[0]);
+    } else if (s.id == SENSOR_SGP40) {
+        s.seq = sgp40Restart;
+        s.seqLen = sizeof(sgp40Restart) / sizeof(sgp40Restart[0]);
+    } else {
+        s.seq = scd41Restart;
+        s.seqLen = sizeof(scd41Restart) / sizeof(scd41Restart[0]);
+    }
+    // no reads while the sensor restarts or changes back to low power
+    if (kind == SEQ_RESTART || kind == SEQ_SLOW) acquireSched.cancel(s.readJob);
+    acquireSched.at(s.seqJob, due);
+}
+
+// the SPS30 only sleeps when its interval leaves time for warm-up and sleep
+static bool sps30Sleeps(const SensorSlot &s) {
+    return SENSOR_LOW_POWER && s.interval >= SPS30_WARMUP_MS + SPS30_SLEEP_MIN_MS;
+}
+
+// the watchdog always lets two read slots pass before it steps in
+static uint32_t recoveryTimeout(const SensorSlot &s) {
+    return recoveryTimeoutMs > 2 * s.interval ? recoveryTimeoutMs : 2 * s.interval;
+}
+
+static uint32_t recoveryDelay(const SensorSlot &s) {
+    uint8_t backoff = acqStats.sensors[s.id].backoff.load(std::memory_order_relaxed);
+    return recoveryTimeout(s) << (backoff < SENSOR_BACKOFF_MAX ? backoff : SENSOR_BACKOFF_MAX);
+}
+
+// a low-power SCD41 measures every 5 s during a burst
+static bool scd41WantsFast(const SensorSlot &s) {
+    return SENSOR_LOW_POWER && s.id == SENSOR_SCD41 && burstRunning.load(std::memory_order_relaxed);
+}
+
+static void finishSequence(SensorSlot &s, bool ok) {
+    uint8_t kind = s.seqKind;
+    s.seqKind = SEQ_NONE;
+    uint32_t now = halMillis();
+    if (kind == SEQ_SLEEP) {
+        // a sensor that didn't go to sleep is still measuring, leave it;
+        // a burst wants it back right away
+        bool burst = burstRunning.load(std::memory_order_relaxed);
+        if (ok) startSequence(s, SEQ_WAKE, burst ? now : s.slot + s.interval - SPS30_WARMUP_MS);
+        return;
+    }
+    if (kind == SEQ_FAST || kind == SEQ_SLOW) {
+        if (!ok) LOG_WARN("%s mode change failed at step %u", sensorNames[s.id], (unsigned)s.seqPos);
+        if (kind == SEQ_FAST) return;
+        uint32_t due = s.slot + s.interval;
+        s.retries = 0;
+        acquireSched.at(s.readJob, (int32_t)(due - now) > 0 ? due : now);
+        // a burst that started again in the meantime
+        if (scd41WantsFast(s)) startSequence(s, SEQ_FAST, now);
+        return;
+    }
+    if (kind != SEQ_RESTART) return;
+    if (ok) LOG_INFO("%s started", sensorNames[s.id]);
+    else LOG_WARN("%s startup failed at step %u", sensorNames[s.id], (unsigned)s.seqPos);
+    // reads resume either way; the watchdog retries a sensor that stays silent
+    s.slot = now + SENSOR_FIRST_READ_MS;
+    s.retries = 0;
+    acquireSched.at(s.readJob, s.slot);
+    acquireSched.at(s.recoveryJob, now + recoveryDelay(s));
+    if (scd41WantsFast(s)) startSequence(s, SEQ_FAST, now);
+    if (sensorsStarting & (1u << s.id)) {
+        sensorsStarting &= ~(1u << s.id);
+        if (sensorsStarting == 0) pipelineBootMark(BOOT_SENSORS);
+    }
+}
+
+static void sensorSeqJob(void *ctx) {
+    SensorSlot &s = *(SensorSlot*)ctx;
+    if (s.seqKind == SEQ_NONE) return;
+    const SensorStep &step = s.seq[s.seqPos];
+    if (!runSensorOp(s.id, step.op)) {
+        bump(acqStats.sensors[s.id].errors);
+        if (step.required) {
+            finishSequence(s, false);
+            return;
+        }
+    }
+    if (++s.seqPos == s.seqLen) {
+        finishSequence(s, true);
+        return;
+    }
+    acquireSched.at(s.seqJob, halMillis() + step.waitMs);
+}
+
+// once all sensors have fresh readings, hand one combined sample over
+static void emitIfComplete() {
+    if (!latestMeasurement.haveSps30 || !latestMeasurement.haveSgp40 || !latestMeasurement.haveScd41) return;
+    if (!measurementQueue.push(latestMeasurement)) bump(acqStats.measurementsDropped);
+    pipelineBootMark(BOOT_FIRST_MEASUREMENT);
+    halWakeTransport();
+    // reset measurement flags so next cycle waits for new readings
+    latestMeasurement.haveSps30 = false;
+    latestMeasurement.haveSgp40 = false;
+    latestMeasurement.haveScd41 = false;
+}
+
+static void sensorReadJob(void *ctx) {
+    SensorSlot &s = *(SensorSlot*)ctx;
+    uint32_t now = halMillis();
+    SensorHealth &h = acqStats.sensors[s.id];
+    if (readSensor(s.id)) {
+        latestMeasurement.ts = halMillis();
+        s.slot = now;
+        s.retries = 0;
+        bump(h.reads);
+        h.backoff.store(0, std::memory_order_relaxed);
+        // a sensor that keeps reporting never needs its recovery
+        acquireSched.at(s.recoveryJob, latestMeasurement.ts + recoveryTimeout(s));
+        bool burst = burstRunning.load(std::memory_order_relaxed);
+        if (s.id == SENSOR_SPS30 && sps30Sleeps(s) && !burst) startSequence(s, SEQ_SLEEP, now);
+        emitIfComplete();
+    } else if (s.retries < SENSOR_RETRIES) {
+        s.retries++;
+        acquireSched.at(s.readJob, now + SENSOR_RETRY_MS);
+        return;
+    } else {
+        // give up on this slot and keep the cadence
+        s.retries = 0;
+        s.slot += s.interval;
+        bump(h.misses);
+    }
+    acquireSched.at(s.readJob, s.slot + s.interval);
+}
+
+// no good read for a while: restart the sensor, backing off while it stays silent
+static void sensorRecoveryJob(void *ctx) {
+    SensorSlot &s = *(SensorSlot*)ctx;
+    SensorHealth &h = acqStats.sensors[s.id];
+    uint8_t backoff = h.backoff.load(std::memory_order_relaxed);
+    LOG_WARN("%s not responding, restarting it (attempt %u)", sensorNames[s.id], (unsigned)backoff + 1);
+    bump(h.recoveries);
+    if (backoff < SENSOR_BACKOFF_MAX) h.backoff.store(backoff + 1, std::memory_order_relaxed);
+    startSequence(s, SEQ_RESTART, halMillis());
+}
+
+// one burst step; a sensor running a sequence sits the tick out
+static void runBurstStep(const BurstStep &step) {
+    SensorSlot &s = sensors[step.sensor];
+    uint8_t bit = (uint8_t)(1u << step.sensor);
+    if (s.seqKind != SEQ_NONE) return;
+    if (!step.fetch) {
+        if (runSensorOp(step.sensor, step.op)) burstIssued |= bit;
+        else bump(acqStats.sensors[step.sensor].errors);
+        return;
+    }
+    if (!(burstIssued & bit)) return;
+    if (!fetchSensor(step.sensor, step.op)) return;
+    if (step.sensor == SENSOR_SCD41) compensateSgp40();
+    burstFresh |= bit;
+    burstUnclaimed |= bit;
+    bump(acqStats.burstReads);
+}
+
+static void startBurst(uint16_t seconds) {
+    uint32_t now = halMillis();
+    burstEndMs = now + seconds * 1000UL;
+    if (burstRunning.load(std::memory_order_relaxed)) {
+        LOG_INFO("Burst now ends in %u s", (unsigned)seconds);
+        return;
+    }
+    if (seconds == 0) return;
+    LOG_INFO("Burst sampling for %u s", (unsigned)seconds);
+    burstRunning.store(true, std::memory_order_release);
+    burstStartMs = now;
+    burstPos = 0;
+    burstUnclaimed = 0;
+    acqStats.burstReads.store(0, std::memory_order_relaxed);
+    acqStats.burstMs.store(0, std::memory_order_relaxed);
+    // a sleeping SPS30 wakes up now instead of before its next slot
+    SensorSlot &pm = sensors[SENSOR_SPS30];
+    if (pm.seqKind == SEQ_WAKE && pm.seqPos == 0) acquireSched.at(pm.seqJob, now);
+    SensorSlot &co2 = sensors[SENSOR_SCD41];
+    // one still starting or changing back switches when that is done
+    if (scd41WantsFast(co2) && co2.seqKind == SEQ_NONE) startSequence(co2, SEQ_FAST, now);
+    acquireSched.at(burstJob, now);
+}
+
+static void endBurst(uint32_t now) {
+    burstRunning.store(false, std::memory_order_release);
+    uint32_t ms = now - burstStartMs;
+    uint32_t reads = acqStats.burstReads.load(std::memory_order_relaxed);
+    acqStats.burstMs.store(ms, std::memory_order_relaxed);
+    uint32_t rate = ms ? (uint32_t)((uint64_t)reads * 100000 / ms) : 0;
+    LOG_INFO("Burst done: %lu readings in %lu ms, %lu.%02lu readings/s", (unsigned long)reads,
+             (unsigned long)ms, (unsigned long)(rate / 100), (unsigned long)(rate % 100));
+    // the rest of the ring goes out now
+    halWakeTransport();
+#if SENSOR_LOW_POWER
+    // back to the low-power modes; the read slots are on the bus again
+    if (sensors[SENSOR_SGP40].seqKind == SEQ_NONE) runSensorOp(SENSOR_SGP40, SGP40_OP_HEATER_OFF);
+    SensorSlot &co2 = sensors[SENSOR_SCD41];
+    if (co2.seqKind != SEQ_RESTART) startSequence(co2, SEQ_SLOW, now);
+#endif
+}
+
+// one step at a time through the tick, then the tick's record to the ring
+static void burstJobFn(void *) {
+    uint32_t now = halMillis();
+    if (burstPos == 0) {
+        // a burst only ends between ticks, with no command left unanswered
+        if ((int32_t)(now - burstEndMs) >= 0) {
+            endBurst(now);
+            return;
+        }
+        burstTickMs = now;
+        burstIssued = 0;
+        burstFresh = 0;
+    }
+    while (burstPos < BURST_STEPS && now - burstTickMs >= burstSteps[burstPos].atMs) {
+        runBurstStep(burstSteps[burstPos++]);
+    }
+    if (burstPos < BURST_STEPS) {
+        acquireSched.at(burstJob, burstTickMs + burstSteps[burstPos].atMs);
+        return;
+    }
+    burstPos = 0;
+    acqStats.burstMs.store(now - burstStartMs, std::memory_order_relaxed);
+    if (burstFresh) {
+        ArchiveRecord rec = makeArchiveRecord(latestMeasurement, ++burstSeq);
+        rec.ts = burstTickMs;
+        rec.flags = burstFresh;
+        bump(acqStats.burstRecords);
+        if (!burstRing.push(rec)) bump(acqStats.burstDropped);
+        else if (burstRing.size() >= BURST_BATCH_RECORDS) halWakeTransport();
+    }
+    acquireSched.at(burstJob, burstTickMs + BURST_TICK_MS);
+}
+
+// move a sensor to a new read interval: the next read, a pending SPS30
+// wake-up and the watchdog follow the new cadence from the last slot
+static void replanSensor(SensorSlot &s, uint32_t interval) {
+    if (interval == s.interval) return;
+    s.interval = interval;
+    uint32_t now = halMillis();
+    if (s.seqKind == SEQ_RESTART) return;  // reads get armed when it is done
+    uint32_t due = s.slot + interval;
+    if ((int32_t)(due - now) < 0) due = now;
+    if (acquireSched.armed(s.readJob) && s.retries == 0) acquireSched.at(s.readJob, due);
+    if (s.seqKind == SEQ_WAKE && s.seqPos == 0) {
+        uint32_t wake = due - now > SPS30_WARMUP_MS ? due - SPS30_WARMUP_MS : now;
+        acquireSched.at(s.seqJob, wake);
+    }
+    if (acquireSched.armed(s.recoveryJob)) acquireSched.at(s.recoveryJob, now + recoveryDelay(s));
+}
+
+static void applyAcquireConfig(const RuntimeConfig &cfg) {
+    recoveryTimeoutMs = cfg.recoveryTimeoutMs;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) replanSensor(sensors[i], cfg.intervalMs[i]);
+    vocEngine.setSamplingInterval(cfg.intervalMs[SENSOR_SGP40]);
+}
+
+static void applyTransportConfig(const RuntimeConfig &cfg) {
+    pacer.setLimits(cfg.notifyRateMin, cfg.notifyRateMax);
+    windowLimit = cfg.windowRecords;
+    reportFilter.enabled = cfg.reportDeadband;
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) reportFilter.deadband[c] = cfg.deadband[c];
+    reportFilter.maxSilenceMs = cfg.maxSilenceMs;
+    // turned off: the advertisement drops the measurement right away
+    if (broadcastOn && !cfg.broadcast) halSetAdvertisement(nullptr, 0);
+    broadcastOn = cfg.broadcast;
+    // a shorter status interval starts now, not after the old one ran out
+    uint32_t due = halMillis() + cfg.statusIntervalMs;
+    statusIntervalMs = cfg.statusIntervalMs;
+    if (!transportSched.armed(statusJob) || (int32_t)(transportSched.deadline(statusJob) - due) > 0) {
+        transportSched.at(statusJob, due);
+    }
+}
+
+// the compiled-in values
+static void configDefaults(RuntimeConfig &cfg) {
+    cfg = RuntimeConfig();
+    cfg.intervalMs[SENSOR_SPS30] = INTERVAL_SPS30;
+    cfg.intervalMs[SENSOR_SGP40] = INTERVAL_SGP40;
+    cfg.intervalMs[SENSOR_SCD41] = INTERVAL_SCD41;
+    cfg.statusIntervalMs = STATUS_UPDATE_INTERVAL;
+    cfg.recoveryTimeoutMs = SENSOR_RECOVERY_TIMEOUT;
+    cfg.notifyRateMin = NOTIFY_RATE_MIN;
+    cfg.notifyRateMax = NOTIFY_RATE_MAX;
+    cfg.windowRecords = MAX_BUFFER_SIZE;
+    ReportFilter f;
+    cfg.reportDeadband = f.enabled;
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) cfg.deadband[c] = f.deadband[c];
+    cfg.maxSilenceMs = f.maxSilenceMs;
+    cfg.broadcast = BROADCAST_ADV;
+}
+
+// the stored block if there is a good one, else the defaults
+static void loadConfig() {
+    uint8_t block[CONFIG_BLOCK_SIZE];
+    if (halConfigLoad(block, sizeof(block)) && configDecode(block, sizeof(block), activeConfig)) {
+        LOG_INFO("Runtime config loaded");
+    } else {
+        configDefaults(activeConfig);
+    }
+    configEncode(activeConfig, block);
+    halSetConfig(block, sizeof(block));
+}
+
+// a stored VOC engine state lets the index go on where it was before the
+// reboot instead of learning the baseline again
+static void loadVocState() {
+    vocEngine.begin(activeConfig.intervalMs[SENSOR_SGP40]);
+    vocCheckpointMs = halMillis();
+    uint8_t block[VOC_CHECKPOINT_SIZE];
+    VocCheckpoint cp;
+    if (halVocStateLoad(block, sizeof(block)) && vocCheckpointDecode(block, sizeof(block), cp) &&
+        vocEngine.restore(cp)) {
+        stats.vocRestored = true;
+        LOG_INFO("VOC index state restored");
+    }
+}
+
+static void saveVocState(VocCheckpoint &cp) {
+    uint8_t block[VOC_CHECKPOINT_SIZE];
+    vocCheckpointEncode(cp, block);
+    if (!halVocStateSave(block, sizeof(block))) {
+        LOG_WARN("VOC index state not stored");
+        return;
+    }
+    stats.vocCheckpoints++;
+}
+
+// a config block from the client: check, store, apply on both sides
+static void applyConfigWrite(const RuntimeConfig &cfg) {
+    if (!configValid(cfg)) {
+        stats.configRejected++;
+        LOG_WARN("Runtime config rejected");
+        return;
+    }
+    activeConfig = cfg;
+    uint8_t block[CONFIG_BLOCK_SIZE];
+    configEncode(activeConfig, block);
+    if (!halConfigSave(block, sizeof(block))) LOG_WARN("Runtime config not stored, applied until reboot");
+    applyTransportConfig(cfg);
+    if (!acquireConfigQueue.push(cfg)) LOG_WARN("Runtime config for sensors dropped, queue full");
+    halWakeAcquire();
+    halSetConfig(block, sizeof(block));
+    stats.configApplied++;
+    LOG_INFO("Runtime config applied");
+}
+
+static void scheduleBegin() {
+    uint32_t now = halMillis();
+    recoveryTimeoutMs = activeConfig.recoveryTimeoutMs;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        SensorSlot &s = sensors[i];
+        s.id = i;
+        s.interval = activeConfig.intervalMs[i];
+        s.slot = now;
+        s.retries = 0;
+        s.seqKind = SEQ_NONE;
+        s.readJob = acquireSched.add(sensorReadJob, &s);
+        s.recoveryJob = acquireSched.add(sensorRecoveryJob, &s);
+        s.seqJob = acquireSched.add(sensorSeqJob, &s);
+        // the startup sequences run side by side; each arms its sensor's
+        // reads when it is done
+        sensorsStarting |= 1u << i;
+        startSequence(s, SEQ_RESTART, now);
+    }
+    burstJob = acquireSched.add(burstJobFn);
+
+    statusJob = transportSched.add(statusJobFn);
+    stepJob = transportSched.add(stepJobFn);
+#if DELIVERY_ACKED
+    ackTimeoutJob = transportSched.add(ackTimeoutJobFn);
+#endif
+    dumpJob = transportSched.add(dumpJobFn);
+    // arms the status update
+    applyTransportConfig(activeConfig);
+}
+
+void pipelineBegin() {
+    static ArchiveLog log(halArchiveStorage());
+    archiveLog = &log;
+    static SerialDump dump(log, serialWrite, nullptr);
+    serialDump = &dump;
+    loadArchiveFromDisk();
+    static HistoryTiers tiers(halArchiveStorage());
+    history = &tiers;
+    history->begin();
+    loadConfig();
+    loadVocState();
+    scheduleBegin();
+    pipelineBootMark(BOOT_ARCHIVE);
+    updateStatus();
+}
+
+void pipelinePublishStatus() {
+    updateStatus();
+}
+
+void pipelineBootMark(BootPhase phase) {
+    static const char *const names[BOOT_PHASE_COUNT] = {"advertising", "archive", "sensors", "first measurement"};
+    if (phase >= BOOT_PHASE_COUNT || acqStats.bootMs[phase].load(std::memory_order_relaxed) != 0) return;
+    uint32_t now = halMillis();
+    acqStats.bootMs[phase].store(now ? now : 1, std::memory_order_relaxed);
+    LOG_INFO("Boot: %s at %lu ms", names[phase], (unsigned long)now);
+}
+
+static void applyLinkState(bool connected) {
+    if (connected == deviceConnected) return;
+    deviceConnected = connected;
+    // start non-blocking flush of archived data when a client connects;
+    // a disconnect is picked up by processFlushStep() / processRangeStep()
+    if (connected) {
+        pacer.reset(halMillis());
+        // alerts raised while nobody was connected go out first
+        if (alertCount > 0) kickStep();
+        startFlushArchive();
+        return;
+    }
+    // unacked records go out again from the first one on the next connect,
+    // and the next client starts without an ack
+    sendOffset = 0;
+    ackRequested.store(0, std::memory_order_relaxed);
+    transportSched.cancel(ackTimeoutJob);
+    // let a running flush or range notice
+    kickStep();
+}
+
+void pipelineControl(const uint8_t *data, size_t len) {
+    // the payload format takes effect right away and is not answered
+    if (len == 2 && data[0] == CONTROL_CMD_FORMAT) {
+        if (data[1] < PAYLOAD_FORMAT_COUNT) payloadFormat.store(data[1], std::memory_order_relaxed);
+        else LOG_WARN("Unknown payload format %u", (unsigned)data[1]);
+        return;
+    }
+    // so does an alert rule change
+    if (len > 0 && data[0] == CONTROL_CMD_ALERT_RULE) {
+        AlertRuleWrite w;
+        if (!alertParseRule(data, len, w.index, w.rule)) LOG_WARN("Bad alert rule");
+        else if (!alertRuleQueue.push(w)) LOG_WARN("Alert rule dropped, queue full");
+        halWakeTransport();
+        return;
+    }
+    // a burst is started or stopped on the acquisition side
+    if (len > 0 && data[0] == CONTROL_CMD_BURST) {
+        uint16_t seconds;
+        if (!burstParse(data, len, seconds)) LOG_WARN("Bad burst request");
+        else if (!burstQueue.push(seconds)) LOG_WARN("Burst request dropped, queue full");
+        halWakeAcquire();
+        return;
+    }
+    RangeRequest req;
+    rangeParse(data, len, req);
+    if (!controlQueue.push(req)) LOG_WARN("Range request dropped, queue full");
+    halWakeTransport();
+}
+
+void pipelineConfigure(const uint8_t *data, size_t len) {
+    // a block of the wrong length fails the size check
+    RuntimeConfig cfg = RuntimeConfig();
+    memcpy(&cfg, data, len < sizeof(cfg) ? len : sizeof(cfg));
+    if (len != sizeof(cfg)) cfg.size = 0;
+    if (!configQueue.push(cfg)) LOG_WARN("Runtime config dropped, queue full");
+    halWakeTransport();
+}
+
+void pipelineNotifyDone(bool ok) {
+    if (ok) {
+        notifyDoneOk.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    notifyDoneFailed.fetch_add(1, std::memory_order_relaxed);
+    halWakeTransport();
+}
+
+void pipelineAck(uint32_t seq) {
+    ackClient.store(true, std::memory_order_relaxed);
+    uint32_t cur = ackRequested.load(std::memory_order_relaxed);
+    while (seq > cur) {
+        if (ackRequested.compare_exchange_weak(cur, seq, std::memory_order_relaxed)) {
+            halWakeTransport();
+            return;
+        }
+    }
+}
+
+void pipelineSetConnected(bool connected) {
+    // a new client gets JSON until it asks for something else, and its
+    // samples are dropped once sent until it acks
+    if (connected) payloadFormat.store(PAYLOAD_JSON, std::memory_order_relaxed);
+    else ackClient.store(false, std::memory_order_relaxed);
+    linkRequested.store(connected, std::memory_order_release);
+    if (!linkEvents.push(connected)) linkResync.store(true, std::memory_order_release);
+    halWakeTransport();
+}
+
+bool pipelineSerialBusy() {
+    return serialBusy.load(std::memory_order_relaxed);
+}
+
+bool pipelineConnected() {
+    return linkRequested.load(std::memory_order_acquire);
+}
+
+uint32_t pipelineArchiveCount() {
+    return archivePending();
+}
+
+uint32_t pipelineHistoryCount(uint8_t tier) {
+    return history ? history->count(tier) : 0;
+}
+
+uint32_t pipelineNotifyIntervalMs() {
+    return pacer.intervalMs();
+}
+
+uint32_t pipelineNotifyBytesPerSec() {
+    return pacer.bytesPerSec();
+}
+
+const PipelineStats &pipelineStats() {
+    return stats;
+}
+
+const AcquireStats &pipelineAcquireStats() {
+    return acqStats;
+}
+
+uint32_t pipelineTransport() {
+    stats.loopIterations++;
+    latencyPoll(LAT_SIDE_TRANSPORT);
+#if LATENCY_STATS
+    // iterations are seconds apart while idle, so what is recorded is how
+    // late a timed wake-up came, not the period; wakes for an event before
+    // any deadline don't count
+    int32_t lateMs = transportSched.lateness(halMillis());
+    if (lateMs >= 0) latencyRecord(LAT_WAKE_LATE, latencyTicksFromMs((uint32_t)lateMs));
+#endif
+
+    // connect/disconnect hand-off from the BLE callback
+    bool connected;
+    while (linkEvents.pop(connected)) {
+        applyLinkState(connected);
+    }
+    if (linkResync.exchange(false, std::memory_order_acq_rel)) {
+        applyLinkState(linkRequested.load(std::memory_order_acquire));
+    }
+
+#if DELIVERY_ACKED
+    uint32_t ack = ackRequested.load(std::memory_order_relaxed);
+    if (ack > archiveLog->ackedSeq()) applyAck(ack);
+#endif
+
+    // service commands on the serial port
+    uint8_t rx[32];
+    size_t n;
+    while ((n = halSerialRead(rx, sizeof(rx))) > 0) {
+        serialDump->receive(rx, n);
+    }
+    if (serialDump->active() && !transportSched.armed(dumpJob)) transportSched.at(dumpJob, halMillis());
+
+    RuntimeConfig cfg;
+    while (configQueue.pop(cfg)) {
+        applyConfigWrite(cfg);
+    }
+
+    VocCheckpoint cp;
+    while (vocStateQueue.pop(cp)) {
+        saveVocState(cp);
+    }
+
+    AlertRuleWrite w;
+    while (alertRuleQueue.pop(w)) {
+        alertEngine.setRule(w.index, w.rule);
+    }
+
+    AirMeasurement m;
+    while (measurementQueue.pop(m)) {
+        emitMeasurement(m);
+    }
+    if (deviceConnected && burstReady()) kickStep();
+
+    // a range request from the client goes before the backlog flush
+    applyControl();
+
+    // flush/range steps and the periodic status update
+    transportSched.runDue(halMillis());
+    return transportSched.timeUntilNext(halMillis(), MAX_WAIT_MS);
+}
+
+uint32_t pipelineAcquire() {
+    bump(acqStats.iterations);
+    latencyPoll(LAT_SIDE_ACQUIRE);
+    RuntimeConfig cfg;
+    while (acquireConfigQueue.pop(cfg)) {
+        applyAcquireConfig(cfg);
+    }
+    uint16_t seconds;
+    while (burstQueue.pop(seconds)) {
+        startBurst(seconds);
+    }
+    // sensor reads, SPS30 wake-up and recovery checks
+    acquireSched.runDue(halMillis());
+    return acquireSched.timeUntilNext(halMillis(), MAX_WAIT_MS);
+}
+
+uint32_t pipelineLoop() {
+    uint32_t acquireWait = pipelineAcquire();
+    uint32_t transportWait = pipelineTransport();
+    return acquireWait < transportWait ? acquireWait : transportWait;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+// Measurement pipeline: sensor polling, combined sample build, live send,
+// offline archive and backlog flush. Platform independent, see hal.h.
+//
+// The work is split in two halves that may run on different cores:
+// pipelineAcquire() polls the sensors and hands combined measurements to
+// pipelineTransport() through a lock-free SPSC queue; the transport side
+// owns BLE sends, the archive and the flush. Each half must only ever be
+// called from one thread. pipelineLoop() runs both in series.
+//
+// Both halves are driven by deadline schedulers (scheduler.h): a call runs
+// whatever is due and returns how long the caller may sleep. The transport
+// side additionally wants to run as soon as halWakeTransport() is called.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// boot milestones, see pipelineBootMark()
+enum BootPhase : uint8_t {
+    BOOT_ADVERTISING = 0,    // BLE advertising started
+    BOOT_ARCHIVE,            // archive attached (pipelineBegin() done)
+    BOOT_SENSORS,            // sensor diag/startup sequences done
+    BOOT_FIRST_MEASUREMENT,  // first combined sample built
+    BOOT_PHASE_COUNT,
+};
+
+// per-sensor health, in SENSOR_* order (sps30, sgp40, scd41)
+#define PIPELINE_SENSORS 3
+struct SensorHealth {
+    std::atomic<uint32_t> reads{0};        // good reads
+    std::atomic<uint32_t> misses{0};       // read slots that ended without data
+    std::atomic<uint32_t> errors{0};       // failed startup/recovery/power ops
+    std::atomic<uint32_t> recoveries{0};   // recovery sequences started by the watchdog
+    std::atomic<uint8_t> backoff{0};       // recoveries since the last good read
+};
+
+// Counters owned by the acquisition side (boot marks also by setup code,
+// before the tasks start). Their one writer stores them relaxed and the
+// transport side reads them relaxed for the status, so every value is
+// whole, though not all from the same instant.
+struct AcquireStats {
+    std::atomic<uint32_t> iterations{0};
+    std::atomic<uint32_t> measurementsDropped{0}; // hand-off queue was full
+    std::atomic<uint32_t> burstRecords{0};   // burst ticks that read something (burst_sampling.h)
+    std::atomic<uint32_t> burstDropped{0};   // burst ring full
+    std::atomic<uint32_t> burstReads{0};     // sensor readings in the current or last burst
+    std::atomic<uint32_t> burstMs{0};        // how long that burst has run
+    std::atomic<uint32_t> bootMs[BOOT_PHASE_COUNT] = {};  // halMillis() per phase, 0 = not yet
+    SensorHealth sensors[PIPELINE_SENSORS];
+};
+
+// Counters owned by the transport side; only it reads and writes them.
+struct PipelineStats {
+    uint32_t loopIterations = 0;     // transport iterations
+    uint32_t measurements = 0;   // combined samples built
+    uint32_t held = 0;           // samples held back by change-only reporting
+    uint32_t sentLive = 0;       // samples notified as soon as they were built
+    uint32_t archived = 0;       // samples that went to the archive instead
+    uint32_t archiveSent = 0;    // archived samples delivered by the flush
+    uint32_t rangeSent = 0;      // archived samples delivered for range requests
+    uint32_t tierSent = 0;       // downsampled buckets delivered for tier requests
+    uint32_t acked = 0;          // sent samples the client acknowledged
+    uint32_t resent = 0;         // ack timeouts that sent the unacked window again
+    uint32_t notifies = 0;       // notifications that went out
+    uint32_t notifyDone = 0;     // of those, reported done by the stack
+    uint32_t notifyDrops = 0;    // refused by the stack or reported failed
+    uint32_t notifyCongested = 0; // sends held back because the stack had no buffer
+    uint32_t alertsRaised = 0;   // alert rule hits (alert_rules.h)
+    uint32_t alertsSent = 0;
+    uint32_t alertsDropped = 0;  // queue overflow or too old to matter
+    uint32_t alertLatencyLastMs = 0;  // measurement to notify, last sent alert
+    uint32_t alertLatencyMaxMs = 0;
+    uint32_t alertLatencySumMs = 0;
+    uint32_t burstSent = 0;      // burst records notified
+    uint32_t vocCheckpoints = 0; // VOC index states stored (voc_index.h)
+    bool vocRestored = false;    // the engine went on from a stored state at boot
+    uint32_t broadcasts = 0;     // advertisement updates (broadcast.h)
+    uint32_t configApplied = 0;  // runtime config blocks taken (runtime_config.h)
+    uint32_t configRejected = 0;
+    uint32_t flushesDone = 0;    // backlogs drained completely
+    uint32_t lastFlushMs = 0;    // duration of the last complete drain
+};
+
+// attach the archive, call once at boot after storage is mounted; only
+// segment headers are read, records come in lazily as the flush needs them
+void pipelineBegin();
+// set the status characteristic now; also works before pipelineBegin(),
+// for the value a client reads while the archive is being attached
+void pipelinePublishStatus();
+// note that a boot phase was reached; only the first call per phase counts.
+// BOOT_ARCHIVE and BOOT_FIRST_MEASUREMENT are marked by the pipeline.
+void pipelineBootMark(BootPhase phase);
+// one iteration of the acquisition side (sensor reads, recovery); returns
+// ms until its next deadline
+uint32_t pipelineAcquire();
+// one iteration of the transport side (send, archive, flush, status);
+// returns ms until its next deadline
+uint32_t pipelineTransport();
+// acquisition and transport in series, for single-threaded builds; returns
+// the shorter of the two waits
+uint32_t pipelineLoop();
+// connect/disconnect from the BLE callback context; queued for the transport
+// side, where a connect starts the flush
+void pipelineSetConnected(bool connected);
+// the client has every seq up to and including seq (ack characteristic,
+// BLE callback context). With DELIVERY_ACKED, a client that acks (right
+// after connecting, with 0 if it has nothing yet) gets at-least-once
+// delivery for the rest of the connection: samples are only dropped once
+// acked, and a reconnect resumes at the first unacked one. Until then
+// samples are dropped as soon as they are sent.
+// A client should treat the first seq of a resume as contiguous with what
+// it has: anything older is gone (acked or overwritten when the archive
+// was full).
+void pipelineAck(uint32_t seq);
+// a runtime config block written by the client (BLE callback context);
+// checked, stored and applied on the transport side, see runtime_config.h
+void pipelineConfigure(const uint8_t *data, size_t len);
+// the stack finished a notification or indication on the data
+// characteristic (BLE callback context); drives the adaptive pacing
+void pipelineNotifyDone(bool ok);
+// a write to the control characteristic (range_query.h), from the BLE
+// callback context; queued for the transport side
+void pipelineControl(const uint8_t *data, size_t len);
+
+bool pipelineConnected();
+// a serial archive dump is running; log output has to wait (serial_dump.h)
+bool pipelineSerialBusy();
+uint32_t pipelineArchiveCount();
+// buckets on flash in a history tier (history_tiers.h)
+uint32_t pipelineHistoryCount(uint8_t tier);
+// current notify pacing (notify_pacer.h)
+uint32_t pipelineNotifyIntervalMs();
+uint32_t pipelineNotifyBytesPerSec();
+// read them from the transport side's thread, or after the pipeline stopped
+const PipelineStats &pipelineStats();
+// any thread, load relaxed
+const AcquireStats &pipelineAcquireStats();
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Range requests on the control characteristic.
+//
+// A client that already holds most of the data asks for what it is missing
+// instead of taking the whole backlog. All values little endian:
+//
+//   0x01 u32 firstSeq | u32 lastSeq    records with firstSeq <= seq <= lastSeq
+//   0x02 u32 fromTs   | u32 toTs       records with fromTs <= ts <= toTs
+//   0x03                               cancel the running range
+//   0x04 u8 tier | u32 firstSeq | u32 lastSeq
+//                                      downsampled buckets (history_tiers.h)
+//                                      whose first sample is in the range
+//   0x05 u8 format                     payload format (payload_schema.h); not
+//                                      a range, it is not answered and leaves
+//                                      a running flush or range alone
+//   0x06 ...                           alert rule (alert_rules.h); handled
+//                                      like 0x05
+//   0x07 u16 seconds                   burst sampling (burst_sampling.h);
+//                                      handled like 0x05
+//
+// Any command also stops the automatic backlog flush started on connect.
+// Matching records that are still on flash are streamed on the data
+// characteristic like the flush (batch frames, JSON with a small MTU), but
+// stay in the backlog. A range only covers what was archived: with
+// DELIVERY_ACKED (the default) that is every sample except the ones a
+// client that doesn't ack got live while nothing older was pending, without
+// it every sample that could not go out live. ts ranges assume ts grows with
+// seq, which holds within one boot. Tier requests cover every sample, live
+// or not, and are streamed as tier frames.
+//
+// Every request, including a malformed one, is answered with an end frame:
+//
+//   u8 RANGE_END_FRAME_TYPE | u8 status | u32 records sent
+//
+// A new request while one is running ends the old one as cancelled first.
+#define RANGE_CMD_SEQ     0x01
+#define RANGE_CMD_TS      0x02
+#define RANGE_CMD_CANCEL  0x03
+#define RANGE_CMD_TIER    0x04
+
+#define RANGE_END_FRAME_TYPE 0xE0
+#define RANGE_END_FRAME_SIZE 6
+
+enum RangeStatus : uint8_t {
+    RANGE_STATUS_DONE = 0,
+    RANGE_STATUS_CANCELLED,
+    RANGE_STATUS_BAD_REQUEST,
+};
+
+struct RangeRequest {
+    uint8_t cmd = 0;   // RANGE_CMD_*, 0 for a malformed write
+    uint8_t tier = 0;  // RANGE_CMD_TIER only
+    uint32_t first = 0;
+    uint32_t last = 0;
+};
+
+static inline uint32_t rangeGetU32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// decode a control write; false (and cmd 0) if it is not a valid request
+static inline bool rangeParse(const uint8_t *data, size_t len, RangeRequest &req) {
+    req = RangeRequest();
+    if (!data || len == 0) return false;
+    switch (data[0]) {
+    case RANGE_CMD_SEQ:
+    case RANGE_CMD_TS:
+        if (len != 9) return false;
+        req.first = rangeGetU32(data + 1);
+        req.last = rangeGetU32(data + 5);
+        if (req.first > req.last) return false;
+        break;
+    case RANGE_CMD_TIER:
+        if (len != 10) return false;
+        req.tier = data[1];
+        req.first = rangeGetU32(data + 2);
+        req.last = rangeGetU32(data + 6);
+        if (req.first > req.last) return false;
+        break;
+    case RANGE_CMD_CANCEL:
+        if (len != 1) return false;
+        break;
+    default:
+        return false;
+    }
+    req.cmd = data[0];
+    return true;
+}
+
+// fill out[RANGE_END_FRAME_SIZE], returns its size
+static inline size_t rangeEndFrame(uint8_t status, uint32_t sent, uint8_t *out) {
+    out[0] = RANGE_END_FRAME_TYPE;
+    out[1] = status;
+    out[2] = (uint8_t)sent;
+    out[3] = (uint8_t)(sent >> 8);
+    out[4] = (uint8_t)(sent >> 16);
+    out[5] = (uint8_t)(sent >> 24);
+    return RANGE_END_FRAME_SIZE;
+}
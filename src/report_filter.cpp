@@ -0,0 +1,40 @@
+#include "report_filter.h"
+
+// co2 20 ppm, temp 0.2 °C, rh 1 %, voc 50 ticks, pm2.5 2 and pm10 3 µg/m³
+static const uint16_t defaultDeadband[STATS_CHANNELS] = {20, 20, 100, 50, 2, 3};
+
+static int32_t channelValue(const ArchiveRecord &rec, uint8_t c) {
+    switch (c) {
+    case STATS_CO2: return rec.co2;
+    case STATS_TEMP: return rec.temp;
+    case STATS_RH: return rec.rh;
+    case STATS_VOC: return rec.voc;
+    case STATS_PM25: return rec.pm25;
+    default: return rec.pm10;
+    }
+}
+
+ReportFilter::ReportFilter() : enabled(REPORT_DEADBAND), maxSilenceMs(REPORT_MAX_SILENCE_MS),
+                               haveLast(false), heldCount(0) {
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) deadband[c] = defaultDeadband[c];
+}
+
+bool ReportFilter::check(const ArchiveRecord &rec, bool force) {
+    if (!enabled || force || !haveLast || heldCount >= REC_HELD_MAX) return true;
+    if ((rec.flags & REC_HAVE_MASK) != (last.flags & REC_HAVE_MASK)) return true;
+    // a ts that went backwards is a reboot
+    if (rec.ts < last.ts || rec.ts - last.ts >= maxSilenceMs) return true;
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) {
+        int32_t d = channelValue(rec, c) - channelValue(last, c);
+        if (d < 0) d = -d;
+        if (d >= deadband[c]) return true;
+    }
+    heldCount++;
+    return false;
+}
+
+void ReportFilter::reported(const ArchiveRecord &rec) {
+    last = rec;
+    haveLast = true;
+    heldCount = 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "archive_record.h"
+#include "rolling_stats.h"
+
+// Change-only reporting.
+//
+// With the deadband on, a sample is only reported (sent live or archived,
+// with a seq of its own) when some channel moved by at least its deadband
+// since the last reported record, a sensor came or went, it tripped an
+// alert, or REPORT_MAX_SILENCE_MS passed. Samples in between are counted
+// instead, and the next reported record carries the count in the high bits
+// of its flags byte:
+//
+//   flags = REC_HAVE_* | held << REC_HELD_SHIFT
+//
+// held samples came right before the record, each within the deadband of
+// the record reported before them, at evenly spaced times between the two
+// records' ts. So seq stays contiguous and every gap can be filled back in.
+// The count is capped at REC_HELD_MAX, reaching it forces a report.
+//
+// Deadbands are in ArchiveRecord units, StatsChannel order. Rolling stats,
+// history tiers and alerts still see every sample.
+
+#ifndef REPORT_DEADBAND
+#define REPORT_DEADBAND 0
+#endif
+#ifndef REPORT_MAX_SILENCE_MS
+#define REPORT_MAX_SILENCE_MS 600000
+#endif
+
+class ReportFilter {
+public:
+    ReportFilter();
+
+    bool enabled;
+    uint16_t deadband[STATS_CHANNELS];
+    uint32_t maxSilenceMs;
+
+    // true if rec has to be reported; false counts it as held. force
+    // reports it regardless (an alert hit).
+    bool check(const ArchiveRecord &rec, bool force);
+    // samples held since the last report
+    uint8_t held() const { return heldCount; }
+    // rec (with held() in its flags) was reported
+    void reported(const ArchiveRecord &rec);
+
+private:
+    ArchiveRecord last;
+    bool haveLast;
+    uint8_t heldCount;
+};
@@ -0,0 +1,190 @@
+#include "rolling_stats.h"
+
+#include <string.h>
+
+static const uint32_t windowLengthsMs[STATS_WINDOWS] = {
+    60UL * 1000,
+    15UL * 60 * 1000,
+    60UL * 60 * 1000,
+};
+
+// sketch range per channel; values outside land in the edge buckets
+struct SketchRange {
+    int32_t lo;
+    int32_t hi;
+};
+
+static const SketchRange sketchRanges[STATS_CHANNELS] = {
+    {350, 3550},      // co2 ppm, 50 ppm buckets
+    {500, 3700},      // temp 0.01 °C, 0.5 °C buckets
+    {1000, 9000},     // rh 0.01 %, 1.25 % buckets
+    {20000, 52000},   // voc ticks
+    {0, 320},         // pm25 µg/m³, 5 µg/m³ buckets
+    {0, 320},         // pm10
+};
+
+static uint8_t bucketFor(uint8_t c, int32_t v) {
+    const SketchRange &r = sketchRanges[c];
+    if (v <= r.lo) return 0;
+    if (v >= r.hi) return STATS_SKETCH_BUCKETS - 1;
+    return (uint8_t)((int64_t)(v - r.lo) * STATS_SKETCH_BUCKETS / (r.hi - r.lo));
+}
+
+RollingStats::RollingStats() {
+    clear();
+}
+
+uint32_t RollingStats::windowLength(uint8_t window) {
+    return window < STATS_WINDOWS ? windowLengthsMs[window] : 0;
+}
+
+void RollingStats::clear() {
+    memset(this, 0, sizeof(*this));
+}
+
+int32_t RollingStats::value(uint8_t pos, uint8_t c) const {
+    uint16_t raw = ring[pos].v[c];
+    return c == STATS_TEMP ? (int32_t)(int16_t)raw : (int32_t)raw;
+}
+
+void RollingStats::enter(Window &w, uint8_t pos) {
+    if (w.count == 0) w.tail = pos;
+    w.count++;
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) {
+        Channel &ch = w.ch[c];
+        int32_t v = value(pos, c);
+        ch.sum += v;
+        ch.sketch[bucketFor(c, v)]++;
+        // drop everything the new sample makes irrelevant, then append it
+        while (ch.minQ.len > 0 && value(ch.minQ.back(), c) >= v) ch.minQ.len--;
+        ch.minQ.pos[(ch.minQ.head + ch.minQ.len++) % STATS_RING_SIZE] = pos;
+        while (ch.maxQ.len > 0 && value(ch.maxQ.back(), c) <= v) ch.maxQ.len--;
+        ch.maxQ.pos[(ch.maxQ.head + ch.maxQ.len++) % STATS_RING_SIZE] = pos;
+    }
+}
+
+void RollingStats::evictOldest(Window &w) {
+    uint8_t pos = (uint8_t)w.tail;
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) {
+        Channel &ch = w.ch[c];
+        int32_t v = value(pos, c);
+        ch.sum -= v;
+        ch.sketch[bucketFor(c, v)]--;
+        if (ch.minQ.len > 0 && ch.minQ.front() == pos) {
+            ch.minQ.head = (ch.minQ.head + 1) % STATS_RING_SIZE;
+            ch.minQ.len--;
+        }
+        if (ch.maxQ.len > 0 && ch.maxQ.front() == pos) {
+            ch.maxQ.head = (ch.maxQ.head + 1) % STATS_RING_SIZE;
+            ch.maxQ.len--;
+        }
+    }
+    w.tail = (w.tail + 1) % STATS_RING_SIZE;
+    w.count--;
+}
+
+void RollingStats::add(const ArchiveRecord &rec) {
+    if (size == STATS_RING_SIZE) {
+        // ring full: the oldest sample leaves every window still holding it
+        uint16_t oldest = (head + STATS_RING_SIZE - size) % STATS_RING_SIZE;
+        for (Window &w : windows) {
+            if (w.count > 0 && w.tail == oldest) evictOldest(w);
+        }
+        size--;
+    }
+    uint8_t pos = (uint8_t)head;
+    Sample &s = ring[pos];
+    s.ts = rec.ts;
+    s.v[STATS_CO2] = rec.co2;
+    s.v[STATS_TEMP] = (uint16_t)rec.temp;
+    s.v[STATS_RH] = rec.rh;
+    s.v[STATS_VOC] = rec.voc;
+    s.v[STATS_PM25] = rec.pm25;
+    s.v[STATS_PM10] = rec.pm10;
+    head = (head + 1) % STATS_RING_SIZE;
+    size++;
+    lastSeq = rec.seq;
+
+    for (uint8_t i = 0; i < STATS_WINDOWS; i++) {
+        Window &w = windows[i];
+        enter(w, pos);
+        while (w.count > 1 && rec.ts - ring[w.tail].ts >= windowLengthsMs[i]) evictOldest(w);
+    }
+}
+
+// nearest-rank p95 from the sketch, interpolated inside the bucket
+int32_t RollingStats::p95(const Window &w, uint8_t c) const {
+    const Channel &ch = w.ch[c];
+    int32_t lo = value(ch.minQ.front(), c);
+    int32_t hi = value(ch.maxQ.front(), c);
+    uint32_t rank = (w.count * 95 + 99) / 100;
+    // small windows: the p95 sample is the maximum, which we know exactly
+    if (rank >= w.count) return hi;
+    uint32_t seen = 0;
+    const SketchRange &r = sketchRanges[c];
+    for (uint8_t b = 0; b < STATS_SKETCH_BUCKETS; b++) {
+        uint32_t n = ch.sketch[b];
+        if (seen + n < rank) {
+            seen += n;
+            continue;
+        }
+        int32_t width = r.hi - r.lo;
+        int32_t bucketLo = r.lo + (int32_t)((int64_t)width * b / STATS_SKETCH_BUCKETS);
+        int32_t bucketHi = r.lo + (int32_t)((int64_t)width * (b + 1) / STATS_SKETCH_BUCKETS);
+        // the edge buckets are open ended, the true extremes bound them
+        if (b == 0 || bucketLo < lo) bucketLo = lo;
+        if (b == STATS_SKETCH_BUCKETS - 1 || bucketHi > hi) bucketHi = hi;
+        int32_t v = bucketLo + (int32_t)(((int64_t)(bucketHi - bucketLo) * (2 * (rank - seen) - 1)) / (2 * n));
+        return v < lo ? lo : (v > hi ? hi : v);
+    }
+    return hi;
+}
+
+void RollingStats::summarize(uint8_t window, StatsWindowSummary &out) const {
+    out = StatsWindowSummary();
+    if (window >= STATS_WINDOWS) return;
+    const Window &w = windows[window];
+    out.lengthMs = windowLengthsMs[window];
+    out.count = w.count;
+    if (w.count == 0) return;
+    for (uint8_t c = 0; c < STATS_CHANNELS; c++) {
+        const Channel &ch = w.ch[c];
+        StatsValue &v = out.ch[c];
+        int32_t half = (int32_t)w.count / 2;
+        v.mean = ch.sum >= 0 ? (ch.sum + half) / (int32_t)w.count : (ch.sum - half) / (int32_t)w.count;
+        v.min = value(ch.minQ.front(), c);
+        v.max = value(ch.maxQ.front(), c);
+        v.p95 = p95(w, c);
+    }
+}
+
+static uint8_t *putU16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+size_t RollingStats::encode(uint8_t *out, size_t cap) const {
+    if (cap < STATS_BLOB_SIZE) return 0;
+    uint8_t *p = out;
+    *p++ = STATS_BLOB_VERSION;
+    *p++ = STATS_WINDOWS;
+    *p++ = STATS_CHANNELS;
+    *p++ = 0;
+    p = putU16(p, (uint16_t)lastSeq);
+    p = putU16(p, (uint16_t)(lastSeq >> 16));
+    for (uint8_t i = 0; i < STATS_WINDOWS; i++) {
+        StatsWindowSummary s;
+        summarize(i, s);
+        p = putU16(p, (uint16_t)(s.lengthMs / 60000));
+        p = putU16(p, s.count);
+        for (uint8_t c = 0; c < STATS_CHANNELS; c++) {
+            // values came from 16 bit record fields, so they round-trip
+            p = putU16(p, (uint16_t)s.ch[c].mean);
+            p = putU16(p, (uint16_t)s.ch[c].min);
+            p = putU16(p, (uint16_t)s.ch[c].max);
+            p = putU16(p, (uint16_t)s.ch[c].p95);
+        }
+    }
+    return p - out;
+}
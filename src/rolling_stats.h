@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "archive_record.h"
+
+// Sliding-window statistics over the measurement stream.
+//
+// For each window length (1 min, 15 min, 1 h) and each channel (co2,
+// temp, rh, voc, pm25, pm10) it keeps the mean, min, max and an
+// approximate p95, updated in amortized O(1) per sample:
+//  - samples live once in a shared ring sized for the longest window, each
+//    window only tracks its oldest sample and evicts by timestamp
+//  - mean from a running sum
+//  - min/max from monotonic deques of ring positions
+//  - p95 from a fixed-bucket histogram per channel that gains a count when
+//    a sample enters the window and loses it when it leaves, interpolated
+//    inside the bucket
+// Values are in ArchiveRecord units (ppm, 0.01 °C, 0.01 %RH, SRAW ticks,
+// µg/m³). If samples come faster than the ring allows, the longest window
+// simply covers less time.
+
+// samples in the shared ring (1 h at the 30 s cadence needs 120)
+#ifndef STATS_RING_SIZE
+#define STATS_RING_SIZE 128
+#endif
+#define STATS_SKETCH_BUCKETS 64
+#define STATS_CHANNELS 6
+#define STATS_WINDOWS 3
+
+enum StatsChannel : uint8_t {
+    STATS_CO2 = 0,
+    STATS_TEMP,
+    STATS_RH,
+    STATS_VOC,
+    STATS_PM25,
+    STATS_PM10,
+};
+
+// summary blob served on the summary characteristic, little endian:
+//   u8 version | u8 windows | u8 channels | u8 reserved | u32 last seq
+//   per window: u16 length [min] | u16 samples
+//     per channel (StatsChannel order): mean | min | max | p95, 16 bit each
+//     (temp is signed, everything else unsigned)
+#define STATS_BLOB_VERSION 1
+#define STATS_BLOB_SIZE (8 + STATS_WINDOWS * (4 + STATS_CHANNELS * 8))
+
+struct StatsValue {
+    int32_t mean = 0;
+    int32_t min = 0;
+    int32_t max = 0;
+    int32_t p95 = 0;
+};
+
+struct StatsWindowSummary {
+    uint32_t lengthMs = 0;
+    uint16_t count = 0;
+    StatsValue ch[STATS_CHANNELS];
+};
+
+class RollingStats {
+public:
+    RollingStats();
+
+    void add(const ArchiveRecord &rec);
+    void clear();
+
+    void summarize(uint8_t window, StatsWindowSummary &out) const;
+    // serialize all windows, returns bytes written (0 if cap is too small)
+    size_t encode(uint8_t *out, size_t cap) const;
+
+    static uint32_t windowLength(uint8_t window);
+
+private:
+    // ring positions and sketch counts are stored as uint8_t
+    static_assert(STATS_RING_SIZE <= 255, "STATS_RING_SIZE too large");
+
+    struct Sample {
+        uint32_t ts;
+        uint16_t v[STATS_CHANNELS];   // raw record fields, see value()
+    };
+
+    // ring of sample positions whose values are monotonic front to back
+    struct MonoDeque {
+        uint8_t pos[STATS_RING_SIZE];
+        uint16_t head;
+        uint16_t len;
+        uint8_t front() const { return pos[head]; }
+        uint8_t back() const { return pos[(head + len - 1) % STATS_RING_SIZE]; }
+    };
+
+    struct Channel {
+        int32_t sum;
+        MonoDeque minQ;
+        MonoDeque maxQ;
+        uint8_t sketch[STATS_SKETCH_BUCKETS];
+    };
+
+    struct Window {
+        uint16_t tail;   // ring position of the oldest sample in the window
+        uint16_t count;
+        Channel ch[STATS_CHANNELS];
+    };
+
+    Sample ring[STATS_RING_SIZE];
+    uint16_t head;   // next write position
+    uint16_t size;
+    uint32_t lastSeq;
+    Window windows[STATS_WINDOWS];
+
+    int32_t value(uint8_t pos, uint8_t c) const;
+    void enter(Window &w, uint8_t pos);
+    void evictOldest(Window &w);
+    int32_t p95(const Window &w, uint8_t c) const;
+};
@@ -0,0 +1,39 @@
+#include "runtime_config.h"
+
+#include <string.h>
+#include "archive_record.h"
+#include "crc.h"
+
+static bool inRange(uint32_t v, uint32_t lo, uint32_t hi) {
+    return v >= lo && v <= hi;
+}
+
+bool configValid(const RuntimeConfig &cfg) {
+    if (cfg.version != CONFIG_VERSION || cfg.size != CONFIG_BLOCK_SIZE) return false;
+    if (cfg.crc != crc16(&cfg, offsetof(RuntimeConfig, crc))) return false;
+    // the SGP40 needs a second per read, an hour is as slow as is useful
+    for (uint8_t i = 0; i < 3; i++) {
+        if (!inRange(cfg.intervalMs[i], 1000, 3600000UL)) return false;
+    }
+    return inRange(cfg.statusIntervalMs, 1000, 600000UL) &&
+           inRange(cfg.recoveryTimeoutMs, 10000, 3600000UL) &&
+           inRange(cfg.notifyRateMin, 1, 1000) &&
+           inRange(cfg.notifyRateMax, cfg.notifyRateMin, 1000) &&
+           inRange(cfg.windowRecords, CONFIG_WINDOW_MIN, MAX_BUFFER_SIZE) &&
+           cfg.reportDeadband <= 1 && cfg.broadcast <= 1 &&
+           inRange(cfg.maxSilenceMs, 30000, 86400000UL);
+}
+
+bool configDecode(const uint8_t *data, size_t len, RuntimeConfig &cfg) {
+    if (!data || len != CONFIG_BLOCK_SIZE) return false;
+    memcpy(&cfg, data, sizeof(cfg));
+    return configValid(cfg);
+}
+
+size_t configEncode(RuntimeConfig &cfg, uint8_t *out) {
+    cfg.version = CONFIG_VERSION;
+    cfg.size = CONFIG_BLOCK_SIZE;
+    cfg.crc = crc16(&cfg, offsetof(RuntimeConfig, crc));
+    memcpy(out, &cfg, sizeof(cfg));
+    return CONFIG_BLOCK_SIZE;
+}
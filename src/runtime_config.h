@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "rolling_stats.h"
+
+// Tuning parameters that can change without a reflash.
+//
+// The config characteristic reads back the active block and takes a new one
+// as a write; the block is checked, stored (NVS on the ESP32, see
+// halConfigSave()) and applied right away. The stored block is applied at
+// boot; a missing, damaged or older-version block means compiled-in
+// defaults. Wire format, little endian, packed:
+//
+//   u8  version (CONFIG_VERSION) | u8 size (CONFIG_BLOCK_SIZE)
+//   u32 read interval ms per sensor (sps30, sgp40, scd41)
+//   u32 status update interval ms
+//   u32 shortest sensor recovery timeout ms
+//   u16 notify rate min | u16 notify rate max      notifies/s (notify_pacer.h)
+//   u16 RAM window records                         <= MAX_BUFFER_SIZE
+//   u8  change-only reporting on | u8 broadcast on (broadcast.h)
+//   u16 deadband per channel (StatsChannel order)  report_filter.h
+//   u32 longest silence ms
+//   u16 crc16 of everything before it
+//
+// A block with the wrong version, size or crc, or any value out of range,
+// is rejected as a whole. Changes take effect at the next deadline they
+// affect: sensor reads, the status update and the watchdogs are moved to
+// the new timing, a smaller RAM window shrinks as the backlog drains.
+
+#define CONFIG_VERSION 1
+
+#pragma pack(push, 1)
+struct RuntimeConfig {
+    uint8_t version;
+    uint8_t size;
+    uint32_t intervalMs[3];
+    uint32_t statusIntervalMs;
+    uint32_t recoveryTimeoutMs;
+    uint16_t notifyRateMin;
+    uint16_t notifyRateMax;
+    uint16_t windowRecords;
+    uint8_t reportDeadband;
+    uint8_t broadcast;
+    uint16_t deadband[STATS_CHANNELS];
+    uint32_t maxSilenceMs;
+    uint16_t crc;
+};
+#pragma pack(pop)
+
+#define CONFIG_BLOCK_SIZE sizeof(RuntimeConfig)
+static_assert(sizeof(RuntimeConfig) == 48, "RuntimeConfig must stay packed");
+
+// smallest RAM window the flush can refill into
+#define CONFIG_WINDOW_MIN 64
+
+// check a block; false if it must not be applied
+bool configValid(const RuntimeConfig &cfg);
+// decode and check a block received or loaded as bytes
+bool configDecode(const uint8_t *data, size_t len, RuntimeConfig &cfg);
+// set version, size and crc, then write the block to out[CONFIG_BLOCK_SIZE]
+size_t configEncode(RuntimeConfig &cfg, uint8_t *out);
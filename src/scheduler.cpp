@@ -0,0 +1,97 @@
+#include "scheduler.h"
+
+int8_t DeadlineScheduler::add(SchedJobFn fn, void *ctx) {
+    if (jobCount >= SCHED_MAX_JOBS) return -1;
+    Job &j = jobs[jobCount];
+    j.fn = fn;
+    j.ctx = ctx;
+    j.due = 0;
+    j.heapPos = -1;
+    return (int8_t)jobCount++;
+}
+
+void DeadlineScheduler::place(uint8_t pos, uint8_t id) {
+    heap[pos] = id;
+    jobs[id].heapPos = (int8_t)pos;
+}
+
+void DeadlineScheduler::siftUp(uint8_t pos) {
+    uint8_t id = heap[pos];
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+        if (!before(jobs[id].due, jobs[heap[parent]].due)) break;
+        place(pos, heap[parent]);
+        pos = parent;
+    }
+    place(pos, id);
+}
+
+void DeadlineScheduler::siftDown(uint8_t pos) {
+    uint8_t id = heap[pos];
+    for (;;) {
+        uint8_t child = 2 * pos + 1;
+        if (child >= heapSize) break;
+        if (child + 1 < heapSize && before(jobs[heap[child + 1]].due, jobs[heap[child]].due)) child++;
+        if (!before(jobs[heap[child]].due, jobs[id].due)) break;
+        place(pos, heap[child]);
+        pos = child;
+    }
+    place(pos, id);
+}
+
+void DeadlineScheduler::removeAt(uint8_t pos) {
+    jobs[heap[pos]].heapPos = -1;
+    heapSize--;
+    if (pos == heapSize) return;
+    // move the last entry into the hole and let it find its place
+    place(pos, heap[heapSize]);
+    siftDown(pos);
+    siftUp((uint8_t)jobs[heap[pos]].heapPos);
+}
+
+void DeadlineScheduler::at(uint8_t id, uint32_t due) {
+    if (id >= jobCount) return;
+    Job &j = jobs[id];
+    if (j.heapPos >= 0) {
+        j.due = due;
+        siftDown((uint8_t)j.heapPos);
+        siftUp((uint8_t)j.heapPos);
+        return;
+    }
+    j.due = due;
+    place(heapSize, id);
+    siftUp(heapSize++);
+}
+
+void DeadlineScheduler::cancel(uint8_t id) {
+    if (!armed(id)) return;
+    removeAt((uint8_t)jobs[id].heapPos);
+}
+
+uint8_t DeadlineScheduler::runDue(uint32_t now) {
+    // every job runs at most once per call, even if it re-arms itself as due
+    uint8_t ran = 0;
+    uint32_t doneMask = 0;
+    while (heapSize > 0 && !before(now, jobs[heap[0]].due)) {
+        uint8_t id = heap[0];
+        if (doneMask & (1UL << id)) break;
+        removeAt(0);
+        doneMask |= 1UL << id;
+        jobs[id].fn(jobs[id].ctx);
+        ran++;
+    }
+    return ran;
+}
+
+int32_t DeadlineScheduler::lateness(uint32_t now) const {
+    if (heapSize == 0 || before(now, jobs[heap[0]].due)) return -1;
+    return (int32_t)(now - jobs[heap[0]].due);
+}
+
+uint32_t DeadlineScheduler::timeUntilNext(uint32_t now, uint32_t maxWait) const {
+    if (heapSize == 0) return maxWait;
+    uint32_t due = jobs[heap[0]].due;
+    if (!before(now, due)) return 0;
+    uint32_t wait = due - now;
+    return wait < maxWait ? wait : maxWait;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Deadline scheduler for the pipeline's timed work.
+//
+// A fixed set of jobs is registered once; each job is either idle or armed
+// with one deadline. Armed jobs sit in a binary min-heap keyed by deadline,
+// so finding the next thing to do is O(1) and arming is O(log n). A job
+// runs once per arming and re-arms itself if it is periodic.
+//
+// The owner calls runDue(now) when it wakes and then sleeps for
+// timeUntilNext(now) ms. Deadlines are halMillis() values and compare
+// wrap-safe as long as they stay within ~24 days of each other.
+// Not thread safe: one scheduler per context.
+
+#include <stdint.h>
+
+#define SCHED_MAX_JOBS 12
+
+typedef void (*SchedJobFn)(void *ctx);
+
+class DeadlineScheduler {
+public:
+    // register an idle job; returns its id, or -1 when SCHED_MAX_JOBS are taken
+    int8_t add(SchedJobFn fn, void *ctx = nullptr);
+
+    // arm (or move) a job to run at due
+    void at(uint8_t id, uint32_t due);
+    // disarm a job; no-op if it is idle
+    void cancel(uint8_t id);
+    bool armed(uint8_t id) const { return id < jobCount && jobs[id].heapPos >= 0; }
+    uint32_t deadline(uint8_t id) const { return jobs[id].due; }
+
+    // run the jobs that are due at now, earliest first; a job that re-arms
+    // itself at or before now waits for the next call. Returns how many ran.
+    uint8_t runDue(uint32_t now);
+
+    // ms until the earliest deadline (0 if one is due), maxWait if none is
+    // armed or the earliest is further away
+    uint32_t timeUntilNext(uint32_t now, uint32_t maxWait) const;
+    // ms the earliest armed job is past its deadline, -1 if none is due
+    int32_t lateness(uint32_t now) const;
+
+private:
+    struct Job {
+        SchedJobFn fn;
+        void *ctx;
+        uint32_t due;
+        int8_t heapPos;   // -1 when idle
+    };
+
+    static bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+    void place(uint8_t pos, uint8_t id);
+    void siftUp(uint8_t pos);
+    void siftDown(uint8_t pos);
+    void removeAt(uint8_t pos);
+
+    Job jobs[SCHED_MAX_JOBS];
+    uint8_t heap[SCHED_MAX_JOBS];   // job ids, heap[0] has the earliest deadline
+    uint8_t jobCount = 0;
+    uint8_t heapSize = 0;
+};
@@ -0,0 +1,76 @@
+#include "serial_dump.h"
+
+#include <string.h>
+
+static void putU32(uint8_t *p, uint32_t v) {
+    for (int b = 0; b < 4; b++) p[b] = (uint8_t)(v >> (8 * b));
+}
+
+static uint32_t getU32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void SerialDump::receive(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        size_t n = reader.push(data[i]);
+        if (n) command(reader.frame(), n);
+    }
+}
+
+void SerialDump::command(const uint8_t *f, size_t len) {
+    if (f[0] == SERIAL_CMD_ABORT && len == 1) {
+        aborted = running;
+        return;
+    }
+    if (f[0] != SERIAL_CMD_DUMP || len != 9) return;
+    // a new dump replaces a running one
+    firstSeq = getU32(f + 1);
+    log.seekRaw(cursor, firstSeq, getU32(f + 5));
+    running = true;
+    started = false;
+    aborted = false;
+    frames = 0;
+    bytes = 0;
+    dumpCount++;
+}
+
+void SerialDump::sendEnd(uint8_t status) {
+    frame[0] = SERIAL_DUMP_END;
+    putU32(frame + 1, frames);
+    putU32(frame + 5, bytes);
+    frame[9] = status;
+    serialWriteFrame(frame, 10, write, writeCtx);
+    running = false;
+}
+
+bool SerialDump::step() {
+    if (!running) return false;
+    if (aborted) {
+        sendEnd(1);
+        return false;
+    }
+    if (!started) {
+        started = true;
+        frame[0] = SERIAL_DUMP_BEGIN;
+        putU32(frame + 1, firstSeq);
+        putU32(frame + 5, cursor.lastSeq);
+        putU32(frame + 9, log.oldestSeq());
+        putU32(frame + 13, log.lastSeq());
+        frame[17] = (uint8_t)sizeof(ArchiveRecord);
+        serialWriteFrame(frame, 18, write, writeCtx);
+        return true;
+    }
+    uint32_t seg, offset;
+    size_t n = log.readRaw(cursor, frame + SERIAL_DUMP_DATA_HEADER, SERIAL_DUMP_CHUNK, seg, offset);
+    if (n == 0) {
+        sendEnd(0);
+        return false;
+    }
+    frame[0] = SERIAL_DUMP_DATA;
+    putU32(frame + 1, seg);
+    putU32(frame + 5, offset);
+    serialWriteFrame(frame, SERIAL_DUMP_DATA_HEADER + n, write, writeCtx);
+    frames++;
+    bytes += (uint32_t)n;
+    return true;
+}
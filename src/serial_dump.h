@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "archive_log.h"
+#include "serial_frame.h"
+
+// Bulk archive download over the serial port, for the service bench.
+//
+// The host sends a command frame (serial_frame.h), little endian:
+//
+//   0x44 u32 firstSeq | u32 lastSeq     dump that seq range (0..ffffffff: all)
+//   0x58                                abort a running dump
+//
+// and the device answers with
+//
+//   0x90 begin  u32 firstSeq | u32 lastSeq | u32 oldest seq on flash
+//               | u32 newest seq | u8 record size
+//   0x91 data   u32 segment | u32 offset | segment bytes as stored
+//   0x92 end    u32 data frames | u32 bytes | u8 status (0 done, 1 aborted)
+//
+// Data frames carry the archive segments as they are on flash
+// (archive_log.h: slots of keyframes and deltas, each with its crc), read
+// straight into the frame buffer in SERIAL_DUMP_CHUNK pieces and never
+// decoded on the device. Slots may straddle two frames of a segment; a
+// segment starts with a keyframe, as does the first frame of a dump, and
+// every segment holds the records it held on flash, so the host drops what
+// falls outside the range. Consumed (acked) records are included as long as
+// their segment is still on flash.
+//
+// While a dump runs the log output is held back so it cannot land inside a
+// frame; BLE keeps running between frames.
+
+#define SERIAL_CMD_DUMP 0x44
+#define SERIAL_CMD_ABORT 0x58
+#define SERIAL_DUMP_BEGIN 0x90
+#define SERIAL_DUMP_DATA 0x91
+#define SERIAL_DUMP_END 0x92
+
+#define SERIAL_DUMP_DATA_HEADER 9
+// segment bytes per data frame
+#define SERIAL_DUMP_CHUNK 1024
+static_assert(SERIAL_DUMP_DATA_HEADER + SERIAL_DUMP_CHUNK + 2 <= SERIAL_FRAME_MAX, "dump chunk does not fit a frame");
+
+class SerialDump {
+public:
+    SerialDump(ArchiveLog &log, SerialWriteFn write, void *ctx)
+        : log(log), write(write), writeCtx(ctx), reader(rx, sizeof(rx)) {}
+
+    // feed bytes received on the port; commands take effect right away
+    void receive(const uint8_t *data, size_t len);
+    // a dump is running; step() sends its next frame
+    bool active() const { return running; }
+    // send one frame; false once the end frame is out
+    bool step();
+
+    uint32_t dumps() const { return dumpCount; }
+
+private:
+    void command(const uint8_t *f, size_t len);
+    void sendEnd(uint8_t status);
+
+    ArchiveLog &log;
+    SerialWriteFn write;
+    void *writeCtx;
+    uint8_t rx[16];
+    SerialFrameReader reader;
+    LogRawCursor cursor;
+    bool running = false;
+    bool started = false;     // begin frame sent
+    bool aborted = false;
+    uint32_t firstSeq = 0;
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+    uint32_t dumpCount = 0;
+    uint8_t frame[SERIAL_FRAME_MAX];
+};
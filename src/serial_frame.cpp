@@ -0,0 +1,55 @@
+#include "serial_frame.h"
+
+#include "crc.h"
+
+void serialWriteFrame(uint8_t *buf, size_t len, SerialWriteFn write, void *ctx) {
+    uint16_t crc = crc16(buf, len);
+    buf[len++] = (uint8_t)crc;
+    buf[len++] = (uint8_t)(crc >> 8);
+    // each block is a code byte and the run of non-zero bytes before the
+    // next zero (which the code stands for) or 254 of them (no zero)
+    size_t pos = 0;
+    for (;;) {
+        size_t run = 0;
+        while (pos + run < len && buf[pos + run] != 0 && run < 254) run++;
+        uint8_t code = (uint8_t)(run + 1);
+        write(&code, 1, ctx);
+        if (run) write(buf + pos, run, ctx);
+        pos += run;
+        if (pos >= len) break;
+        if (run < 254) pos++;
+    }
+    const uint8_t delimiter = 0;
+    write(&delimiter, 1, ctx);
+}
+
+bool cobsDecode(const uint8_t *in, size_t len, uint8_t *out, size_t &outLen) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len) return false;
+        for (uint8_t k = 1; k < code; k++) out[o++] = in[i++];
+        if (code < 0xFF && i < len) out[o++] = 0;
+    }
+    outLen = o;
+    return true;
+}
+
+size_t SerialFrameReader::push(uint8_t b) {
+    if (b != 0) {
+        if (len < cap) buf[len++] = b;
+        else overflow = true;
+        return 0;
+    }
+    if (len == 0) return 0;  // back-to-back delimiters
+    size_t n = 0;
+    bool ok = !overflow && cobsDecode(buf, len, buf, n) && n >= 3 &&
+              crc16(buf, n - 2) == (uint16_t)(buf[n - 2] | (buf[n - 1] << 8));
+    len = 0;
+    overflow = false;
+    if (!ok) {
+        bad++;
+        return 0;
+    }
+    return n - 2;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary frames on the serial port, for the service-bench archive dump
+// (serial_dump.h) and its host decoder (sim/aqs_dump.cpp).
+//
+// A frame is COBS encoded and followed by a 0x00 delimiter, so a reader
+// resyncs at the next zero after garbage or a log line. Decoded, every
+// frame is
+//
+//   u8 type | body | u16 crc16(type + body)          (little endian)
+//
+// and a frame with a bad crc is dropped. The encoder writes the source
+// buffer in slices between its zero bytes, nothing is copied.
+
+// largest decoded frame, crc included
+#define SERIAL_FRAME_MAX 1040
+// COBS adds one byte per 254, plus the delimiter
+#define SERIAL_FRAME_ENCODED_MAX (SERIAL_FRAME_MAX + SERIAL_FRAME_MAX / 254 + 2)
+
+typedef void (*SerialWriteFn)(const uint8_t *data, size_t len, void *ctx);
+
+// append the crc of buf[0..len) to buf (2 more bytes), then send it COBS
+// encoded and delimited through write
+void serialWriteFrame(uint8_t *buf, size_t len, SerialWriteFn write, void *ctx);
+
+// decode one COBS block (delimiter not included) into out, which may be in;
+// false if it is malformed
+bool cobsDecode(const uint8_t *in, size_t len, uint8_t *out, size_t &outLen);
+
+// collects received bytes into frames
+class SerialFrameReader {
+public:
+    SerialFrameReader(uint8_t *buf, size_t cap) : buf(buf), cap(cap) {}
+
+    // feed one byte; returns the length of a complete frame without its crc,
+    // readable at frame() until the next push, or 0 while none is complete
+    // or it was bad
+    size_t push(uint8_t b);
+    const uint8_t *frame() const { return buf; }
+    uint32_t badFrames() const { return bad; }
+    void reset() { len = 0; overflow = false; }
+
+private:
+    uint8_t *buf;
+    size_t cap;
+    size_t len = 0;
+    bool overflow = false;
+    uint32_t bad = 0;
+};
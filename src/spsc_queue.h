@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring.
+//
+// Exactly one thread may call push() and exactly one (other) thread may
+// call pop(). N must be a power of two; one slot stays unused to tell a
+// full ring from an empty one, so it holds N - 1 items. No heap, no locks:
+// the producer owns head, the consumer owns tail, and each publishes its
+// index with release ordering after touching the slot.
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    // producer side; false if the ring is full
+    bool push(const T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t next = (h + 1) & (N - 1);
+        if (next == tail.load(std::memory_order_acquire)) return false;
+        items[h] = item;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side; false if the ring is empty
+    bool pop(T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        item = items[t];
+        tail.store((t + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    // approximate when called concurrently with push/pop
+    size_t size() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return (h - t) & (N - 1);
+    }
+
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N - 1; }
+
+private:
+    T items[N];
+    // producer and consumer indices on separate cache lines
+    alignas(32) std::atomic<size_t> head{0};
+    alignas(32) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+// Host stand-in for SpiffsLogStorage: maps archive paths onto plain files
+// below a root directory so the archive log can be exercised on Linux.
+#include <stdio.h>
+#include <string>
+#include "log_storage.h"
+
+class FileLogStorage : public LogStorage {
+public:
+    explicit FileLogStorage(const char *rootDir) : root(rootDir) {}
+
+    bool append(const char *path, const void *data, size_t len) override {
+        FILE *f = fopen(full(path).c_str(), "ab");
+        if (!f) return false;
+        size_t n = fwrite(data, 1, len, f);
+        fclose(f);
+        return n == len;
+    }
+
+    bool writeFile(const char *path, const void *data, size_t len) override {
+        FILE *f = fopen(full(path).c_str(), "wb");
+        if (!f) return false;
+        size_t n = fwrite(data, 1, len, f);
+        fclose(f);
+        return n == len;
+    }
+
+    size_t readAt(const char *path, uint32_t offset, void *buf, size_t len) override {
+        FILE *f = fopen(full(path).c_str(), "rb");
+        if (!f) return 0;
+        size_t n = 0;
+        if (fseek(f, (long)offset, SEEK_SET) == 0) n = fread(buf, 1, len, f);
+        fclose(f);
+        return n;
+    }
+
+    bool exists(const char *path) override {
+        FILE *f = fopen(full(path).c_str(), "rb");
+        if (!f) return false;
+        fclose(f);
+        return true;
+    }
+
+    bool remove(const char *path) override {
+        return ::remove(full(path).c_str()) == 0;
+    }
+
+private:
+    // SPIFFS paths are flat ("/name"), so a plain prefix is enough
+    std::string full(const char *path) const { return root + path; }
+
+    std::string root;
+};
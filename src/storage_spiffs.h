@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SPIFFS.h>
+#include "log_storage.h"
+
+// LogStorage backed by the SPIFFS partition
+class SpiffsLogStorage : public LogStorage {
+public:
+    bool append(const char *path, const void *data, size_t len) override {
+        File f = SPIFFS.open(path, FILE_APPEND);
+        if (!f) return false;
+        size_t n = f.write((const uint8_t*)data, len);
+        f.close();
+        return n == len;
+    }
+
+    bool writeFile(const char *path, const void *data, size_t len) override {
+        File f = SPIFFS.open(path, FILE_WRITE);
+        if (!f) return false;
+        size_t n = f.write((const uint8_t*)data, len);
+        f.close();
+        return n == len;
+    }
+
+    size_t readAt(const char *path, uint32_t offset, void *buf, size_t len) override {
+        if (!SPIFFS.exists(path)) return 0;
+        File f = SPIFFS.open(path, FILE_READ);
+        if (!f) return 0;
+        size_t n = 0;
+        if (f.seek(offset, SeekSet)) n = f.read((uint8_t*)buf, len);
+        f.close();
+        return n;
+    }
+
+    bool exists(const char *path) override {
+        return SPIFFS.exists(path);
+    }
+
+    bool remove(const char *path) override {
+        return SPIFFS.remove(path);
+    }
+};
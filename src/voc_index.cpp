@@ -0,0 +1,311 @@
+#include "voc_index.h"
+
+#include <string.h>
+#include "crc.h"
+
+// Sensirion's VOC defaults
+#define VOC_SRAW_MINIMUM 20000
+#define VOC_INDEX_GAIN 230
+#define VOC_SRAW_STD_INITIAL 50
+#define VOC_SRAW_STD_BONUS 220
+#define VOC_TAU_MEAN_H 12
+#define VOC_TAU_VARIANCE_H 12
+#define VOC_TAU_INITIAL_MEAN_S 20
+#define VOC_TAU_INITIAL_VARIANCE_S 2500
+#define VOC_INIT_TRANSITION 0.01
+#define VOC_GATING_THRESHOLD 340
+#define VOC_GATING_THRESHOLD_INITIAL 510
+#define VOC_GATING_TRANSITION 0.09
+#define VOC_GATING_MAX_MIN 180
+#define VOC_GATING_MAX_RATIO 0.3
+#define VOC_SIGMOID_L 500
+#define VOC_SIGMOID_K -0.0065
+#define VOC_SIGMOID_X0 213
+#define VOC_LP_TAU_FAST_S 20
+#define VOC_LP_TAU_SLOW_S 500
+#define VOC_LP_ALPHA -0.2
+// the estimator works on deltas scaled down by this, so squares stay in range
+#define VOC_GAMMA_SCALING 64
+#define VOC_MEAN_SCALING 8
+// uptimes stop counting here (s)
+#define VOC_UPTIME_LIMIT 32767
+
+#define FIX16_MAX ((fix16)0x7FFFFFFF)
+#define FIX16_MIN ((fix16)0x80000000)
+
+// --- Q16.16 arithmetic, saturating ---
+
+static fix16 fixSat(int64_t v) {
+    if (v > FIX16_MAX) return FIX16_MAX;
+    if (v < FIX16_MIN) return FIX16_MIN;
+    return (fix16)v;
+}
+
+static fix16 fixAdd(fix16 a, fix16 b) {
+    return fixSat((int64_t)a + b);
+}
+
+static fix16 fixMul(fix16 a, fix16 b) {
+    return fixSat(((int64_t)a * b + 0x8000) >> 16);
+}
+
+static fix16 fixDiv(fix16 a, fix16 b) {
+    if (b == 0) return a >= 0 ? FIX16_MAX : FIX16_MIN;
+    int64_t n = (int64_t)a * FIX16_ONE;
+    // round to nearest
+    n += (a < 0) == (b < 0) ? b / 2 : -(b / 2);
+    return fixSat(n / b);
+}
+
+// rounded square root
+static uint32_t isqrt64(uint64_t v) {
+    uint64_t r = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    // v is the remainder now; round to nearest
+    return (uint32_t)(v > r ? r + 1 : r);
+}
+
+// e^1, e^(1/8), e^(1/64), e^(1/512) and their inverses
+static const fix16 expPos[4] = {F16(2.7182818), F16(1.1331485), F16(1.0157477), F16(1.0019550)};
+static const fix16 expNeg[4] = {F16(0.3678794), F16(0.8824969), F16(0.9844964), F16(0.9980488)};
+
+static fix16 fixExp(fix16 x) {
+    if (x >= F16(10.3972)) return FIX16_MAX;
+    if (x <= F16(-11.7835)) return 0;
+    bool neg = x < 0;
+    const fix16 *table = neg ? expNeg : expPos;
+    if (neg) x = -x;
+    fix16 res = FIX16_ONE;
+    fix16 step = FIX16_ONE;
+    for (uint8_t i = 0; i < 4; i++) {
+        while (x >= step) {
+            res = fixMul(res, table[i]);
+            x -= step;
+        }
+        step >>= 3;
+    }
+    // less than 1/512 left, e^x ~ 1 + x
+    fix16 rest = fixMul(res, x);
+    return neg ? res - rest : res + rest;
+}
+
+// learning rate weights are Q32 (ONE32 = 1): the initial rates are
+// thousands of times the final ones, so the tail of their transition has to
+// be resolved far below a Q16 LSB
+#define ONE32 (1LL << 32)
+
+// e^-8, e^-1, e^(-1/8), e^(-1/64), e^(-1/512) in Q32
+static const uint64_t expNeg32[5] = {1440801ULL, 1580030169ULL, 3790295335ULL, 4228380000ULL, 4286586875ULL};
+
+// e^-x in Q32 for x >= 0
+static uint64_t fixExpNeg32(fix16 x) {
+    uint64_t res = ONE32;
+    fix16 step = 8 * FIX16_ONE;
+    for (uint8_t i = 0; i < 5 && res; i++) {
+        while (x >= step && res) {
+            res = (res * expNeg32[i] + (1ULL << 31)) >> 32;
+            x -= step;
+        }
+        step >>= 3;
+    }
+    return res - ((res * (uint32_t)x) >> 16);
+}
+
+// 1 / (1 + e^(k (sample - x0))) in Q32
+static int64_t sigmoid32(fix16 sample, fix16 x0, fix16 k) {
+    fix16 x = fixMul(k, fixAdd(sample, -x0));
+    if (x < F16(-50)) return ONE32;
+    if (x > F16(50)) return 0;
+    // e^-|x| / (1 + e^-|x|), mirrored for x < 0
+    uint64_t e = fixExpNeg32(x < 0 ? -x : x);
+    int64_t s = e >= (uint64_t)ONE32 ? ONE32 / 2 : (int64_t)((e << 32) / (ONE32 + e));
+    return x >= 0 ? s : ONE32 - s;
+}
+
+static fix16 fixMul32(fix16 a, int64_t w) {
+    return fixSat(((int64_t)a * w + (1LL << 31)) >> 32);
+}
+
+// scale * interval / (tau + interval)
+static fix16 gammaFor(uint32_t scale, uint32_t intervalMs, uint64_t tauMs) {
+    return fixSat(((int64_t)scale * intervalMs * FIX16_ONE) / (int64_t)(tauMs + intervalMs));
+}
+
+// --- engine ---
+
+void VocIndexEngine::begin(uint32_t samplingIntervalMs) {
+    uptime = 0;
+    srawLast = 0;
+    gasIndex = 0;
+    initialized = false;
+    mean = 0;
+    srawOffset = 0;
+    std = F16(VOC_SRAW_STD_INITIAL);
+    gammaMean = 0;
+    gammaVariance = 0;
+    uptimeGamma = 0;
+    uptimeGating = 0;
+    gatingDurationMin = 0;
+    lowpassStarted = false;
+    x1 = x2 = x3 = 0;
+    setSamplingInterval(samplingIntervalMs);
+}
+
+void VocIndexEngine::setSamplingInterval(uint32_t ms) {
+    if (ms == 0) ms = 1000;
+    samplingInterval = fixSat((int64_t)ms * FIX16_ONE / 1000);
+    gammaMeanLong = gammaFor(VOC_MEAN_SCALING * VOC_GAMMA_SCALING, ms, VOC_TAU_MEAN_H * 3600000ULL);
+    gammaVarianceLong = gammaFor(VOC_GAMMA_SCALING, ms, VOC_TAU_VARIANCE_H * 3600000ULL);
+    gammaMeanInitial = gammaFor(VOC_MEAN_SCALING * VOC_GAMMA_SCALING, ms, VOC_TAU_INITIAL_MEAN_S * 1000ULL);
+    gammaVarianceInitial = gammaFor(VOC_GAMMA_SCALING, ms, VOC_TAU_INITIAL_VARIANCE_S * 1000ULL);
+    a1 = gammaFor(1, ms, VOC_LP_TAU_FAST_S * 1000ULL);
+    a2 = gammaFor(1, ms, VOC_LP_TAU_SLOW_S * 1000ULL);
+}
+
+uint16_t VocIndexEngine::process(uint16_t sraw) {
+    if (uptime <= F16(VOC_INITIAL_BLACKOUT_S)) {
+        uptime += samplingInterval;
+        return index();
+    }
+    // 0 and anything from 65000 up are read errors; the last good value stands in
+    if (sraw > 0 && sraw < 65000) {
+        int32_t s = sraw;
+        if (s < VOC_SRAW_MINIMUM + 1) s = VOC_SRAW_MINIMUM + 1;
+        else if (s > VOC_SRAW_MINIMUM + 32767) s = VOC_SRAW_MINIMUM + 32767;
+        srawLast = (s - VOC_SRAW_MINIMUM) * FIX16_ONE;
+    }
+
+    // mox model: deviation from the learned baseline in units of its spread
+    fix16 dev = fixSat((int64_t)srawLast - srawOffset - mean);
+    fix16 x = fixMul(fixDiv(dev, -(std + F16(VOC_SRAW_STD_BONUS))), F16(VOC_INDEX_GAIN));
+
+    // sigmoid onto 0..500; with the default index offset of 100 its shift is 0
+    fix16 k = fixMul(F16(VOC_SIGMOID_K), fixAdd(x, -F16(VOC_SIGMOID_X0)));
+    fix16 scaled;
+    if (k < F16(-50)) scaled = F16(VOC_SIGMOID_L);
+    else if (k > F16(50)) scaled = 0;
+    else scaled = fixDiv(F16(VOC_SIGMOID_L), fixAdd(FIX16_ONE, fixExp(k)));
+
+    // adaptive lowpass: tau slides from slow to fast as the fast and slow
+    // averages move apart
+    if (!lowpassStarted) {
+        x1 = x2 = x3 = scaled;
+        lowpassStarted = true;
+    }
+    x1 = fixMul(FIX16_ONE - a1, x1) + fixMul(a1, scaled);
+    x2 = fixMul(FIX16_ONE - a2, x2) + fixMul(a2, scaled);
+    fix16 d = x1 - x2;
+    if (d < 0) d = -d;
+    fix16 f1 = fixExp(fixMul(F16(VOC_LP_ALPHA), d));
+    fix16 tau = fixMul(F16(VOC_LP_TAU_SLOW_S - VOC_LP_TAU_FAST_S), f1) + F16(VOC_LP_TAU_FAST_S);
+    fix16 a3 = fixDiv(samplingInterval, samplingInterval + tau);
+    x3 = fixMul(FIX16_ONE - a3, x3) + fixMul(a3, scaled);
+
+    gasIndex = x3 < FIX16_ONE / 2 ? FIX16_ONE / 2 : x3;
+    if (srawLast > 0) estimate(srawLast);
+    return index();
+}
+
+void VocIndexEngine::estimate(fix16 sraw) {
+    if (!initialized) {
+        initialized = true;
+        srawOffset = sraw;
+        mean = 0;
+        return;
+    }
+    // keep mean small so the deltas below stay in range
+    if (mean >= F16(100) || mean <= F16(-100)) {
+        srawOffset = fixAdd(srawOffset, mean);
+        mean = 0;
+    }
+    sraw = fixAdd(sraw, -srawOffset);
+    calculateGamma();
+    fix16 delta = fixDiv(fixAdd(sraw, -mean), F16(VOC_GAMMA_SCALING));
+    // std'^2 = (64 - g) (std^2 / 64 + g delta^2), worked out on the square
+    // in Q32: at short intervals the decay per step is below a Q16 LSB of
+    // std and would be lost to rounding
+    int64_t square = ((int64_t)std * std) >> 6;
+    square += ((((int64_t)gammaVariance * delta + (1 << 11)) >> 12) * delta + (1 << 3)) >> 4;
+    // times (64 - g), g * square split so it stays in range
+    square = square * VOC_GAMMA_SCALING -
+             ((square >> 16) * gammaVariance + (((square & 0xFFFF) * gammaVariance) >> 16));
+    std = square > 0 ? (fix16)isqrt64((uint64_t)square) : 0;
+    // mean += g delta / 8, rounded once
+    int64_t step = (int64_t)gammaMean * fixAdd(sraw, -mean);
+    mean = fixAdd(mean, (fix16)((step + (1LL << 24)) >> 25));
+}
+
+// learning rates for this step: fast at first, slow later, and close to
+// nothing while the index is above the gating threshold (an event, not the
+// baseline) unless that has gone on for too long
+void VocIndexEngine::calculateGamma() {
+    fix16 limit = F16(VOC_UPTIME_LIMIT) - samplingInterval;
+    if (uptimeGamma < limit) uptimeGamma += samplingInterval;
+    if (uptimeGating < limit) uptimeGating += samplingInterval;
+    const fix16 thresholdSpan = F16(VOC_GATING_THRESHOLD_INITIAL - VOC_GATING_THRESHOLD);
+
+    int64_t initialMean = sigmoid32(uptimeGamma, F16(VOC_INIT_DURATION_MEAN_S), F16(VOC_INIT_TRANSITION));
+    fix16 gMean = gammaMeanLong + fixMul32(gammaMeanInitial - gammaMeanLong, initialMean);
+    fix16 thresholdMean = F16(VOC_GATING_THRESHOLD) +
+        fixMul32(thresholdSpan, sigmoid32(uptimeGating, F16(VOC_INIT_DURATION_MEAN_S), F16(VOC_INIT_TRANSITION)));
+    int64_t gatingMean = sigmoid32(gasIndex, thresholdMean, F16(VOC_GATING_TRANSITION));
+    gammaMean = fixMul32(gMean, gatingMean);
+
+    int64_t initialVariance = sigmoid32(uptimeGamma, F16(VOC_INIT_DURATION_VARIANCE_S), F16(VOC_INIT_TRANSITION));
+    fix16 gVariance = gammaVarianceLong +
+        fixMul32(gammaVarianceInitial - gammaVarianceLong, initialVariance - initialMean);
+    fix16 thresholdVariance = F16(VOC_GATING_THRESHOLD) +
+        fixMul32(thresholdSpan, sigmoid32(uptimeGating, F16(VOC_INIT_DURATION_VARIANCE_S), F16(VOC_INIT_TRANSITION)));
+    int64_t gatingVariance = sigmoid32(gasIndex, thresholdVariance, F16(VOC_GATING_TRANSITION));
+    gammaVariance = fixMul32(gVariance, gatingVariance);
+
+    // minutes spent gated, paid back at VOC_GATING_MAX_RATIO while not
+    fix16 gated = fixMul32(F16(1 + VOC_GATING_MAX_RATIO), ONE32 - gatingMean) - F16(VOC_GATING_MAX_RATIO);
+    gatingDurationMin += fixMul(fixDiv(samplingInterval, F16(60)), gated);
+    if (gatingDurationMin < 0) gatingDurationMin = 0;
+    if (gatingDurationMin > F16(VOC_GATING_MAX_MIN)) uptimeGating = 0;
+}
+
+void VocIndexEngine::checkpoint(VocCheckpoint &cp) const {
+    cp = VocCheckpoint();
+    cp.mean = fixAdd(mean, srawOffset);
+    cp.std = std;
+}
+
+bool VocIndexEngine::restore(const VocCheckpoint &cp) {
+    if (cp.mean <= 0 || cp.std <= 0) return false;
+    initialized = true;
+    mean = cp.mean;
+    srawOffset = 0;
+    std = cp.std;
+    uptimeGamma = F16(VOC_SETTLED_UPTIME_S);
+    srawLast = cp.mean;
+    return true;
+}
+
+// --- checkpoint block ---
+
+bool vocCheckpointDecode(const uint8_t *data, size_t len, VocCheckpoint &cp) {
+    if (!data || len != VOC_CHECKPOINT_SIZE) return false;
+    memcpy(&cp, data, sizeof(cp));
+    return cp.version == VOC_CHECKPOINT_VERSION && cp.size == VOC_CHECKPOINT_SIZE &&
+           cp.crc == crc16(&cp, offsetof(VocCheckpoint, crc)) && cp.mean > 0 && cp.std > 0;
+}
+
+size_t vocCheckpointEncode(VocCheckpoint &cp, uint8_t *out) {
+    cp.version = VOC_CHECKPOINT_VERSION;
+    cp.size = VOC_CHECKPOINT_SIZE;
+    cp.crc = crc16(&cp, offsetof(VocCheckpoint, crc));
+    memcpy(out, &cp, sizeof(cp));
+    return VOC_CHECKPOINT_SIZE;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// On-device VOC index from the SGP40 raw signal.
+//
+// Sensirion's gas index algorithm (VOC mode, default tuning) in Q16.16
+// fixed point, one step per raw reading, no floats and no allocation:
+//  - a mean/variance estimator learns the sensor's baseline; it adapts fast
+//    for the first VOC_INIT_DURATION_MEAN/_VARIANCE s and slowly (12 h
+//    time constant) after that, and stops learning while the index is high
+//  - the raw signal's deviation from that baseline is mapped onto 1..500
+//    by a sigmoid, 100 being the average of the past hours
+//  - an adaptive lowpass smooths the result, faster when it moves a lot
+// The first VOC_INITIAL_BLACKOUT_S give index 0 (not known yet).
+//
+// The sampling interval is the SGP40 read interval; it can change at
+// runtime without losing what was learned. The learned baseline (mean and
+// std) goes into a checkpoint once the estimator has run for
+// VOC_SETTLED_UPTIME_S, and a restored checkpoint skips the fast initial
+// phase, like Sensirion's set_states(). Checkpoint block, little endian,
+// packed:
+//
+//   u8  version (VOC_CHECKPOINT_VERSION) | u8 size (VOC_CHECKPOINT_SIZE)
+//   i32 mean | i32 std       Q16.16, SRAW ticks
+//   u16 crc16 of everything before it
+//
+// The raw signal is only comparable over time when the SGP40 gets the
+// current humidity and temperature; vocRhTicks()/vocTempTicks() convert an
+// SCD41 reading into its compensation arguments.
+//
+// The index goes out with live samples ("voc_index", payload_schema.h) and
+// in the broadcast (broadcast.h). Archived records keep only SRAW_VOC, so a
+// sample that waited in the archive or comes from a range query arrives
+// without it; a connected client gets every sample live unless it has a
+// backlog to catch up on, acking or not.
+
+typedef int32_t fix16;
+
+#define FIX16_ONE 0x10000
+#define F16(x) ((fix16)((x) >= 0 ? (x) * 65536.0 + 0.5 : (x) * 65536.0 - 0.5))
+
+#define VOC_INDEX_MAX 500
+#define VOC_INITIAL_BLACKOUT_S 45
+#define VOC_INIT_DURATION_MEAN_S 2700
+#define VOC_INIT_DURATION_VARIANCE_S 5220
+// estimator uptime a restored checkpoint starts from
+#define VOC_SETTLED_UPTIME_S 10800
+// how often the pipeline stores a checkpoint once settled (flash wear)
+#ifndef VOC_CHECKPOINT_MS
+#define VOC_CHECKPOINT_MS 3600000UL
+#endif
+
+#define VOC_CHECKPOINT_VERSION 1
+
+#pragma pack(push, 1)
+struct VocCheckpoint {
+    uint8_t version;
+    uint8_t size;
+    int32_t mean;
+    int32_t std;
+    uint16_t crc;
+};
+#pragma pack(pop)
+
+#define VOC_CHECKPOINT_SIZE sizeof(VocCheckpoint)
+static_assert(sizeof(VocCheckpoint) == 12, "VocCheckpoint must stay packed");
+
+// decode and check a stored block
+bool vocCheckpointDecode(const uint8_t *data, size_t len, VocCheckpoint &cp);
+// set version, size and crc, then write the block to out[VOC_CHECKPOINT_SIZE]
+size_t vocCheckpointEncode(VocCheckpoint &cp, uint8_t *out);
+
+class VocIndexEngine {
+public:
+    VocIndexEngine() { begin(1000); }
+
+    // forget everything learned and start over
+    void begin(uint32_t samplingIntervalMs);
+    // a new read interval; what was learned is kept
+    void setSamplingInterval(uint32_t samplingIntervalMs);
+
+    // one raw reading; returns the index, 0 during the initial blackout
+    uint16_t process(uint16_t sraw);
+    uint16_t index() const { return (uint16_t)((gasIndex + FIX16_ONE / 2) >> 16); }
+
+    // learned long enough for a checkpoint to be worth keeping
+    bool settled() const { return initialized && uptimeGamma >= F16(VOC_SETTLED_UPTIME_S); }
+    void checkpoint(VocCheckpoint &cp) const;
+    // continue from a checkpoint; false (and nothing changed) if it is bad
+    bool restore(const VocCheckpoint &cp);
+
+private:
+    void estimate(fix16 sraw);
+    void calculateGamma();
+
+    fix16 samplingInterval;
+    fix16 uptime;              // up to the end of the blackout
+    fix16 srawLast;            // minus VOC_SRAW_MINIMUM
+    fix16 gasIndex;
+
+    // mean/variance estimator
+    bool initialized;
+    fix16 mean;
+    fix16 srawOffset;          // mean is kept relative to it
+    fix16 std;
+    fix16 gammaMeanLong, gammaVarianceLong;        // after the initial phase
+    fix16 gammaMeanInitial, gammaVarianceInitial;
+    fix16 gammaMean, gammaVariance;                // this step
+    fix16 uptimeGamma;
+    fix16 uptimeGating;
+    fix16 gatingDurationMin;
+
+    // adaptive lowpass
+    bool lowpassStarted;
+    fix16 a1, a2;
+    fix16 x1, x2, x3;
+};
+
+// SGP40 compensation arguments from an SCD41 reading
+static inline uint16_t vocRhTicks(float rh) {
+    if (rh <= 0.0f) return 0;
+    if (rh >= 100.0f) return 0xFFFF;
+    return (uint16_t)(rh * 65535.0f / 100.0f + 0.5f);
+}
+
+static inline uint16_t vocTempTicks(float t) {
+    if (t <= -45.0f) return 0;
+    if (t >= 130.0f) return 0xFFFF;
+    return (uint16_t)((t + 45.0f) * 65535.0f / 175.0f + 0.5f);
+}